@@ -49,4 +49,18 @@ absl::Duration ComputeBackoff(absl::Duration min_delay,
   return delay;
 }
 
+void LatencyEstimator::Record(absl::Duration latency) {
+  // Each observation moves the estimate an eighth of the way towards it, as
+  // in TCP's smoothed round-trip time.
+  constexpr int kSmoothingDivisor = 8;
+
+  absl::MutexLock lock(&mutex_);
+  estimate_ += (latency - estimate_) / kSmoothingDivisor;
+}
+
+absl::Duration LatencyEstimator::estimate() const {
+  absl::MutexLock lock(&mutex_);
+  return estimate_;
+}
+
 }  // namespace cloud_kms
@@ -17,6 +17,7 @@
 #ifndef COMMON_BACKOFF_H_
 #define COMMON_BACKOFF_H_
 
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 
 namespace cloud_kms {
@@ -24,6 +25,26 @@ namespace cloud_kms {
 absl::Duration ComputeBackoff(absl::Duration min_delay,
                               absl::Duration max_delay, int previous_tries);
 
+// LatencyEstimator keeps a moving average of the observed latencies of some
+// recurring operation, so that polling for its completion can begin around
+// the time it usually completes.
+//
+// LatencyEstimator is safe for concurrent use.
+class LatencyEstimator {
+ public:
+  explicit LatencyEstimator(absl::Duration initial_estimate)
+      : estimate_(initial_estimate) {}
+
+  // Folds `latency` into the estimate.
+  void Record(absl::Duration latency);
+
+  absl::Duration estimate() const;
+
+ private:
+  mutable absl::Mutex mutex_;
+  absl::Duration estimate_ ABSL_GUARDED_BY(mutex_);
+};
+
 }  // namespace cloud_kms
 
 #endif  // COMMON_BACKOFF_H_
@@ -72,5 +72,29 @@ TEST(ComputeBackoffTest, ManyRetries) {
   EXPECT_LE(backoff, absl::InfiniteDuration());
 }
 
+TEST(LatencyEstimatorTest, InitialEstimate) {
+  LatencyEstimator estimator(absl::Milliseconds(20));
+  EXPECT_EQ(estimator.estimate(), absl::Milliseconds(20));
+}
+
+TEST(LatencyEstimatorTest, RecordMovesEstimateTowardsLatency) {
+  LatencyEstimator estimator(absl::Milliseconds(100));
+
+  estimator.Record(absl::Milliseconds(20));
+  EXPECT_EQ(estimator.estimate(), absl::Milliseconds(90));
+
+  estimator.Record(absl::Milliseconds(170));
+  EXPECT_EQ(estimator.estimate(), absl::Milliseconds(100));
+}
+
+TEST(LatencyEstimatorTest, EstimateConvergesToSteadyLatency) {
+  LatencyEstimator estimator(absl::Seconds(1));
+  for (int i = 0; i < 100; i++) {
+    estimator.Record(absl::Milliseconds(30));
+  }
+  EXPECT_LT(absl::AbsDuration(estimator.estimate() - absl::Milliseconds(30)),
+            absl::Milliseconds(1));
+}
+
 }  // namespace
 }  // namespace cloud_kms
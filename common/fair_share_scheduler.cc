@@ -0,0 +1,124 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/fair_share_scheduler.h"
+
+#include <algorithm>
+
+#include "absl/strings/str_format.h"
+
+namespace cloud_kms {
+
+FairShareScheduler::Admission::~Admission() {
+  if (scheduler_) {
+    scheduler_->Release(flow_);
+  }
+}
+
+FairShareScheduler::FairShareScheduler(
+    uint32_t max_in_flight,
+    const absl::flat_hash_map<std::string, FlowOptions>& flows)
+    : max_in_flight_(max_in_flight) {
+  for (const auto& [name, options] : flows) {
+    Flow& flow = flows_[name];
+    flow.options = options;
+    flow.options.weight = std::max(flow.options.weight, 1u);
+  }
+}
+
+absl::StatusOr<FairShareScheduler::Admission> FairShareScheduler::Admit(
+    std::string_view flow_name, absl::Time deadline) {
+  absl::MutexLock lock(&mutex_);
+
+  Flow& flow = GetFlow(flow_name);
+  uint64_t sequence = next_sequence_++;
+  flow.waiting.push_back(sequence);
+  waiting_++;
+  while (!CanAdmit(flow, sequence)) {
+    if (capacity_changed_.WaitWithDeadline(&mutex_, deadline) &&
+        !CanAdmit(flow, sequence)) {
+      flow.waiting.erase(
+          std::find(flow.waiting.begin(), flow.waiting.end(), sequence));
+      waiting_--;
+      // The next waiter may now be admissible.
+      capacity_changed_.SignalAll();
+      return absl::DeadlineExceededError(absl::StrFormat(
+          "deadline exceeded while waiting to call Cloud KMS on behalf of "
+          "'%s'",
+          flow_name));
+    }
+  }
+  // The flow is charged for the call only now that it is admitted.
+  virtual_time_ = HeadKey(flow).first;
+  flow.finish_tag = virtual_time_ + 1.0 / flow.options.weight;
+  flow.waiting.pop_front();
+  waiting_--;
+
+  in_flight_++;
+  flow.in_flight++;
+  // Capacity may remain for the next waiter.
+  capacity_changed_.SignalAll();
+  return Admission(this, &flow);
+}
+
+size_t FairShareScheduler::waiting() const {
+  absl::MutexLock lock(&mutex_);
+  return waiting_;
+}
+
+FairShareScheduler::Flow& FairShareScheduler::GetFlow(std::string_view name) {
+  auto it = flows_.find(name);
+  if (it == flows_.end()) {
+    it = flows_.emplace(std::string(name), Flow()).first;
+  }
+  return it->second;
+}
+
+FairShareScheduler::WaiterKey FairShareScheduler::HeadKey(
+    const Flow& flow) const {
+  return WaiterKey(std::max(virtual_time_, flow.finish_tag),
+                   flow.waiting.front());
+}
+
+bool FairShareScheduler::CanAdmit(const Flow& flow, uint64_t sequence) const {
+  if (max_in_flight_ > 0 && in_flight_ >= max_in_flight_) {
+    return false;
+  }
+  auto below_cap = [](const Flow& f) {
+    return f.options.max_in_flight == 0 ||
+           f.in_flight < f.options.max_in_flight;
+  };
+  if (flow.waiting.front() != sequence || !below_cap(flow)) {
+    return false;
+  }
+  // The call must have the lowest key among the oldest waiters of the flows
+  // that are below their caps.
+  WaiterKey key = HeadKey(flow);
+  for (const auto& [name, other] : flows_) {
+    if (&other != &flow && !other.waiting.empty() && below_cap(other) &&
+        HeadKey(other) < key) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void FairShareScheduler::Release(Flow* flow) {
+  absl::MutexLock lock(&mutex_);
+  in_flight_--;
+  flow->in_flight--;
+  capacity_changed_.SignalAll();
+}
+
+}  // namespace cloud_kms
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMMON_FAIR_SHARE_SCHEDULER_H_
+#define COMMON_FAIR_SHARE_SCHEDULER_H_
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace cloud_kms {
+
+// FairShareScheduler bounds the number of calls in flight, and divides that
+// capacity between flows in proportion to their weights when calls have to
+// wait for it. A flow may also have its own in-flight cap, which bounds the
+// capacity it can take from the other flows.
+//
+// Waiting calls are ordered by start-time fair queueing: each flow's calls wait
+// in arrival order, the oldest is tagged with the flow's virtual start time,
+// and the call with the lowest tag whose flow is below its cap is admitted
+// next. A flow's virtual time advances by 1/weight for every call that is
+// admitted, so calls that give up waiting cost their flow nothing. A flow that
+// has been idle does not accumulate credit.
+//
+// FairShareScheduler is safe for concurrent use.
+class FairShareScheduler {
+ private:
+  struct Flow;
+
+ public:
+  struct FlowOptions {
+    // The flow's share of capacity, relative to other flows. Must be at
+    // least 1.
+    uint32_t weight = 1;
+    // The maximum number of the flow's calls in flight at once. 0 means that
+    // only the scheduler-wide limit applies.
+    uint32_t max_in_flight = 0;
+  };
+
+  // A permission for one call to proceed. The capacity it holds is returned to
+  // the scheduler when the Admission is destroyed.
+  class Admission {
+   public:
+    // Creates an Admission that holds no capacity.
+    Admission() : scheduler_(nullptr), flow_(nullptr) {}
+
+    Admission(Admission&& other)
+        : scheduler_(std::exchange(other.scheduler_, nullptr)),
+          flow_(other.flow_) {}
+    Admission& operator=(Admission&& other) = delete;
+    ~Admission();
+
+   private:
+    friend class FairShareScheduler;
+
+    Admission(FairShareScheduler* scheduler, Flow* flow)
+        : scheduler_(scheduler), flow_(flow) {}
+
+    FairShareScheduler* scheduler_;
+    Flow* flow_;
+  };
+
+  // Creates a scheduler that admits up to `max_in_flight` calls at once, where
+  // 0 means no limit. `flows` provides the options for the named flows; other
+  // flows have the default options.
+  FairShareScheduler(
+      uint32_t max_in_flight,
+      const absl::flat_hash_map<std::string, FlowOptions>& flows = {});
+
+  // Blocks until a call in `flow` may proceed, or until `deadline`, in which
+  // case it returns DeadlineExceeded.
+  absl::StatusOr<Admission> Admit(std::string_view flow, absl::Time deadline);
+
+  // Returns the number of calls that are waiting to be admitted.
+  size_t waiting() const;
+
+ private:
+  struct Flow {
+    FlowOptions options;
+    uint32_t in_flight = 0;
+    // The virtual finish time of the flow's latest admitted call.
+    double finish_tag = 0;
+    // The sequence numbers of the flow's waiting calls, in arrival order.
+    std::deque<uint64_t> waiting;
+  };
+  // Waiting calls are ordered by virtual start time, then arrival order.
+  using WaiterKey = std::pair<double, uint64_t>;
+
+  Flow& GetFlow(std::string_view name) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns the key of the oldest waiting call in `flow`, which must not be
+  // empty.
+  WaiterKey HeadKey(const Flow& flow) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool CanAdmit(const Flow& flow, uint64_t sequence) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void Release(Flow* flow);
+
+  const uint32_t max_in_flight_;
+
+  mutable absl::Mutex mutex_;
+  absl::CondVar capacity_changed_;
+  absl::node_hash_map<std::string, Flow> flows_ ABSL_GUARDED_BY(mutex_);
+  size_t waiting_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint32_t in_flight_ ABSL_GUARDED_BY(mutex_) = 0;
+  double virtual_time_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint64_t next_sequence_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace cloud_kms
+
+#endif  // COMMON_FAIR_SHARE_SCHEDULER_H_
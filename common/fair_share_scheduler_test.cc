@@ -0,0 +1,203 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/fair_share_scheduler.h"
+
+#include <algorithm>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "common/test/matchers.h"
+#include "common/test/test_status_macros.h"
+#include "gmock/gmock.h"
+
+namespace cloud_kms {
+namespace {
+
+using ::testing::ElementsAre;
+
+constexpr absl::Duration kLongWait = absl::Seconds(10);
+
+// Records the order in which calls are admitted. Each call is released as soon
+// as it is recorded.
+class AdmissionRecorder {
+ public:
+  explicit AdmissionRecorder(FairShareScheduler* scheduler)
+      : scheduler_(scheduler) {}
+
+  ~AdmissionRecorder() {
+    for (std::thread& t : threads_) {
+      t.join();
+    }
+  }
+
+  // Starts a call in `flow`, and returns once it is waiting for admission.
+  void StartCall(std::string flow) {
+    size_t waiting = scheduler_->waiting();
+    threads_.emplace_back([this, flow] {
+      absl::StatusOr<FairShareScheduler::Admission> admission =
+          scheduler_->Admit(flow, absl::Now() + kLongWait);
+      EXPECT_OK(admission);
+      absl::MutexLock lock(&mutex_);
+      order_.push_back(flow);
+    });
+    while (scheduler_->waiting() == waiting) {
+      absl::SleepFor(absl::Milliseconds(1));
+    }
+  }
+
+  std::vector<std::string> Finish() {
+    for (std::thread& t : threads_) {
+      t.join();
+    }
+    threads_.clear();
+    absl::MutexLock lock(&mutex_);
+    return order_;
+  }
+
+ private:
+  FairShareScheduler* scheduler_;
+  std::vector<std::thread> threads_;
+  absl::Mutex mutex_;
+  std::vector<std::string> order_ ABSL_GUARDED_BY(mutex_);
+};
+
+TEST(FairShareSchedulerTest, AdmitsUpToCapacity) {
+  FairShareScheduler scheduler(2);
+
+  ASSERT_OK_AND_ASSIGN(FairShareScheduler::Admission first,
+                       scheduler.Admit("a", absl::Now() + kLongWait));
+  ASSERT_OK_AND_ASSIGN(FairShareScheduler::Admission second,
+                       scheduler.Admit("b", absl::Now() + kLongWait));
+  EXPECT_THAT(scheduler.Admit("a", absl::Now() + absl::Milliseconds(20)),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+  EXPECT_EQ(scheduler.waiting(), 0);
+}
+
+TEST(FairShareSchedulerTest, ReleaseAdmitsWaitingCall) {
+  FairShareScheduler scheduler(1);
+  std::optional<FairShareScheduler::Admission> holder;
+  {
+    ASSERT_OK_AND_ASSIGN(FairShareScheduler::Admission admission,
+                         scheduler.Admit("a", absl::Now() + kLongWait));
+    holder.emplace(std::move(admission));
+  }
+
+  AdmissionRecorder recorder(&scheduler);
+  recorder.StartCall("b");
+  holder.reset();
+
+  EXPECT_THAT(recorder.Finish(), ElementsAre("b"));
+}
+
+TEST(FairShareSchedulerTest, FlowCapIsEnforced) {
+  FairShareScheduler scheduler(0, {{"a", {.max_in_flight = 1}}});
+
+  ASSERT_OK_AND_ASSIGN(FairShareScheduler::Admission a,
+                       scheduler.Admit("a", absl::Now() + kLongWait));
+  EXPECT_THAT(scheduler.Admit("a", absl::Now() + absl::Milliseconds(20)),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+  EXPECT_OK(scheduler.Admit("b", absl::Now() + kLongWait));
+}
+
+TEST(FairShareSchedulerTest, BusyFlowDoesNotStarveOtherFlow) {
+  FairShareScheduler scheduler(1);
+  std::optional<FairShareScheduler::Admission> holder;
+  {
+    ASSERT_OK_AND_ASSIGN(FairShareScheduler::Admission admission,
+                         scheduler.Admit("holder", absl::Now() + kLongWait));
+    holder.emplace(std::move(admission));
+  }
+
+  AdmissionRecorder recorder(&scheduler);
+  for (int i = 0; i < 10; i++) {
+    recorder.StartCall("noisy");
+  }
+  recorder.StartCall("quiet");
+  holder.reset();
+
+  std::vector<std::string> order = recorder.Finish();
+  ASSERT_EQ(order.size(), 11);
+  EXPECT_EQ(order[1], "quiet");
+}
+
+TEST(FairShareSchedulerTest, WeightsDivideCapacity) {
+  FairShareScheduler scheduler(1, {{"a", {.weight = 3}}, {"b", {.weight = 1}}});
+  std::optional<FairShareScheduler::Admission> holder;
+  {
+    ASSERT_OK_AND_ASSIGN(FairShareScheduler::Admission admission,
+                         scheduler.Admit("holder", absl::Now() + kLongWait));
+    holder.emplace(std::move(admission));
+  }
+
+  AdmissionRecorder recorder(&scheduler);
+  for (int i = 0; i < 8; i++) {
+    recorder.StartCall("a");
+  }
+  for (int i = 0; i < 8; i++) {
+    recorder.StartCall("b");
+  }
+  holder.reset();
+
+  std::vector<std::string> order = recorder.Finish();
+  ASSERT_EQ(order.size(), 16);
+  EXPECT_EQ(std::count(order.begin(), order.begin() + 8, "a"), 6);
+}
+
+TEST(FairShareSchedulerTest, TimedOutCallDoesNotBlockLaterCalls) {
+  FairShareScheduler scheduler(1);
+  std::optional<FairShareScheduler::Admission> holder;
+  {
+    ASSERT_OK_AND_ASSIGN(FairShareScheduler::Admission admission,
+                         scheduler.Admit("a", absl::Now() + kLongWait));
+    holder.emplace(std::move(admission));
+  }
+
+  EXPECT_THAT(scheduler.Admit("a", absl::Now() + absl::Milliseconds(20)),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+
+  AdmissionRecorder recorder(&scheduler);
+  recorder.StartCall("b");
+  holder.reset();
+
+  EXPECT_THAT(recorder.Finish(), ElementsAre("b"));
+}
+
+TEST(FairShareSchedulerTest, TimedOutCallsDoNotCostFlowItsShare) {
+  FairShareScheduler scheduler(1);
+  std::optional<FairShareScheduler::Admission> holder;
+  {
+    ASSERT_OK_AND_ASSIGN(FairShareScheduler::Admission admission,
+                         scheduler.Admit("holder", absl::Now() + kLongWait));
+    holder.emplace(std::move(admission));
+  }
+
+  for (int i = 0; i < 5; i++) {
+    EXPECT_THAT(scheduler.Admit("a", absl::Now() + absl::Milliseconds(5)),
+                StatusIs(absl::StatusCode::kDeadlineExceeded));
+  }
+
+  AdmissionRecorder recorder(&scheduler);
+  recorder.StartCall("b");
+  recorder.StartCall("b");
+  recorder.StartCall("a");
+  holder.reset();
+
+  EXPECT_THAT(recorder.Finish(), ElementsAre("b", "a", "b"));
+}
+
+}  // namespace
+}  // namespace cloud_kms
@@ -0,0 +1,476 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/http_client.h"
+
+#include <cstdlib>
+#include <optional>
+#include <vector>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "common/openssl.h"
+#include "common/platform.h"
+#include "common/source_location.h"
+#include "common/status_macros.h"
+#include "common/string_utils.h"
+#include "openssl/ssl.h"
+
+namespace cloud_kms {
+namespace {
+
+constexpr std::string_view kCrlf = "\r\n";
+
+// A TLS connection is a chain of an SSL BIO and a connect BIO, both of which
+// must be freed.
+struct BioChainDeleter {
+  void operator()(BIO* bio) { BIO_free_all(bio); }
+};
+using BioChain = std::unique_ptr<BIO, BioChainDeleter>;
+
+absl::Status TransportError(std::string_view what, const SourceLocation& loc) {
+  return absl::UnavailableError(
+      absl::StrFormat("at %s: %s: %s", loc.ToString(), what,
+                      ERR_error_string(ERR_get_error(), nullptr)));
+}
+
+// Waits until the socket under `bio` is ready for the operation that `bio`
+// asked to retry. If the operation failed outright instead, returns an error
+// that describes `what` failed.
+absl::Status AwaitRetry(BIO* bio, std::string_view what, absl::Time deadline,
+                        const SourceLocation& loc) {
+  if (!BIO_should_retry(bio)) {
+    return TransportError(what, loc);
+  }
+  int socket;
+  if (BIO_get_fd(bio, &socket) < 0) {
+    return TransportError("unable to get socket", SOURCE_LOCATION);
+  }
+  return WaitForSocket(socket, /*for_write=*/!BIO_should_read(bio), deadline);
+}
+
+// Decodes the chunked body at the start of `data` into `body`. Returns the
+// number of bytes of `data` that the body, including any trailer fields,
+// occupies, or std::nullopt if `data` ends before the body does.
+absl::StatusOr<std::optional<size_t>> DecodeChunkedBody(std::string_view data,
+                                                        std::string* body) {
+  body->clear();
+  std::string_view remaining = data;
+  while (true) {
+    size_t line_end = remaining.find(kCrlf);
+    if (line_end == std::string_view::npos) {
+      return std::nullopt;
+    }
+    // Chunk extensions, if any, follow a semicolon.
+    std::string_view size_field = remaining.substr(0, line_end);
+    size_field = size_field.substr(0, size_field.find(';'));
+    uint32_t size;
+    if (!absl::SimpleHexAtoi(absl::StripAsciiWhitespace(size_field), &size)) {
+      return absl::InternalError("malformed chunk size in HTTP response");
+    }
+    remaining.remove_prefix(line_end + kCrlf.size());
+    if (size == 0) {
+      break;
+    }
+    if (remaining.size() < size + kCrlf.size()) {
+      return std::nullopt;
+    }
+    body->append(remaining.substr(0, size));
+    remaining.remove_prefix(size + kCrlf.size());
+  }
+  // Trailer fields are ignored. The body ends with an empty line.
+  while (true) {
+    size_t line_end = remaining.find(kCrlf);
+    if (line_end == std::string_view::npos) {
+      return std::nullopt;
+    }
+    remaining.remove_prefix(line_end + kCrlf.size());
+    if (line_end == 0) {
+      return data.size() - remaining.size();
+    }
+  }
+}
+
+// Returns true if a Connection header value lists the "close" option.
+bool HasCloseOption(std::string_view connection) {
+  for (std::string_view option : absl::StrSplit(connection, ',')) {
+    if (absl::EqualsIgnoreCase(absl::StripAsciiWhitespace(option), "close")) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct ParsedResponse {
+  HttpResponse response;
+  // The number of bytes that the response message occupies.
+  size_t size;
+  // Whether the connection may be used for another request.
+  bool keep_alive;
+};
+
+// Parses the HTTP/1.1 response at the start of `data`. Returns std::nullopt if
+// `data` ends before the response does. `at_eof` indicates that the connection
+// has ended, which ends a body whose length is not otherwise given.
+absl::StatusOr<std::optional<ParsedResponse>> ParseResponse(
+    std::string_view data, bool at_eof) {
+  size_t head_end = data.find("\r\n\r\n");
+  if (head_end == std::string_view::npos) {
+    return std::nullopt;
+  }
+  std::vector<std::string_view> lines =
+      absl::StrSplit(data.substr(0, head_end), kCrlf);
+  size_t body_start = head_end + 2 * kCrlf.size();
+  std::string_view body = data.substr(body_start);
+
+  // The status line is of the form "HTTP/1.1 200 OK".
+  std::vector<std::string_view> status_line =
+      absl::StrSplit(lines[0], absl::MaxSplits(' ', 2));
+  ParsedResponse parsed;
+  HttpResponse& response = parsed.response;
+  if (status_line.size() < 2 || !absl::StartsWith(status_line[0], "HTTP/") ||
+      !absl::SimpleAtoi(status_line[1], &response.status_code)) {
+    return absl::InternalError(
+        absl::StrCat("malformed HTTP status line: ", lines[0]));
+  }
+  // Older servers close the connection after each response.
+  parsed.keep_alive = status_line[0] == "HTTP/1.1";
+
+  bool chunked = false;
+  std::optional<size_t> content_length;
+  for (size_t i = 1; i < lines.size(); i++) {
+    std::pair<std::string_view, std::string_view> header =
+        absl::StrSplit(lines[i], absl::MaxSplits(':', 1));
+    std::string_view value = absl::StripAsciiWhitespace(header.second);
+    if (absl::EqualsIgnoreCase(header.first, "Transfer-Encoding")) {
+      chunked = absl::StrContains(absl::AsciiStrToLower(value), "chunked");
+    } else if (absl::EqualsIgnoreCase(header.first, "Content-Length")) {
+      size_t length;
+      if (!absl::SimpleAtoi(value, &length)) {
+        return absl::InternalError(
+            absl::StrCat("malformed HTTP Content-Length: ", value));
+      }
+      content_length = length;
+    } else if (absl::EqualsIgnoreCase(header.first, "Connection") &&
+               HasCloseOption(value)) {
+      parsed.keep_alive = false;
+    }
+  }
+
+  if (response.status_code == 204 || response.status_code == 304) {
+    // These responses never have a body.
+    parsed.size = body_start;
+  } else if (chunked) {
+    ASSIGN_OR_RETURN(std::optional<size_t> body_size,
+                     DecodeChunkedBody(body, &response.body));
+    if (!body_size.has_value()) {
+      return std::nullopt;
+    }
+    parsed.size = body_start + *body_size;
+  } else if (content_length.has_value()) {
+    if (body.size() < *content_length) {
+      return std::nullopt;
+    }
+    response.body = std::string(body.substr(0, *content_length));
+    parsed.size = body_start + *content_length;
+  } else {
+    if (!at_eof) {
+      return std::nullopt;
+    }
+    response.body = std::string(body);
+    parsed.size = data.size();
+    parsed.keep_alive = false;
+  }
+  return parsed;
+}
+
+// The most idle connections that a client keeps open for reuse.
+constexpr size_t kMaxIdleConnections = 16;
+
+class BioHttpClient : public HttpClient {
+ public:
+  BioHttpClient(std::string host_port, SSL_CTX* ssl_ctx)
+      : host_port_(std::move(host_port)),
+        host_(host_port_.substr(0, host_port_.rfind(':'))),
+        ssl_ctx_(ssl_ctx) {}
+
+  ~BioHttpClient() override {
+    {
+      absl::MutexLock lock(&mutex_);
+      idle_.clear();
+    }
+    if (ssl_ctx_) {
+      SSL_CTX_free(ssl_ctx_);
+    }
+  }
+
+  absl::StatusOr<HttpResponse> Send(const HttpRequest& request) override;
+
+ private:
+  absl::StatusOr<BioChain> Connect(absl::Time deadline);
+
+  // Sends `message` over `bio` and reads the response. If the connection may
+  // be reused afterward, it is kept as an idle connection. Sets
+  // `response_started` once any of the response has been received.
+  absl::StatusOr<HttpResponse> RoundTrip(BioChain bio, std::string_view message,
+                                         absl::Time deadline,
+                                         bool* response_started);
+
+  // Returns an idle connection that the server has not closed, or nullptr if
+  // there is none.
+  BioChain TakeIdleConnection();
+  void KeepIdleConnection(BioChain bio);
+
+  const std::string host_port_;
+  const std::string host_;
+  SSL_CTX* const ssl_ctx_;  // nullptr if TLS is not used
+
+  absl::Mutex mutex_;
+  std::vector<BioChain> idle_ ABSL_GUARDED_BY(mutex_);
+};
+
+absl::StatusOr<BioChain> BioHttpClient::Connect(absl::Time deadline) {
+  BioChain bio;
+  if (ssl_ctx_) {
+    bio.reset(BIO_new_ssl_connect(ssl_ctx_));
+  } else {
+    bio.reset(BIO_new(BIO_s_connect()));
+  }
+  if (!bio) {
+    return TransportError("unable to create connection", SOURCE_LOCATION);
+  }
+  BIO* connect_bio = ssl_ctx_ ? BIO_next(bio.get()) : bio.get();
+  BIO_set_conn_hostname(connect_bio, host_port_.c_str());
+  // The socket is non-blocking, so that connecting, the TLS handshake and
+  // each read and write can be bounded by the deadline. Resolving the host
+  // name still blocks.
+  BIO_set_nbio(connect_bio, 1);
+
+  if (ssl_ctx_) {
+    SSL* ssl;
+    BIO_get_ssl(bio.get(), &ssl);
+    if (!SSL_set_tlsext_host_name(ssl, host_.c_str()) ||
+        !X509_VERIFY_PARAM_set1_host(SSL_get0_param(ssl), host_.data(),
+                                     host_.size())) {
+      return TransportError("unable to set TLS host name", SOURCE_LOCATION);
+    }
+  }
+
+  while (BIO_do_connect(connect_bio) <= 0) {
+    RETURN_IF_ERROR(AwaitRetry(
+        connect_bio, absl::StrCat("unable to connect to ", host_port_),
+        deadline, SOURCE_LOCATION));
+  }
+  while (ssl_ctx_ && BIO_do_handshake(bio.get()) <= 0) {
+    RETURN_IF_ERROR(
+        AwaitRetry(bio.get(),
+                   absl::StrCat("TLS handshake with ", host_port_, " failed"),
+                   deadline, SOURCE_LOCATION));
+  }
+  return bio;
+}
+
+absl::StatusOr<HttpResponse> BioHttpClient::Send(const HttpRequest& request) {
+  if (absl::Now() >= request.deadline) {
+    return absl::DeadlineExceededError(absl::StrFormat(
+        "at %s: deadline exceeded before sending HTTP request",
+        SOURCE_LOCATION.ToString()));
+  }
+
+  std::string message =
+      absl::StrCat(request.method, " ", request.target, " HTTP/1.1", kCrlf,
+                   "Host: ", host_, kCrlf);
+  if (!request.body.empty() || request.method == "POST") {
+    absl::StrAppend(&message, "Content-Length: ", request.body.size(), kCrlf);
+  }
+  for (const auto& [name, value] : request.headers) {
+    absl::StrAppend(&message, name, ": ", value, kCrlf);
+  }
+  absl::StrAppend(&message, kCrlf, request.body);
+
+  // The server may close an idle connection just as it is reused. If that
+  // happens before any of the response arrives, a GET is retried on a new
+  // connection; other requests may already have taken effect.
+  if (BioChain bio = TakeIdleConnection(); bio) {
+    bool response_started = false;
+    absl::StatusOr<HttpResponse> response =
+        RoundTrip(std::move(bio), message, request.deadline, &response_started);
+    if (response.ok() || response_started || request.method != "GET" ||
+        !absl::IsUnavailable(response.status())) {
+      return response;
+    }
+  }
+  ASSIGN_OR_RETURN(BioChain bio, Connect(request.deadline));
+  bool response_started = false;
+  return RoundTrip(std::move(bio), message, request.deadline,
+                   &response_started);
+}
+
+absl::StatusOr<HttpResponse> BioHttpClient::RoundTrip(BioChain bio,
+                                                      std::string_view message,
+                                                      absl::Time deadline,
+                                                      bool* response_started) {
+  std::string_view remaining = message;
+  while (!remaining.empty()) {
+    int written = BIO_write(bio.get(), remaining.data(), remaining.size());
+    if (written <= 0) {
+      RETURN_IF_ERROR(AwaitRetry(bio.get(), "error sending HTTP request",
+                                 deadline, SOURCE_LOCATION));
+      continue;
+    }
+    remaining.remove_prefix(written);
+  }
+
+  std::string data;
+  char buffer[16384];
+  while (true) {
+    int read = BIO_read(bio.get(), buffer, sizeof(buffer));
+    if (read < 0) {
+      RETURN_IF_ERROR(AwaitRetry(bio.get(), "error reading HTTP response",
+                                 deadline, SOURCE_LOCATION));
+      continue;
+    }
+    if (read > 0) {
+      *response_started = true;
+      data.append(buffer, read);
+    }
+    ASSIGN_OR_RETURN(std::optional<ParsedResponse> parsed,
+                     ParseResponse(data, /*at_eof=*/read == 0));
+    if (parsed.has_value()) {
+      // A connection with more data than the response is out of step.
+      if (parsed->keep_alive && parsed->size == data.size()) {
+        KeepIdleConnection(std::move(bio));
+      }
+      return std::move(parsed->response);
+    }
+    if (read == 0) {
+      return absl::UnavailableError(absl::StrFormat(
+          "at %s: connection closed before the HTTP response was complete",
+          SOURCE_LOCATION.ToString()));
+    }
+  }
+}
+
+BioChain BioHttpClient::TakeIdleConnection() {
+  while (true) {
+    BioChain bio;
+    {
+      absl::MutexLock lock(&mutex_);
+      if (idle_.empty()) {
+        return nullptr;
+      }
+      bio = std::move(idle_.back());
+      idle_.pop_back();
+    }
+    // An idle connection has nothing to read, unless the server has closed it.
+    char byte;
+    if (BIO_read(bio.get(), &byte, 1) < 0 && BIO_should_retry(bio.get())) {
+      return bio;
+    }
+    ERR_clear_error();
+  }
+}
+
+void BioHttpClient::KeepIdleConnection(BioChain bio) {
+  absl::MutexLock lock(&mutex_);
+  if (idle_.size() < kMaxIdleConnections) {
+    idle_.push_back(std::move(bio));
+  }
+}
+
+// Reads the PEM bundle of trusted root certificates, as described for
+// NewHttpClient.
+absl::StatusOr<std::string> ReadRootCertificates(
+    std::string_view root_certs_file) {
+  std::string path(root_certs_file);
+  if (path.empty()) {
+    const char* grpc_path =
+        std::getenv(std::string(kGrpcRootCertsEnvVariable).c_str());
+    if (grpc_path && *grpc_path) {
+      path = grpc_path;
+    }
+  }
+  if (path.empty()) {
+    return ReadSystemRootCertificates();
+  }
+  absl::StatusOr<std::string> pem = ReadFileToString(path);
+  if (!pem.ok()) {
+    return absl::FailedPreconditionError(
+        absl::StrFormat("unable to read trusted root certificates from %s: %s",
+                        path, pem.status().message()));
+  }
+  return pem;
+}
+
+// Adds the certificates in the PEM bundle `pem` to the trusted roots of
+// `ssl_ctx`. Fails if the bundle has no certificates.
+absl::Status AddRootCertificates(SSL_CTX* ssl_ctx, std::string_view pem) {
+  bssl::UniquePtr<BIO> bio(BIO_new_mem_buf(pem.data(), pem.size()));
+  X509_STORE* store = SSL_CTX_get_cert_store(ssl_ctx);
+  int added = 0;
+  while (bssl::UniquePtr<X509> cert{
+      PEM_read_bio_X509(bio.get(), nullptr, nullptr, nullptr)}) {
+    // A bundle may repeat a certificate, which is not an error.
+    if (X509_STORE_add_cert(store, cert.get()) == 1) {
+      added++;
+    }
+  }
+  // Reading stops with an error at the end of the bundle.
+  ERR_clear_error();
+  if (added == 0) {
+    return absl::FailedPreconditionError(
+        "no trusted root certificates could be loaded");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<HttpClient>> NewHttpClient(
+    std::string host_port, bool use_tls, std::string_view root_certs_file) {
+  if (!use_tls) {
+    return std::make_unique<BioHttpClient>(std::move(host_port), nullptr);
+  }
+
+  ASSIGN_OR_RETURN(std::string pem, ReadRootCertificates(root_certs_file));
+  SSL_CTX* ssl_ctx = SSL_CTX_new(TLS_client_method());
+  if (!ssl_ctx) {
+    return absl::InternalError(
+        absl::StrFormat("at %s: unable to create TLS context: %s",
+                        SOURCE_LOCATION.ToString(),
+                        ERR_error_string(ERR_get_error(), nullptr)));
+  }
+  // The client takes ownership of the context.
+  auto client = std::make_unique<BioHttpClient>(std::move(host_port), ssl_ctx);
+  SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_PEER, nullptr);
+  RETURN_IF_ERROR(AddRootCertificates(ssl_ctx, pem));
+  return client;
+}
+
+absl::StatusOr<HttpResponse> ParseHttpResponse(std::string_view message) {
+  ASSIGN_OR_RETURN(std::optional<ParsedResponse> parsed,
+                   ParseResponse(message, /*at_eof=*/true));
+  if (!parsed.has_value()) {
+    return absl::InternalError("truncated HTTP response");
+  }
+  return std::move(parsed->response);
+}
+
+}  // namespace cloud_kms
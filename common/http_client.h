@@ -0,0 +1,77 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMMON_HTTP_CLIENT_H_
+#define COMMON_HTTP_CLIENT_H_
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+
+namespace cloud_kms {
+
+struct HttpRequest {
+  std::string method;
+  // The request target, such as "/v1/projects/foo/locations/bar?pageSize=10".
+  std::string target;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+  absl::Time deadline = absl::InfiniteFuture();
+};
+
+struct HttpResponse {
+  int status_code = 0;
+  std::string body;
+};
+
+// HttpClient sends HTTP requests to a single host.
+class HttpClient {
+ public:
+  virtual ~HttpClient() = default;
+
+  virtual absl::StatusOr<HttpResponse> Send(const HttpRequest& request) = 0;
+};
+
+// The environment variable that gRPC reads the path of its trusted root
+// certificates from. HttpClient honors it as well, so that both transports
+// trust the same roots.
+inline constexpr std::string_view kGrpcRootCertsEnvVariable =
+    "GRPC_DEFAULT_SSL_ROOTS_FILE_PATH";
+
+// Returns an HttpClient that sends HTTP/1.1 requests to `host_port` (such as
+// "cloudkms.googleapis.com:443"). Connections are kept alive and reused by
+// later requests.
+//
+// If `use_tls` is true, connections use TLS, and the server's certificate is
+// verified against the PEM certificates in `root_certs_file`, or else in the
+// file named by kGrpcRootCertsEnvVariable, or else the operating system's
+// trusted roots. Fails if no trusted root certificates can be loaded.
+absl::StatusOr<std::unique_ptr<HttpClient>> NewHttpClient(
+    std::string host_port, bool use_tls,
+    std::string_view root_certs_file = "");
+
+// Parses a complete HTTP/1.1 response message, including a body with chunked
+// transfer encoding.
+absl::StatusOr<HttpResponse> ParseHttpResponse(std::string_view message);
+
+}  // namespace cloud_kms
+
+#endif  // COMMON_HTTP_CLIENT_H_
@@ -0,0 +1,232 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/http_client.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "common/test/matchers.h"
+#include "common/test/runfiles.h"
+#include "common/test/test_status_macros.h"
+#include "gmock/gmock.h"
+
+namespace cloud_kms {
+namespace {
+
+using ::testing::HasSubstr;
+
+TEST(ParseHttpResponseTest, BodyWithContentLength) {
+  ASSERT_OK_AND_ASSIGN(HttpResponse response,
+                       ParseHttpResponse("HTTP/1.1 200 OK\r\n"
+                                         "Content-Type: application/json\r\n"
+                                         "Content-Length: 4\r\n"
+                                         "\r\n"
+                                         "{}\r\n"));
+  EXPECT_EQ(response.status_code, 200);
+  EXPECT_EQ(response.body, "{}\r\n");
+}
+
+TEST(ParseHttpResponseTest, BodyWithoutContentLengthEndsAtEndOfMessage) {
+  ASSERT_OK_AND_ASSIGN(HttpResponse response,
+                       ParseHttpResponse("HTTP/1.1 404 Not Found\r\n"
+                                         "\r\n"
+                                         "not found"));
+  EXPECT_EQ(response.status_code, 404);
+  EXPECT_EQ(response.body, "not found");
+}
+
+TEST(ParseHttpResponseTest, ChunkedBody) {
+  ASSERT_OK_AND_ASSIGN(HttpResponse response,
+                       ParseHttpResponse("HTTP/1.1 200 OK\r\n"
+                                         "transfer-encoding: chunked\r\n"
+                                         "\r\n"
+                                         "4\r\n"
+                                         "{\"a\"\r\n"
+                                         "a;name=value\r\n"
+                                         ": \"bcdef\"}\r\n"
+                                         "0\r\n"
+                                         "\r\n"));
+  EXPECT_EQ(response.body, "{\"a\": \"bcdef\"}");
+}
+
+TEST(ParseHttpResponseTest, ChunkedBodyWithTrailers) {
+  ASSERT_OK_AND_ASSIGN(HttpResponse response,
+                       ParseHttpResponse("HTTP/1.1 200 OK\r\n"
+                                         "Transfer-Encoding: chunked\r\n"
+                                         "\r\n"
+                                         "2\r\n"
+                                         "{}\r\n"
+                                         "0\r\n"
+                                         "Checksum: abc\r\n"
+                                         "\r\n"));
+  EXPECT_EQ(response.body, "{}");
+}
+
+TEST(ParseHttpResponseTest, ChunkedBodyWithoutFinalLineIsError) {
+  EXPECT_THAT(ParseHttpResponse("HTTP/1.1 200 OK\r\n"
+                                "Transfer-Encoding: chunked\r\n"
+                                "\r\n"
+                                "0\r\n"),
+              StatusIs(absl::StatusCode::kInternal));
+}
+
+TEST(ParseHttpResponseTest, NoContentHasNoBody) {
+  ASSERT_OK_AND_ASSIGN(HttpResponse response,
+                       ParseHttpResponse("HTTP/1.1 204 No Content\r\n"
+                                         "\r\n"));
+  EXPECT_EQ(response.status_code, 204);
+  EXPECT_EQ(response.body, "");
+}
+
+TEST(ParseHttpResponseTest, TruncatedChunkIsError) {
+  EXPECT_THAT(ParseHttpResponse("HTTP/1.1 200 OK\r\n"
+                                "Transfer-Encoding: chunked\r\n"
+                                "\r\n"
+                                "10\r\n"
+                                "short\r\n"),
+              StatusIs(absl::StatusCode::kInternal));
+}
+
+TEST(ParseHttpResponseTest, TruncatedBodyIsError) {
+  EXPECT_THAT(ParseHttpResponse("HTTP/1.1 200 OK\r\n"
+                                "Content-Length: 10\r\n"
+                                "\r\n"
+                                "short"),
+              StatusIs(absl::StatusCode::kInternal));
+}
+
+TEST(ParseHttpResponseTest, MalformedStatusLineIsError) {
+  EXPECT_THAT(ParseHttpResponse("SPDY/3 OK\r\n\r\n"),
+              StatusIs(absl::StatusCode::kInternal));
+}
+
+TEST(ParseHttpResponseTest, MissingHeaderTerminatorIsError) {
+  EXPECT_THAT(ParseHttpResponse("HTTP/1.1 200 OK\r\n"),
+              StatusIs(absl::StatusCode::kInternal));
+}
+
+std::string TestRootCertsFile() {
+  return RunfileLocation(
+      "com_google_kmstools/common/test/testdata/ec_p256_cert.pem");
+}
+
+TEST(NewHttpClientTest, LoadsRootCertificatesFile) {
+  EXPECT_OK(NewHttpClient("localhost:443", /*use_tls=*/true,
+                          TestRootCertsFile()));
+}
+
+TEST(NewHttpClientTest, MissingRootCertificatesFileIsFailedPrecondition) {
+  EXPECT_THAT(NewHttpClient("localhost:443", /*use_tls=*/true,
+                            "/nonexistent/roots.pem"),
+              StatusIs(absl::StatusCode::kFailedPrecondition,
+                       HasSubstr("/nonexistent/roots.pem")));
+}
+
+TEST(NewHttpClientTest, RootCertificatesFileWithoutCertificatesFails) {
+  std::string roots_file = std::tmpnam(nullptr);
+  std::ofstream(roots_file) << "not a certificate";
+
+  EXPECT_THAT(NewHttpClient("localhost:443", /*use_tls=*/true, roots_file),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+  std::remove(roots_file.c_str());
+}
+
+TEST(NewHttpClientTest, PlainHttpDoesNotLoadRootCertificates) {
+  EXPECT_OK(NewHttpClient("localhost:80", /*use_tls=*/false,
+                          "/nonexistent/roots.pem"));
+}
+
+TEST(HttpClientTest, ExpiredDeadlineIsDeadlineExceeded) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<HttpClient> client,
+      NewHttpClient("localhost:443", /*use_tls=*/true, TestRootCertsFile()));
+
+  HttpRequest request;
+  request.method = "GET";
+  request.target = "/";
+  request.deadline = absl::Now() - absl::Seconds(1);
+
+  EXPECT_THAT(client->Send(request),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+}
+
+#ifndef _WIN32
+TEST(HttpClientTest, ReusesConnection) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(listener, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t address_size = sizeof(address);
+  ASSERT_EQ(
+      bind(listener, reinterpret_cast<sockaddr*>(&address), address_size), 0);
+  ASSERT_EQ(listen(listener, 1), 0);
+  ASSERT_EQ(getsockname(listener, reinterpret_cast<sockaddr*>(&address),
+                        &address_size),
+            0);
+
+  // The server answers both requests on the first connection it accepts, so
+  // the second request only succeeds if the connection is reused.
+  std::thread server([listener] {
+    int connection = accept(listener, nullptr, nullptr);
+    for (std::string_view body : {"first", "second"}) {
+      // The requests have no body, so each ends with an empty line.
+      std::string request;
+      char c;
+      while (!absl::EndsWith(request, "\r\n\r\n") &&
+             read(connection, &c, 1) == 1) {
+        request.push_back(c);
+      }
+      std::string response =
+          absl::StrCat("HTTP/1.1 200 OK\r\nContent-Length: ", body.size(),
+                       "\r\n\r\n", body);
+      EXPECT_EQ(write(connection, response.data(), response.size()),
+                response.size());
+    }
+    close(connection);
+  });
+
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<HttpClient> client,
+      NewHttpClient(absl::StrCat("127.0.0.1:", ntohs(address.sin_port)),
+                    /*use_tls=*/false));
+  HttpRequest request;
+  request.method = "GET";
+  request.target = "/";
+  request.deadline = absl::Now() + absl::Seconds(10);
+
+  ASSERT_OK_AND_ASSIGN(HttpResponse first, client->Send(request));
+  EXPECT_EQ(first.body, "first");
+  ASSERT_OK_AND_ASSIGN(HttpResponse second, client->Send(request));
+  EXPECT_EQ(second.body, "second");
+
+  server.join();
+  close(listener);
+}
+#endif  // _WIN32
+
+}  // namespace
+}  // namespace cloud_kms
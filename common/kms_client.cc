@@ -14,9 +14,14 @@
 
 #include "common/kms_client.h"
 
+#include <thread>
+
 #include "absl/crc/crc32c.h"
+#include "absl/functional/function_ref.h"
+#include "absl/strings/internal/resize_uninitialized.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
 #include "cloudkms_grpc_service_config.h"
 #include "common/backoff.h"
 #include "common/openssl.h"
@@ -69,6 +74,87 @@ absl::StatusOr<std::string> GetDigestString(const kms_v1::Digest& digest) {
   }
 }
 
+thread_local absl::Time current_rpc_deadline = absl::InfiniteFuture();
+
+// The time for newly generated HSM keys to flip to enabled in (real) KMS
+// varies from 10-40ish milliseconds depending on key type.
+constexpr absl::Duration kMinGenerationPollDelay = absl::Milliseconds(20);
+constexpr absl::Duration kMaxGenerationPollDelay = absl::Seconds(1);
+
+// WorkerGroup runs batches of calls on up to `parallelism` threads at once,
+// including the calling thread. Its threads are started once and reused by
+// every batch.
+class WorkerGroup {
+ public:
+  explicit WorkerGroup(size_t parallelism) {
+    for (size_t i = 1; i < parallelism; i++) {
+      threads_.emplace_back([this] { Work(); });
+    }
+  }
+
+  ~WorkerGroup() {
+    {
+      absl::MutexLock lock(&mutex_);
+      stopping_ = true;
+      work_available_.SignalAll();
+    }
+    for (std::thread& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  // Calls `fn` with each index in [0, `count`), and returns once every call
+  // has returned.
+  void ParallelFor(size_t count, absl::FunctionRef<void(size_t)> fn) {
+    absl::MutexLock lock(&mutex_);
+    fn_ = &fn;
+    count_ = count;
+    next_ = 0;
+    finished_ = 0;
+    work_available_.SignalAll();
+    RunCalls();
+    while (finished_ < count_) {
+      batch_finished_.Wait(&mutex_);
+    }
+    fn_ = nullptr;
+    count_ = 0;
+    next_ = 0;
+  }
+
+ private:
+  void Work() {
+    absl::MutexLock lock(&mutex_);
+    while (!stopping_) {
+      RunCalls();
+      work_available_.Wait(&mutex_);
+    }
+  }
+
+  // Makes calls from the current batch until none are left to start.
+  void RunCalls() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    while (next_ < count_) {
+      size_t i = next_++;
+      absl::FunctionRef<void(size_t)> fn = *fn_;
+      mutex_.Unlock();
+      fn(i);
+      mutex_.Lock();
+      if (++finished_ == count_) {
+        batch_finished_.Signal();
+      }
+    }
+  }
+
+  absl::Mutex mutex_;
+  absl::CondVar work_available_;
+  absl::CondVar batch_finished_;
+  absl::FunctionRef<void(size_t)>* fn_ ABSL_GUARDED_BY(mutex_) = nullptr;
+  size_t count_ ABSL_GUARDED_BY(mutex_) = 0;
+  size_t next_ ABSL_GUARDED_BY(mutex_) = 0;
+  size_t finished_ ABSL_GUARDED_BY(mutex_) = 0;
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+  std::vector<std::thread> threads_;
+};
+
 uint32_t ComputeCRC32C(std::string_view data) {
   return static_cast<uint32_t>(absl::ComputeCrc32c(data));
 }
@@ -79,6 +165,15 @@ bool CRC32CMatches(std::string_view data, uint32_t crc32c) {
 
 }  // namespace
 
+ScopedRpcDeadline::ScopedRpcDeadline(absl::Time deadline)
+    : previous_(current_rpc_deadline) {
+  current_rpc_deadline = std::min(previous_, deadline);
+}
+
+ScopedRpcDeadline::~ScopedRpcDeadline() { current_rpc_deadline = previous_; }
+
+absl::Time ScopedRpcDeadline::Current() { return current_rpc_deadline; }
+
 void KmsClient::AddContextSettings(grpc::ClientContext* ctx,
                                    std::string_view relative_resource,
                                    std::string_view resource_name,
@@ -96,6 +191,21 @@ void KmsClient::AddContextSettings(grpc::ClientContext* ctx,
   }
 }
 
+absl::StatusOr<FairShareScheduler::Admission> KmsClient::Admit(
+    const grpc::ClientContext& ctx, std::string_view resource_name) const {
+  if (!scheduler_) {
+    return FairShareScheduler::Admission();
+  }
+  absl::StatusOr<FairShareScheduler::Admission> admission =
+      scheduler_->Admit(SchedulerFlowName(resource_name),
+                        absl::FromChrono(ctx.deadline()));
+  if (!admission.ok()) {
+    absl::Status status = admission.status();
+    return DecorateStatus(status);
+  }
+  return admission;
+}
+
 absl::Status KmsClient::DecorateStatus(absl::Status& status) const {
   if (error_decorator_.has_value()) {
     (*error_decorator_)(status);
@@ -107,7 +217,14 @@ KmsClient::KmsClient(const Options& options)
     : rpc_timeout_(options.rpc_timeout),
       rpc_feature_flags_(options.rpc_feature_flags),
       user_project_override_(options.user_project_override),
-      error_decorator_(options.error_decorator) {
+      error_decorator_(options.error_decorator),
+      scheduler_(options.scheduler),
+      transport_(options.transport),
+      generation_latency_(kMinGenerationPollDelay) {
+  if (transport_) {
+    return;
+  }
+
   grpc::ChannelArguments args;
   args.SetUserAgentPrefix(ComputeUserAgentPrefix(
       options.user_agent, options.version_major, options.version_minor));
@@ -117,19 +234,24 @@ KmsClient::KmsClient(const Options& options)
       std::string(options.endpoint_address), options.creds, args);
 
   kms_stub_ = kms_v1::KeyManagementService::NewStub(channel);
+  transport_ = NewGrpcTransport(kms_stub_.get());
 }
 
 absl::StatusOr<kms_v1::AsymmetricDecryptResponse> KmsClient::AsymmetricDecrypt(
     kms_v1::AsymmetricDecryptRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "name", request.name());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.name()));
 
-  request.mutable_ciphertext_crc32c()->set_value(
-      ComputeCRC32C(request.ciphertext()));
+  if (!request.has_ciphertext_crc32c()) {
+    request.mutable_ciphertext_crc32c()->set_value(
+        ComputeCRC32C(request.ciphertext()));
+  }
 
   kms_v1::AsymmetricDecryptResponse response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->AsymmetricDecrypt(&ctx, request, &response));
+      ToStatus(transport_->AsymmetricDecrypt(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -157,11 +279,15 @@ absl::StatusOr<kms_v1::AsymmetricSignResponse> KmsClient::AsymmetricSign(
     kms_v1::AsymmetricSignRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "name", request.name());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.name()));
 
   bool use_data = false;
   if (!request.data().empty()) {
     use_data = true;
-    request.mutable_data_crc32c()->set_value(ComputeCRC32C(request.data()));
+    if (!request.has_data_crc32c()) {
+      request.mutable_data_crc32c()->set_value(ComputeCRC32C(request.data()));
+    }
   } else {
     absl::StatusOr<std::string> digest_string =
         GetDigestString(request.digest());
@@ -174,7 +300,7 @@ absl::StatusOr<kms_v1::AsymmetricSignResponse> KmsClient::AsymmetricSign(
 
   kms_v1::AsymmetricSignResponse response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->AsymmetricSign(&ctx, request, &response));
+      ToStatus(transport_->AsymmetricSign(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -209,12 +335,16 @@ absl::StatusOr<kms_v1::MacSignResponse> KmsClient::MacSign(
     kms_v1::MacSignRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "name", request.name());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.name()));
 
-  request.mutable_data_crc32c()->set_value(ComputeCRC32C(request.data()));
+  if (!request.has_data_crc32c()) {
+    request.mutable_data_crc32c()->set_value(ComputeCRC32C(request.data()));
+  }
 
   kms_v1::MacSignResponse response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->MacSign(&ctx, request, &response));
+      ToStatus(transport_->MacSign(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -241,13 +371,19 @@ absl::StatusOr<kms_v1::MacVerifyResponse> KmsClient::MacVerify(
     kms_v1::MacVerifyRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "name", request.name());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.name()));
 
-  request.mutable_data_crc32c()->set_value(ComputeCRC32C(request.data()));
-  request.mutable_mac_crc32c()->set_value(ComputeCRC32C(request.mac()));
+  if (!request.has_data_crc32c()) {
+    request.mutable_data_crc32c()->set_value(ComputeCRC32C(request.data()));
+  }
+  if (!request.has_mac_crc32c()) {
+    request.mutable_mac_crc32c()->set_value(ComputeCRC32C(request.mac()));
+  }
 
   kms_v1::MacVerifyResponse response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->MacVerify(&ctx, request, &response));
+      ToStatus(transport_->MacVerify(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -274,9 +410,13 @@ absl::StatusOr<kms_v1::RawDecryptResponse> KmsClient::RawDecrypt(
     kms_v1::RawDecryptRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "name", request.name());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.name()));
 
-  request.mutable_ciphertext_crc32c()->set_value(
-      ComputeCRC32C(request.ciphertext()));
+  if (!request.has_ciphertext_crc32c()) {
+    request.mutable_ciphertext_crc32c()->set_value(
+        ComputeCRC32C(request.ciphertext()));
+  }
   request.mutable_initialization_vector_crc32c()->set_value(
       ComputeCRC32C(request.initialization_vector()));
   request.mutable_additional_authenticated_data_crc32c()->set_value(
@@ -284,7 +424,7 @@ absl::StatusOr<kms_v1::RawDecryptResponse> KmsClient::RawDecrypt(
 
   kms_v1::RawDecryptResponse response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->RawDecrypt(&ctx, request, &response));
+      ToStatus(transport_->RawDecrypt(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -304,9 +444,13 @@ absl::StatusOr<kms_v1::RawEncryptResponse> KmsClient::RawEncrypt(
     kms_v1::RawEncryptRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "name", request.name());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.name()));
 
-  request.mutable_plaintext_crc32c()->set_value(
-      ComputeCRC32C(request.plaintext()));
+  if (!request.has_plaintext_crc32c()) {
+    request.mutable_plaintext_crc32c()->set_value(
+        ComputeCRC32C(request.plaintext()));
+  }
   request.mutable_additional_authenticated_data_crc32c()->set_value(
       ComputeCRC32C(request.additional_authenticated_data()));
   request.mutable_initialization_vector_crc32c()->set_value(
@@ -314,7 +458,7 @@ absl::StatusOr<kms_v1::RawEncryptResponse> KmsClient::RawEncrypt(
 
   kms_v1::RawEncryptResponse response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->RawEncrypt(&ctx, request, &response));
+      ToStatus(transport_->RawEncrypt(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -344,10 +488,12 @@ absl::StatusOr<kms_v1::CryptoKey> KmsClient::CreateCryptoKey(
     const kms_v1::CreateCryptoKeyRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "parent", request.parent());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.parent()));
 
   kms_v1::CryptoKey response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->CreateCryptoKey(&ctx, request, &response));
+      ToStatus(transport_->CreateCryptoKey(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -357,46 +503,117 @@ absl::StatusOr<kms_v1::CryptoKey> KmsClient::CreateCryptoKey(
 absl::StatusOr<CryptoKeyAndVersion>
 KmsClient::CreateCryptoKeyAndWaitForFirstVersion(
     const kms_v1::CreateCryptoKeyRequest& request) const {
-  absl::Time deadline = absl::Now() + rpc_timeout_;
+  absl::Time deadline = RpcDeadline();
 
-  ASSIGN_OR_RETURN(kms_v1::CryptoKey ck, CreateCryptoKey(request));
+  ASSIGN_OR_RETURN(CryptoKeyAndVersion result,
+                   CreateCryptoKeyAndGetFirstVersion(request, deadline));
+  RETURN_IF_ERROR(WaitForGeneration(result.crypto_key_version, deadline));
+  return result;
+}
 
-  kms_v1::CryptoKeyVersion ckv;
-  if (ck.has_primary()) {
-    ckv = ck.primary();
-  } else {
-    std::string name = absl::StrCat(ck.name(), "/cryptoKeyVersions/1");
+std::vector<absl::StatusOr<CryptoKeyAndVersion>>
+KmsClient::CreateCryptoKeysAndWaitForFirstVersions(
+    absl::Span<const kms_v1::CreateCryptoKeyRequest> requests,
+    size_t max_parallelism) const {
+  // The caller's deadline scope is thread-local, so it is carried over to the
+  // worker threads explicitly.
+  const absl::Time scope_deadline = ScopedRpcDeadline::Current();
+
+  std::vector<absl::StatusOr<CryptoKeyAndVersion>> results(requests.size());
+  std::vector<absl::Time> deadlines(requests.size());
+  std::vector<absl::Time> created(requests.size());
+  std::vector<absl::Time> last_pending(requests.size());
+
+  // The same workers create the keys and then poll them in every round.
+  WorkerGroup workers(
+      std::min(std::max<size_t>(max_parallelism, 1), requests.size()));
+  workers.ParallelFor(requests.size(), [&](size_t i) {
+    ScopedRpcDeadline scope(scope_deadline);
+    deadlines[i] = RpcDeadline();
+    results[i] = CreateCryptoKeyAndGetFirstVersion(requests[i], deadlines[i]);
+    created[i] = last_pending[i] = absl::Now();
+  });
+
+  auto is_pending = [&](size_t i) {
+    return results[i].ok() && results[i]->crypto_key_version.state() ==
+                                  kms_v1::CryptoKeyVersion::PENDING_GENERATION;
+  };
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < results.size(); i++) {
+    if (is_pending(i)) {
+      pending.push_back(i);
+    }
+  }
 
-    grpc::ClientContext ctx;
-    AddContextSettings(&ctx, "name", name, deadline);
+  // Rather than each key polling on its own schedule, every round polls all
+  // of the versions that are still pending.
+  for (int round = 0; !pending.empty(); round++) {
+    absl::SleepFor(GenerationPollDelay(round));
+
+    workers.ParallelFor(pending.size(), [&](size_t j) {
+      size_t i = pending[j];
+      absl::Time polled = absl::Now();
+      absl::Status refreshed =
+          RefreshCryptoKeyVersion(results[i]->crypto_key_version, deadlines[i]);
+      if (!refreshed.ok()) {
+        results[i] = refreshed;
+      } else if (is_pending(i)) {
+        last_pending[i] = polled;
+      } else {
+        RecordGenerationLatency(created[i], last_pending[i], polled);
+      }
+    });
+    std::erase_if(pending, [&](size_t i) { return !is_pending(i); });
+  }
+  return results;
+}
 
-    kms_v1::GetCryptoKeyVersionRequest get_ckv_req;
-    get_ckv_req.set_name(name);
+absl::StatusOr<CryptoKeyAndVersion>
+KmsClient::CreateCryptoKeyAndGetFirstVersion(
+    const kms_v1::CreateCryptoKeyRequest& request, absl::Time deadline) const {
+  kms_v1::CryptoKey ck;
+  {
+    grpc::ClientContext ctx;
+    AddContextSettings(&ctx, "parent", request.parent(), deadline);
+    ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                     Admit(ctx, request.parent()));
 
     absl::Status rpc_result =
-        ToStatus(kms_stub_->GetCryptoKeyVersion(&ctx, get_ckv_req, &ckv));
+        ToStatus(transport_->CreateCryptoKey(&ctx, request, &ck));
     if (!rpc_result.ok()) {
       return DecorateStatus(rpc_result);
     }
   }
 
-  RETURN_IF_ERROR(WaitForGeneration(ckv, deadline));
+  kms_v1::CryptoKeyVersion ckv;
+  if (ck.has_primary()) {
+    ckv = ck.primary();
+  } else {
+    ckv.set_name(absl::StrCat(ck.name(), "/cryptoKeyVersions/1"));
+    RETURN_IF_ERROR(RefreshCryptoKeyVersion(ckv, deadline));
+  }
   return CryptoKeyAndVersion{ck, ckv};
 }
 
 absl::StatusOr<kms_v1::CryptoKeyVersion>
 KmsClient::CreateCryptoKeyVersionAndWait(
     const kms_v1::CreateCryptoKeyVersionRequest& request) const {
-  absl::Time deadline = absl::Now() + rpc_timeout_;
-
-  grpc::ClientContext ctx;
-  AddContextSettings(&ctx, "parent", request.parent(), deadline);
+  absl::Time deadline = RpcDeadline();
 
   kms_v1::CryptoKeyVersion response;
-  absl::Status rpc_result =
-      ToStatus(kms_stub_->CreateCryptoKeyVersion(&ctx, request, &response));
-  if (!rpc_result.ok()) {
-    return DecorateStatus(rpc_result);
+  {
+    // The admission must be released before polling, which is admitted on
+    // the same flow.
+    grpc::ClientContext ctx;
+    AddContextSettings(&ctx, "parent", request.parent(), deadline);
+    ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                     Admit(ctx, request.parent()));
+
+    absl::Status rpc_result =
+        ToStatus(transport_->CreateCryptoKeyVersion(&ctx, request, &response));
+    if (!rpc_result.ok()) {
+      return DecorateStatus(rpc_result);
+    }
   }
   RETURN_IF_ERROR(WaitForGeneration(response, deadline));
   return response;
@@ -406,10 +623,12 @@ absl::StatusOr<kms_v1::CryptoKeyVersion> KmsClient::DestroyCryptoKeyVersion(
     const kms_v1::DestroyCryptoKeyVersionRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "name", request.name());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.name()));
 
   kms_v1::CryptoKeyVersion response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->DestroyCryptoKeyVersion(&ctx, request, &response));
+      ToStatus(transport_->DestroyCryptoKeyVersion(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -420,10 +639,12 @@ absl::StatusOr<kms_v1::CryptoKey> KmsClient::GetCryptoKey(
     const kms_v1::GetCryptoKeyRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "name", request.name());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.name()));
 
   kms_v1::CryptoKey response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->GetCryptoKey(&ctx, request, &response));
+      ToStatus(transport_->GetCryptoKey(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -434,10 +655,12 @@ absl::StatusOr<kms_v1::CryptoKeyVersion> KmsClient::GetCryptoKeyVersion(
     const kms_v1::GetCryptoKeyVersionRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "name", request.name());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.name()));
 
   kms_v1::CryptoKeyVersion response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->GetCryptoKeyVersion(&ctx, request, &response));
+      ToStatus(transport_->GetCryptoKeyVersion(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -448,10 +671,12 @@ absl::StatusOr<kms_v1::PublicKey> KmsClient::GetPublicKey(
     const kms_v1::GetPublicKeyRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "name", request.name());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.name()));
 
   kms_v1::PublicKey response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->GetPublicKey(&ctx, request, &response));
+      ToStatus(transport_->GetPublicKey(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -466,10 +691,12 @@ CryptoKeysRange KmsClient::ListCryptoKeys(
           -> absl::StatusOr<kms_v1::ListCryptoKeysResponse> {
         grpc::ClientContext ctx;
         AddContextSettings(&ctx, "parent", request.parent());
+        ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                         Admit(ctx, request.parent()));
 
         kms_v1::ListCryptoKeysResponse response;
         absl::Status rpc_result =
-            ToStatus(kms_stub_->ListCryptoKeys(&ctx, request, &response));
+            ToStatus(transport_->ListCryptoKeys(&ctx, request, &response));
         if (!rpc_result.ok()) {
           return DecorateStatus(rpc_result);
         }
@@ -492,10 +719,12 @@ CryptoKeyVersionsRange KmsClient::ListCryptoKeyVersions(
           -> absl::StatusOr<kms_v1::ListCryptoKeyVersionsResponse> {
         grpc::ClientContext ctx;
         AddContextSettings(&ctx, "parent", request.parent());
+        ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                         Admit(ctx, request.parent()));
 
         kms_v1::ListCryptoKeyVersionsResponse response;
         absl::Status rpc_result = ToStatus(
-            kms_stub_->ListCryptoKeyVersions(&ctx, request, &response));
+            transport_->ListCryptoKeyVersions(&ctx, request, &response));
         if (!rpc_result.ok()) {
           return DecorateStatus(rpc_result);
         }
@@ -516,10 +745,12 @@ KmsClient::GenerateRandomBytes(
     const kms_v1::GenerateRandomBytesRequest& request) const {
   grpc::ClientContext ctx;
   AddContextSettings(&ctx, "location", request.location());
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, request.location()));
 
   kms_v1::GenerateRandomBytesResponse response;
   absl::Status rpc_result =
-      ToStatus(kms_stub_->GenerateRandomBytes(&ctx, request, &response));
+      ToStatus(transport_->GenerateRandomBytes(&ctx, request, &response));
   if (!rpc_result.ok()) {
     return DecorateStatus(rpc_result);
   }
@@ -528,27 +759,80 @@ KmsClient::GenerateRandomBytes(
 
 absl::Status KmsClient::WaitForGeneration(kms_v1::CryptoKeyVersion& ckv,
                                           absl::Time deadline) const {
-  // The time for newly generated HSM keys to flip to enabled in (real) KMS
-  // varies from 10-40ish milliseconds depending on key type.
-  constexpr absl::Duration kMinDelay = absl::Milliseconds(20);
-  constexpr absl::Duration kMaxDelay = absl::Seconds(1);
+  absl::Time created = absl::Now();
+  absl::Time last_pending = created;
 
   int tries = 0;
   while (ckv.state() == kms_v1::CryptoKeyVersion::PENDING_GENERATION) {
-    absl::SleepFor(ComputeBackoff(kMinDelay, kMaxDelay, tries++));
+    absl::SleepFor(GenerationPollDelay(tries++));
+
+    absl::Time polled = absl::Now();
+    RETURN_IF_ERROR(RefreshCryptoKeyVersion(ckv, deadline));
+    if (ckv.state() == kms_v1::CryptoKeyVersion::PENDING_GENERATION) {
+      last_pending = polled;
+    } else {
+      RecordGenerationLatency(created, last_pending, polled);
+    }
+  }
+  return absl::OkStatus();
+}
 
-    grpc::ClientContext ctx;
-    AddContextSettings(&ctx, "name", ckv.name(), deadline);
+absl::Status KmsClient::RefreshCryptoKeyVersion(kms_v1::CryptoKeyVersion& ckv,
+                                                absl::Time deadline) const {
+  grpc::ClientContext ctx;
+  AddContextSettings(&ctx, "name", ckv.name(), deadline);
+  ASSIGN_OR_RETURN(FairShareScheduler::Admission admission,
+                   Admit(ctx, ckv.name()));
 
-    kms_v1::GetCryptoKeyVersionRequest req;
-    req.set_name(ckv.name());
-    absl::Status rpc_result =
-        ToStatus(kms_stub_->GetCryptoKeyVersion(&ctx, req, &ckv));
-    if (!rpc_result.ok()) {
-      return DecorateStatus(rpc_result);
-    }
+  kms_v1::GetCryptoKeyVersionRequest req;
+  req.set_name(ckv.name());
+  absl::Status rpc_result =
+      ToStatus(transport_->GetCryptoKeyVersion(&ctx, req, &ckv));
+  if (!rpc_result.ok()) {
+    return DecorateStatus(rpc_result);
   }
   return absl::OkStatus();
 }
 
+absl::Duration KmsClient::GenerationPollDelay(int previous_polls) const {
+  if (previous_polls == 0) {
+    return std::clamp(generation_latency_.estimate(), kMinGenerationPollDelay,
+                      kMaxGenerationPollDelay);
+  }
+  return ComputeBackoff(kMinGenerationPollDelay, kMaxGenerationPollDelay,
+                        previous_polls - 1);
+}
+
+void KmsClient::RecordGenerationLatency(absl::Time created,
+                                        absl::Time last_pending,
+                                        absl::Time generated) const {
+  // Generation completed at some point between the last two polls. Taking
+  // the midpoint keeps the estimate from creeping upwards by a polling
+  // interval each time, as it would if the later poll were taken as exact.
+  generation_latency_.Record(((last_pending - created) +
+                              (generated - created)) / 2);
+}
+
+std::string UserAgentPrefix(UserAgent user_agent, int version_major,
+                            int version_minor) {
+  return ComputeUserAgentPrefix(user_agent, version_major, version_minor);
+}
+
+uint32_t CopyWithCRC32C(std::string_view data, std::string* field) {
+  // Every byte is overwritten by the copy, so there is no need to zero-fill.
+  absl::strings_internal::STLStringResizeUninitialized(field, data.size());
+  return static_cast<uint32_t>(
+      absl::MemcpyCrc32c(field->data(), data.data(), data.size()));
+}
+
+std::string_view SchedulerFlowName(std::string_view resource_name) {
+  constexpr std::string_view kKeyRings = "/keyRings/";
+  size_t key_rings = resource_name.find(kKeyRings);
+  if (key_rings == std::string_view::npos) {
+    return "";
+  }
+  size_t end = resource_name.find('/', key_rings + kKeyRings.size());
+  return resource_name.substr(0, end);
+}
+
 }  // namespace cloud_kms
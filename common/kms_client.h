@@ -17,12 +17,18 @@
 #ifndef COMMON_KMS_CLIENT_H_
 #define COMMON_KMS_CLIENT_H_
 
+#include <algorithm>
 #include <functional>
 #include <string_view>
+#include <vector>
 
 #include "absl/status/statusor.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "common/backoff.h"
+#include "common/fair_share_scheduler.h"
+#include "common/kms_transport.h"
 #include "common/kms_v1.h"
 #include "common/pagination_range.h"
 #include "grpcpp/security/credentials.h"
@@ -43,6 +49,27 @@ using CryptoKeyVersionsRange =
                     kms_v1::ListCryptoKeyVersionsRequest,
                     kms_v1::ListCryptoKeyVersionsResponse>;
 
+// ScopedRpcDeadline bounds the deadline of every KmsClient RPC issued by the
+// current thread while it is in scope, including any retries of those RPCs.
+// The configured KmsClient RPC timeout still applies, so the effective deadline
+// is whichever comes first. Scopes may be nested; an inner scope can only
+// shorten the deadline.
+class ScopedRpcDeadline {
+ public:
+  explicit ScopedRpcDeadline(absl::Time deadline);
+  ~ScopedRpcDeadline();
+
+  ScopedRpcDeadline(const ScopedRpcDeadline&) = delete;
+  ScopedRpcDeadline& operator=(const ScopedRpcDeadline&) = delete;
+
+  // Returns the deadline in effect for the current thread, or
+  // absl::InfiniteFuture() if there is none.
+  static absl::Time Current();
+
+ private:
+  const absl::Time previous_;
+};
+
 struct CryptoKeyAndVersion {
   kms_v1::CryptoKey crypto_key;
   kms_v1::CryptoKeyVersion crypto_key_version;
@@ -62,6 +89,12 @@ class KmsClient {
     std::optional<ErrorDecorator> error_decorator = std::nullopt;
     std::string rpc_feature_flags = "";
     std::string user_project_override = "";
+    // If set, every RPC waits for admission from the scheduler before it is
+    // sent, in a flow named for the key ring that the RPC targets.
+    std::shared_ptr<FairShareScheduler> scheduler = nullptr;
+    // The transport to make calls with. If unset, calls are made over a gRPC
+    // channel to `endpoint_address` with `creds`.
+    std::shared_ptr<KmsTransport> transport = nullptr;
   };
 
   KmsClient(const Options& options);
@@ -92,6 +125,17 @@ class KmsClient {
   absl::StatusOr<CryptoKeyAndVersion> CreateCryptoKeyAndWaitForFirstVersion(
       const kms_v1::CreateCryptoKeyRequest& request) const;
 
+  // Creates the CryptoKeys in `requests`, with at most `max_parallelism` calls
+  // in flight at once, and waits for the first version of each to be
+  // generated. Pending versions are polled together in rounds. Each key has
+  // its own RPC deadline, which starts when its creation is issued. Results
+  // are returned in request order, and one key failing does not affect the
+  // others.
+  std::vector<absl::StatusOr<CryptoKeyAndVersion>>
+  CreateCryptoKeysAndWaitForFirstVersions(
+      absl::Span<const kms_v1::CreateCryptoKeyRequest> requests,
+      size_t max_parallelism) const;
+
   absl::StatusOr<kms_v1::CryptoKeyVersion> CreateCryptoKeyVersionAndWait(
       const kms_v1::CreateCryptoKeyVersionRequest& request) const;
 
@@ -117,9 +161,30 @@ class KmsClient {
       const kms_v1::GenerateRandomBytesRequest& request) const;
 
  private:
+  // Creates a CryptoKey and retrieves its first version, which may still be
+  // pending generation.
+  absl::StatusOr<CryptoKeyAndVersion> CreateCryptoKeyAndGetFirstVersion(
+      const kms_v1::CreateCryptoKeyRequest& request,
+      absl::Time deadline) const;
+
   absl::Status WaitForGeneration(kms_v1::CryptoKeyVersion& ckv,
                                  absl::Time deadline) const;
 
+  // Replaces `ckv` with its current state in Cloud KMS.
+  absl::Status RefreshCryptoKeyVersion(kms_v1::CryptoKeyVersion& ckv,
+                                       absl::Time deadline) const;
+
+  // Returns the delay before polling a version that is pending generation
+  // for the `previous_polls + 1`th time. The first poll is timed by the
+  // generation latencies that this client has observed.
+  absl::Duration GenerationPollDelay(int previous_polls) const;
+
+  // Records the generation latency of a version that was created at
+  // `created`, was last seen pending at `last_pending`, and was first seen
+  // generated at `generated`.
+  void RecordGenerationLatency(absl::Time created, absl::Time last_pending,
+                               absl::Time generated) const;
+
   absl::Status DecorateStatus(absl::Status& status) const;
 
   void AddContextSettings(grpc::ClientContext* ctx,
@@ -131,16 +196,53 @@ class KmsClient {
                                  std::string_view relative_resource,
                                  std::string_view resource_name) const {
     return AddContextSettings(ctx, relative_resource, resource_name,
-                              absl::Now() + rpc_timeout_);
+                              RpcDeadline());
   }
 
+  // Waits until the scheduler admits an RPC with the provided context and
+  // resource name, or until the context's deadline passes.
+  absl::StatusOr<FairShareScheduler::Admission> Admit(
+      const grpc::ClientContext& ctx, std::string_view resource_name) const;
+
+  // Returns the deadline for an operation that starts now.
+  inline absl::Time RpcDeadline() const {
+    return std::min(absl::Now() + rpc_timeout_, ScopedRpcDeadline::Current());
+  }
+
+  // Unset if a transport was provided in Options.
   std::unique_ptr<kms_v1::KeyManagementService::Stub> kms_stub_;
   const absl::Duration rpc_timeout_;
   const std::string rpc_feature_flags_;
   const std::string user_project_override_;
   const std::optional<ErrorDecorator> error_decorator_;
+  const std::shared_ptr<FairShareScheduler> scheduler_;
+  std::shared_ptr<KmsTransport> transport_;
+  mutable LatencyEstimator generation_latency_;
 };
 
+// Returns the scheduler flow for an RPC on the provided resource: the name of
+// the key ring that contains it, or the empty string if it is not contained in
+// a key ring.
+std::string_view SchedulerFlowName(std::string_view resource_name);
+
+// Returns the prefix of the user agent that identifies this library, such as
+// `cloud-kms-pkcs11/1.2 (amd64; BoringSSL; Linux/5.10; glibc/2.31)`.
+std::string UserAgentPrefix(UserAgent user_agent, int version_major,
+                            int version_minor);
+
+// Copies `data` into the request field `field`, and returns the CRC32C of
+// `data`, reading `data` only once. KmsClient sends a request checksum that is
+// already set as is, so callers that marshal payloads with this function
+// should set the corresponding checksum field to the result.
+uint32_t CopyWithCRC32C(std::string_view data, std::string* field);
+
+inline uint32_t CopyWithCRC32C(absl::Span<const uint8_t> data,
+                               std::string* field) {
+  return CopyWithCRC32C(
+      std::string_view(reinterpret_cast<const char*>(data.data()), data.size()),
+      field);
+}
+
 }  // namespace cloud_kms
 
 #endif  // COMMON_KMS_CLIENT_H_
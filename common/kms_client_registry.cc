@@ -0,0 +1,92 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/kms_client_registry.h"
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+
+namespace cloud_kms {
+namespace {
+
+// Appends `field` to `key` with a length prefix, so that no two sequences of
+// fields produce the same key.
+void AppendField(std::string* key, std::string_view field) {
+  absl::StrAppend(key, field.size(), ":", field, ";");
+}
+
+}  // namespace
+
+KmsClientRegistry& KmsClientRegistry::Global() {
+  static KmsClientRegistry* const kRegistry = new KmsClientRegistry();
+  return *kRegistry;
+}
+
+std::string KmsClientRegistry::KeyFor(const KmsClient::Options& options,
+                                      std::string_view creds_type) {
+  std::string key;
+  AppendField(&key, options.endpoint_address);
+  AppendField(&key, creds_type);
+  AppendField(&key, absl::FormatDuration(options.rpc_timeout));
+  AppendField(&key, absl::StrCat(options.version_major, ".",
+                                 options.version_minor));
+  AppendField(&key, absl::StrCat(static_cast<int>(options.user_agent)));
+  AppendField(&key, options.rpc_feature_flags);
+  AppendField(&key, options.user_project_override);
+  return key;
+}
+
+absl::StatusOr<std::shared_ptr<KmsClient>> KmsClientRegistry::GetOrCreate(
+    std::string_view key, Factory factory) {
+  absl::MutexLock lock(&mutex_);
+  if (auto it = clients_.find(key); it != clients_.end()) {
+    if (std::shared_ptr<KmsClient> client = it->second.lock()) {
+      return client;
+    }
+  }
+
+  // The factory is called with the lock held, so that concurrent callers with
+  // the same key never create two clients.
+  absl::StatusOr<std::unique_ptr<KmsClient>> created = factory();
+  if (!created.ok()) {
+    return created.status();
+  }
+  std::shared_ptr<KmsClient> client = *std::move(created);
+
+  // Drop the entries of clients that have since been destroyed, so that the
+  // map does not grow with every distinct configuration ever used.
+  absl::erase_if(clients_, [](const auto& entry) {
+    return entry.second.expired();
+  });
+  clients_.insert_or_assign(std::string(key), client);
+  return client;
+}
+
+size_t KmsClientRegistry::size() const {
+  absl::MutexLock lock(&mutex_);
+  size_t live = 0;
+  for (const auto& [key, client] : clients_) {
+    if (!client.expired()) {
+      live++;
+    }
+  }
+  return live;
+}
+
+void KmsClientRegistry::Clear() {
+  absl::MutexLock lock(&mutex_);
+  clients_.clear();
+}
+
+}  // namespace cloud_kms
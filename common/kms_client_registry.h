@@ -0,0 +1,76 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMMON_KMS_CLIENT_REGISTRY_H_
+#define COMMON_KMS_CLIENT_REGISTRY_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "common/kms_client.h"
+
+namespace cloud_kms {
+
+// KmsClientRegistry hands out shared KmsClients, so that callers with the same
+// client configuration share one channel and its connections instead of
+// opening their own. A client lives for as long as a caller holds it; the
+// registry itself does not keep clients alive.
+//
+// KmsClientRegistry is safe for concurrent use.
+class KmsClientRegistry {
+ public:
+  using Factory =
+      absl::FunctionRef<absl::StatusOr<std::unique_ptr<KmsClient>>()>;
+
+  // Returns the registry shared by everything in this process.
+  static KmsClientRegistry& Global();
+
+  // Returns a registry key for clients created with `options`, whose channel
+  // credentials are identified by `creds_type` (e.g. "default" or
+  // "insecure"). The error decorator, scheduler and transport are not part of
+  // the key; callers that set them must keep their keys apart themselves.
+  static std::string KeyFor(const KmsClient::Options& options,
+                            std::string_view creds_type);
+
+  // Returns the live client registered under `key`, or creates one with
+  // `factory` and registers it if there is none. Errors from `factory` are
+  // returned as is, and nothing is registered.
+  absl::StatusOr<std::shared_ptr<KmsClient>> GetOrCreate(std::string_view key,
+                                                         Factory factory);
+
+  // Returns the number of live clients.
+  size_t size() const;
+
+  // Forgets every client. Clients already handed out are unaffected, but are
+  // no longer shared with later callers. This is safe to call in a child
+  // process after fork.
+  void Clear();
+
+ private:
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, std::weak_ptr<KmsClient>> clients_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace cloud_kms
+
+#endif  // COMMON_KMS_CLIENT_REGISTRY_H_
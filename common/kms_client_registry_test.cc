@@ -0,0 +1,161 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/kms_client_registry.h"
+
+#include <thread>
+#include <vector>
+
+#include "common/test/matchers.h"
+#include "common/test/test_status_macros.h"
+#include "gmock/gmock.h"
+
+namespace cloud_kms {
+namespace {
+
+using ::testing::Ne;
+
+KmsClient::Options TestOptions() {
+  return KmsClient::Options{.endpoint_address = "localhost:1",
+                            .rpc_timeout = absl::Seconds(1)};
+}
+
+absl::StatusOr<std::unique_ptr<KmsClient>> NewTestClient() {
+  return std::make_unique<KmsClient>(TestOptions());
+}
+
+TEST(KmsClientRegistryTest, SameKeyReturnsSameClient) {
+  KmsClientRegistry registry;
+
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<KmsClient> client1,
+                       registry.GetOrCreate("key", NewTestClient));
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<KmsClient> client2,
+                       registry.GetOrCreate("key", NewTestClient));
+
+  EXPECT_EQ(client1, client2);
+  EXPECT_EQ(registry.size(), 1);
+}
+
+TEST(KmsClientRegistryTest, DifferentKeysReturnDifferentClients) {
+  KmsClientRegistry registry;
+
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<KmsClient> client1,
+                       registry.GetOrCreate("key1", NewTestClient));
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<KmsClient> client2,
+                       registry.GetOrCreate("key2", NewTestClient));
+
+  EXPECT_NE(client1, client2);
+  EXPECT_EQ(registry.size(), 2);
+}
+
+TEST(KmsClientRegistryTest, ClientIsDestroyedWithItsLastHolder) {
+  KmsClientRegistry registry;
+
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<KmsClient> client,
+                       registry.GetOrCreate("key", NewTestClient));
+  std::weak_ptr<KmsClient> weak = client;
+  client.reset();
+
+  EXPECT_TRUE(weak.expired());
+  EXPECT_EQ(registry.size(), 0);
+}
+
+TEST(KmsClientRegistryTest, DestroyedClientIsRecreated) {
+  KmsClientRegistry registry;
+  int created = 0;
+  auto factory = [&]() -> absl::StatusOr<std::unique_ptr<KmsClient>> {
+    created++;
+    return NewTestClient();
+  };
+
+  ASSERT_OK(registry.GetOrCreate("key", factory));
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<KmsClient> client,
+                       registry.GetOrCreate("key", factory));
+
+  EXPECT_EQ(created, 2);
+  EXPECT_THAT(client, Ne(nullptr));
+}
+
+TEST(KmsClientRegistryTest, FactoryErrorIsReturnedAndNotRegistered) {
+  KmsClientRegistry registry;
+
+  EXPECT_THAT(registry.GetOrCreate(
+                  "key",
+                  []() -> absl::StatusOr<std::unique_ptr<KmsClient>> {
+                    return absl::UnavailableError("boom");
+                  }),
+              StatusIs(absl::StatusCode::kUnavailable));
+  EXPECT_EQ(registry.size(), 0);
+
+  EXPECT_OK(registry.GetOrCreate("key", NewTestClient));
+}
+
+TEST(KmsClientRegistryTest, ConcurrentCallersShareOneClient) {
+  KmsClientRegistry registry;
+  int created = 0;
+  auto factory = [&]() -> absl::StatusOr<std::unique_ptr<KmsClient>> {
+    created++;
+    return NewTestClient();
+  };
+
+  std::vector<std::shared_ptr<KmsClient>> clients(8);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < clients.size(); i++) {
+    threads.emplace_back([&, i] {
+      clients[i] = registry.GetOrCreate("key", factory).value();
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(created, 1);
+  for (const std::shared_ptr<KmsClient>& client : clients) {
+    EXPECT_EQ(client, clients[0]);
+  }
+}
+
+TEST(KmsClientRegistryTest, ClearStopsSharingClients) {
+  KmsClientRegistry registry;
+
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<KmsClient> client1,
+                       registry.GetOrCreate("key", NewTestClient));
+  registry.Clear();
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<KmsClient> client2,
+                       registry.GetOrCreate("key", NewTestClient));
+
+  EXPECT_NE(client1, client2);
+}
+
+TEST(KmsClientRegistryTest, KeyForDistinguishesOptions) {
+  KmsClient::Options options = TestOptions();
+  std::string key = KmsClientRegistry::KeyFor(options, "default");
+
+  EXPECT_EQ(KmsClientRegistry::KeyFor(TestOptions(), "default"), key);
+  EXPECT_NE(KmsClientRegistry::KeyFor(options, "insecure"), key);
+
+  options.user_project_override = "other-project";
+  EXPECT_NE(KmsClientRegistry::KeyFor(options, "default"), key);
+
+  options = TestOptions();
+  options.rpc_feature_flags = "flag";
+  EXPECT_NE(KmsClientRegistry::KeyFor(options, "default"), key);
+
+  options = TestOptions();
+  options.endpoint_address = "localhost:2";
+  EXPECT_NE(KmsClientRegistry::KeyFor(options, "default"), key);
+}
+
+}  // namespace
+}  // namespace cloud_kms
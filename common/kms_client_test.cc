@@ -14,6 +14,7 @@
 
 #include "common/kms_client.h"
 
+#include "absl/crc/crc32c.h"
 #include "absl/time/time.h"
 #include "common/openssl.h"
 #include "common/test/matchers.h"
@@ -389,6 +390,51 @@ TEST(KmsClientTest, RawEncryptDecryptSuccess) {
   EXPECT_EQ(decrypt_resp.plaintext(), data);
 }
 
+TEST(KmsClientTest, RawEncryptSendsChecksumFromCopyWithCRC32C) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake,
+                       fakekms::Server::New());
+  std::unique_ptr<KmsClient> client = NewClient(fake->listen_addr());
+
+  kms_v1::KeyRing kr;
+  kr = CreateKeyRingOrDie(client->kms_stub(), kTestLocation, RandomId(), kr);
+
+  kms_v1::CryptoKey ck;
+  ck.set_purpose(kms_v1::CryptoKey::RAW_ENCRYPT_DECRYPT);
+  ck.mutable_version_template()->set_algorithm(
+      kms_v1::CryptoKeyVersion::AES_256_GCM);
+  ck = CreateCryptoKeyOrDie(client->kms_stub(), kr.name(), "ck", ck, true);
+
+  kms_v1::CryptoKeyVersion ckv;
+  ckv = CreateCryptoKeyVersionOrDie(client->kms_stub(), ck.name(), ckv);
+  ckv = WaitForEnablement(client->kms_stub(), ckv);
+
+  kms_v1::RawEncryptRequest encrypt_req;
+  encrypt_req.set_name(ckv.name());
+  encrypt_req.mutable_plaintext_crc32c()->set_value(CopyWithCRC32C(
+      "Here is some data to encrypt", encrypt_req.mutable_plaintext()));
+
+  ASSERT_OK_AND_ASSIGN(kms_v1::RawEncryptResponse encrypt_resp,
+                       client->RawEncrypt(encrypt_req));
+  EXPECT_TRUE(encrypt_resp.verified_plaintext_crc32c());
+
+  // A preset checksum is not recomputed, so a wrong one reaches the server.
+  encrypt_req.mutable_plaintext_crc32c()->set_value(
+      encrypt_req.plaintext_crc32c().value() ^ 1);
+  EXPECT_THAT(client->RawEncrypt(encrypt_req),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(KmsClientTest, CopyWithCRC32CCopiesAndChecksums) {
+  std::string data(65536, 'x');
+  data[1234] = 'y';
+
+  std::string field = "previous contents";
+  uint32_t crc32c = CopyWithCRC32C(data, &field);
+
+  EXPECT_EQ(field, data);
+  EXPECT_EQ(crc32c, static_cast<uint32_t>(absl::ComputeCrc32c(data)));
+}
+
 TEST(KmsClientTest, RawEncryptFailureInvalidName) {
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake,
                        fakekms::Server::New());
@@ -593,6 +639,202 @@ TEST(KmsClientTest, CreateCryptoKeyAndFirstVersionTimesOutAtDeadline) {
               StatusIs(absl::StatusCode::kDeadlineExceeded));
 }
 
+kms_v1::CreateCryptoKeyRequest NewSigningKeyRequest(std::string_view parent,
+                                                    std::string_view id) {
+  kms_v1::CreateCryptoKeyRequest req;
+  req.set_parent(std::string(parent));
+  req.set_crypto_key_id(std::string(id));
+  req.mutable_crypto_key()->set_purpose(kms_v1::CryptoKey::ASYMMETRIC_SIGN);
+  req.mutable_crypto_key()->mutable_version_template()->set_algorithm(
+      kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+  return req;
+}
+
+TEST(KmsClientTest, CreateCryptoKeysAndFirstVersionsCreatesAllKeys) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake,
+                       fakekms::Server::New());
+  std::unique_ptr<KmsClient> client = NewClient(fake->listen_addr());
+
+  kms_v1::KeyRing kr;
+  kr = CreateKeyRingOrDie(client->kms_stub(), kTestLocation, RandomId(), kr);
+
+  std::vector<kms_v1::CreateCryptoKeyRequest> reqs;
+  for (int i = 0; i < 5; i++) {
+    reqs.push_back(NewSigningKeyRequest(kr.name(), absl::StrCat("ck", i)));
+  }
+
+  std::vector<absl::StatusOr<CryptoKeyAndVersion>> created =
+      client->CreateCryptoKeysAndWaitForFirstVersions(reqs, 2);
+
+  ASSERT_THAT(created, SizeIs(reqs.size()));
+  for (size_t i = 0; i < reqs.size(); i++) {
+    ASSERT_OK(created[i]);
+    std::string ck_name = absl::StrCat(kr.name(), "/cryptoKeys/ck", i);
+    EXPECT_EQ(created[i]->crypto_key.name(), ck_name);
+    EXPECT_THAT(GetCryptoKeyVersionOrDie(client->kms_stub(),
+                                         ck_name + "/cryptoKeyVersions/1"),
+                EqualsProto(created[i]->crypto_key_version));
+    EXPECT_EQ(created[i]->crypto_key_version.state(),
+              kms_v1::CryptoKeyVersion::ENABLED);
+  }
+}
+
+TEST(KmsClientTest, CreateCryptoKeysAndFirstVersionsReportsErrorsPerKey) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake,
+                       fakekms::Server::New());
+  std::unique_ptr<KmsClient> client = NewClient(fake->listen_addr());
+
+  kms_v1::KeyRing kr;
+  kr = CreateKeyRingOrDie(client->kms_stub(), kTestLocation, RandomId(), kr);
+
+  std::vector<kms_v1::CreateCryptoKeyRequest> reqs = {
+      NewSigningKeyRequest(kr.name(), "ck1"),
+      NewSigningKeyRequest(kr.name(), "@123!"),
+      NewSigningKeyRequest(kr.name(), "ck2"),
+  };
+
+  std::vector<absl::StatusOr<CryptoKeyAndVersion>> created =
+      client->CreateCryptoKeysAndWaitForFirstVersions(reqs, 3);
+
+  ASSERT_THAT(created, SizeIs(3));
+  EXPECT_OK(created[0]);
+  EXPECT_THAT(created[1], StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_OK(created[2]);
+}
+
+TEST(KmsClientTest, CreateCryptoKeysAndFirstVersionsHonorsScopedRpcDeadline) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake,
+                       fakekms::Server::New());
+  std::unique_ptr<KmsClient> client = NewClient(fake->listen_addr());
+
+  kms_v1::KeyRing kr;
+  kr = CreateKeyRingOrDie(client->kms_stub(), kTestLocation, RandomId(), kr);
+
+  std::vector<kms_v1::CreateCryptoKeyRequest> reqs = {
+      NewSigningKeyRequest(kr.name(), "ck1"),
+      NewSigningKeyRequest(kr.name(), "ck2"),
+  };
+
+  AddDelayOrDie(*fake, absl::Milliseconds(200), "CreateCryptoKey");
+
+  // The keys are created on worker threads, which must inherit the calling
+  // thread's deadline scope.
+  ScopedRpcDeadline deadline(absl::Now() + absl::Milliseconds(100));
+  std::vector<absl::StatusOr<CryptoKeyAndVersion>> created =
+      client->CreateCryptoKeysAndWaitForFirstVersions(reqs, 2);
+
+  ASSERT_THAT(created, SizeIs(2));
+  EXPECT_THAT(created[0], StatusIs(absl::StatusCode::kDeadlineExceeded));
+  EXPECT_THAT(created[1], StatusIs(absl::StatusCode::kDeadlineExceeded));
+}
+
+TEST(KmsClientTest, ScopedRpcDeadlineShortensRpcDeadline) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake,
+                       fakekms::Server::New());
+  std::unique_ptr<KmsClient> client = NewClient(fake->listen_addr());
+
+  kms_v1::KeyRing kr;
+  kr = CreateKeyRingOrDie(client->kms_stub(), kTestLocation, RandomId(), kr);
+
+  kms_v1::CreateCryptoKeyRequest req;
+  req.set_parent(kr.name());
+  req.set_crypto_key_id("ck");
+  req.mutable_crypto_key()->set_purpose(kms_v1::CryptoKey::ENCRYPT_DECRYPT);
+
+  AddDelayOrDie(*fake, absl::Milliseconds(200), "CreateCryptoKey");
+
+  // The client's 500ms timeout would be long enough, but the scope's 100ms
+  // deadline is not.
+  ScopedRpcDeadline deadline(absl::Now() + absl::Milliseconds(100));
+  EXPECT_THAT(client->CreateCryptoKey(req),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+}
+
+TEST(KmsClientTest, NestedScopedRpcDeadlineCannotExtendDeadline) {
+  EXPECT_EQ(ScopedRpcDeadline::Current(), absl::InfiniteFuture());
+
+  absl::Time outer_deadline = absl::Now() + absl::Seconds(1);
+  {
+    ScopedRpcDeadline outer(outer_deadline);
+    {
+      ScopedRpcDeadline inner(outer_deadline + absl::Seconds(1));
+      EXPECT_EQ(ScopedRpcDeadline::Current(), outer_deadline);
+    }
+    {
+      ScopedRpcDeadline inner(outer_deadline - absl::Milliseconds(500));
+      EXPECT_EQ(ScopedRpcDeadline::Current(),
+                outer_deadline - absl::Milliseconds(500));
+    }
+    EXPECT_EQ(ScopedRpcDeadline::Current(), outer_deadline);
+  }
+
+  EXPECT_EQ(ScopedRpcDeadline::Current(), absl::InfiniteFuture());
+}
+
+TEST(KmsClientTest, RpcWaitsForSchedulerAdmission) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake,
+                       fakekms::Server::New());
+  auto scheduler = std::make_shared<FairShareScheduler>(1);
+  KmsClient client(KmsClient::Options{
+      .endpoint_address = std::string(fake->listen_addr()),
+      .rpc_timeout = absl::Milliseconds(100),
+      .scheduler = scheduler,
+  });
+
+  kms_v1::KeyRing kr;
+  kr = CreateKeyRingOrDie(client.kms_stub(), kTestLocation, RandomId(), kr);
+  kms_v1::CryptoKey ck;
+  ck.set_purpose(kms_v1::CryptoKey::ENCRYPT_DECRYPT);
+  ck = CreateCryptoKeyOrDie(client.kms_stub(), kr.name(), "ck", ck, true);
+
+  kms_v1::GetCryptoKeyRequest req;
+  req.set_name(ck.name());
+  {
+    // While another call holds the only slot, the RPC times out in the queue.
+    ASSERT_OK_AND_ASSIGN(
+        FairShareScheduler::Admission admission,
+        scheduler->Admit("other", absl::Now() + absl::Seconds(1)));
+    EXPECT_THAT(client.GetCryptoKey(req),
+                StatusIs(absl::StatusCode::kDeadlineExceeded));
+  }
+  EXPECT_OK(client.GetCryptoKey(req));
+}
+
+TEST(KmsClientTest, CreateCryptoKeyVersionAndWaitPollsWithinSchedulerCap) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake,
+                       fakekms::Server::New());
+  KmsClient client(KmsClient::Options{
+      .endpoint_address = std::string(fake->listen_addr()),
+      .rpc_timeout = absl::Seconds(2),
+      .scheduler = std::make_shared<FairShareScheduler>(1),
+  });
+
+  kms_v1::KeyRing kr;
+  kr = CreateKeyRingOrDie(client.kms_stub(), kTestLocation, RandomId(), kr);
+  kms_v1::CryptoKey ck;
+  ck.set_purpose(kms_v1::CryptoKey::ASYMMETRIC_SIGN);
+  ck.mutable_version_template()->set_algorithm(
+      kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+  ck = CreateCryptoKeyOrDie(client.kms_stub(), kr.name(), RandomId(), ck,
+                            false);
+
+  // Polling for generation must not wait on the slot held for the create.
+  kms_v1::CreateCryptoKeyVersionRequest req;
+  req.set_parent(ck.name());
+  ASSERT_OK_AND_ASSIGN(kms_v1::CryptoKeyVersion ckv,
+                       client.CreateCryptoKeyVersionAndWait(req));
+  EXPECT_EQ(ckv.state(), kms_v1::CryptoKeyVersion::ENABLED);
+}
+
+TEST(KmsClientTest, SchedulerFlowNameIsKeyRing) {
+  EXPECT_EQ(SchedulerFlowName("projects/p/locations/l/keyRings/kr/cryptoKeys/"
+                              "ck/cryptoKeyVersions/1"),
+            "projects/p/locations/l/keyRings/kr");
+  EXPECT_EQ(SchedulerFlowName("projects/p/locations/l/keyRings/kr"),
+            "projects/p/locations/l/keyRings/kr");
+  EXPECT_EQ(SchedulerFlowName("projects/p/locations/l"), "");
+}
+
 TEST(KmsClientTest, DestroyCryptoKeyVersionSuccess) {
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake,
                        fakekms::Server::New());
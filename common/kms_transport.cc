@@ -0,0 +1,131 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/kms_transport.h"
+
+namespace cloud_kms {
+namespace {
+
+class GrpcTransport : public KmsTransport {
+ public:
+  explicit GrpcTransport(kms_v1::KeyManagementService::StubInterface* stub)
+      : stub_(stub) {}
+
+  grpc::Status AsymmetricDecrypt(
+      grpc::ClientContext* ctx, const kms_v1::AsymmetricDecryptRequest& request,
+      kms_v1::AsymmetricDecryptResponse* response) override {
+    return stub_->AsymmetricDecrypt(ctx, request, response);
+  }
+
+  grpc::Status AsymmetricSign(
+      grpc::ClientContext* ctx, const kms_v1::AsymmetricSignRequest& request,
+      kms_v1::AsymmetricSignResponse* response) override {
+    return stub_->AsymmetricSign(ctx, request, response);
+  }
+
+  grpc::Status MacSign(grpc::ClientContext* ctx,
+                       const kms_v1::MacSignRequest& request,
+                       kms_v1::MacSignResponse* response) override {
+    return stub_->MacSign(ctx, request, response);
+  }
+
+  grpc::Status MacVerify(grpc::ClientContext* ctx,
+                         const kms_v1::MacVerifyRequest& request,
+                         kms_v1::MacVerifyResponse* response) override {
+    return stub_->MacVerify(ctx, request, response);
+  }
+
+  grpc::Status RawDecrypt(grpc::ClientContext* ctx,
+                          const kms_v1::RawDecryptRequest& request,
+                          kms_v1::RawDecryptResponse* response) override {
+    return stub_->RawDecrypt(ctx, request, response);
+  }
+
+  grpc::Status RawEncrypt(grpc::ClientContext* ctx,
+                          const kms_v1::RawEncryptRequest& request,
+                          kms_v1::RawEncryptResponse* response) override {
+    return stub_->RawEncrypt(ctx, request, response);
+  }
+
+  grpc::Status CreateCryptoKey(grpc::ClientContext* ctx,
+                               const kms_v1::CreateCryptoKeyRequest& request,
+                               kms_v1::CryptoKey* response) override {
+    return stub_->CreateCryptoKey(ctx, request, response);
+  }
+
+  grpc::Status CreateCryptoKeyVersion(
+      grpc::ClientContext* ctx,
+      const kms_v1::CreateCryptoKeyVersionRequest& request,
+      kms_v1::CryptoKeyVersion* response) override {
+    return stub_->CreateCryptoKeyVersion(ctx, request, response);
+  }
+
+  grpc::Status DestroyCryptoKeyVersion(
+      grpc::ClientContext* ctx,
+      const kms_v1::DestroyCryptoKeyVersionRequest& request,
+      kms_v1::CryptoKeyVersion* response) override {
+    return stub_->DestroyCryptoKeyVersion(ctx, request, response);
+  }
+
+  grpc::Status GetCryptoKey(grpc::ClientContext* ctx,
+                            const kms_v1::GetCryptoKeyRequest& request,
+                            kms_v1::CryptoKey* response) override {
+    return stub_->GetCryptoKey(ctx, request, response);
+  }
+
+  grpc::Status GetCryptoKeyVersion(
+      grpc::ClientContext* ctx,
+      const kms_v1::GetCryptoKeyVersionRequest& request,
+      kms_v1::CryptoKeyVersion* response) override {
+    return stub_->GetCryptoKeyVersion(ctx, request, response);
+  }
+
+  grpc::Status GetPublicKey(grpc::ClientContext* ctx,
+                            const kms_v1::GetPublicKeyRequest& request,
+                            kms_v1::PublicKey* response) override {
+    return stub_->GetPublicKey(ctx, request, response);
+  }
+
+  grpc::Status ListCryptoKeys(
+      grpc::ClientContext* ctx, const kms_v1::ListCryptoKeysRequest& request,
+      kms_v1::ListCryptoKeysResponse* response) override {
+    return stub_->ListCryptoKeys(ctx, request, response);
+  }
+
+  grpc::Status ListCryptoKeyVersions(
+      grpc::ClientContext* ctx,
+      const kms_v1::ListCryptoKeyVersionsRequest& request,
+      kms_v1::ListCryptoKeyVersionsResponse* response) override {
+    return stub_->ListCryptoKeyVersions(ctx, request, response);
+  }
+
+  grpc::Status GenerateRandomBytes(
+      grpc::ClientContext* ctx,
+      const kms_v1::GenerateRandomBytesRequest& request,
+      kms_v1::GenerateRandomBytesResponse* response) override {
+    return stub_->GenerateRandomBytes(ctx, request, response);
+  }
+
+ private:
+  kms_v1::KeyManagementService::StubInterface* stub_;
+};
+
+}  // namespace
+
+std::unique_ptr<KmsTransport> NewGrpcTransport(
+    kms_v1::KeyManagementService::StubInterface* stub) {
+  return std::make_unique<GrpcTransport>(stub);
+}
+
+}  // namespace cloud_kms
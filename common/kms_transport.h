@@ -0,0 +1,95 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMMON_KMS_TRANSPORT_H_
+#define COMMON_KMS_TRANSPORT_H_
+
+#include <memory>
+
+#include "common/kms_v1.h"
+#include "grpcpp/client_context.h"
+#include "grpcpp/support/status.h"
+
+namespace cloud_kms {
+
+// KmsTransport carries the calls that KmsClient makes to Cloud KMS. Its
+// methods mirror the synchronous methods of the generated gRPC stub, so that
+// the gRPC transport is a thin wrapper. Other transports honor the deadline
+// set on the provided context.
+class KmsTransport {
+ public:
+  virtual ~KmsTransport() = default;
+
+  virtual grpc::Status AsymmetricDecrypt(
+      grpc::ClientContext* ctx, const kms_v1::AsymmetricDecryptRequest& request,
+      kms_v1::AsymmetricDecryptResponse* response) = 0;
+  virtual grpc::Status AsymmetricSign(
+      grpc::ClientContext* ctx, const kms_v1::AsymmetricSignRequest& request,
+      kms_v1::AsymmetricSignResponse* response) = 0;
+  virtual grpc::Status MacSign(grpc::ClientContext* ctx,
+                               const kms_v1::MacSignRequest& request,
+                               kms_v1::MacSignResponse* response) = 0;
+  virtual grpc::Status MacVerify(grpc::ClientContext* ctx,
+                                 const kms_v1::MacVerifyRequest& request,
+                                 kms_v1::MacVerifyResponse* response) = 0;
+  virtual grpc::Status RawDecrypt(grpc::ClientContext* ctx,
+                                  const kms_v1::RawDecryptRequest& request,
+                                  kms_v1::RawDecryptResponse* response) = 0;
+  virtual grpc::Status RawEncrypt(grpc::ClientContext* ctx,
+                                  const kms_v1::RawEncryptRequest& request,
+                                  kms_v1::RawEncryptResponse* response) = 0;
+  virtual grpc::Status CreateCryptoKey(
+      grpc::ClientContext* ctx, const kms_v1::CreateCryptoKeyRequest& request,
+      kms_v1::CryptoKey* response) = 0;
+  virtual grpc::Status CreateCryptoKeyVersion(
+      grpc::ClientContext* ctx,
+      const kms_v1::CreateCryptoKeyVersionRequest& request,
+      kms_v1::CryptoKeyVersion* response) = 0;
+  virtual grpc::Status DestroyCryptoKeyVersion(
+      grpc::ClientContext* ctx,
+      const kms_v1::DestroyCryptoKeyVersionRequest& request,
+      kms_v1::CryptoKeyVersion* response) = 0;
+  virtual grpc::Status GetCryptoKey(grpc::ClientContext* ctx,
+                                    const kms_v1::GetCryptoKeyRequest& request,
+                                    kms_v1::CryptoKey* response) = 0;
+  virtual grpc::Status GetCryptoKeyVersion(
+      grpc::ClientContext* ctx,
+      const kms_v1::GetCryptoKeyVersionRequest& request,
+      kms_v1::CryptoKeyVersion* response) = 0;
+  virtual grpc::Status GetPublicKey(grpc::ClientContext* ctx,
+                                    const kms_v1::GetPublicKeyRequest& request,
+                                    kms_v1::PublicKey* response) = 0;
+  virtual grpc::Status ListCryptoKeys(
+      grpc::ClientContext* ctx, const kms_v1::ListCryptoKeysRequest& request,
+      kms_v1::ListCryptoKeysResponse* response) = 0;
+  virtual grpc::Status ListCryptoKeyVersions(
+      grpc::ClientContext* ctx,
+      const kms_v1::ListCryptoKeyVersionsRequest& request,
+      kms_v1::ListCryptoKeyVersionsResponse* response) = 0;
+  virtual grpc::Status GenerateRandomBytes(
+      grpc::ClientContext* ctx,
+      const kms_v1::GenerateRandomBytesRequest& request,
+      kms_v1::GenerateRandomBytesResponse* response) = 0;
+};
+
+// Returns a transport that makes its calls with the provided gRPC stub, which
+// must outlive the transport.
+std::unique_ptr<KmsTransport> NewGrpcTransport(
+    kms_v1::KeyManagementService::StubInterface* stub);
+
+}  // namespace cloud_kms
+
+#endif  // COMMON_KMS_TRANSPORT_H_
@@ -21,6 +21,8 @@
 #include <string>
 
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
 
 namespace cloud_kms {
 
@@ -46,6 +48,21 @@ std::string GetHostPlatformInfo();
 // Writes the provided message to the system log. This is a no-op on Windows.
 void WriteToSystemLog(const char* message);
 
+// Returns the directory in which gcloud keeps the user's configuration, such as
+// "/home/user/.config/gcloud", or an empty string if it cannot be determined.
+std::string GetGcloudConfigDirectory();
+
+// Returns the operating system's trusted TLS root certificates as a PEM
+// bundle. On Windows they are read from the system's ROOT certificate store;
+// elsewhere, from the first CA bundle that exists in the locations that gRPC
+// also searches. Returns NotFound if there is no such bundle.
+absl::StatusOr<std::string> ReadSystemRootCertificates();
+
+// Waits until the provided socket is ready for reading, or for writing if
+// `for_write` is true. Returns DeadlineExceeded if it is not ready by
+// `deadline`.
+absl::Status WaitForSocket(int socket, bool for_write, absl::Time deadline);
+
 }  // namespace cloud_kms
 
 #endif  // COMMON_PLATFORM_H_
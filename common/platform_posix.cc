@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <errno.h>
+#include <poll.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
@@ -23,7 +24,14 @@
 #include <gnu/libc-version.h>
 #endif
 
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
 #include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/time/clock.h"
 #include "common/platform.h"
 #include "common/source_location.h"
 
@@ -83,4 +91,65 @@ void WriteToSystemLog(const char* message) {
   closelog();
 }
 
+std::string GetGcloudConfigDirectory() {
+  const char* home = std::getenv("HOME");
+  if (!home || !*home) {
+    return "";
+  }
+  return absl::StrFormat("%s/.config/gcloud", home);
+}
+
+absl::StatusOr<std::string> ReadSystemRootCertificates() {
+  // The CA bundles of common distributions, in the order that gRPC searches
+  // them.
+  static constexpr const char* kBundlePaths[] = {
+      "/etc/ssl/certs/ca-certificates.crt",  // Debian, Ubuntu, Alpine
+      "/etc/pki/tls/certs/ca-bundle.crt",    // Fedora, RHEL 6
+      "/etc/ssl/ca-bundle.pem",              // OpenSUSE
+      "/etc/pki/tls/cacert.pem",             // OpenELEC
+      "/etc/pki/ca-trust/extracted/pem/tls-ca-bundle.pem",  // CentOS, RHEL 7
+      "/etc/ssl/cert.pem",                                  // macOS, FreeBSD
+  };
+  for (const char* path : kBundlePaths) {
+    std::ifstream bundle(path, std::ifstream::in | std::ifstream::binary);
+    if (bundle) {
+      std::stringstream contents;
+      contents << bundle.rdbuf();
+      return contents.str();
+    }
+  }
+  return absl::NotFoundError(
+      absl::StrFormat("no trusted root certificates were found in %s",
+                      absl::StrJoin(kBundlePaths, ", ")));
+}
+
+absl::Status WaitForSocket(int socket, bool for_write, absl::Time deadline) {
+  struct pollfd fd = {socket, static_cast<short>(for_write ? POLLOUT : POLLIN),
+                      0};
+  while (true) {
+    absl::Duration remaining = deadline - absl::Now();
+    if (remaining <= absl::ZeroDuration()) {
+      return absl::DeadlineExceededError(
+          absl::StrFormat("at %s: deadline exceeded waiting for socket",
+                          SOURCE_LOCATION.ToString()));
+    }
+    // Round up, so that the deadline has passed when poll times out.
+    int timeout_ms = remaining == absl::InfiniteDuration()
+                         ? -1
+                         : static_cast<int>(std::min<int64_t>(
+                               absl::ToInt64Milliseconds(remaining) + 1,
+                               std::numeric_limits<int>::max()));
+    int ready = poll(&fd, 1, timeout_ms);
+    // Errors and hangups are reported by the next read or write.
+    if (ready > 0) {
+      return absl::OkStatus();
+    }
+    if (ready < 0 && errno != EINTR) {
+      return absl::InternalError(
+          absl::StrFormat("at %s: unable to poll socket: error %d",
+                          SOURCE_LOCATION.ToString(), errno));
+    }
+  }
+}
+
 }  // namespace cloud_kms
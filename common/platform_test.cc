@@ -14,6 +14,12 @@
 
 #include "common/platform.h"
 
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "absl/time/clock.h"
 #include "gmock/gmock.h"
 
 namespace cloud_kms {
@@ -26,5 +32,29 @@ TEST(PlatformTest, HostPlatformInfoIsKnown) {
   EXPECT_THAT(GetHostPlatformInfo(), Not(HasSubstr("unknown")));
 }
 
+#ifndef _WIN32
+TEST(PlatformTest, WaitForSocketWaitsForReadiness) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  // Nothing has been written, so the socket is writable but not readable.
+  EXPECT_EQ(WaitForSocket(fds[0], /*for_write=*/false,
+                          absl::Now() + absl::Milliseconds(20))
+                .code(),
+            absl::StatusCode::kDeadlineExceeded);
+  EXPECT_TRUE(WaitForSocket(fds[0], /*for_write=*/true,
+                            absl::Now() + absl::Seconds(10))
+                  .ok());
+
+  ASSERT_EQ(write(fds[1], "x", 1), 1);
+  EXPECT_TRUE(WaitForSocket(fds[0], /*for_write=*/false,
+                            absl::Now() + absl::Seconds(10))
+                  .ok());
+
+  close(fds[0]);
+  close(fds[1]);
+}
+#endif
+
 }  // namespace
 }  // namespace cloud_kms
@@ -14,11 +14,18 @@
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#include <wincrypt.h>
+#include <winsock2.h>
+
+#include <algorithm>
+#include <limits>
 
 #include "absl/cleanup/cleanup.h"
 #include "absl/log/absl_check.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/escaping.h"
 #include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
 #include "common/platform.h"
 #include "common/source_location.h"
 #include "common/status_macros.h"
@@ -157,4 +164,69 @@ void WriteToSystemLog(const char* message) {
   // https://learn.microsoft.com/en-us/windows/win32/eventlog/event-sources
 }
 
+std::string GetGcloudConfigDirectory() {
+  const char* app_data = std::getenv("APPDATA");
+  if (!app_data || !*app_data) {
+    return "";
+  }
+  return absl::StrFormat("%s\\gcloud", app_data);
+}
+
+absl::StatusOr<std::string> ReadSystemRootCertificates() {
+  HCERTSTORE store = CertOpenSystemStoreW(0, L"ROOT");
+  if (!store) {
+    return absl::NotFoundError(absl::StrFormat(
+        "at %s: unable to open the ROOT certificate store (error %d)",
+        SOURCE_LOCATION.ToString(), GetLastError()));
+  }
+  absl::Cleanup close_store = [store] { CertCloseStore(store, 0); };
+
+  std::string bundle;
+  PCCERT_CONTEXT cert = nullptr;
+  while ((cert = CertEnumCertificatesInStore(store, cert)) != nullptr) {
+    std::string base64 = absl::Base64Escape(
+        std::string_view(reinterpret_cast<const char*>(cert->pbCertEncoded),
+                         cert->cbCertEncoded));
+    bundle.append("-----BEGIN CERTIFICATE-----\n");
+    for (size_t i = 0; i < base64.size(); i += 64) {
+      bundle.append(base64, i, 64).push_back('\n');
+    }
+    bundle.append("-----END CERTIFICATE-----\n");
+  }
+  if (bundle.empty()) {
+    return absl::NotFoundError(
+        "the ROOT certificate store has no trusted root certificates");
+  }
+  return bundle;
+}
+
+absl::Status WaitForSocket(int socket, bool for_write, absl::Time deadline) {
+  WSAPOLLFD fd = {static_cast<SOCKET>(socket),
+                  static_cast<SHORT>(for_write ? POLLWRNORM : POLLRDNORM), 0};
+  while (true) {
+    absl::Duration remaining = deadline - absl::Now();
+    if (remaining <= absl::ZeroDuration()) {
+      return absl::DeadlineExceededError(
+          absl::StrFormat("at %s: deadline exceeded waiting for socket",
+                          SOURCE_LOCATION.ToString()));
+    }
+    // Round up, so that the deadline has passed when WSAPoll times out.
+    INT timeout_ms = remaining == absl::InfiniteDuration()
+                         ? -1
+                         : static_cast<INT>(std::min<int64_t>(
+                               absl::ToInt64Milliseconds(remaining) + 1,
+                               std::numeric_limits<INT>::max()));
+    int ready = WSAPoll(&fd, 1, timeout_ms);
+    // Errors and hangups are reported by the next read or write.
+    if (ready > 0) {
+      return absl::OkStatus();
+    }
+    if (ready == SOCKET_ERROR) {
+      return absl::InternalError(
+          absl::StrFormat("at %s: unable to poll socket: error %d",
+                          SOURCE_LOCATION.ToString(), WSAGetLastError()));
+    }
+  }
+}
+
 }  // namespace cloud_kms
@@ -0,0 +1,154 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/public_key_cache.h"
+
+#include <optional>
+
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "common/source_location.h"
+#include "common/status_macros.h"
+
+namespace cloud_kms {
+namespace {
+
+// The bounds of the process-wide cache. Public keys never change, so the TTL
+// only bounds how long a key that has since been destroyed remains usable
+// locally.
+constexpr size_t kGlobalCapacity = 4096;
+constexpr absl::Duration kGlobalTtl = absl::Hours(1);
+
+absl::Status ParseError(std::string_view what, std::string_view ckv_name,
+                        const SourceLocation& source_location) {
+  return absl::InternalError(absl::StrFormat(
+      "at %s: error %s public key for %s: %s", source_location.ToString(),
+      what, ckv_name, ERR_error_string(ERR_get_error(), nullptr)));
+}
+
+absl::StatusOr<std::shared_ptr<const CachedPublicKey>> FetchPublicKey(
+    const KmsClient& client, std::string_view ckv_name) {
+  kms_v1::GetPublicKeyRequest req;
+  req.set_name(std::string(ckv_name));
+
+  auto key = std::make_shared<CachedPublicKey>();
+  ASSIGN_OR_RETURN(key->public_key, client.GetPublicKey(req));
+
+  const std::string& pem = key->public_key.pem();
+  bssl::UniquePtr<BIO> bio(BIO_new_mem_buf(pem.data(), pem.size()));
+  key->key.reset(PEM_read_bio_PUBKEY(bio.get(), nullptr, nullptr, nullptr));
+  if (!key->key) {
+    return ParseError("parsing", ckv_name, SOURCE_LOCATION);
+  }
+
+  int len = i2d_PUBKEY(key->key.get(), nullptr);
+  if (len <= 0) {
+    return ParseError("marshaling", ckv_name, SOURCE_LOCATION);
+  }
+  key->der.resize(len);
+  uint8_t* der = reinterpret_cast<uint8_t*>(key->der.data());
+  if (i2d_PUBKEY(key->key.get(), &der) != len) {
+    return ParseError("marshaling", ckv_name, SOURCE_LOCATION);
+  }
+  return key;
+}
+
+}  // namespace
+
+struct PublicKeyCache::Slot {
+  // Set when the fetch completes. Other callers wait for it.
+  bool done = false;
+  absl::StatusOr<std::shared_ptr<const CachedPublicKey>> result;
+  absl::Time expiry;
+  // The slot's position in lru_, once the fetched key is stored.
+  std::optional<std::list<std::string>::iterator> lru;
+};
+
+PublicKeyCache& PublicKeyCache::Global() {
+  static PublicKeyCache* const kCache = new PublicKeyCache(
+      Options{.capacity = kGlobalCapacity, .ttl = kGlobalTtl});
+  return *kCache;
+}
+
+absl::StatusOr<std::shared_ptr<const CachedPublicKey>> PublicKeyCache::Get(
+    const KmsClient& client, std::string_view ckv_name) {
+  std::shared_ptr<Slot> slot;
+  {
+    absl::MutexLock lock(&mutex_);
+    if (auto it = slots_.find(ckv_name); it != slots_.end()) {
+      slot = it->second;
+      if (!slot->done) {
+        mutex_.Await(absl::Condition(&slot->done));
+        return slot->result;
+      }
+      if (absl::Now() < slot->expiry) {
+        lru_.splice(lru_.begin(), lru_, *slot->lru);
+        return slot->result;
+      }
+      EraseLocked(ckv_name);
+    }
+    slot = std::make_shared<Slot>();
+    slots_.emplace(ckv_name, slot);
+  }
+
+  absl::StatusOr<std::shared_ptr<const CachedPublicKey>> result =
+      FetchPublicKey(client, ckv_name);
+
+  absl::MutexLock lock(&mutex_);
+  slot->result = result;
+  slot->done = true;
+
+  // The slot is gone if the cache was cleared during the fetch.
+  auto it = slots_.find(ckv_name);
+  if (it == slots_.end() || it->second != slot) {
+    return result;
+  }
+  if (!result.ok()) {
+    slots_.erase(it);
+    return result;
+  }
+  slot->expiry = absl::Now() + options_.ttl;
+  lru_.push_front(std::string(ckv_name));
+  slot->lru = lru_.begin();
+  if (options_.capacity > 0 && lru_.size() > options_.capacity) {
+    EraseLocked(lru_.back());
+  }
+  return result;
+}
+
+size_t PublicKeyCache::size() const {
+  absl::MutexLock lock(&mutex_);
+  return lru_.size();
+}
+
+void PublicKeyCache::Clear() {
+  absl::MutexLock lock(&mutex_);
+  slots_.clear();
+  lru_.clear();
+}
+
+void PublicKeyCache::EraseLocked(std::string_view ckv_name) {
+  auto it = slots_.find(ckv_name);
+  if (it == slots_.end()) {
+    return;
+  }
+  // `ckv_name` may refer to the lru_ entry, so it must not be used after the
+  // entry is erased.
+  if (it->second->lru.has_value()) {
+    lru_.erase(*it->second->lru);
+  }
+  slots_.erase(it);
+}
+
+}  // namespace cloud_kms
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMMON_PUBLIC_KEY_CACHE_H_
+#define COMMON_PUBLIC_KEY_CACHE_H_
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "common/kms_client.h"
+#include "common/kms_v1.h"
+#include "common/openssl.h"
+
+namespace cloud_kms {
+
+// A Cloud KMS public key, in the forms that the providers consume.
+struct CachedPublicKey {
+  // The GetPublicKey response.
+  kms_v1::PublicKey public_key;
+  // The parsed public key.
+  bssl::UniquePtr<EVP_PKEY> key;
+  // The DER-encoded public key in SubjectPublicKeyInfo format.
+  std::string der;
+};
+
+// PublicKeyCache holds the public keys of CryptoKeyVersions, keyed by
+// CryptoKeyVersion name, so that using a key again does not cost a
+// GetPublicKey RPC or a PEM parse. Concurrent requests for a key that is not
+// cached share a single fetch. Failed fetches are not cached.
+//
+// PublicKeyCache is safe for concurrent use.
+class PublicKeyCache {
+ public:
+  struct Options {
+    // The maximum number of keys to hold. When it is exceeded, the least
+    // recently used key is evicted. 0 means no limit.
+    size_t capacity = 0;
+    // The time for which a fetched key is served from the cache.
+    absl::Duration ttl = absl::InfiniteDuration();
+  };
+
+  explicit PublicKeyCache(Options options) : options_(options) {}
+
+  // Returns the cache shared by everything in this process.
+  static PublicKeyCache& Global();
+
+  // Returns the public key of the CryptoKeyVersion `ckv_name`, fetching it
+  // with `client` if it is not cached.
+  absl::StatusOr<std::shared_ptr<const CachedPublicKey>> Get(
+      const KmsClient& client, std::string_view ckv_name);
+
+  // Returns the number of keys held.
+  size_t size() const;
+
+  // Evicts every key. Fetches in flight are abandoned: their results are
+  // returned to their callers but not stored. This is safe to call in a child
+  // process after fork.
+  void Clear();
+
+ private:
+  struct Slot;
+
+  void EraseLocked(std::string_view ckv_name)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const Options options_;
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, std::shared_ptr<Slot>> slots_
+      ABSL_GUARDED_BY(mutex_);
+  // The names of the keys held, most recently used first.
+  std::list<std::string> lru_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace cloud_kms
+
+#endif  // COMMON_PUBLIC_KEY_CACHE_H_
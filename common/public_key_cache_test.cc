@@ -0,0 +1,267 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/public_key_cache.h"
+
+#include <thread>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "common/test/matchers.h"
+#include "common/test/runfiles.h"
+#include "common/test/test_status_macros.h"
+#include "gmock/gmock.h"
+
+namespace cloud_kms {
+namespace {
+
+using ::testing::_;
+using ::testing::NotNull;
+
+constexpr std::string_view kCkvName =
+    "projects/p/locations/l/keyRings/kr/cryptoKeys/ck/cryptoKeyVersions/1";
+
+class MockKmsTransport : public KmsTransport {
+ public:
+  MOCK_METHOD(grpc::Status, AsymmetricDecrypt,
+              (grpc::ClientContext*, const kms_v1::AsymmetricDecryptRequest&,
+               kms_v1::AsymmetricDecryptResponse*),
+              (override));
+  MOCK_METHOD(grpc::Status, AsymmetricSign,
+              (grpc::ClientContext*, const kms_v1::AsymmetricSignRequest&,
+               kms_v1::AsymmetricSignResponse*),
+              (override));
+  MOCK_METHOD(grpc::Status, MacSign,
+              (grpc::ClientContext*, const kms_v1::MacSignRequest&,
+               kms_v1::MacSignResponse*),
+              (override));
+  MOCK_METHOD(grpc::Status, MacVerify,
+              (grpc::ClientContext*, const kms_v1::MacVerifyRequest&,
+               kms_v1::MacVerifyResponse*),
+              (override));
+  MOCK_METHOD(grpc::Status, RawDecrypt,
+              (grpc::ClientContext*, const kms_v1::RawDecryptRequest&,
+               kms_v1::RawDecryptResponse*),
+              (override));
+  MOCK_METHOD(grpc::Status, RawEncrypt,
+              (grpc::ClientContext*, const kms_v1::RawEncryptRequest&,
+               kms_v1::RawEncryptResponse*),
+              (override));
+  MOCK_METHOD(grpc::Status, CreateCryptoKey,
+              (grpc::ClientContext*, const kms_v1::CreateCryptoKeyRequest&,
+               kms_v1::CryptoKey*),
+              (override));
+  MOCK_METHOD(grpc::Status, CreateCryptoKeyVersion,
+              (grpc::ClientContext*,
+               const kms_v1::CreateCryptoKeyVersionRequest&,
+               kms_v1::CryptoKeyVersion*),
+              (override));
+  MOCK_METHOD(grpc::Status, DestroyCryptoKeyVersion,
+              (grpc::ClientContext*,
+               const kms_v1::DestroyCryptoKeyVersionRequest&,
+               kms_v1::CryptoKeyVersion*),
+              (override));
+  MOCK_METHOD(grpc::Status, GetCryptoKey,
+              (grpc::ClientContext*, const kms_v1::GetCryptoKeyRequest&,
+               kms_v1::CryptoKey*),
+              (override));
+  MOCK_METHOD(grpc::Status, GetCryptoKeyVersion,
+              (grpc::ClientContext*, const kms_v1::GetCryptoKeyVersionRequest&,
+               kms_v1::CryptoKeyVersion*),
+              (override));
+  MOCK_METHOD(grpc::Status, GetPublicKey,
+              (grpc::ClientContext*, const kms_v1::GetPublicKeyRequest&,
+               kms_v1::PublicKey*),
+              (override));
+  MOCK_METHOD(grpc::Status, ListCryptoKeys,
+              (grpc::ClientContext*, const kms_v1::ListCryptoKeysRequest&,
+               kms_v1::ListCryptoKeysResponse*),
+              (override));
+  MOCK_METHOD(grpc::Status, ListCryptoKeyVersions,
+              (grpc::ClientContext*,
+               const kms_v1::ListCryptoKeyVersionsRequest&,
+               kms_v1::ListCryptoKeyVersionsResponse*),
+              (override));
+  MOCK_METHOD(grpc::Status, GenerateRandomBytes,
+              (grpc::ClientContext*, const kms_v1::GenerateRandomBytesRequest&,
+               kms_v1::GenerateRandomBytesResponse*),
+              (override));
+};
+
+class PublicKeyCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_OK_AND_ASSIGN(pem_, LoadTestRunfile("ec_p256_public.pem"));
+    ASSERT_OK_AND_ASSIGN(der_, LoadTestRunfile("ec_p256_public.der"));
+    transport_ = std::make_shared<MockKmsTransport>();
+    client_ = std::make_unique<KmsClient>(
+        KmsClient::Options{.transport = transport_});
+  }
+
+  // Serves the test public key for every CryptoKeyVersion, and counts the
+  // RPCs for each.
+  void ServePublicKeys() {
+    EXPECT_CALL(*transport_, GetPublicKey(_, _, _))
+        .WillRepeatedly([this](grpc::ClientContext*,
+                               const kms_v1::GetPublicKeyRequest& req,
+                               kms_v1::PublicKey* resp) {
+          absl::MutexLock lock(&mutex_);
+          rpc_counts_[req.name()]++;
+          resp->set_name(req.name());
+          resp->set_pem(pem_);
+          resp->set_algorithm(kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+          return grpc::Status::OK;
+        });
+  }
+
+  int RpcCount(std::string_view ckv_name) {
+    absl::MutexLock lock(&mutex_);
+    return rpc_counts_[ckv_name];
+  }
+
+  std::string pem_;
+  std::string der_;
+  std::shared_ptr<MockKmsTransport> transport_;
+  std::unique_ptr<KmsClient> client_;
+
+  absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, int> rpc_counts_ ABSL_GUARDED_BY(mutex_);
+};
+
+TEST_F(PublicKeyCacheTest, GetReturnsParsedKey) {
+  ServePublicKeys();
+  PublicKeyCache cache({});
+
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const CachedPublicKey> key,
+                       cache.Get(*client_, kCkvName));
+
+  EXPECT_EQ(key->public_key.name(), kCkvName);
+  EXPECT_EQ(key->public_key.algorithm(),
+            kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+  EXPECT_THAT(key->key, NotNull());
+  EXPECT_EQ(EVP_PKEY_id(key->key.get()), EVP_PKEY_EC);
+  EXPECT_EQ(key->der, der_);
+}
+
+TEST_F(PublicKeyCacheTest, SecondGetIsServedFromCache) {
+  ServePublicKeys();
+  PublicKeyCache cache({});
+
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const CachedPublicKey> first,
+                       cache.Get(*client_, kCkvName));
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<const CachedPublicKey> second,
+                       cache.Get(*client_, kCkvName));
+
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(RpcCount(kCkvName), 1);
+}
+
+TEST_F(PublicKeyCacheTest, ConcurrentGetsShareOneFetch) {
+  absl::Notification release;
+  EXPECT_CALL(*transport_, GetPublicKey(_, _, _))
+      .WillOnce([&](grpc::ClientContext*, const kms_v1::GetPublicKeyRequest&,
+                    kms_v1::PublicKey* resp) {
+        release.WaitForNotification();
+        resp->set_pem(pem_);
+        return grpc::Status::OK;
+      });
+  PublicKeyCache cache({});
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; i++) {
+    threads.emplace_back([&] { EXPECT_OK(cache.Get(*client_, kCkvName)); });
+  }
+  absl::SleepFor(absl::Milliseconds(50));
+  release.Notify();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+TEST_F(PublicKeyCacheTest, FailedFetchIsNotCached) {
+  EXPECT_CALL(*transport_, GetPublicKey(_, _, _))
+      .WillOnce(testing::Return(
+          grpc::Status(grpc::StatusCode::NOT_FOUND, "not found")))
+      .WillOnce([&](grpc::ClientContext*, const kms_v1::GetPublicKeyRequest&,
+                    kms_v1::PublicKey* resp) {
+        resp->set_pem(pem_);
+        return grpc::Status::OK;
+      });
+  PublicKeyCache cache({});
+
+  EXPECT_THAT(cache.Get(*client_, kCkvName),
+              StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_OK(cache.Get(*client_, kCkvName));
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST_F(PublicKeyCacheTest, MalformedPemIsInternalError) {
+  EXPECT_CALL(*transport_, GetPublicKey(_, _, _))
+      .WillOnce([](grpc::ClientContext*, const kms_v1::GetPublicKeyRequest&,
+                   kms_v1::PublicKey* resp) {
+        resp->set_pem("-----BEGIN PUBLIC KEY-----\nAAAA\n");
+        return grpc::Status::OK;
+      });
+  PublicKeyCache cache({});
+
+  EXPECT_THAT(cache.Get(*client_, kCkvName),
+              StatusIs(absl::StatusCode::kInternal));
+}
+
+TEST_F(PublicKeyCacheTest, ExpiredKeyIsFetchedAgain) {
+  ServePublicKeys();
+  PublicKeyCache cache({.ttl = absl::ZeroDuration()});
+
+  EXPECT_OK(cache.Get(*client_, kCkvName));
+  EXPECT_OK(cache.Get(*client_, kCkvName));
+
+  EXPECT_EQ(RpcCount(kCkvName), 2);
+}
+
+TEST_F(PublicKeyCacheTest, CapacityEvictsLeastRecentlyUsed) {
+  ServePublicKeys();
+  PublicKeyCache cache({.capacity = 2});
+
+  EXPECT_OK(cache.Get(*client_, "a"));
+  EXPECT_OK(cache.Get(*client_, "b"));
+  EXPECT_OK(cache.Get(*client_, "a"));
+  EXPECT_OK(cache.Get(*client_, "c"));  // evicts b
+  EXPECT_EQ(cache.size(), 2);
+
+  EXPECT_OK(cache.Get(*client_, "a"));
+  EXPECT_OK(cache.Get(*client_, "c"));
+  EXPECT_OK(cache.Get(*client_, "b"));
+
+  EXPECT_EQ(RpcCount("a"), 1);
+  EXPECT_EQ(RpcCount("b"), 2);
+  EXPECT_EQ(RpcCount("c"), 1);
+}
+
+TEST_F(PublicKeyCacheTest, ClearEvictsAllKeys) {
+  ServePublicKeys();
+  PublicKeyCache cache({});
+
+  EXPECT_OK(cache.Get(*client_, kCkvName));
+  cache.Clear();
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_OK(cache.Get(*client_, kCkvName));
+
+  EXPECT_EQ(RpcCount(kCkvName), 2);
+}
+
+}  // namespace
+}  // namespace cloud_kms
@@ -0,0 +1,793 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/rest_transport.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <optional>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/random/random.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "common/openssl.h"
+#include "common/platform.h"
+#include "common/status_macros.h"
+#include "common/string_utils.h"
+#include "google/protobuf/struct.pb.h"
+#include "google/protobuf/util/json_util.h"
+
+namespace cloud_kms {
+namespace {
+
+using ::google::protobuf::Message;
+using ::google::protobuf::Struct;
+using ::google::protobuf::Value;
+
+constexpr std::string_view kGet = "GET";
+constexpr std::string_view kPost = "POST";
+
+constexpr char kCredentialsEnvVariable[] = "GOOGLE_APPLICATION_CREDENTIALS";
+constexpr std::string_view kGcloudCredentialsFile =
+    "application_default_credentials.json";
+constexpr std::string_view kMetadataServerAddress =
+    "metadata.google.internal:80";
+constexpr std::string_view kTokenEndpointAddress = "oauth2.googleapis.com:443";
+constexpr std::string_view kTokenEndpointUri =
+    "https://oauth2.googleapis.com/token";
+constexpr std::string_view kJwtBearerGrant =
+    "urn:ietf:params:oauth:grant-type:jwt-bearer";
+constexpr std::string_view kCloudPlatformScope =
+    "https://www.googleapis.com/auth/cloud-platform";
+
+grpc::Status ToGrpcStatus(const absl::Status& status) {
+  // gRPC and Abseil status codes have the same numeric values.
+  return grpc::Status(static_cast<grpc::StatusCode>(status.code()),
+                      std::string(status.message()));
+}
+
+absl::StatusOr<Struct> ParseJsonObject(std::string_view json) {
+  Struct result;
+  RETURN_IF_ERROR(google::protobuf::util::JsonStringToMessage(json, &result));
+  return result;
+}
+
+const Value* FindField(const Struct& object, std::string_view name) {
+  auto it = object.fields().find(std::string(name));
+  return it == object.fields().end() ? nullptr : &it->second;
+}
+
+// Maps the canonical code name in the `status` field of an error response
+// body to a gRPC status code.
+std::optional<grpc::StatusCode> CodeFromName(std::string_view name) {
+  static const auto* const kCodes =
+      new absl::flat_hash_map<std::string_view, grpc::StatusCode>({
+          {"CANCELLED", grpc::StatusCode::CANCELLED},
+          {"UNKNOWN", grpc::StatusCode::UNKNOWN},
+          {"INVALID_ARGUMENT", grpc::StatusCode::INVALID_ARGUMENT},
+          {"DEADLINE_EXCEEDED", grpc::StatusCode::DEADLINE_EXCEEDED},
+          {"NOT_FOUND", grpc::StatusCode::NOT_FOUND},
+          {"ALREADY_EXISTS", grpc::StatusCode::ALREADY_EXISTS},
+          {"PERMISSION_DENIED", grpc::StatusCode::PERMISSION_DENIED},
+          {"RESOURCE_EXHAUSTED", grpc::StatusCode::RESOURCE_EXHAUSTED},
+          {"FAILED_PRECONDITION", grpc::StatusCode::FAILED_PRECONDITION},
+          {"ABORTED", grpc::StatusCode::ABORTED},
+          {"OUT_OF_RANGE", grpc::StatusCode::OUT_OF_RANGE},
+          {"UNIMPLEMENTED", grpc::StatusCode::UNIMPLEMENTED},
+          {"INTERNAL", grpc::StatusCode::INTERNAL},
+          {"UNAVAILABLE", grpc::StatusCode::UNAVAILABLE},
+          {"DATA_LOSS", grpc::StatusCode::DATA_LOSS},
+          {"UNAUTHENTICATED", grpc::StatusCode::UNAUTHENTICATED},
+      });
+  auto it = kCodes->find(name);
+  if (it == kCodes->end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+// Maps an HTTP status to a gRPC status code, for error responses whose body
+// does not name a canonical code. See
+// https://github.com/googleapis/googleapis/blob/master/google/rpc/code.proto
+grpc::StatusCode CodeFromHttpStatus(int http_status) {
+  switch (http_status) {
+    case 400:
+      return grpc::StatusCode::INVALID_ARGUMENT;
+    case 401:
+      return grpc::StatusCode::UNAUTHENTICATED;
+    case 403:
+      return grpc::StatusCode::PERMISSION_DENIED;
+    case 404:
+      return grpc::StatusCode::NOT_FOUND;
+    case 409:
+      return grpc::StatusCode::ABORTED;
+    case 429:
+      return grpc::StatusCode::RESOURCE_EXHAUSTED;
+    case 499:
+      return grpc::StatusCode::CANCELLED;
+    case 500:
+      return grpc::StatusCode::INTERNAL;
+    case 501:
+      return grpc::StatusCode::UNIMPLEMENTED;
+    case 503:
+      return grpc::StatusCode::UNAVAILABLE;
+    case 504:
+      return grpc::StatusCode::DEADLINE_EXCEEDED;
+    default:
+      return grpc::StatusCode::UNKNOWN;
+  }
+}
+
+// Converts an error response, whose body is normally of the form
+// {"error": {"code": 404, "message": "...", "status": "NOT_FOUND"}}.
+grpc::Status ErrorFromResponse(const HttpResponse& response) {
+  grpc::StatusCode code = CodeFromHttpStatus(response.status_code);
+  std::string message = absl::StrFormat("HTTP status %d: %s",
+                                        response.status_code, response.body);
+
+  absl::StatusOr<Struct> body = ParseJsonObject(response.body);
+  const Value* error = body.ok() ? FindField(*body, "error") : nullptr;
+  if (error && error->has_struct_value()) {
+    const Value* status = FindField(error->struct_value(), "status");
+    if (status && status->has_string_value()) {
+      code = CodeFromName(status->string_value()).value_or(code);
+    }
+    const Value* error_message = FindField(error->struct_value(), "message");
+    if (error_message && error_message->has_string_value()) {
+      message = error_message->string_value();
+    }
+  }
+  return grpc::Status(code, message);
+}
+
+std::string UrlEncode(std::string_view value) {
+  std::string result;
+  for (char c : value) {
+    if (absl::ascii_isalnum(c) || c == '-' || c == '.' || c == '_' ||
+        c == '~') {
+      result.push_back(c);
+    } else {
+      absl::StrAppendFormat(&result, "%%%02X", static_cast<uint8_t>(c));
+    }
+  }
+  return result;
+}
+
+// Returns the populated fields of `message` as URL query parameters, such as
+// "?pageSize=10&filter=state%3DENABLED". Fields that are carried in the path
+// or the body must be cleared beforehand.
+absl::StatusOr<std::string> QueryString(const Message& message) {
+  std::string json;
+  RETURN_IF_ERROR(google::protobuf::util::MessageToJsonString(message, &json));
+  ASSIGN_OR_RETURN(Struct fields, ParseJsonObject(json));
+
+  std::vector<std::string> params;
+  for (const auto& [name, value] : fields.fields()) {
+    switch (value.kind_case()) {
+      case Value::kStringValue:
+        params.push_back(
+            absl::StrCat(name, "=", UrlEncode(value.string_value())));
+        break;
+      case Value::kNumberValue:
+        // 64-bit integers are strings in JSON, so this is at most 32 bits.
+        params.push_back(absl::StrCat(
+            name, "=", static_cast<int64_t>(value.number_value())));
+        break;
+      case Value::kBoolValue:
+        params.push_back(
+            absl::StrCat(name, "=", value.bool_value() ? "true" : "false"));
+        break;
+      default:
+        return absl::InvalidArgumentError(absl::StrFormat(
+            "field %s cannot be sent as a query parameter", name));
+    }
+  }
+  if (params.empty()) {
+    return "";
+  }
+  std::sort(params.begin(), params.end());
+  return absl::StrCat("?", absl::StrJoin(params, "&"));
+}
+
+struct AccessToken {
+  std::string token;
+  absl::Time expiry = absl::InfinitePast();
+};
+
+// Parses the access token in a response from the metadata server or the OAuth
+// 2.0 token endpoint, which `issuer` names.
+absl::StatusOr<AccessToken> ParseAccessToken(const HttpResponse& response,
+                                             std::string_view issuer) {
+  if (response.status_code != 200) {
+    return absl::UnavailableError(
+        absl::StrFormat("%s returned HTTP status %d: %s", issuer,
+                        response.status_code, response.body));
+  }
+  ASSIGN_OR_RETURN(Struct body, ParseJsonObject(response.body));
+  const Value* token = FindField(body, "access_token");
+  const Value* expires_in = FindField(body, "expires_in");
+  if (!token || !token->has_string_value() || !expires_in ||
+      expires_in->kind_case() != Value::kNumberValue) {
+    return absl::InternalError(
+        absl::StrCat(issuer, " returned a malformed access token"));
+  }
+  return AccessToken{
+      .token = token->string_value(),
+      .expiry = absl::Now() + absl::Seconds(expires_in->number_value()),
+  };
+}
+
+// Returns an AccessTokenSource that obtains tokens with `fetch`, and reuses
+// each token until shortly before it expires.
+AccessTokenSource NewCachingTokenSource(
+    std::function<absl::StatusOr<AccessToken>()> fetch) {
+  struct State {
+    std::function<absl::StatusOr<AccessToken>()> fetch;
+    absl::Mutex mutex;
+    AccessToken token ABSL_GUARDED_BY(mutex);
+  };
+  auto state = std::make_shared<State>();
+  state->fetch = std::move(fetch);
+
+  return [state]() -> absl::StatusOr<std::string> {
+    absl::MutexLock lock(&state->mutex);
+    // Leave a margin so that a token does not expire while a call is in
+    // flight.
+    if (absl::Now() + absl::Minutes(1) < state->token.expiry) {
+      return state->token.token;
+    }
+    ASSIGN_OR_RETURN(state->token, state->fetch());
+    return state->token.token;
+  };
+}
+
+// Requests an access token from the OAuth 2.0 token endpoint with the
+// form-encoded `grant`.
+absl::StatusOr<AccessToken> RequestAccessToken(HttpClient& http_client,
+                                               std::string grant) {
+  HttpRequest request;
+  request.method = kPost;
+  request.target = "/token";
+  request.headers = {{"Content-Type", "application/x-www-form-urlencoded"}};
+  request.body = std::move(grant);
+  request.deadline = absl::Now() + absl::Seconds(10);
+
+  ASSIGN_OR_RETURN(HttpResponse response, http_client.Send(request));
+  // The endpoint rejects revoked or malformed credentials with these codes,
+  // and retrying will not help.
+  if (response.status_code == 400 || response.status_code == 401) {
+    return absl::UnauthenticatedError(absl::StrFormat(
+        "OAuth 2.0 token endpoint rejected the credentials: %s",
+        response.body));
+  }
+  return ParseAccessToken(response, "OAuth 2.0 token endpoint");
+}
+
+absl::StatusOr<std::string> Base64UrlEncodeJson(const Struct& object) {
+  std::string json;
+  RETURN_IF_ERROR(google::protobuf::util::MessageToJsonString(object, &json));
+  return absl::WebSafeBase64Escape(json);
+}
+
+// Returns a JWT, signed with `key`, that the service account `client_email`
+// exchanges for an access token, as specified by RFC 7523.
+absl::StatusOr<std::string> ServiceAccountAssertion(
+    EVP_PKEY* key, std::string_view key_id, std::string_view client_email) {
+  Struct header;
+  (*header.mutable_fields())["alg"].set_string_value("RS256");
+  (*header.mutable_fields())["typ"].set_string_value("JWT");
+  if (!key_id.empty()) {
+    (*header.mutable_fields())["kid"].set_string_value(std::string(key_id));
+  }
+
+  int64_t now = absl::ToUnixSeconds(absl::Now());
+  Struct claims;
+  (*claims.mutable_fields())["iss"].set_string_value(std::string(client_email));
+  (*claims.mutable_fields())["scope"].set_string_value(
+      std::string(kCloudPlatformScope));
+  (*claims.mutable_fields())["aud"].set_string_value(
+      std::string(kTokenEndpointUri));
+  (*claims.mutable_fields())["iat"].set_number_value(now);
+  (*claims.mutable_fields())["exp"].set_number_value(now + 3600);
+
+  ASSIGN_OR_RETURN(std::string encoded_header, Base64UrlEncodeJson(header));
+  ASSIGN_OR_RETURN(std::string encoded_claims, Base64UrlEncodeJson(claims));
+  std::string signing_input =
+      absl::StrCat(encoded_header, ".", encoded_claims);
+  bssl::UniquePtr<EVP_MD_CTX> ctx(EVP_MD_CTX_new());
+  size_t signature_size;
+  if (!ctx ||
+      !EVP_DigestSignInit(ctx.get(), nullptr, EVP_sha256(), nullptr, key) ||
+      !EVP_DigestSignUpdate(ctx.get(), signing_input.data(),
+                            signing_input.size()) ||
+      !EVP_DigestSignFinal(ctx.get(), nullptr, &signature_size)) {
+    return absl::InternalError(
+        absl::StrCat("error signing service account assertion: ",
+                     ERR_error_string(ERR_get_error(), nullptr)));
+  }
+  std::string signature(signature_size, '\0');
+  if (!EVP_DigestSignFinal(ctx.get(),
+                           reinterpret_cast<uint8_t*>(signature.data()),
+                           &signature_size)) {
+    return absl::InternalError(
+        absl::StrCat("error signing service account assertion: ",
+                     ERR_error_string(ERR_get_error(), nullptr)));
+  }
+  signature.resize(signature_size);
+  return absl::StrCat(signing_input, ".", absl::WebSafeBase64Escape(signature));
+}
+
+// Parses a duration field of a gRPC service config, such as "0.100s".
+absl::StatusOr<absl::Duration> ParseConfigDuration(const Struct& object,
+                                                   std::string_view name) {
+  const Value* value = FindField(object, name);
+  absl::Duration duration;
+  if (!value || !value->has_string_value() ||
+      !absl::ParseDuration(value->string_value(), &duration) ||
+      duration <= absl::ZeroDuration()) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("retry policy has no valid %s", name));
+  }
+  return duration;
+}
+
+absl::StatusOr<RetryPolicy> ParseRetryPolicy(const Struct& object) {
+  RetryPolicy policy;
+  const Value* max_attempts = FindField(object, "maxAttempts");
+  if (!max_attempts || max_attempts->number_value() < 2) {
+    return absl::InvalidArgumentError(
+        "retry policy must allow at least 2 attempts");
+  }
+  // gRPC limits every policy to 5 attempts.
+  policy.max_attempts =
+      static_cast<int>(std::min(max_attempts->number_value(), 5.0));
+  ASSIGN_OR_RETURN(policy.initial_backoff,
+                   ParseConfigDuration(object, "initialBackoff"));
+  ASSIGN_OR_RETURN(policy.max_backoff,
+                   ParseConfigDuration(object, "maxBackoff"));
+  const Value* multiplier = FindField(object, "backoffMultiplier");
+  if (!multiplier || multiplier->number_value() <= 0) {
+    return absl::InvalidArgumentError(
+        "retry policy has no valid backoffMultiplier");
+  }
+  policy.backoff_multiplier = multiplier->number_value();
+  const Value* codes = FindField(object, "retryableStatusCodes");
+  if (codes) {
+    for (const Value& code : codes->list_value().values()) {
+      std::optional<grpc::StatusCode> parsed =
+          CodeFromName(code.string_value());
+      if (!parsed.has_value()) {
+        return absl::InvalidArgumentError(absl::StrFormat(
+            "unknown retryable status code %s", code.string_value()));
+      }
+      policy.retryable_codes.push_back(*parsed);
+    }
+  }
+  return policy;
+}
+
+bool IsRetryable(const RetryPolicy& policy, grpc::StatusCode code) {
+  return std::find(policy.retryable_codes.begin(), policy.retryable_codes.end(),
+                   code) != policy.retryable_codes.end();
+}
+
+}  // namespace
+
+AccessTokenSource NewMetadataServerTokenSource(
+    std::unique_ptr<HttpClient> http_client) {
+  std::shared_ptr<HttpClient> client = std::move(http_client);
+  return NewCachingTokenSource([client]() -> absl::StatusOr<AccessToken> {
+    HttpRequest request;
+    request.method = kGet;
+    request.target =
+        "/computeMetadata/v1/instance/service-accounts/default/token";
+    request.headers = {{"Metadata-Flavor", "Google"}};
+    request.deadline = absl::Now() + absl::Seconds(10);
+
+    ASSIGN_OR_RETURN(HttpResponse response, client->Send(request));
+    return ParseAccessToken(response, "metadata server");
+  });
+}
+
+absl::StatusOr<AccessTokenSource> NewCredentialsFileTokenSource(
+    std::string_view credentials_json,
+    std::unique_ptr<HttpClient> http_client) {
+  absl::StatusOr<Struct> credentials = ParseJsonObject(credentials_json);
+  if (!credentials.ok()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "malformed credentials file: ", credentials.status().message()));
+  }
+  auto string_field = [&](std::string_view name) -> std::string {
+    const Value* value = FindField(*credentials, name);
+    return value && value->has_string_value() ? value->string_value() : "";
+  };
+  std::shared_ptr<HttpClient> client = std::move(http_client);
+
+  std::string type = string_field("type");
+  if (type == "service_account") {
+    std::string client_email = string_field("client_email");
+    std::string private_key = string_field("private_key");
+    if (client_email.empty() || private_key.empty()) {
+      return absl::InvalidArgumentError(
+          "service account credentials must have a client_email and a "
+          "private_key");
+    }
+    bssl::UniquePtr<BIO> bio(
+        BIO_new_mem_buf(private_key.data(), private_key.size()));
+    bssl::UniquePtr<EVP_PKEY> parsed_key(
+        bio ? PEM_read_bio_PrivateKey(bio.get(), nullptr, nullptr, nullptr)
+            : nullptr);
+    if (!parsed_key || EVP_PKEY_id(parsed_key.get()) != EVP_PKEY_RSA) {
+      return absl::InvalidArgumentError(
+          "service account private_key is not a PEM-encoded RSA key");
+    }
+    std::shared_ptr<EVP_PKEY> key = std::move(parsed_key);
+    std::string key_id = string_field("private_key_id");
+    return NewCachingTokenSource(
+        [client, key, key_id, client_email]() -> absl::StatusOr<AccessToken> {
+          ASSIGN_OR_RETURN(
+              std::string assertion,
+              ServiceAccountAssertion(key.get(), key_id, client_email));
+          return RequestAccessToken(
+              *client, absl::StrCat("grant_type=", UrlEncode(kJwtBearerGrant),
+                                    "&assertion=", assertion));
+        });
+  }
+
+  if (type == "authorized_user") {
+    std::string client_id = string_field("client_id");
+    std::string client_secret = string_field("client_secret");
+    std::string refresh_token = string_field("refresh_token");
+    if (client_id.empty() || client_secret.empty() || refresh_token.empty()) {
+      return absl::InvalidArgumentError(
+          "authorized user credentials must have a client_id, a client_secret "
+          "and a refresh_token");
+    }
+    std::string grant = absl::StrCat(
+        "grant_type=refresh_token&client_id=", UrlEncode(client_id),
+        "&client_secret=", UrlEncode(client_secret),
+        "&refresh_token=", UrlEncode(refresh_token));
+    return NewCachingTokenSource(
+        [client, grant]() -> absl::StatusOr<AccessToken> {
+          return RequestAccessToken(*client, grant);
+        });
+  }
+
+  return absl::InvalidArgumentError(absl::StrFormat(
+      "unsupported credentials type \"%s\"; only service_account and "
+      "authorized_user credentials are supported",
+      type));
+}
+
+absl::StatusOr<AccessTokenSource> NewDefaultTokenSource(
+    std::string_view root_certs_file) {
+  std::string path;
+  const char* named_path = std::getenv(kCredentialsEnvVariable);
+  bool named = named_path && *named_path;
+  if (named) {
+    path = named_path;
+  } else if (const char* config = std::getenv("CLOUDSDK_CONFIG");
+             config && *config) {
+    path = absl::StrCat(config, "/", kGcloudCredentialsFile);
+  } else if (std::string config = GetGcloudConfigDirectory(); !config.empty()) {
+    path = absl::StrCat(config, "/", kGcloudCredentialsFile);
+  }
+
+  if (!path.empty()) {
+    absl::StatusOr<std::string> credentials_json = ReadFileToString(path);
+    if (credentials_json.ok()) {
+      ASSIGN_OR_RETURN(std::unique_ptr<HttpClient> http_client,
+                       NewHttpClient(std::string(kTokenEndpointAddress),
+                                     /*use_tls=*/true, root_certs_file));
+      return NewCredentialsFileTokenSource(*credentials_json,
+                                           std::move(http_client));
+    }
+    // Only a file named explicitly must exist.
+    if (named) {
+      return absl::FailedPreconditionError(absl::StrFormat(
+          "unable to read the credentials file named by %s: %s",
+          kCredentialsEnvVariable, credentials_json.status().message()));
+    }
+  }
+
+  ASSIGN_OR_RETURN(std::unique_ptr<HttpClient> http_client,
+                   NewHttpClient(std::string(kMetadataServerAddress),
+                                 /*use_tls=*/false));
+  AccessTokenSource metadata_server =
+      NewMetadataServerTokenSource(std::move(http_client));
+  // Outside Google Cloud there is no metadata server, so name the other
+  // sources of credentials.
+  return [metadata_server]() -> absl::StatusOr<std::string> {
+    absl::StatusOr<std::string> token = metadata_server();
+    if (!token.ok()) {
+      return absl::Status(
+          token.status().code(),
+          absl::StrFormat("no credentials file was found (set %s to name one), "
+                          "and the metadata server did not provide a token: %s",
+                          kCredentialsEnvVariable, token.status().message()));
+    }
+    return token;
+  };
+}
+
+absl::StatusOr<RetryPolicies> ParseRetryPolicies(
+    std::string_view service_config) {
+  ASSIGN_OR_RETURN(Struct config, ParseJsonObject(service_config));
+  RetryPolicies policies;
+  const Value* method_configs = FindField(config, "methodConfig");
+  if (!method_configs) {
+    return policies;
+  }
+  for (const Value& method_config : method_configs->list_value().values()) {
+    const Value* retry_policy =
+        FindField(method_config.struct_value(), "retryPolicy");
+    const Value* names = FindField(method_config.struct_value(), "name");
+    if (!retry_policy || !names) {
+      continue;
+    }
+    ASSIGN_OR_RETURN(RetryPolicy policy,
+                     ParseRetryPolicy(retry_policy->struct_value()));
+    for (const Value& name : names->list_value().values()) {
+      const Value* service = FindField(name.struct_value(), "service");
+      const Value* method = FindField(name.struct_value(), "method");
+      if (service && method &&
+          service->string_value() ==
+              "google.cloud.kms.v1.KeyManagementService") {
+        policies[method->string_value()] = policy;
+      }
+    }
+  }
+  return policies;
+}
+
+grpc::Status RestTransport::Call(grpc::ClientContext* ctx, std::string_view rpc,
+                                 std::string_view method, std::string target,
+                                 const Message* body, Message* response) {
+  HttpRequest request;
+  request.method = method;
+  request.target = absl::StrCat("/v1/", target);
+  request.deadline = absl::FromChrono(ctx->deadline());
+  request.headers.emplace_back("Content-Type", "application/json");
+  if (!options_.user_agent.empty()) {
+    request.headers.emplace_back("User-Agent", options_.user_agent);
+  }
+  if (!options_.user_project_override.empty()) {
+    request.headers.emplace_back("x-goog-user-project",
+                                 options_.user_project_override);
+  }
+  if (!options_.rpc_feature_flags.empty()) {
+    request.headers.emplace_back("x-cloud-kms-features",
+                                 options_.rpc_feature_flags);
+  }
+  if (options_.access_token_source) {
+    absl::StatusOr<std::string> token = options_.access_token_source();
+    if (!token.ok()) {
+      return grpc::Status(
+          grpc::StatusCode::UNAUTHENTICATED,
+          absl::StrCat("unable to obtain an access token: ",
+                       token.status().message()));
+    }
+    request.headers.emplace_back("Authorization",
+                                 absl::StrCat("Bearer ", *token));
+  }
+  if (body) {
+    absl::Status result =
+        google::protobuf::util::MessageToJsonString(*body, &request.body);
+    if (!result.ok()) {
+      return ToGrpcStatus(result);
+    }
+  }
+
+  auto it = options_.retry_policies.find(rpc);
+  const RetryPolicy* policy =
+      it == options_.retry_policies.end() ? nullptr : &it->second;
+  absl::Duration backoff =
+      policy ? policy->initial_backoff : absl::ZeroDuration();
+  absl::StatusOr<HttpResponse> http_response;
+  for (int attempt = 1;; attempt++) {
+    http_response = http_client_->Send(request);
+    grpc::Status status = grpc::Status::OK;
+    if (!http_response.ok()) {
+      status = ToGrpcStatus(http_response.status());
+    } else if (http_response->status_code != 200) {
+      status = ErrorFromResponse(*http_response);
+    }
+    if (status.ok()) {
+      break;
+    }
+    if (!policy || attempt >= policy->max_attempts ||
+        !IsRetryable(*policy, status.error_code())) {
+      return status;
+    }
+    // As in gRPC, wait for a random fraction of the backoff.
+    absl::BitGen bitgen;
+    absl::Duration delay = backoff * absl::Uniform(bitgen, 0.0, 1.0);
+    if (absl::Now() + delay >= request.deadline) {
+      return status;
+    }
+    absl::SleepFor(delay);
+    backoff = std::min(backoff * policy->backoff_multiplier,
+                       policy->max_backoff);
+  }
+
+  google::protobuf::util::JsonParseOptions parse_options;
+  parse_options.ignore_unknown_fields = true;
+  absl::Status result = google::protobuf::util::JsonStringToMessage(
+      http_response->body, response, parse_options);
+  if (!result.ok()) {
+    return grpc::Status(
+        grpc::StatusCode::INTERNAL,
+        absl::StrCat("malformed response body: ", result.message()));
+  }
+  return grpc::Status::OK;
+}
+
+grpc::Status RestTransport::AsymmetricDecrypt(
+    grpc::ClientContext* ctx, const kms_v1::AsymmetricDecryptRequest& request,
+    kms_v1::AsymmetricDecryptResponse* response) {
+  kms_v1::AsymmetricDecryptRequest body = request;
+  body.clear_name();
+  return Call(ctx, "AsymmetricDecrypt", kPost,
+              absl::StrCat(request.name(), ":asymmetricDecrypt"), &body,
+              response);
+}
+
+grpc::Status RestTransport::AsymmetricSign(
+    grpc::ClientContext* ctx, const kms_v1::AsymmetricSignRequest& request,
+    kms_v1::AsymmetricSignResponse* response) {
+  kms_v1::AsymmetricSignRequest body = request;
+  body.clear_name();
+  return Call(ctx, "AsymmetricSign", kPost,
+              absl::StrCat(request.name(), ":asymmetricSign"), &body,
+              response);
+}
+
+grpc::Status RestTransport::MacSign(grpc::ClientContext* ctx,
+                                    const kms_v1::MacSignRequest& request,
+                                    kms_v1::MacSignResponse* response) {
+  kms_v1::MacSignRequest body = request;
+  body.clear_name();
+  return Call(ctx, "MacSign", kPost, absl::StrCat(request.name(), ":macSign"),
+              &body, response);
+}
+
+grpc::Status RestTransport::MacVerify(grpc::ClientContext* ctx,
+                                      const kms_v1::MacVerifyRequest& request,
+                                      kms_v1::MacVerifyResponse* response) {
+  kms_v1::MacVerifyRequest body = request;
+  body.clear_name();
+  return Call(ctx, "MacVerify", kPost,
+              absl::StrCat(request.name(), ":macVerify"), &body, response);
+}
+
+grpc::Status RestTransport::RawDecrypt(
+    grpc::ClientContext* ctx, const kms_v1::RawDecryptRequest& request,
+    kms_v1::RawDecryptResponse* response) {
+  kms_v1::RawDecryptRequest body = request;
+  body.clear_name();
+  return Call(ctx, "RawDecrypt", kPost,
+              absl::StrCat(request.name(), ":rawDecrypt"), &body, response);
+}
+
+grpc::Status RestTransport::RawEncrypt(
+    grpc::ClientContext* ctx, const kms_v1::RawEncryptRequest& request,
+    kms_v1::RawEncryptResponse* response) {
+  kms_v1::RawEncryptRequest body = request;
+  body.clear_name();
+  return Call(ctx, "RawEncrypt", kPost,
+              absl::StrCat(request.name(), ":rawEncrypt"), &body, response);
+}
+
+grpc::Status RestTransport::CreateCryptoKey(
+    grpc::ClientContext* ctx, const kms_v1::CreateCryptoKeyRequest& request,
+    kms_v1::CryptoKey* response) {
+  kms_v1::CreateCryptoKeyRequest query = request;
+  query.clear_parent();
+  query.clear_crypto_key();
+  absl::StatusOr<std::string> query_string = QueryString(query);
+  if (!query_string.ok()) {
+    return ToGrpcStatus(query_string.status());
+  }
+  return Call(ctx, "CreateCryptoKey", kPost,
+              absl::StrCat(request.parent(), "/cryptoKeys", *query_string),
+              &request.crypto_key(), response);
+}
+
+grpc::Status RestTransport::CreateCryptoKeyVersion(
+    grpc::ClientContext* ctx,
+    const kms_v1::CreateCryptoKeyVersionRequest& request,
+    kms_v1::CryptoKeyVersion* response) {
+  return Call(ctx, "CreateCryptoKeyVersion", kPost,
+              absl::StrCat(request.parent(), "/cryptoKeyVersions"),
+              &request.crypto_key_version(), response);
+}
+
+grpc::Status RestTransport::DestroyCryptoKeyVersion(
+    grpc::ClientContext* ctx,
+    const kms_v1::DestroyCryptoKeyVersionRequest& request,
+    kms_v1::CryptoKeyVersion* response) {
+  kms_v1::DestroyCryptoKeyVersionRequest body = request;
+  body.clear_name();
+  return Call(ctx, "DestroyCryptoKeyVersion", kPost,
+              absl::StrCat(request.name(), ":destroy"), &body, response);
+}
+
+grpc::Status RestTransport::GetCryptoKey(
+    grpc::ClientContext* ctx, const kms_v1::GetCryptoKeyRequest& request,
+    kms_v1::CryptoKey* response) {
+  return Call(ctx, "GetCryptoKey", kGet, request.name(), nullptr, response);
+}
+
+grpc::Status RestTransport::GetCryptoKeyVersion(
+    grpc::ClientContext* ctx, const kms_v1::GetCryptoKeyVersionRequest& request,
+    kms_v1::CryptoKeyVersion* response) {
+  return Call(ctx, "GetCryptoKeyVersion", kGet, request.name(), nullptr,
+              response);
+}
+
+grpc::Status RestTransport::GetPublicKey(
+    grpc::ClientContext* ctx, const kms_v1::GetPublicKeyRequest& request,
+    kms_v1::PublicKey* response) {
+  return Call(ctx, "GetPublicKey", kGet,
+              absl::StrCat(request.name(), "/publicKey"), nullptr, response);
+}
+
+grpc::Status RestTransport::ListCryptoKeys(
+    grpc::ClientContext* ctx, const kms_v1::ListCryptoKeysRequest& request,
+    kms_v1::ListCryptoKeysResponse* response) {
+  kms_v1::ListCryptoKeysRequest query = request;
+  query.clear_parent();
+  absl::StatusOr<std::string> query_string = QueryString(query);
+  if (!query_string.ok()) {
+    return ToGrpcStatus(query_string.status());
+  }
+  return Call(ctx, "ListCryptoKeys", kGet,
+              absl::StrCat(request.parent(), "/cryptoKeys", *query_string),
+              nullptr, response);
+}
+
+grpc::Status RestTransport::ListCryptoKeyVersions(
+    grpc::ClientContext* ctx,
+    const kms_v1::ListCryptoKeyVersionsRequest& request,
+    kms_v1::ListCryptoKeyVersionsResponse* response) {
+  kms_v1::ListCryptoKeyVersionsRequest query = request;
+  query.clear_parent();
+  absl::StatusOr<std::string> query_string = QueryString(query);
+  if (!query_string.ok()) {
+    return ToGrpcStatus(query_string.status());
+  }
+  return Call(
+      ctx, "ListCryptoKeyVersions", kGet,
+      absl::StrCat(request.parent(), "/cryptoKeyVersions", *query_string),
+      nullptr, response);
+}
+
+grpc::Status RestTransport::GenerateRandomBytes(
+    grpc::ClientContext* ctx, const kms_v1::GenerateRandomBytesRequest& request,
+    kms_v1::GenerateRandomBytesResponse* response) {
+  kms_v1::GenerateRandomBytesRequest body = request;
+  body.clear_location();
+  return Call(ctx, "GenerateRandomBytes", kPost,
+              absl::StrCat(request.location(), ":generateRandomBytes"), &body,
+              response);
+}
+
+}  // namespace cloud_kms
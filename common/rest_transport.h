@@ -0,0 +1,168 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMMON_REST_TRANSPORT_H_
+#define COMMON_REST_TRANSPORT_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "common/http_client.h"
+#include "common/kms_transport.h"
+#include "google/protobuf/message.h"
+
+namespace cloud_kms {
+
+// Returns an OAuth 2.0 access token with which to authorize calls.
+using AccessTokenSource = std::function<absl::StatusOr<std::string>()>;
+
+// Returns an AccessTokenSource that obtains tokens for the default service
+// account from the Compute Engine metadata server, and reuses each token until
+// shortly before it expires.
+AccessTokenSource NewMetadataServerTokenSource(
+    std::unique_ptr<HttpClient> http_client);
+
+// Returns an AccessTokenSource for `credentials_json`, the contents of a
+// "service_account" or "authorized_user" credentials file. Tokens are obtained
+// from the OAuth 2.0 token endpoint with `http_client`, and each is reused
+// until shortly before it expires.
+absl::StatusOr<AccessTokenSource> NewCredentialsFileTokenSource(
+    std::string_view credentials_json, std::unique_ptr<HttpClient> http_client);
+
+// Returns an AccessTokenSource for Application Default Credentials: the
+// credentials file named by GOOGLE_APPLICATION_CREDENTIALS, or else the one
+// written by `gcloud auth application-default login`, or else the default
+// service account from the Compute Engine metadata server. The token endpoint
+// is trusted as described for NewHttpClient with `root_certs_file`.
+absl::StatusOr<AccessTokenSource> NewDefaultTokenSource(
+    std::string_view root_certs_file = "");
+
+// The retry policy that a gRPC service config sets for a method. Failed calls
+// are retried up to `max_attempts` attempts in all, after a random delay of up
+// to a backoff that starts at `initial_backoff` and grows by
+// `backoff_multiplier` for each retry, up to `max_backoff`.
+struct RetryPolicy {
+  int max_attempts = 1;
+  absl::Duration initial_backoff;
+  absl::Duration max_backoff;
+  double backoff_multiplier = 1;
+  std::vector<grpc::StatusCode> retryable_codes;
+};
+
+// Retry policies keyed by Cloud KMS method name, such as "AsymmetricSign".
+using RetryPolicies = absl::flat_hash_map<std::string, RetryPolicy>;
+
+// Parses the retry policies for the methods of KeyManagementService in the
+// gRPC service config `service_config`, such as
+// kDefaultCloudKmsGrpcServiceConfig. As in gRPC, at most 5 attempts are made.
+absl::StatusOr<RetryPolicies> ParseRetryPolicies(
+    std::string_view service_config);
+
+// RestTransport makes calls with the Cloud KMS REST/JSON API, for environments
+// in which a gRPC channel is impractical. Requests and responses are converted
+// with the standard proto3 JSON mapping, so CRC32C checksums are carried as
+// they are over gRPC.
+class RestTransport : public KmsTransport {
+ public:
+  struct Options {
+    std::string user_agent = "";
+    std::string user_project_override = "";
+    std::string rpc_feature_flags = "";
+    // If unset, calls are not authorized, which is only useful with a local
+    // stand-in for Cloud KMS.
+    AccessTokenSource access_token_source = nullptr;
+    // Calls to the methods that have a policy are retried within their
+    // deadline. Calls to other methods are not retried.
+    RetryPolicies retry_policies;
+  };
+
+  // `http_client` must be safe for concurrent use.
+  RestTransport(std::unique_ptr<HttpClient> http_client, Options options)
+      : http_client_(std::move(http_client)), options_(std::move(options)) {}
+
+  grpc::Status AsymmetricDecrypt(
+      grpc::ClientContext* ctx, const kms_v1::AsymmetricDecryptRequest& request,
+      kms_v1::AsymmetricDecryptResponse* response) override;
+  grpc::Status AsymmetricSign(
+      grpc::ClientContext* ctx, const kms_v1::AsymmetricSignRequest& request,
+      kms_v1::AsymmetricSignResponse* response) override;
+  grpc::Status MacSign(grpc::ClientContext* ctx,
+                       const kms_v1::MacSignRequest& request,
+                       kms_v1::MacSignResponse* response) override;
+  grpc::Status MacVerify(grpc::ClientContext* ctx,
+                         const kms_v1::MacVerifyRequest& request,
+                         kms_v1::MacVerifyResponse* response) override;
+  grpc::Status RawDecrypt(grpc::ClientContext* ctx,
+                          const kms_v1::RawDecryptRequest& request,
+                          kms_v1::RawDecryptResponse* response) override;
+  grpc::Status RawEncrypt(grpc::ClientContext* ctx,
+                          const kms_v1::RawEncryptRequest& request,
+                          kms_v1::RawEncryptResponse* response) override;
+  grpc::Status CreateCryptoKey(grpc::ClientContext* ctx,
+                               const kms_v1::CreateCryptoKeyRequest& request,
+                               kms_v1::CryptoKey* response) override;
+  grpc::Status CreateCryptoKeyVersion(
+      grpc::ClientContext* ctx,
+      const kms_v1::CreateCryptoKeyVersionRequest& request,
+      kms_v1::CryptoKeyVersion* response) override;
+  grpc::Status DestroyCryptoKeyVersion(
+      grpc::ClientContext* ctx,
+      const kms_v1::DestroyCryptoKeyVersionRequest& request,
+      kms_v1::CryptoKeyVersion* response) override;
+  grpc::Status GetCryptoKey(grpc::ClientContext* ctx,
+                            const kms_v1::GetCryptoKeyRequest& request,
+                            kms_v1::CryptoKey* response) override;
+  grpc::Status GetCryptoKeyVersion(
+      grpc::ClientContext* ctx,
+      const kms_v1::GetCryptoKeyVersionRequest& request,
+      kms_v1::CryptoKeyVersion* response) override;
+  grpc::Status GetPublicKey(grpc::ClientContext* ctx,
+                            const kms_v1::GetPublicKeyRequest& request,
+                            kms_v1::PublicKey* response) override;
+  grpc::Status ListCryptoKeys(
+      grpc::ClientContext* ctx, const kms_v1::ListCryptoKeysRequest& request,
+      kms_v1::ListCryptoKeysResponse* response) override;
+  grpc::Status ListCryptoKeyVersions(
+      grpc::ClientContext* ctx,
+      const kms_v1::ListCryptoKeyVersionsRequest& request,
+      kms_v1::ListCryptoKeyVersionsResponse* response) override;
+  grpc::Status GenerateRandomBytes(
+      grpc::ClientContext* ctx,
+      const kms_v1::GenerateRandomBytesRequest& request,
+      kms_v1::GenerateRandomBytesResponse* response) override;
+
+ private:
+  // Sends `body` (if any) to the resource at `target`, and parses the reply
+  // into `response`. `rpc` names the Cloud KMS method, and selects its retry
+  // policy.
+  grpc::Status Call(grpc::ClientContext* ctx, std::string_view rpc,
+                    std::string_view method, std::string target,
+                    const google::protobuf::Message* body,
+                    google::protobuf::Message* response);
+
+  std::unique_ptr<HttpClient> http_client_;
+  const Options options_;
+};
+
+}  // namespace cloud_kms
+
+#endif  // COMMON_REST_TRANSPORT_H_
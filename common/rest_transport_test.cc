@@ -0,0 +1,618 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/rest_transport.h"
+
+#include "absl/cleanup/cleanup.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_split.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "cloudkms_grpc_service_config.h"
+#include "common/kms_client.h"
+#include "common/openssl.h"
+#include "common/test/matchers.h"
+#include "common/test/runfiles.h"
+#include "common/test/test_platform.h"
+#include "common/test/test_status_macros.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/struct.pb.h"
+#include "google/protobuf/util/json_util.h"
+
+namespace cloud_kms {
+namespace {
+
+using ::google::protobuf::Struct;
+using ::testing::Contains;
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+using ::testing::IsEmpty;
+using ::testing::Pair;
+using ::testing::SizeIs;
+
+constexpr std::string_view kKeyRingName =
+    "projects/foo/locations/global/keyRings/bar";
+constexpr std::string_view kCkvName =
+    "projects/foo/locations/global/keyRings/bar/cryptoKeys/baz/"
+    "cryptoKeyVersions/1";
+
+// A stand-in for the Cloud KMS REST endpoint, which records each request and
+// replies with a canned response.
+class FakeHttpClient : public HttpClient {
+ public:
+  explicit FakeHttpClient(HttpResponse response)
+      : FakeHttpClient(std::vector<HttpResponse>{std::move(response)}) {}
+
+  // Replies with `responses` in order, and then repeats the last one.
+  explicit FakeHttpClient(std::vector<HttpResponse> responses)
+      : responses_(std::move(responses)) {}
+
+  absl::StatusOr<HttpResponse> Send(const HttpRequest& request) override {
+    absl::MutexLock lock(&mutex_);
+    requests_.push_back(request);
+    return responses_[std::min(requests_.size(), responses_.size()) - 1];
+  }
+
+  std::vector<HttpRequest> requests() {
+    absl::MutexLock lock(&mutex_);
+    return requests_;
+  }
+
+ private:
+  const std::vector<HttpResponse> responses_;
+  absl::Mutex mutex_;
+  std::vector<HttpRequest> requests_ ABSL_GUARDED_BY(mutex_);
+};
+
+struct TestTransport {
+  FakeHttpClient* http_client;
+  std::unique_ptr<RestTransport> transport;
+};
+
+TestTransport NewTestTransport(int status_code, std::string_view body,
+                               RestTransport::Options options = {}) {
+  auto http_client = std::make_unique<FakeHttpClient>(
+      HttpResponse{status_code, std::string(body)});
+  FakeHttpClient* http_client_ptr = http_client.get();
+  return TestTransport{http_client_ptr,
+                       std::make_unique<RestTransport>(std::move(http_client),
+                                                       std::move(options))};
+}
+
+template <typename T>
+T ParseJsonOrDie(std::string_view json) {
+  T message;
+  CHECK_OK(google::protobuf::util::JsonStringToMessage(json, &message));
+  return message;
+}
+
+TEST(RestTransportTest, AsymmetricSignPostsToMethodPath) {
+  TestTransport t = NewTestTransport(
+      200, R"({"signature": "c2ln", "signatureCrc32c": "12345",
+               "verifiedDigestCrc32c": true, "unknownField": 1})");
+
+  kms_v1::AsymmetricSignRequest request;
+  request.set_name(kCkvName);
+  request.mutable_digest()->set_sha256(std::string(32, 'a'));
+  request.mutable_digest_crc32c()->set_value(6789);
+
+  grpc::ClientContext ctx;
+  ctx.set_deadline(absl::ToChronoTime(absl::Now() + absl::Seconds(5)));
+  kms_v1::AsymmetricSignResponse response;
+  EXPECT_OK(t.transport->AsymmetricSign(&ctx, request, &response));
+
+  EXPECT_EQ(response.signature(), "sig");
+  EXPECT_EQ(response.signature_crc32c().value(), 12345);
+  EXPECT_TRUE(response.verified_digest_crc32c());
+
+  std::vector<HttpRequest> requests = t.http_client->requests();
+  ASSERT_THAT(requests, SizeIs(1));
+  EXPECT_EQ(requests[0].method, "POST");
+  EXPECT_EQ(requests[0].target,
+            absl::StrCat("/v1/", kCkvName, ":asymmetricSign"));
+  EXPECT_EQ(requests[0].deadline, absl::FromChrono(ctx.deadline()));
+
+  kms_v1::AsymmetricSignRequest want_body = request;
+  want_body.clear_name();
+  EXPECT_THAT(ParseJsonOrDie<kms_v1::AsymmetricSignRequest>(requests[0].body),
+              EqualsProto(want_body));
+}
+
+TEST(RestTransportTest, GetPublicKeyUsesResourcePath) {
+  TestTransport t = NewTestTransport(200, R"({"pem": "-----BEGIN"})");
+
+  kms_v1::GetPublicKeyRequest request;
+  request.set_name(kCkvName);
+
+  grpc::ClientContext ctx;
+  kms_v1::PublicKey response;
+  EXPECT_OK(t.transport->GetPublicKey(&ctx, request, &response));
+  EXPECT_EQ(response.pem(), "-----BEGIN");
+
+  std::vector<HttpRequest> requests = t.http_client->requests();
+  ASSERT_THAT(requests, SizeIs(1));
+  EXPECT_EQ(requests[0].method, "GET");
+  EXPECT_EQ(requests[0].target, absl::StrCat("/v1/", kCkvName, "/publicKey"));
+  EXPECT_THAT(requests[0].body, IsEmpty());
+}
+
+TEST(RestTransportTest, ListCryptoKeyVersionsSendsQueryParameters) {
+  TestTransport t = NewTestTransport(
+      200, absl::StrCat(R"({"cryptoKeyVersions": [{"name": ")", kCkvName,
+                        R"("}], "nextPageToken": "next"})"));
+
+  kms_v1::ListCryptoKeyVersionsRequest request;
+  request.set_parent(absl::StrCat(kKeyRingName, "/cryptoKeys/baz"));
+  request.set_page_size(10);
+  request.set_page_token("a b");
+  request.set_filter("state=ENABLED");
+  request.set_view(kms_v1::CryptoKeyVersion::FULL);
+
+  grpc::ClientContext ctx;
+  kms_v1::ListCryptoKeyVersionsResponse response;
+  EXPECT_OK(t.transport->ListCryptoKeyVersions(&ctx, request, &response));
+  ASSERT_THAT(response.crypto_key_versions(), SizeIs(1));
+  EXPECT_EQ(response.crypto_key_versions(0).name(), kCkvName);
+  EXPECT_EQ(response.next_page_token(), "next");
+
+  std::vector<HttpRequest> requests = t.http_client->requests();
+  ASSERT_THAT(requests, SizeIs(1));
+  EXPECT_EQ(requests[0].method, "GET");
+  EXPECT_EQ(requests[0].target,
+            absl::StrCat("/v1/", request.parent(),
+                         "/cryptoKeyVersions?filter=state%3DENABLED&"
+                         "pageSize=10&pageToken=a%20b&view=FULL"));
+}
+
+TEST(RestTransportTest, CreateCryptoKeySendsKeyAsBody) {
+  TestTransport t = NewTestTransport(
+      200, absl::StrCat(R"({"name": ")", kKeyRingName,
+                        R"(/cryptoKeys/baz", "purpose": "MAC"})"));
+
+  kms_v1::CreateCryptoKeyRequest request;
+  request.set_parent(kKeyRingName);
+  request.set_crypto_key_id("baz");
+  request.set_skip_initial_version_creation(true);
+  request.mutable_crypto_key()->set_purpose(kms_v1::CryptoKey::MAC);
+  request.mutable_crypto_key()->mutable_version_template()->set_algorithm(
+      kms_v1::CryptoKeyVersion::HMAC_SHA256);
+
+  grpc::ClientContext ctx;
+  kms_v1::CryptoKey response;
+  EXPECT_OK(t.transport->CreateCryptoKey(&ctx, request, &response));
+  EXPECT_EQ(response.purpose(), kms_v1::CryptoKey::MAC);
+
+  std::vector<HttpRequest> requests = t.http_client->requests();
+  ASSERT_THAT(requests, SizeIs(1));
+  EXPECT_EQ(requests[0].method, "POST");
+  EXPECT_EQ(requests[0].target,
+            absl::StrCat("/v1/", kKeyRingName,
+                         "/cryptoKeys?cryptoKeyId=baz&"
+                         "skipInitialVersionCreation=true"));
+  EXPECT_THAT(ParseJsonOrDie<kms_v1::CryptoKey>(requests[0].body),
+              EqualsProto(request.crypto_key()));
+}
+
+TEST(RestTransportTest, HeadersAreSent) {
+  TestTransport t = NewTestTransport(
+      200, "{}",
+      RestTransport::Options{
+          .user_agent = "kmsp11/1.1",
+          .user_project_override = "other-project",
+          .rpc_feature_flags = "some-feature",
+          .access_token_source = [] { return std::string("token"); },
+      });
+
+  kms_v1::GetCryptoKeyVersionRequest request;
+  request.set_name(kCkvName);
+
+  grpc::ClientContext ctx;
+  kms_v1::CryptoKeyVersion response;
+  EXPECT_OK(t.transport->GetCryptoKeyVersion(&ctx, request, &response));
+
+  std::vector<HttpRequest> requests = t.http_client->requests();
+  ASSERT_THAT(requests, SizeIs(1));
+  EXPECT_THAT(requests[0].headers, Contains(Pair("User-Agent", "kmsp11/1.1")));
+  EXPECT_THAT(requests[0].headers,
+              Contains(Pair("x-goog-user-project", "other-project")));
+  EXPECT_THAT(requests[0].headers,
+              Contains(Pair("x-cloud-kms-features", "some-feature")));
+  EXPECT_THAT(requests[0].headers,
+              Contains(Pair("Authorization", "Bearer token")));
+}
+
+TEST(RestTransportTest, TokenSourceFailureIsUnauthenticated) {
+  TestTransport t = NewTestTransport(
+      200, "{}", RestTransport::Options{.access_token_source = [] {
+        return absl::StatusOr<std::string>(
+            absl::UnavailableError("no metadata server"));
+      }});
+
+  kms_v1::GetCryptoKeyRequest request;
+  request.set_name(absl::StrCat(kKeyRingName, "/cryptoKeys/baz"));
+
+  grpc::ClientContext ctx;
+  kms_v1::CryptoKey response;
+  EXPECT_THAT(t.transport->GetCryptoKey(&ctx, request, &response),
+              StatusIs(absl::StatusCode::kUnauthenticated,
+                       HasSubstr("no metadata server")));
+  EXPECT_THAT(t.http_client->requests(), IsEmpty());
+}
+
+TEST(RestTransportTest, ErrorBodyIsMappedToStatus) {
+  TestTransport t = NewTestTransport(400, R"({"error": {
+      "code": 400,
+      "message": "key is not enabled",
+      "status": "FAILED_PRECONDITION"}})");
+
+  kms_v1::GetCryptoKeyRequest request;
+  request.set_name(absl::StrCat(kKeyRingName, "/cryptoKeys/baz"));
+
+  grpc::ClientContext ctx;
+  kms_v1::CryptoKey response;
+  EXPECT_THAT(t.transport->GetCryptoKey(&ctx, request, &response),
+              StatusIs(absl::StatusCode::kFailedPrecondition,
+                       "key is not enabled"));
+}
+
+TEST(RestTransportTest, HttpStatusIsMappedWithoutErrorBody) {
+  TestTransport t = NewTestTransport(503, "upstream unavailable");
+
+  kms_v1::GetCryptoKeyRequest request;
+  request.set_name(absl::StrCat(kKeyRingName, "/cryptoKeys/baz"));
+
+  grpc::ClientContext ctx;
+  kms_v1::CryptoKey response;
+  EXPECT_THAT(t.transport->GetCryptoKey(&ctx, request, &response),
+              StatusIs(absl::StatusCode::kUnavailable,
+                       HasSubstr("upstream unavailable")));
+}
+
+TEST(RestTransportTest, MalformedResponseIsInternal) {
+  TestTransport t = NewTestTransport(200, "<html></html>");
+
+  kms_v1::GetCryptoKeyRequest request;
+  request.set_name(absl::StrCat(kKeyRingName, "/cryptoKeys/baz"));
+
+  grpc::ClientContext ctx;
+  kms_v1::CryptoKey response;
+  EXPECT_THAT(t.transport->GetCryptoKey(&ctx, request, &response),
+              StatusIs(absl::StatusCode::kInternal));
+}
+
+TEST(RestTransportTest, KmsClientVerifiesResponseChecksums) {
+  // The signature "sig" does not have CRC32C 1.
+  TestTransport t = NewTestTransport(
+      200, R"({"signature": "c2ln", "signatureCrc32c": "1",
+               "verifiedDigestCrc32c": true})");
+  KmsClient client(KmsClient::Options{.transport = std::move(t.transport)});
+
+  kms_v1::AsymmetricSignRequest request;
+  request.set_name(kCkvName);
+  request.mutable_digest()->set_sha256(std::string(32, 'a'));
+
+  EXPECT_THAT(client.AsymmetricSign(request),
+              StatusIs(absl::StatusCode::kInternal,
+                       HasSubstr("crc32c did not match")));
+
+  // The client computed the request checksum before it was sent.
+  std::vector<HttpRequest> requests = t.http_client->requests();
+  ASSERT_THAT(requests, SizeIs(1));
+  EXPECT_THAT(requests[0].body, HasSubstr("digestCrc32c"));
+}
+
+RetryPolicy TestRetryPolicy() {
+  RetryPolicy policy;
+  policy.max_attempts = 3;
+  policy.initial_backoff = absl::Milliseconds(1);
+  policy.max_backoff = absl::Milliseconds(2);
+  policy.backoff_multiplier = 2;
+  policy.retryable_codes = {grpc::StatusCode::UNAVAILABLE};
+  return policy;
+}
+
+TEST(RestTransportTest, UnavailableIsRetried) {
+  RestTransport::Options options;
+  options.retry_policies["GetCryptoKey"] = TestRetryPolicy();
+  auto http_client = std::make_unique<FakeHttpClient>(std::vector<HttpResponse>{
+      {503, "upstream unavailable"}, {200, R"({"name": "baz"})"}});
+  FakeHttpClient* http_client_ptr = http_client.get();
+  RestTransport transport(std::move(http_client), std::move(options));
+
+  kms_v1::GetCryptoKeyRequest request;
+  request.set_name(absl::StrCat(kKeyRingName, "/cryptoKeys/baz"));
+
+  grpc::ClientContext ctx;
+  kms_v1::CryptoKey response;
+  EXPECT_OK(transport.GetCryptoKey(&ctx, request, &response));
+  EXPECT_EQ(response.name(), "baz");
+  EXPECT_THAT(http_client_ptr->requests(), SizeIs(2));
+}
+
+TEST(RestTransportTest, RetriesStopAfterMaxAttempts) {
+  RestTransport::Options options;
+  options.retry_policies["GetCryptoKey"] = TestRetryPolicy();
+  TestTransport t =
+      NewTestTransport(503, "upstream unavailable", std::move(options));
+
+  kms_v1::GetCryptoKeyRequest request;
+  request.set_name(absl::StrCat(kKeyRingName, "/cryptoKeys/baz"));
+
+  grpc::ClientContext ctx;
+  kms_v1::CryptoKey response;
+  EXPECT_THAT(t.transport->GetCryptoKey(&ctx, request, &response),
+              StatusIs(absl::StatusCode::kUnavailable));
+  EXPECT_THAT(t.http_client->requests(), SizeIs(3));
+}
+
+TEST(RestTransportTest, RetriesStopAtDeadline) {
+  RestTransport::Options options;
+  RetryPolicy policy = TestRetryPolicy();
+  policy.initial_backoff = absl::Seconds(10);
+  policy.max_backoff = absl::Seconds(10);
+  options.retry_policies["GetCryptoKey"] = policy;
+  TestTransport t =
+      NewTestTransport(503, "upstream unavailable", std::move(options));
+
+  kms_v1::GetCryptoKeyRequest request;
+  request.set_name(absl::StrCat(kKeyRingName, "/cryptoKeys/baz"));
+
+  // The call fails once a delay no longer fits within the deadline, instead
+  // of sleeping past it.
+  absl::Time start = absl::Now();
+  grpc::ClientContext ctx;
+  ctx.set_deadline(absl::ToChronoTime(start + absl::Milliseconds(100)));
+  kms_v1::CryptoKey response;
+  EXPECT_THAT(t.transport->GetCryptoKey(&ctx, request, &response),
+              StatusIs(absl::StatusCode::kUnavailable));
+  EXPECT_LT(absl::Now() - start, absl::Seconds(5));
+}
+
+TEST(RestTransportTest, NonRetryableErrorIsNotRetried) {
+  RestTransport::Options options;
+  options.retry_policies["GetCryptoKey"] = TestRetryPolicy();
+  TestTransport t = NewTestTransport(404, "not found", std::move(options));
+
+  kms_v1::GetCryptoKeyRequest request;
+  request.set_name(absl::StrCat(kKeyRingName, "/cryptoKeys/baz"));
+
+  grpc::ClientContext ctx;
+  kms_v1::CryptoKey response;
+  EXPECT_THAT(t.transport->GetCryptoKey(&ctx, request, &response),
+              StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_THAT(t.http_client->requests(), SizeIs(1));
+}
+
+TEST(RestTransportTest, MethodWithoutPolicyIsNotRetried) {
+  RestTransport::Options options;
+  options.retry_policies["GetCryptoKey"] = TestRetryPolicy();
+  TestTransport t =
+      NewTestTransport(503, "upstream unavailable", std::move(options));
+
+  kms_v1::GetCryptoKeyVersionRequest request;
+  request.set_name(kCkvName);
+
+  grpc::ClientContext ctx;
+  kms_v1::CryptoKeyVersion response;
+  EXPECT_THAT(t.transport->GetCryptoKeyVersion(&ctx, request, &response),
+              StatusIs(absl::StatusCode::kUnavailable));
+  EXPECT_THAT(t.http_client->requests(), SizeIs(1));
+}
+
+TEST(ParseRetryPoliciesTest, PoliciesAreKeyedByMethod) {
+  ASSERT_OK_AND_ASSIGN(RetryPolicies policies, ParseRetryPolicies(R"({
+    "methodConfig": [{
+      "name": [
+        {"service": "google.cloud.kms.v1.KeyManagementService",
+         "method": "AsymmetricSign"},
+        {"service": "google.cloud.kms.v1.KeyManagementService",
+         "method": "GetPublicKey"},
+        {"service": "google.cloud.other.v1.OtherService", "method": "Get"}
+      ],
+      "timeout": "60s",
+      "retryPolicy": {
+        "maxAttempts": 9,
+        "initialBackoff": "0.100s",
+        "maxBackoff": "60s",
+        "backoffMultiplier": 1.3,
+        "retryableStatusCodes": ["UNAVAILABLE", "DEADLINE_EXCEEDED"]
+      }
+    }, {
+      "name": [{"service": "google.cloud.kms.v1.KeyManagementService",
+                "method": "CreateCryptoKey"}],
+      "timeout": "60s"
+    }]
+  })"));
+
+  ASSERT_THAT(policies, SizeIs(2));
+  ASSERT_TRUE(policies.contains("AsymmetricSign"));
+  EXPECT_TRUE(policies.contains("GetPublicKey"));
+  const RetryPolicy& policy = policies["AsymmetricSign"];
+  EXPECT_EQ(policy.max_attempts, 5);
+  EXPECT_EQ(policy.initial_backoff, absl::Milliseconds(100));
+  EXPECT_EQ(policy.max_backoff, absl::Seconds(60));
+  EXPECT_DOUBLE_EQ(policy.backoff_multiplier, 1.3);
+  EXPECT_THAT(policy.retryable_codes,
+              ElementsAre(grpc::StatusCode::UNAVAILABLE,
+                          grpc::StatusCode::DEADLINE_EXCEEDED));
+}
+
+TEST(ParseRetryPoliciesTest, UnknownStatusCodeIsInvalidArgument) {
+  EXPECT_THAT(ParseRetryPolicies(R"({
+    "methodConfig": [{
+      "name": [{"service": "google.cloud.kms.v1.KeyManagementService",
+                "method": "AsymmetricSign"}],
+      "retryPolicy": {
+        "maxAttempts": 5,
+        "initialBackoff": "0.100s",
+        "maxBackoff": "60s",
+        "backoffMultiplier": 1.3,
+        "retryableStatusCodes": ["SOMETIMES"]
+      }
+    }]
+  })"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(ParseRetryPoliciesTest, DefaultServiceConfigIsValid) {
+  EXPECT_OK(ParseRetryPolicies(kDefaultCloudKmsGrpcServiceConfig));
+}
+
+TEST(MetadataServerTokenSourceTest, TokenIsCachedUntilExpiry) {
+  auto http_client = std::make_unique<FakeHttpClient>(
+      HttpResponse{200, R"({"access_token": "token", "expires_in": 3599})"});
+  FakeHttpClient* http_client_ptr = http_client.get();
+  AccessTokenSource source =
+      NewMetadataServerTokenSource(std::move(http_client));
+
+  EXPECT_THAT(source(), IsOkAndHolds("token"));
+  EXPECT_THAT(source(), IsOkAndHolds("token"));
+
+  std::vector<HttpRequest> requests = http_client_ptr->requests();
+  ASSERT_THAT(requests, SizeIs(1));
+  EXPECT_EQ(requests[0].target,
+            "/computeMetadata/v1/instance/service-accounts/default/token");
+  EXPECT_THAT(requests[0].headers, Contains(Pair("Metadata-Flavor", "Google")));
+}
+
+TEST(MetadataServerTokenSourceTest, ErrorStatusIsUnavailable) {
+  AccessTokenSource source = NewMetadataServerTokenSource(
+      std::make_unique<FakeHttpClient>(HttpResponse{404, "not found"}));
+
+  EXPECT_THAT(source(), StatusIs(absl::StatusCode::kUnavailable));
+}
+
+TEST(CredentialsFileTokenSourceTest, AuthorizedUserRefreshesToken) {
+  auto http_client = std::make_unique<FakeHttpClient>(
+      HttpResponse{200, R"({"access_token": "token", "expires_in": 3599})"});
+  FakeHttpClient* http_client_ptr = http_client.get();
+  ASSERT_OK_AND_ASSIGN(
+      AccessTokenSource source,
+      NewCredentialsFileTokenSource(
+          R"({"type": "authorized_user", "client_id": "id",
+              "client_secret": "secret", "refresh_token": "refresh/token"})",
+          std::move(http_client)));
+
+  EXPECT_THAT(source(), IsOkAndHolds("token"));
+  EXPECT_THAT(source(), IsOkAndHolds("token"));
+
+  std::vector<HttpRequest> requests = http_client_ptr->requests();
+  ASSERT_THAT(requests, SizeIs(1));
+  EXPECT_EQ(requests[0].method, "POST");
+  EXPECT_EQ(requests[0].target, "/token");
+  EXPECT_EQ(requests[0].body,
+            "grant_type=refresh_token&client_id=id&client_secret=secret&"
+            "refresh_token=refresh%2Ftoken");
+}
+
+TEST(CredentialsFileTokenSourceTest, ServiceAccountSignsAssertion) {
+  ASSERT_OK_AND_ASSIGN(std::string private_key,
+                       LoadTestRunfile("rsa_2048_private.pem"));
+  Struct credentials;
+  auto& fields = *credentials.mutable_fields();
+  fields["type"].set_string_value("service_account");
+  fields["client_email"].set_string_value("sa@foo.iam.gserviceaccount.com");
+  fields["private_key_id"].set_string_value("key-id");
+  fields["private_key"].set_string_value(private_key);
+  std::string credentials_json;
+  ASSERT_OK(google::protobuf::util::MessageToJsonString(credentials,
+                                                        &credentials_json));
+
+  auto http_client = std::make_unique<FakeHttpClient>(
+      HttpResponse{200, R"({"access_token": "token", "expires_in": 3599})"});
+  FakeHttpClient* http_client_ptr = http_client.get();
+  ASSERT_OK_AND_ASSIGN(
+      AccessTokenSource source,
+      NewCredentialsFileTokenSource(credentials_json, std::move(http_client)));
+  EXPECT_THAT(source(), IsOkAndHolds("token"));
+
+  std::vector<HttpRequest> requests = http_client_ptr->requests();
+  ASSERT_THAT(requests, SizeIs(1));
+  constexpr std::string_view kGrantPrefix =
+      "grant_type=urn%3Aietf%3Aparams%3Aoauth%3Agrant-type%3Ajwt-bearer&"
+      "assertion=";
+  ASSERT_TRUE(absl::StartsWith(requests[0].body, kGrantPrefix));
+  std::string_view assertion =
+      std::string_view(requests[0].body).substr(kGrantPrefix.size());
+  std::vector<std::string> parts = absl::StrSplit(assertion, '.');
+  ASSERT_THAT(parts, SizeIs(3));
+
+  std::string header, claims, signature;
+  ASSERT_TRUE(absl::WebSafeBase64Unescape(parts[0], &header));
+  ASSERT_TRUE(absl::WebSafeBase64Unescape(parts[1], &claims));
+  ASSERT_TRUE(absl::WebSafeBase64Unescape(parts[2], &signature));
+  EXPECT_THAT(header, HasSubstr(R"("alg":"RS256")"));
+  EXPECT_THAT(header, HasSubstr(R"("kid":"key-id")"));
+  EXPECT_THAT(claims, HasSubstr(R"("iss":"sa@foo.iam.gserviceaccount.com")"));
+  EXPECT_THAT(claims,
+              HasSubstr(R"("aud":"https://oauth2.googleapis.com/token")"));
+
+  bssl::UniquePtr<BIO> bio(
+      BIO_new_mem_buf(private_key.data(), private_key.size()));
+  bssl::UniquePtr<EVP_PKEY> key(
+      PEM_read_bio_PrivateKey(bio.get(), nullptr, nullptr, nullptr));
+  ASSERT_TRUE(key);
+  std::string signing_input = absl::StrCat(parts[0], ".", parts[1]);
+  bssl::UniquePtr<EVP_MD_CTX> ctx(EVP_MD_CTX_new());
+  ASSERT_TRUE(EVP_DigestVerifyInit(ctx.get(), nullptr, EVP_sha256(), nullptr,
+                                   key.get()));
+  ASSERT_TRUE(EVP_DigestVerifyUpdate(ctx.get(), signing_input.data(),
+                                     signing_input.size()));
+  EXPECT_EQ(EVP_DigestVerifyFinal(
+                ctx.get(), reinterpret_cast<const uint8_t*>(signature.data()),
+                signature.size()),
+            1);
+}
+
+TEST(CredentialsFileTokenSourceTest, RejectedCredentialsAreUnauthenticated) {
+  ASSERT_OK_AND_ASSIGN(
+      AccessTokenSource source,
+      NewCredentialsFileTokenSource(
+          R"({"type": "authorized_user", "client_id": "id",
+              "client_secret": "secret", "refresh_token": "revoked"})",
+          std::make_unique<FakeHttpClient>(
+              HttpResponse{400, R"({"error": "invalid_grant"})"})));
+
+  EXPECT_THAT(source(), StatusIs(absl::StatusCode::kUnauthenticated));
+}
+
+TEST(CredentialsFileTokenSourceTest, UnsupportedTypeIsInvalidArgument) {
+  EXPECT_THAT(
+      NewCredentialsFileTokenSource(
+          R"({"type": "external_account"})",
+          std::make_unique<FakeHttpClient>(HttpResponse{200, "{}"})),
+      StatusIs(absl::StatusCode::kInvalidArgument,
+               HasSubstr("external_account")));
+}
+
+TEST(CredentialsFileTokenSourceTest, MalformedJsonIsInvalidArgument) {
+  EXPECT_THAT(NewCredentialsFileTokenSource(
+                  "not json",
+                  std::make_unique<FakeHttpClient>(HttpResponse{200, "{}"})),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(DefaultTokenSourceTest, MissingNamedCredentialsFileIsFailedPrecondition) {
+  SetEnvVariable("GOOGLE_APPLICATION_CREDENTIALS",
+                 "/nonexistent/credentials.json");
+  absl::Cleanup c = [] { ClearEnvVariable("GOOGLE_APPLICATION_CREDENTIALS"); };
+
+  EXPECT_THAT(NewDefaultTokenSource(),
+              StatusIs(absl::StatusCode::kFailedPrecondition,
+                       HasSubstr("GOOGLE_APPLICATION_CREDENTIALS")));
+}
+
+}  // namespace
+}  // namespace cloud_kms
@@ -21,6 +21,7 @@
 #include "absl/strings/str_split.h"
 #include "absl/strings/strip.h"
 #include "fakekms/fault/fault.grpc.pb.h"
+#include "fakekms/stats/stats.grpc.pb.h"
 #include "glog/logging.h"
 #include "google/cloud/kms/v1/service.grpc.pb.h"
 #include "grpcpp/create_channel.h"
@@ -32,19 +33,24 @@ namespace fakekms {
 // Class Server provides a C++ language binding for launching a Fake KMS
 // server.
 //
-// The binding is implemented by launching the fake server in a child process.
-// Unfortunately, cgo is not an option for our use, because cgo requires clang
-// or gcc, and we compile using MSVC on Windows.
+// On Linux, the fake server is linked into the calling process as a Go
+// c-archive, and listens on a Unix domain socket. cgo is not an option
+// everywhere, because cgo requires clang or gcc, and we compile using MSVC on
+// Windows. On other platforms, the fake server is launched in a child process
+// and the parent captures the child-determined listen address.
 //
-// On both Windows and Posix platforms, the fake server is launched in a child
-// process and the parent captures the child-determined listen address. During
-// the FakeKms object lifetime, the server at listen_addr() is available for
-// use. The FakeKms destructor shuts down the child process and releases all
-// resources associated with the fake.
+// During the Server object lifetime, the server at listen_addr() is available
+// for use. The Server destructor shuts down the fake and releases all
+// resources associated with it.
 class Server {
  public:
+  // Starts a fake in the fastest mode that the platform supports.
   static absl::StatusOr<std::unique_ptr<Server>> New();
 
+  // Starts a fake in a child process. Tests that fork must use this mode, since
+  // an in-process fake does not survive in a forked child.
+  static absl::StatusOr<std::unique_ptr<Server>> NewSubprocess();
+
   virtual ~Server() {}
 
   const std::string& listen_addr() const { return listen_addr_; }
@@ -59,6 +65,10 @@ class Server {
     return FaultService::NewStub(client_channel_);
   }
 
+  inline std::unique_ptr<StatsService::Stub> NewStatsClient() const {
+    return StatsService::NewStub(client_channel_);
+  }
+
  protected:
   Server(std::string listen_addr) {
     std::vector<std::string> split = absl::StrSplit(listen_addr, '\n');
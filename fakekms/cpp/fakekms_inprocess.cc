@@ -0,0 +1,56 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdlib>
+
+#include "absl/strings/str_cat.h"
+#include "fakekms/cpp/fakekms.h"
+
+// Exported by the Go c-archive built from inprocess.go.
+extern "C" {
+int FakeKmsStart(long long* id, char** out);
+void FakeKmsStop(long long id);
+}
+
+namespace fakekms {
+namespace {
+
+class InProcessServer : public Server {
+ public:
+  InProcessServer(std::string listen_addr, long long id)
+      : Server(listen_addr), id_(id) {}
+
+  ~InProcessServer() { FakeKmsStop(id_); }
+
+ private:
+  long long id_;
+};
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<Server>> Server::New() {
+  long long id;
+  char* out = nullptr;
+  int result = FakeKmsStart(&id, &out);
+  std::string message(out);
+  free(out);
+
+  if (result != 0) {
+    return absl::InternalError(
+        absl::StrCat("error starting in-process fakekms: ", message));
+  }
+  return std::make_unique<InProcessServer>(message, id);
+}
+
+}  // namespace fakekms
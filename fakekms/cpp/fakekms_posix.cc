@@ -42,7 +42,7 @@ absl::Status PosixErrorToStatus(std::string_view prefix) {
 
 }  // namespace
 
-absl::StatusOr<std::unique_ptr<Server>> Server::New() {
+absl::StatusOr<std::unique_ptr<Server>> Server::NewSubprocess() {
   int fd[2];
   if (pipe(fd) == -1) {
     return PosixErrorToStatus("unable to create output pipe");
@@ -97,4 +97,10 @@ absl::StatusOr<std::unique_ptr<Server>> Server::New() {
   }
 }
 
+#ifndef FAKEKMS_IN_PROCESS
+absl::StatusOr<std::unique_ptr<Server>> Server::New() {
+  return NewSubprocess();
+}
+#endif
+
 }  // namespace fakekms
\ No newline at end of file
@@ -30,12 +30,8 @@ MATCHER(IsOk, absl::StrFormat("status is %sOK", negation ? "not " : "")) {
   return arg.ok();
 }
 
-TEST(ServerTest, SmokeTest) {
-  absl::StatusOr<std::unique_ptr<Server>> server = Server::New();
-  ASSERT_THAT(server.status(), IsOk());
-
-  std::unique_ptr<kms_v1::KeyManagementService::Stub> stub =
-      (*server)->NewClient();
+void CreateKeyRingSucceeds(const Server& server) {
+  std::unique_ptr<kms_v1::KeyManagementService::Stub> stub = server.NewClient();
 
   grpc::ClientContext ctx;
 
@@ -50,5 +46,29 @@ TEST(ServerTest, SmokeTest) {
             "projects/my-project/locations/us-central1/keyRings/kr1");
 }
 
+TEST(ServerTest, SmokeTest) {
+  absl::StatusOr<std::unique_ptr<Server>> server = Server::New();
+  ASSERT_THAT(server.status(), IsOk());
+  CreateKeyRingSucceeds(**server);
+}
+
+TEST(ServerTest, SubprocessSmokeTest) {
+  absl::StatusOr<std::unique_ptr<Server>> server = Server::NewSubprocess();
+  ASSERT_THAT(server.status(), IsOk());
+  CreateKeyRingSucceeds(**server);
+}
+
+TEST(ServerTest, ServersDoNotShareState) {
+  absl::StatusOr<std::unique_ptr<Server>> server1 = Server::New();
+  ASSERT_THAT(server1.status(), IsOk());
+  absl::StatusOr<std::unique_ptr<Server>> server2 = Server::New();
+  ASSERT_THAT(server2.status(), IsOk());
+
+  EXPECT_NE((*server1)->listen_addr(), (*server2)->listen_addr());
+  // Each server accepts the same key ring ID.
+  CreateKeyRingSucceeds(**server1);
+  CreateKeyRingSucceeds(**server2);
+}
+
 }  // namespace
 }  // namespace fakekms
@@ -55,7 +55,7 @@ absl::Status Win32ErrorToStatus(std::string_view message) {
 
 }  // namespace
 
-absl::StatusOr<std::unique_ptr<Server>> Server::New() {
+absl::StatusOr<std::unique_ptr<Server>> Server::NewSubprocess() {
   // https://docs.microsoft.com/en-us/windows/win32/procthread/creating-a-child-process-with-redirected-input-and-output
   SECURITY_ATTRIBUTES security_attrs{
       sizeof(SECURITY_ATTRIBUTES),  // nLength
@@ -99,4 +99,8 @@ absl::StatusOr<std::unique_ptr<Server>> Server::New() {
   return std::make_unique<WindowsServer>(address, process_info.hProcess);
 }
 
+absl::StatusOr<std::unique_ptr<Server>> Server::New() {
+  return NewSubprocess();
+}
+
 }  // namespace fakekms
\ No newline at end of file
@@ -15,6 +15,7 @@
 #include "fakekms/cpp/fault_helpers.h"
 
 #include "fakekms/fault/fault.grpc.pb.h"
+#include "fakekms/stats/stats.grpc.pb.h"
 #include "glog/logging.h"
 #include "grpcpp/grpcpp.h"
 
@@ -58,4 +59,34 @@ void AddErrorOrDie(const Server& server, absl::Status error,
   AddResponseActionOrDie(server, method_name, action);
 }
 
+Stats GetStatsOrDie(const Server& server) {
+  grpc::ClientContext ctx;
+  google::protobuf::Empty request;
+  Stats stats;
+  grpc::Status result =
+      server.NewStatsClient()->GetStats(&ctx, request, &stats);
+  CHECK(result.ok()) << "status code: " << result.error_code()
+                     << "; message: " << result.error_message();
+  return stats;
+}
+
+void ResetStatsOrDie(const Server& server) {
+  grpc::ClientContext ctx;
+  google::protobuf::Empty request, response;
+  grpc::Status result =
+      server.NewStatsClient()->ResetStats(&ctx, request, &response);
+  CHECK(result.ok()) << "status code: " << result.error_code()
+                     << "; message: " << result.error_message();
+}
+
+int64_t CallCount(const Stats& stats, std::string_view method_name) {
+  int64_t count = 0;
+  for (const MethodStats& method : stats.methods()) {
+    if (method_name.empty() || method.method_name() == method_name) {
+      count += method.call_count();
+    }
+  }
+  return count;
+}
+
 }  // namespace fakekms
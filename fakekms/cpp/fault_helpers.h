@@ -23,6 +23,7 @@
 #include "absl/time/time.h"
 #include "fakekms/cpp/fakekms.h"
 #include "fakekms/fault/fault.grpc.pb.h"
+#include "fakekms/stats/stats.grpc.pb.h"
 
 namespace fakekms {
 
@@ -32,6 +33,16 @@ void AddDelayOrDie(const Server& server, absl::Duration delay,
 void AddErrorOrDie(const Server& server, absl::Status error,
                    std::string_view method_name = "");
 
+// Returns the counters for the KMS calls that the server has received since it
+// started, or since the last call to ResetStatsOrDie.
+Stats GetStatsOrDie(const Server& server);
+
+void ResetStatsOrDie(const Server& server);
+
+// Returns the number of calls to method_name in stats, or the number of calls
+// to all methods if method_name is empty.
+int64_t CallCount(const Stats& stats, std::string_view method_name = "");
+
 }  // namespace fakekms
 
 #endif  // FAKEKMS_CPP_FAULT_HELPERS_H_
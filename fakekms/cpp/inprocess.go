@@ -0,0 +1,112 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Binary inprocess exports a C interface for running Fake KMS servers inside
+// the calling process. It is built as a c-archive and linked into C++ tests
+// by fakekms_inprocess.cc.
+package main
+
+// #include <stdlib.h>
+import "C"
+
+import (
+	"net"
+	"os"
+	"path/filepath"
+	"sync"
+
+	"cloud.google.com/kms/integrations/fakekms"
+)
+
+type server struct {
+	srv *fakekms.Server
+	dir string
+}
+
+var (
+	mu      sync.Mutex
+	servers = make(map[C.longlong]server)
+	nextID  C.longlong
+)
+
+// maxSocketPath is a conservative bound on the length of a Unix domain socket
+// path; sockaddr_un.sun_path is 108 bytes on Linux.
+const maxSocketPath = 100
+
+// listen returns a listener on a Unix domain socket in a new temporary
+// directory, and the directory's path.
+func listen() (net.Listener, string, error) {
+	dir, err := os.MkdirTemp("", "fakekms")
+	if err != nil {
+		return nil, "", err
+	}
+	if len(dir) > maxSocketPath-len("/socket") {
+		// TMPDIR may be deep inside a test sandbox; fall back to /tmp.
+		os.RemoveAll(dir)
+		if dir, err = os.MkdirTemp("/tmp", "fakekms"); err != nil {
+			return nil, "", err
+		}
+	}
+	lis, err := net.Listen("unix", filepath.Join(dir, "socket"))
+	if err != nil {
+		os.RemoveAll(dir)
+		return nil, "", err
+	}
+	return lis, dir, nil
+}
+
+// FakeKmsStart starts a new server. On success, it returns 0, sets *id to an
+// identifier for the server, and sets *out to the server's gRPC target. On
+// failure, it returns 1 and sets *out to an error message. In either case, the
+// caller must release *out with free().
+//
+//export FakeKmsStart
+func FakeKmsStart(id *C.longlong, out **C.char) C.int {
+	lis, dir, err := listen()
+	if err != nil {
+		*out = C.CString(err.Error())
+		return 1
+	}
+	srv, err := fakekms.NewServerWithOptions(fakekms.ServerOptions{Listener: lis})
+	if err != nil {
+		os.RemoveAll(dir)
+		*out = C.CString(err.Error())
+		return 1
+	}
+
+	mu.Lock()
+	defer mu.Unlock()
+	nextID++
+	servers[nextID] = server{srv: srv, dir: dir}
+	*id = nextID
+	*out = C.CString("unix:" + srv.Addr.String())
+	return 0
+}
+
+// FakeKmsStop stops the server identified by id and releases its resources.
+//
+//export FakeKmsStop
+func FakeKmsStop(id C.longlong) {
+	mu.Lock()
+	s, ok := servers[id]
+	delete(servers, id)
+	mu.Unlock()
+
+	if ok {
+		s.srv.Close()
+		os.RemoveAll(s.dir)
+	}
+}
+
+func main() {}
@@ -87,7 +87,7 @@ func (f *fakeKMS) CreateCryptoKey(ctx context.Context, req *kmspb.CreateCryptoKe
 	}
 
 	if !req.SkipInitialVersionCreation {
-		ckv := f.createVersion(ck)
+		ckv := f.createVersion(kr, ck)
 		if purpose == kmspb.CryptoKey_ENCRYPT_DECRYPT {
 			pb.Primary = ckv
 		}
@@ -16,6 +16,7 @@ package fakekms
 
 import (
 	"context"
+	"crypto/sha256"
 	"sort"
 	"strconv"
 	"time"
@@ -40,12 +41,13 @@ func (f *fakeKMS) CreateCryptoKeyVersion(ctx context.Context, req *kmspb.CreateC
 		return nil, err
 	}
 
-	return f.createVersion(ck), nil
+	return f.createVersion(f.keyRings[ckName.keyRingName], ck), nil
 }
 
-// createVersion adds a new version to the provided cryptoKey and returns its proto.
-// Callers must already be holding f.mux (normally via the locking interceptor).
-func (f *fakeKMS) createVersion(ck *cryptoKey) *kmspb.CryptoKeyVersion {
+// createVersion adds a new version to the provided cryptoKey, which belongs to
+// the provided keyRing, and returns its proto. Callers must already be holding
+// kr.mux for writing (normally via the locking interceptor).
+func (f *fakeKMS) createVersion(kr *keyRing, ck *cryptoKey) *kmspb.CryptoKeyVersion {
 	ckName, _ := parseCryptoKeyName(ck.pb.Name)
 	name := cryptoKeyVersionName{
 		cryptoKeyName:      ckName,
@@ -66,15 +68,16 @@ func (f *fakeKMS) createVersion(ck *cryptoKey) *kmspb.CryptoKeyVersion {
 		// async generation
 		pb.State = kmspb.CryptoKeyVersion_PENDING_GENERATION
 		go func() {
-			k := def.KeyFactory.Generate() // no need to wait on the lock for this
+			k := f.newKeyMaterial(def, name) // no need to wait on the lock for this
 
-			// Our lock interceptor ensures that f.mux is held whenever an RPC is in
-			// flight. This goroutine won't be able to acquire f.mux until after the
-			// CreateCryptoKeyVersion RPC completes. Since all RPCs acquire f.mux, we
-			// can further guarantee that no other RPCs are in flight when this
+			// Our lock interceptor ensures that kr.mux is held whenever an RPC on
+			// this key ring is in flight. This goroutine won't be able to acquire
+			// kr.mux until after the CreateCryptoKeyVersion RPC completes. Since all
+			// RPCs on this key ring acquire kr.mux, we can further guarantee that no
+			// other RPCs that might observe this version are in flight when this
 			// routine proceeds.
-			f.mux.Lock()
-			defer f.mux.Unlock()
+			kr.mux.Lock()
+			defer kr.mux.Unlock()
 
 			ckv.keyMaterial = k
 			pb.State = kmspb.CryptoKeyVersion_ENABLED
@@ -82,7 +85,7 @@ func (f *fakeKMS) createVersion(ck *cryptoKey) *kmspb.CryptoKeyVersion {
 		}()
 	} else {
 		// sync generation
-		ckv.keyMaterial = def.KeyFactory.Generate()
+		ckv.keyMaterial = f.newKeyMaterial(def, name)
 		pb.GenerateTime = pb.CreateTime
 		pb.State = kmspb.CryptoKeyVersion_ENABLED
 	}
@@ -91,6 +94,17 @@ func (f *fakeKMS) createVersion(ck *cryptoKey) *kmspb.CryptoKeyVersion {
 	return pb
 }
 
+// newKeyMaterial returns key material for the named key version.
+func (f *fakeKMS) newKeyMaterial(def algDef, name cryptoKeyVersionName) interface{} {
+	if f.keySeed == nil {
+		return def.KeyFactory.Generate()
+	}
+	h := sha256.New()
+	h.Write(f.keySeed)
+	h.Write([]byte(name.String()))
+	return def.KeyFactory.Derive(h.Sum(nil))
+}
+
 // GetCryptoKeyVersion fakes a Cloud KMS API function.
 func (f *fakeKMS) GetCryptoKeyVersion(ctx context.Context, req *kmspb.GetCryptoKeyVersionRequest) (*kmspb.CryptoKeyVersion, error) {
 	if err := allowlist("name").check(req); err != nil {
@@ -17,15 +17,19 @@
 package fakekms
 
 import (
+	"context"
 	"net"
 	"sync"
 	"time"
 
 	"cloud.google.com/kms/integrations/fakekms/fault"
+	"cloud.google.com/kms/integrations/fakekms/stats"
 	"google.golang.org/grpc"
 
 	"cloud.google.com/go/kms/apiv1/kmspb"
 	"cloud.google.com/kms/integrations/fakekms/fault/faultpb"
+	"cloud.google.com/kms/integrations/fakekms/state/statepb"
+	"cloud.google.com/kms/integrations/fakekms/stats/statspb"
 )
 
 // maxPageSize is the maximum number of elements that will be returned in
@@ -37,8 +41,13 @@ type fakeKMS struct {
 	kmspb.UnimplementedKeyManagementServiceServer
 	keyRings map[keyRingName]*keyRing
 
+	// If set, key material is derived from keySeed instead of being generated.
+	keySeed []byte
+
 	// Protects keyRings. For guarding object use within RPCs, the lock is held
-	// in the lock interceptor rather than directly in the RPC function.
+	// in the lock interceptor rather than directly in the RPC function. RPCs
+	// that are scoped to a key ring hold this lock for reading, and also hold
+	// the key ring's lock.
 	mux sync.RWMutex
 }
 
@@ -46,6 +55,10 @@ type fakeKMS struct {
 type keyRing struct {
 	pb   *kmspb.KeyRing
 	keys map[cryptoKeyName]*cryptoKey
+
+	// Protects keys, and the crypto keys and versions they contain. Like
+	// fakeKMS.mux, the lock is held in the lock interceptor.
+	mux sync.RWMutex
 }
 
 // cryptoKey models a CryptoKey in Cloud KMS.
@@ -88,10 +101,68 @@ func (f *fakeKMS) cryptoKeyVersion(name cryptoKeyVersionName) (*cryptoKeyVersion
 	return ckv, nil
 }
 
+// algorithmName returns the name of the algorithm of the key version or crypto
+// key named by resourceName, or "" if there is no such key. Unlike RPC
+// functions, it acquires the locks it needs.
+func (f *fakeKMS) algorithmName(resourceName string) string {
+	ckvName, err := parseCryptoKeyVersionName(resourceName)
+	isVersion := err == nil
+	ckName := ckvName.cryptoKeyName
+	if !isVersion {
+		if ckName, err = parseCryptoKeyName(resourceName); err != nil {
+			return ""
+		}
+	}
+
+	f.mux.RLock()
+	defer f.mux.RUnlock()
+	kr, ok := f.keyRings[ckName.keyRingName]
+	if !ok {
+		return ""
+	}
+	kr.mux.RLock()
+	defer kr.mux.RUnlock()
+
+	alg := kmspb.CryptoKeyVersion_CRYPTO_KEY_VERSION_ALGORITHM_UNSPECIFIED
+	if isVersion {
+		ckv, err := f.cryptoKeyVersion(ckvName)
+		if err != nil {
+			return ""
+		}
+		alg = ckv.pb.Algorithm
+	} else {
+		ck, err := f.cryptoKey(ckName)
+		if err != nil {
+			return ""
+		}
+		alg = ck.pb.VersionTemplate.Algorithm
+	}
+	return kmspb.CryptoKeyVersion_CryptoKeyVersionAlgorithm_name[int32(alg)]
+}
+
 // Server wraps a local gRPC server that serves KMS requests.
 type Server struct {
 	Addr       net.Addr
 	grpcServer *grpc.Server
+	fakeKMS    *fakeKMS
+}
+
+// Seed creates the resources described by spec, like StateService.Seed.
+func (s *Server) Seed(spec *statepb.SeedSpec) error {
+	_, err := s.fakeKMS.seed(spec)
+	return err
+}
+
+// SaveSnapshot writes the server's state to a file, like
+// StateService.SaveSnapshot.
+func (s *Server) SaveSnapshot(path string) error {
+	return s.fakeKMS.saveSnapshot(path)
+}
+
+// LoadSnapshot replaces the server's state with the contents of a file, like
+// StateService.LoadSnapshot.
+func (s *Server) LoadSnapshot(path string) error {
+	return s.fakeKMS.loadSnapshot(path)
 }
 
 // Close stops the server by immediately closing all connections and listeners.
@@ -101,24 +172,58 @@ func (s *Server) Close() {
 
 // ServerOptions contains options for the FakeKMS server.
 type ServerOptions struct {
-	// The amount of time each request should be delayed before processing.
+	// The amount of time each KMS request should be delayed before processing.
 	Delay time.Duration
+
+	// If set, the key material for each key version is derived from KeySeed
+	// and the key version's name, so that a key version has the same key
+	// material in every server that uses the same seed. RSA key material comes
+	// from pre-generated keys in testdata in every mode.
+	KeySeed []byte
+
+	// If set, the server starts with this performance profile, as if it had
+	// been set with FaultService.SetPerformanceProfile.
+	PerformanceProfile *faultpb.PerformanceProfile
+
+	// If set, the server accepts connections on Listener, and closes it when
+	// the server is closed. If unset, the server listens on a new TCP port on
+	// localhost.
+	Listener net.Listener
 }
 
 // NewServer starts a new local Fake KMS server that is listening for gRPC requests.
 func NewServer() (*Server, error) {
-	lis, err := net.Listen("tcp", "localhost:0")
-	if err != nil {
-		return nil, err
+	return NewServerWithOptions(ServerOptions{})
+}
+
+// NewServerWithOptions starts a new local Fake KMS server that is listening for
+// gRPC requests, and that behaves according to the provided options.
+func NewServerWithOptions(opts ServerOptions) (*Server, error) {
+	lis := opts.Listener
+	if lis == nil {
+		var err error
+		if lis, err = net.Listen("tcp", "localhost:0"); err != nil {
+			return nil, err
+		}
 	}
 
-	fakeKMS := &fakeKMS{keyRings: make(map[keyRingName]*keyRing)}
-	faultServer := &fault.Server{}
-	s := grpc.NewServer(grpc.ChainUnaryInterceptor(
-		faultServer.NewInterceptor(), newLockInterceptor(&fakeKMS.mux)))
+	fakeKMS := &fakeKMS{keyRings: make(map[keyRingName]*keyRing), keySeed: opts.KeySeed}
+	faultServer := &fault.Server{ResourceAlgorithm: fakeKMS.algorithmName}
+	if opts.PerformanceProfile != nil {
+		if _, err := faultServer.SetPerformanceProfile(context.Background(), opts.PerformanceProfile); err != nil {
+			lis.Close()
+			return nil, err
+		}
+	}
+	statsServer := new(stats.Server)
+	s := grpc.NewServer(grpc.ChainUnaryInterceptor(statsServer.NewInterceptor(),
+		newDelayInterceptor(opts.Delay), faultServer.NewInterceptor(),
+		newLockInterceptor(fakeKMS)))
 	kmspb.RegisterKeyManagementServiceServer(s, fakeKMS)
 	faultpb.RegisterFaultServiceServer(s, faultServer)
+	statepb.RegisterStateServiceServer(s, &stateServer{f: fakeKMS})
+	statspb.RegisterStatsServiceServer(s, statsServer)
 
 	go s.Serve(lis)
-	return &Server{Addr: lis.Addr(), grpcServer: s}, nil
+	return &Server{Addr: lis.Addr(), grpcServer: s, fakeKMS: fakeKMS}, nil
 }
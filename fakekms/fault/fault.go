@@ -18,20 +18,30 @@ import (
 	"context"
 	"strings"
 	"sync"
+	"sync/atomic"
 	"time"
 
 	"google.golang.org/grpc"
+	"google.golang.org/grpc/codes"
 	"google.golang.org/grpc/status"
 
 	"cloud.google.com/kms/integrations/fakekms/fault/faultpb"
+	"cloud.google.com/kms/integrations/fakekms/resource"
 	"google.golang.org/protobuf/types/known/emptypb"
 )
 
 var _ faultpb.FaultServiceServer = (*Server)(nil)
 
 type Server struct {
+	// If set, ResourceAlgorithm returns the algorithm name of the key named by
+	// a request's resource name, or "" if the resource is not a key. It is used
+	// to match profile rules on algorithm.
+	ResourceAlgorithm func(resourceName string) string
+
 	lock   sync.Mutex
 	faults []*faultpb.Fault
+
+	profile atomic.Pointer[profile]
 }
 
 func (s *Server) AddFault(ctx context.Context, fault *faultpb.Fault) (*emptypb.Empty, error) {
@@ -42,6 +52,43 @@ func (s *Server) AddFault(ctx context.Context, fault *faultpb.Fault) (*emptypb.E
 	return &emptypb.Empty{}, nil
 }
 
+func (s *Server) SetPerformanceProfile(ctx context.Context, pb *faultpb.PerformanceProfile) (*emptypb.Empty, error) {
+	p, err := newProfile(pb)
+	if err != nil {
+		return nil, status.Errorf(codes.InvalidArgument, "invalid performance profile: %v", err)
+	}
+	s.profile.Store(p)
+	return &emptypb.Empty{}, nil
+}
+
+// applyProfile applies the performance profile to a request, and returns an
+// error if the request should fail.
+func (s *Server) applyProfile(ctx context.Context, method string, req interface{}) error {
+	p := s.profile.Load()
+	if p == nil {
+		return nil
+	}
+
+	r := &request{method: method, resource: resource.Name(req)}
+	if p.needsAlgorithm && s.ResourceAlgorithm != nil && r.resource != "" {
+		r.algorithm = s.ResourceAlgorithm(r.resource)
+	}
+
+	if err := p.checkQuota(r, time.Now()); err != nil {
+		return err
+	}
+	if d := p.latency(r); d > 0 {
+		t := time.NewTimer(d)
+		select {
+		case <-t.C:
+		case <-ctx.Done():
+			t.Stop()
+			return status.FromContextError(ctx.Err()).Err()
+		}
+	}
+	return p.injectedError(r)
+}
+
 // Returns an appropriate ResponseAction for the method, or nil if
 // normal processing should be used.
 func (s *Server) findFaultResponse(method string) *faultpb.ResponseAction {
@@ -68,8 +115,9 @@ func (s *Server) findFaultResponse(method string) *faultpb.ResponseAction {
 
 func (s *Server) NewInterceptor() grpc.UnaryServerInterceptor {
 	return func(ctx context.Context, req interface{}, info *grpc.UnaryServerInfo, handler grpc.UnaryHandler) (interface{}, error) {
-		// Don't attempt to match on requests meant for the FaultService.
-		if strings.HasPrefix(info.FullMethod, "/fakekms.FaultService/") {
+		// Don't attempt to match on requests meant for the FaultService, or
+		// other fakekms control services.
+		if strings.HasPrefix(info.FullMethod, "/fakekms.") {
 			return handler(ctx, req)
 		}
 
@@ -82,6 +130,9 @@ func (s *Server) NewInterceptor() grpc.UnaryServerInterceptor {
 		if action.GetError() != nil {
 			return nil, status.ErrorProto(action.Error)
 		}
+		if err := s.applyProfile(ctx, method, req); err != nil {
+			return nil, err
+		}
 		return handler(ctx, req)
 	}
 }
@@ -0,0 +1,246 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package fault
+
+import (
+	"fmt"
+	"math"
+	"math/rand"
+	"sort"
+	"strings"
+	"sync"
+	"time"
+
+	"google.golang.org/grpc/codes"
+	"google.golang.org/grpc/status"
+	"google.golang.org/protobuf/proto"
+
+	"cloud.google.com/kms/integrations/fakekms/fault/faultpb"
+)
+
+// profile is the active form of a faultpb.PerformanceProfile.
+type profile struct {
+	pb *faultpb.PerformanceProfile
+
+	// needsAlgorithm is true if any rule matches on algorithm.
+	needsAlgorithm bool
+
+	// Protects buckets.
+	lock    sync.Mutex
+	buckets map[bucketKey]*tokenBucket
+}
+
+type bucketKey struct {
+	rule  int
+	scope string
+}
+
+func validateLatency(d *faultpb.LatencyDistribution) error {
+	switch {
+	case d.GetConstant() != nil, d.GetNormal() != nil, d.GetLogNormal() != nil:
+		return nil
+	case d.GetHistogram() != nil:
+		buckets := d.GetHistogram().GetBuckets()
+		if len(buckets) == 0 {
+			return fmt.Errorf("histogram has no buckets")
+		}
+		total := 0.0
+		for i, b := range buckets {
+			if b.GetWeight() < 0 {
+				return fmt.Errorf("histogram bucket %d has negative weight", i)
+			}
+			if i > 0 && b.GetUpperBound().AsDuration() < buckets[i-1].GetUpperBound().AsDuration() {
+				return fmt.Errorf("histogram buckets are not sorted by upper_bound")
+			}
+			total += b.GetWeight()
+		}
+		if total <= 0 {
+			return fmt.Errorf("histogram has no weight")
+		}
+		return nil
+	default:
+		return fmt.Errorf("latency distribution is not set")
+	}
+}
+
+func newProfile(pb *faultpb.PerformanceProfile) (*profile, error) {
+	p := &profile{pb: proto.Clone(pb).(*faultpb.PerformanceProfile), buckets: make(map[bucketKey]*tokenBucket)}
+
+	for i, r := range pb.LatencyRules {
+		if err := validateLatency(r.GetLatency()); err != nil {
+			return nil, fmt.Errorf("latency rule %d: %v", i, err)
+		}
+		p.needsAlgorithm = p.needsAlgorithm || r.GetMatcher().GetAlgorithm() != ""
+	}
+	for i, r := range pb.QuotaRules {
+		if r.GetScope() == faultpb.QuotaRule_SCOPE_UNSPECIFIED {
+			return nil, fmt.Errorf("quota rule %d: scope is not set", i)
+		}
+		if r.GetQueriesPerSecond() <= 0 {
+			return nil, fmt.Errorf("quota rule %d: queries_per_second must be positive", i)
+		}
+		p.needsAlgorithm = p.needsAlgorithm || r.GetMatcher().GetAlgorithm() != ""
+	}
+	for i, r := range pb.ErrorRules {
+		if r.GetProbability() < 0 || r.GetProbability() > 1 {
+			return nil, fmt.Errorf("error rule %d: probability must be in [0, 1]", i)
+		}
+		if r.GetError().GetCode() == int32(codes.OK) {
+			return nil, fmt.Errorf("error rule %d: error code must not be OK", i)
+		}
+		p.needsAlgorithm = p.needsAlgorithm || r.GetMatcher().GetAlgorithm() != ""
+	}
+	return p, nil
+}
+
+// request holds the attributes of a request that profile rules match on.
+type request struct {
+	method, resource, algorithm string
+}
+
+func (r *request) matches(m *faultpb.ProfileMatcher) bool {
+	return (m.GetMethodName() == "" || m.GetMethodName() == r.method) &&
+		(m.GetAlgorithm() == "" || m.GetAlgorithm() == r.algorithm)
+}
+
+// quotaScope returns the bucket scope for resource, or "" if the resource is
+// not subject to the rule.
+func quotaScope(scope faultpb.QuotaRule_Scope, resource string) string {
+	parts := strings.Split(resource, "/")
+	switch scope {
+	case faultpb.QuotaRule_PER_KEY:
+		// projects/p/locations/l/keyRings/kr/cryptoKeys/ck[/cryptoKeyVersions/v]
+		if len(parts) >= 8 && parts[6] == "cryptoKeys" {
+			return strings.Join(parts[:8], "/")
+		}
+	case faultpb.QuotaRule_PER_PROJECT:
+		if len(parts) >= 2 && parts[0] == "projects" {
+			return strings.Join(parts[:2], "/")
+		}
+	}
+	return ""
+}
+
+// checkQuota consumes a token from each matching quota, and returns an error
+// if any quota is exhausted.
+func (p *profile) checkQuota(r *request, now time.Time) error {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+
+	for i, rule := range p.pb.QuotaRules {
+		if !r.matches(rule.GetMatcher()) {
+			continue
+		}
+		scope := quotaScope(rule.GetScope(), r.resource)
+		if scope == "" {
+			continue
+		}
+		key := bucketKey{rule: i, scope: scope}
+		b, ok := p.buckets[key]
+		if !ok {
+			b = newTokenBucket(rule.GetQueriesPerSecond(), rule.GetBurst(), now)
+			p.buckets[key] = b
+		}
+		if !b.take(now) {
+			return status.Errorf(codes.ResourceExhausted, "quota exceeded for %s (%g queries per second)",
+				scope, rule.GetQueriesPerSecond())
+		}
+	}
+	return nil
+}
+
+// latency returns the latency for the request.
+func (p *profile) latency(r *request) time.Duration {
+	for _, rule := range p.pb.LatencyRules {
+		if r.matches(rule.GetMatcher()) {
+			return sampleLatency(rule.GetLatency())
+		}
+	}
+	return 0
+}
+
+// injectedError returns an error if one of the error rules fails the request.
+func (p *profile) injectedError(r *request) error {
+	for _, rule := range p.pb.ErrorRules {
+		if r.matches(rule.GetMatcher()) && rand.Float64() < rule.GetProbability() {
+			return status.ErrorProto(rule.GetError())
+		}
+	}
+	return nil
+}
+
+func sampleLatency(d *faultpb.LatencyDistribution) time.Duration {
+	var seconds float64
+	switch {
+	case d.GetConstant() != nil:
+		return d.GetConstant().AsDuration()
+	case d.GetNormal() != nil:
+		n := d.GetNormal()
+		seconds = n.GetMean().AsDuration().Seconds() + rand.NormFloat64()*n.GetStddev().AsDuration().Seconds()
+	case d.GetLogNormal() != nil:
+		ln := d.GetLogNormal()
+		seconds = ln.GetMedian().AsDuration().Seconds() * math.Exp(ln.GetSigma()*rand.NormFloat64())
+	case d.GetHistogram() != nil:
+		buckets := d.GetHistogram().GetBuckets()
+		cumulative := make([]float64, len(buckets))
+		total := 0.0
+		for i, b := range buckets {
+			total += b.GetWeight()
+			cumulative[i] = total
+		}
+		i := sort.SearchFloat64s(cumulative, rand.Float64()*total)
+		if i == len(buckets) {
+			i = len(buckets) - 1
+		}
+		lower := 0.0
+		if i > 0 {
+			lower = buckets[i-1].GetUpperBound().AsDuration().Seconds()
+		}
+		upper := buckets[i].GetUpperBound().AsDuration().Seconds()
+		seconds = lower + rand.Float64()*(upper-lower)
+	}
+	if seconds <= 0 {
+		return 0
+	}
+	return time.Duration(seconds * float64(time.Second))
+}
+
+// tokenBucket is a token bucket rate limiter. It is not safe for concurrent
+// use.
+type tokenBucket struct {
+	rate, burst, tokens float64
+	last                time.Time
+}
+
+func newTokenBucket(qps float64, burst uint32, now time.Time) *tokenBucket {
+	b := float64(burst)
+	if b == 0 {
+		b = math.Max(1, math.Ceil(qps))
+	}
+	return &tokenBucket{rate: qps, burst: b, tokens: b, last: now}
+}
+
+// take consumes a token if one is available, and reports whether it did.
+func (b *tokenBucket) take(now time.Time) bool {
+	if elapsed := now.Sub(b.last).Seconds(); elapsed > 0 {
+		b.tokens = math.Min(b.burst, b.tokens+elapsed*b.rate)
+		b.last = now
+	}
+	if b.tokens < 1 {
+		return false
+	}
+	b.tokens--
+	return true
+}
@@ -0,0 +1,200 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package fault
+
+import (
+	"context"
+	"testing"
+	"time"
+
+	"google.golang.org/grpc/codes"
+	"google.golang.org/grpc/status"
+
+	"cloud.google.com/kms/integrations/fakekms/fault/faultpb"
+	"cloud.google.com/kms/integrations/fakekms/fault/mathpb"
+	statuspb "google.golang.org/genproto/googleapis/rpc/status"
+	"google.golang.org/protobuf/types/known/durationpb"
+)
+
+func TestProfileErrorRuleFailsMatchingMethod(t *testing.T) {
+	ctx := context.Background()
+	conn, cancel, err := startTestServer(ctx)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer cancel()
+
+	faultClient := faultpb.NewFaultServiceClient(conn)
+	_, err = faultClient.SetPerformanceProfile(ctx, &faultpb.PerformanceProfile{
+		ErrorRules: []*faultpb.ErrorRule{{
+			Matcher:     &faultpb.ProfileMatcher{MethodName: "Add"},
+			Probability: 1,
+			Error:       &statuspb.Status{Code: int32(codes.Unavailable)},
+		}},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	mathClient := mathpb.NewMathServiceClient(conn)
+	// The rule is persistent: every matching request fails.
+	for i := 0; i < 3; i++ {
+		if _, err := mathClient.Add(ctx, &mathpb.AddRequest{}); status.Code(err) != codes.Unavailable {
+			t.Errorf("status.Code(err)=%v, want Unavailable", status.Code(err))
+		}
+	}
+	if _, err := mathClient.Multiply(ctx, &mathpb.MultiplyRequest{}); err != nil {
+		t.Errorf("Multiply returned error %v", err)
+	}
+
+	// An empty profile removes the rule.
+	if _, err := faultClient.SetPerformanceProfile(ctx, &faultpb.PerformanceProfile{}); err != nil {
+		t.Fatal(err)
+	}
+	if _, err := mathClient.Add(ctx, &mathpb.AddRequest{}); err != nil {
+		t.Errorf("Add returned error %v", err)
+	}
+}
+
+func TestProfileLatencyRuleDelaysRequests(t *testing.T) {
+	ctx := context.Background()
+	conn, cancel, err := startTestServer(ctx)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer cancel()
+
+	const delay = 50 * time.Millisecond
+	faultClient := faultpb.NewFaultServiceClient(conn)
+	_, err = faultClient.SetPerformanceProfile(ctx, &faultpb.PerformanceProfile{
+		LatencyRules: []*faultpb.LatencyRule{{
+			Latency: &faultpb.LatencyDistribution{
+				Distribution: &faultpb.LatencyDistribution_Constant{Constant: durationpb.New(delay)},
+			},
+		}},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	mathClient := mathpb.NewMathServiceClient(conn)
+	start := time.Now()
+	if _, err := mathClient.Add(ctx, &mathpb.AddRequest{}); err != nil {
+		t.Fatal(err)
+	}
+	if elapsed := time.Since(start); elapsed < delay {
+		t.Errorf("elapsed=%v, want at least %v", elapsed, delay)
+	}
+}
+
+func TestSetPerformanceProfileRejectsInvalidProfile(t *testing.T) {
+	ctx := context.Background()
+	conn, cancel, err := startTestServer(ctx)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer cancel()
+
+	faultClient := faultpb.NewFaultServiceClient(conn)
+	_, err = faultClient.SetPerformanceProfile(ctx, &faultpb.PerformanceProfile{
+		QuotaRules: []*faultpb.QuotaRule{{Scope: faultpb.QuotaRule_PER_KEY}},
+	})
+	if status.Code(err) != codes.InvalidArgument {
+		t.Errorf("status.Code(err)=%v, want InvalidArgument", status.Code(err))
+	}
+}
+
+func TestQuotaIsEnforcedPerKey(t *testing.T) {
+	p, err := newProfile(&faultpb.PerformanceProfile{
+		QuotaRules: []*faultpb.QuotaRule{{
+			Scope:            faultpb.QuotaRule_PER_KEY,
+			QueriesPerSecond: 1,
+			Burst:            2,
+		}},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	const ck1 = "projects/p/locations/l/keyRings/kr/cryptoKeys/ck1"
+	const ck2 = "projects/p/locations/l/keyRings/kr/cryptoKeys/ck2"
+	now := time.Now()
+	for i := 0; i < 2; i++ {
+		if err := p.checkQuota(&request{resource: ck1 + "/cryptoKeyVersions/1"}, now); err != nil {
+			t.Fatalf("request %d: %v", i, err)
+		}
+	}
+	if err := p.checkQuota(&request{resource: ck1}, now); status.Code(err) != codes.ResourceExhausted {
+		t.Errorf("status.Code(err)=%v, want ResourceExhausted", status.Code(err))
+	}
+	if err := p.checkQuota(&request{resource: ck2}, now); err != nil {
+		t.Errorf("request for another key: %v", err)
+	}
+	// One token is added back after a second.
+	if err := p.checkQuota(&request{resource: ck1}, now.Add(time.Second)); err != nil {
+		t.Errorf("request after refill: %v", err)
+	}
+}
+
+func TestQuotaScope(t *testing.T) {
+	for _, c := range []struct {
+		scope          faultpb.QuotaRule_Scope
+		resource, want string
+	}{
+		{faultpb.QuotaRule_PER_KEY, "projects/p/locations/l/keyRings/kr/cryptoKeys/ck/cryptoKeyVersions/1", "projects/p/locations/l/keyRings/kr/cryptoKeys/ck"},
+		{faultpb.QuotaRule_PER_KEY, "projects/p/locations/l/keyRings/kr", ""},
+		{faultpb.QuotaRule_PER_PROJECT, "projects/p/locations/l/keyRings/kr", "projects/p"},
+		{faultpb.QuotaRule_PER_PROJECT, "", ""},
+	} {
+		if got := quotaScope(c.scope, c.resource); got != c.want {
+			t.Errorf("quotaScope(%v, %q)=%q, want %q", c.scope, c.resource, got, c.want)
+		}
+	}
+}
+
+func TestSampleLatencyStaysInHistogramBounds(t *testing.T) {
+	d := &faultpb.LatencyDistribution{
+		Distribution: &faultpb.LatencyDistribution_Histogram_{Histogram: &faultpb.LatencyDistribution_Histogram{
+			Buckets: []*faultpb.LatencyDistribution_Histogram_Bucket{
+				{UpperBound: durationpb.New(10 * time.Millisecond), Weight: 0},
+				{UpperBound: durationpb.New(20 * time.Millisecond), Weight: 1},
+			},
+		}},
+	}
+	for i := 0; i < 1000; i++ {
+		if l := sampleLatency(d); l < 10*time.Millisecond || l > 20*time.Millisecond {
+			t.Fatalf("sampleLatency=%v, want in [10ms, 20ms]", l)
+		}
+	}
+}
+
+func TestSampleLatencyLogNormalMedian(t *testing.T) {
+	d := &faultpb.LatencyDistribution{
+		Distribution: &faultpb.LatencyDistribution_LogNormal_{LogNormal: &faultpb.LatencyDistribution_LogNormal{
+			Median: durationpb.New(10 * time.Millisecond),
+			Sigma:  0.5,
+		}},
+	}
+	below := 0
+	const n = 10000
+	for i := 0; i < n; i++ {
+		if sampleLatency(d) < 10*time.Millisecond {
+			below++
+		}
+	}
+	if below < n*45/100 || below > n*55/100 {
+		t.Errorf("%d of %d samples were below the median, want about half", below, n)
+	}
+}
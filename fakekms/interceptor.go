@@ -17,13 +17,53 @@ package fakekms
 import (
 	"context"
 	"strings"
-	"sync"
+	"time"
 
+	"cloud.google.com/kms/integrations/fakekms/resource"
 	"google.golang.org/grpc"
 	"google.golang.org/protobuf/proto"
 )
 
-func newLockInterceptor(mux *sync.RWMutex) grpc.UnaryServerInterceptor {
+// newDelayInterceptor returns an interceptor that waits for delay before
+// handling each KMS request. Requests to other services are not delayed.
+func newDelayInterceptor(delay time.Duration) grpc.UnaryServerInterceptor {
+	return func(ctx context.Context, req interface{}, info *grpc.UnaryServerInfo, handler grpc.UnaryHandler) (interface{}, error) {
+		if delay > 0 && strings.HasPrefix(info.FullMethod, "/google.cloud.kms.v1.KeyManagementService/") {
+			t := time.NewTimer(delay)
+			select {
+			case <-t.C:
+			case <-ctx.Done():
+				t.Stop()
+				return nil, ctx.Err()
+			}
+		}
+		return handler(ctx, req)
+	}
+}
+
+// keyRingScope returns the name of the key ring that req operates on, if the
+// request names one.
+func keyRingScope(req interface{}) (keyRingName, bool) {
+	name := resource.Name(req)
+
+	// A key ring name has six segments, and names of resources in the key ring
+	// begin with the key ring name.
+	parts := strings.SplitN(name, "/", 7)
+	if len(parts) < 6 {
+		return keyRingName{}, false
+	}
+	krName, err := parseKeyRingName(strings.Join(parts[:6], "/"))
+	return krName, err == nil
+}
+
+// newLockInterceptor returns an interceptor that acquires the locks an RPC
+// needs before handling it.
+//
+// Key ring RPCs lock f.mux. Other RPCs are scoped to a single key ring: they
+// hold f.mux for reading, which prevents key ring creation, and lock only their
+// key ring. Read-only RPCs, including all cryptographic operations, hold locks
+// for reading, so that they can run in parallel with one another on any key.
+func newLockInterceptor(f *fakeKMS) grpc.UnaryServerInterceptor {
 	return func(ctx context.Context, req interface{}, info *grpc.UnaryServerInfo, handler grpc.UnaryHandler) (interface{}, error) {
 		methodParts := strings.Split(info.FullMethod, "/")
 		svc, method := methodParts[1], methodParts[2]
@@ -31,28 +71,34 @@ func newLockInterceptor(mux *sync.RWMutex) grpc.UnaryServerInterceptor {
 		switch svc {
 		case "google.cloud.kms.v1.KeyManagementService":
 			break
-		case "fakekms.FaultService":
+		case "fakekms.FaultService", "fakekms.StateService", "fakekms.StatsService":
 			return handler(ctx, req)
 		default:
 			return nil, errUnimplemented("unsupported service: %s", svc)
 		}
 
-		var locker sync.Locker
+		var unlock func()
 		switch method {
-		case "AsymmetricDecrypt", "AsymmetricSign", "GenerateRandomBytes", "GetCryptoKey",
-			"GetCryptoKeyVersion", "GetKeyRing", "GetPublicKey", "ListCryptoKeys",
-			"ListCryptoKeyVersions", "ListKeyRings", "MacSign", "MacVerify", "RawDecrypt",
-			"RawEncrypt":
-			locker = mux.RLocker()
-		case "CreateCryptoKey", "CreateCryptoKeyVersion", "CreateKeyRing", "DestroyCryptoKeyVersion",
+		case "GenerateRandomBytes":
+			// No state is accessed.
+			unlock = func() {}
+		case "GetKeyRing", "ListKeyRings":
+			f.mux.RLock()
+			unlock = f.mux.RUnlock
+		case "CreateKeyRing":
+			f.mux.Lock()
+			unlock = f.mux.Unlock
+		case "AsymmetricDecrypt", "AsymmetricSign", "GetCryptoKey", "GetCryptoKeyVersion",
+			"GetPublicKey", "ListCryptoKeys", "ListCryptoKeyVersions", "MacSign", "MacVerify",
+			"RawDecrypt", "RawEncrypt":
+			unlock = lockKeyRing(f, req, false)
+		case "CreateCryptoKey", "CreateCryptoKeyVersion", "DestroyCryptoKeyVersion",
 			"UpdateCryptoKey", "UpdateCryptoKeyVersion":
-			locker = mux
+			unlock = lockKeyRing(f, req, true)
 		default:
 			return nil, errUnimplemented("unsupported method: %s", info.FullMethod)
 		}
-
-		locker.Lock()
-		defer locker.Unlock()
+		defer unlock()
 
 		resp, err := handler(ctx, req)
 		if err != nil {
@@ -68,3 +114,32 @@ func newLockInterceptor(mux *sync.RWMutex) grpc.UnaryServerInterceptor {
 		return proto.Clone(respMsg), nil
 	}
 }
+
+// lockKeyRing acquires the locks for an RPC that is scoped to the key ring
+// named in req, and returns a function that releases them. If the key ring
+// does not exist, holding f.mux for reading is sufficient: the RPC will fail,
+// and the key ring cannot be created while the RPC is in flight.
+func lockKeyRing(f *fakeKMS, req interface{}, write bool) func() {
+	f.mux.RLock()
+	krName, ok := keyRingScope(req)
+	if !ok {
+		return f.mux.RUnlock
+	}
+	kr, ok := f.keyRings[krName]
+	if !ok {
+		return f.mux.RUnlock
+	}
+
+	if write {
+		kr.mux.Lock()
+		return func() {
+			kr.mux.Unlock()
+			f.mux.RUnlock()
+		}
+	}
+	kr.mux.RLock()
+	return func() {
+		kr.mux.RUnlock()
+		f.mux.RUnlock()
+	}
+}
@@ -0,0 +1,166 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package fakekms
+
+import (
+	"context"
+	"testing"
+	"time"
+
+	"cloud.google.com/go/kms/apiv1/kmspb"
+	"google.golang.org/grpc"
+)
+
+func noopHandler(ctx context.Context, req interface{}) (interface{}, error) {
+	return req, nil
+}
+
+func TestDelayInterceptorDelaysKMSRequests(t *testing.T) {
+	const delay = 50 * time.Millisecond
+	interceptor := newDelayInterceptor(delay)
+	info := &grpc.UnaryServerInfo{FullMethod: "/google.cloud.kms.v1.KeyManagementService/GetKeyRing"}
+
+	start := time.Now()
+	if _, err := interceptor(context.Background(), nil, info, noopHandler); err != nil {
+		t.Fatal(err)
+	}
+	if elapsed := time.Since(start); elapsed < delay {
+		t.Errorf("elapsed=%v, want at least %v", elapsed, delay)
+	}
+}
+
+func TestDelayInterceptorSkipsOtherServices(t *testing.T) {
+	interceptor := newDelayInterceptor(time.Hour)
+	info := &grpc.UnaryServerInfo{FullMethod: "/fakekms.FaultService/AddFault"}
+
+	if _, err := interceptor(context.Background(), nil, info, noopHandler); err != nil {
+		t.Fatal(err)
+	}
+}
+
+func TestDelayInterceptorHonorsCancellation(t *testing.T) {
+	interceptor := newDelayInterceptor(time.Hour)
+	info := &grpc.UnaryServerInfo{FullMethod: "/google.cloud.kms.v1.KeyManagementService/GetKeyRing"}
+
+	ctx, cancel := context.WithCancel(context.Background())
+	cancel()
+	if _, err := interceptor(ctx, nil, info, noopHandler); err != context.Canceled {
+		t.Errorf("err=%v, want %v", err, context.Canceled)
+	}
+}
+
+func newTestFakeKMS(t *testing.T, keyRingNames ...string) *fakeKMS {
+	t.Helper()
+	f := &fakeKMS{keyRings: make(map[keyRingName]*keyRing)}
+	for _, n := range keyRingNames {
+		name, err := parseKeyRingName(n)
+		if err != nil {
+			t.Fatal(err)
+		}
+		f.keyRings[name] = &keyRing{
+			pb:   &kmspb.KeyRing{Name: n},
+			keys: make(map[cryptoKeyName]*cryptoKey),
+		}
+	}
+	return f
+}
+
+// blockingHandler returns a handler that signals on started when it begins,
+// then waits for release to be closed.
+func blockingHandler(started chan<- struct{}, release <-chan struct{}) grpc.UnaryHandler {
+	return func(ctx context.Context, req interface{}) (interface{}, error) {
+		started <- struct{}{}
+		<-release
+		return &kmspb.CryptoKey{}, nil
+	}
+}
+
+func kmsMethod(name string) *grpc.UnaryServerInfo {
+	return &grpc.UnaryServerInfo{FullMethod: "/google.cloud.kms.v1.KeyManagementService/" + name}
+}
+
+func TestLockInterceptorAllowsConcurrentReadsOnOneKeyRing(t *testing.T) {
+	const kr = "projects/p/locations/l/keyRings/kr"
+	interceptor := newLockInterceptor(newTestFakeKMS(t, kr))
+	req := &kmspb.AsymmetricSignRequest{Name: kr + "/cryptoKeys/ck/cryptoKeyVersions/1"}
+
+	started, release := make(chan struct{}), make(chan struct{})
+	go interceptor(context.Background(), req, kmsMethod("AsymmetricSign"), blockingHandler(started, release))
+	<-started
+
+	// A second read on the same key ring must not wait for the first.
+	done := make(chan struct{})
+	go func() {
+		interceptor(context.Background(), req, kmsMethod("AsymmetricSign"), noopHandler)
+		close(done)
+	}()
+	select {
+	case <-done:
+	case <-time.After(10 * time.Second):
+		t.Error("concurrent read was blocked")
+	}
+	close(release)
+}
+
+func TestLockInterceptorAllowsConcurrentWritesOnDifferentKeyRings(t *testing.T) {
+	const kr1, kr2 = "projects/p/locations/l/keyRings/kr1", "projects/p/locations/l/keyRings/kr2"
+	interceptor := newLockInterceptor(newTestFakeKMS(t, kr1, kr2))
+
+	started, release := make(chan struct{}), make(chan struct{})
+	go interceptor(context.Background(), &kmspb.CreateCryptoKeyRequest{Parent: kr1},
+		kmsMethod("CreateCryptoKey"), blockingHandler(started, release))
+	<-started
+
+	done := make(chan struct{})
+	go func() {
+		interceptor(context.Background(), &kmspb.CreateCryptoKeyRequest{Parent: kr2},
+			kmsMethod("CreateCryptoKey"), func(ctx context.Context, req interface{}) (interface{}, error) {
+				return &kmspb.CryptoKey{}, nil
+			})
+		close(done)
+	}()
+	select {
+	case <-done:
+	case <-time.After(10 * time.Second):
+		t.Error("write on a different key ring was blocked")
+	}
+	close(release)
+}
+
+func TestLockInterceptorSerializesWritesWithReadsOnOneKeyRing(t *testing.T) {
+	const kr = "projects/p/locations/l/keyRings/kr"
+	interceptor := newLockInterceptor(newTestFakeKMS(t, kr))
+
+	started, release := make(chan struct{}), make(chan struct{})
+	go interceptor(context.Background(), &kmspb.CreateCryptoKeyRequest{Parent: kr},
+		kmsMethod("CreateCryptoKey"), blockingHandler(started, release))
+	<-started
+
+	done := make(chan struct{})
+	go func() {
+		interceptor(context.Background(), &kmspb.GetCryptoKeyRequest{Name: kr + "/cryptoKeys/ck"},
+			kmsMethod("GetCryptoKey"), func(ctx context.Context, req interface{}) (interface{}, error) {
+				return &kmspb.CryptoKey{}, nil
+			})
+		close(done)
+	}()
+	select {
+	case <-done:
+		t.Error("read proceeded while a write on the same key ring was in flight")
+	case <-time.After(50 * time.Millisecond):
+	}
+	close(release)
+	<-done
+}
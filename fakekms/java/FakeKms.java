@@ -19,10 +19,16 @@ import com.google.api.gax.grpc.GrpcTransportChannel;
 import com.google.api.gax.rpc.FixedTransportChannelProvider;
 import com.google.api.gax.rpc.TransportChannelProvider;
 import com.google.cloud.kms.v1.KeyManagementServiceClient;
+import com.google.cloud.kms.pkcs11.fakekms.stats.Stats;
 import com.google.cloud.kms.v1.KeyManagementServiceSettings;
 import com.google.devtools.build.runfiles.Runfiles;
+import com.google.protobuf.Empty;
+import io.grpc.CallOptions;
 import io.grpc.ManagedChannel;
 import io.grpc.ManagedChannelBuilder;
+import io.grpc.MethodDescriptor;
+import io.grpc.protobuf.ProtoUtils;
+import io.grpc.stub.ClientCalls;
 import java.io.BufferedReader;
 import java.io.IOException;
 import java.io.InputStreamReader;
@@ -35,9 +41,20 @@ public class FakeKms implements AutoCloseable {
       "com_google_kmstools/fakekms/main/fakekms_/fakekms"
           + (System.getProperty("os.name").startsWith("Windows") ? ".exe" : "");
 
+  // The workspace has no Java gRPC code generation, so the StatsService method is described here.
+  private static final MethodDescriptor<Empty, Stats> GET_STATS_METHOD =
+      MethodDescriptor.<Empty, Stats>newBuilder()
+          .setType(MethodDescriptor.MethodType.UNARY)
+          .setFullMethodName(
+              MethodDescriptor.generateFullMethodName("fakekms.StatsService", "GetStats"))
+          .setRequestMarshaller(ProtoUtils.marshaller(Empty.getDefaultInstance()))
+          .setResponseMarshaller(ProtoUtils.marshaller(Stats.getDefaultInstance()))
+          .build();
+
   private final Process process;
   private final String serverAddress;
   private ArrayList<GrpcTransportChannel> channels;
+  private ManagedChannel statsChannel;
 
   /** Creates and starts a new Fake KMS server. */
   public FakeKms() throws IOException {
@@ -68,12 +85,27 @@ public class FakeKms implements AutoCloseable {
     return serverAddress;
   }
 
+  /**
+   * Returns the counters for the KMS calls that this fake has received. Calls to the fake's
+   * control services are not counted.
+   */
+  public synchronized Stats getStats() {
+    if (statsChannel == null) {
+      statsChannel = ManagedChannelBuilder.forTarget(serverAddress).usePlaintext().build();
+    }
+    return ClientCalls.blockingUnaryCall(
+        statsChannel, GET_STATS_METHOD, CallOptions.DEFAULT, Empty.getDefaultInstance());
+  }
+
   /** Stops the fake server and releases all resources associated with it. */
   @Override
   public void close() {
     for (GrpcTransportChannel c : channels) {
       c.close();
     }
+    if (statsChannel != null) {
+      statsChannel.shutdownNow();
+    }
 
     if (process.isAlive()) {
       process.destroy();
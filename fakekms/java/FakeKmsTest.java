@@ -14,6 +14,8 @@
 
 package com.google.cloud.kms.pkcs11.fakekms;
 
+import com.google.cloud.kms.pkcs11.fakekms.stats.MethodStats;
+import com.google.cloud.kms.pkcs11.fakekms.stats.Stats;
 import com.google.cloud.kms.v1.KeyManagementServiceClient;
 import com.google.cloud.kms.v1.KeyRing;
 import org.junit.Assert;
@@ -32,4 +34,20 @@ public class FakeKmsTest {
       }
     }
   }
+
+  @Test
+  public void getStatsCountsKmsCalls() throws Exception {
+    try (FakeKms fake = new FakeKms()) {
+      try (KeyManagementServiceClient client = fake.newClient()) {
+        client.createKeyRing(
+            "projects/foo/locations/global", "my-key-ring", KeyRing.getDefaultInstance());
+      }
+
+      Stats stats = fake.getStats();
+      Assert.assertEquals(stats.getMethodsCount(), 1);
+      MethodStats method = stats.getMethods(0);
+      Assert.assertEquals(method.getMethodName(), "CreateKeyRing");
+      Assert.assertEquals(method.getCallCount(), 1);
+    }
+  }
 }
@@ -19,37 +19,126 @@ import (
 	"crypto/elliptic"
 	"crypto/rand"
 	"crypto/rsa"
+	"crypto/sha256"
 	"crypto/x509"
 	"embed"
+	"encoding/binary"
 	"encoding/pem"
 	"errors"
 	"fmt"
+	"math/big"
+	"sync"
 )
 
 //go:embed testdata/*.pem
 var testdata embed.FS
 
 type keyFactory interface {
+	// Generate returns new key material. Generate should be fast: factories for
+	// slow-to-generate keys pre-generate or pre-load key material.
 	Generate() interface{}
+	// Derive returns key material that is fully determined by seed.
+	Derive(seed []byte) interface{}
 	// TODO(bdhess): implement for import
 	// Parse([]byte) (interface{}, error)
 }
 
+// seedReader is an io.Reader that returns a deterministic stream of bytes:
+// SHA-256(seed || counter) for counter = 0, 1, 2, ...
+type seedReader struct {
+	seed    []byte
+	counter uint32
+	buf     []byte
+}
+
+func (r *seedReader) Read(p []byte) (int, error) {
+	n := 0
+	for n < len(p) {
+		if len(r.buf) == 0 {
+			var ctr [4]byte
+			binary.BigEndian.PutUint32(ctr[:], r.counter)
+			r.counter++
+			h := sha256.New()
+			h.Write(r.seed)
+			h.Write(ctr[:])
+			r.buf = h.Sum(nil)
+		}
+		c := copy(p[n:], r.buf)
+		r.buf = r.buf[c:]
+		n += c
+	}
+	return n, nil
+}
+
+// ecKeyPoolSize is the number of keys that each ecKeyFactory keeps ready.
+const ecKeyPoolSize = 64
+
 type ecKeyFactory struct {
 	curve elliptic.Curve
+
+	// pool is filled by a background goroutine, which is started on first use
+	// so that curves that are never used don't cost anything.
+	startPool sync.Once
+	pool      chan *ecdsa.PrivateKey
 }
 
-func (f *ecKeyFactory) Generate() interface{} {
-	k, err := ecdsa.GenerateKey(f.curve, rand.Reader)
+func generateECKey(curve elliptic.Curve) *ecdsa.PrivateKey {
+	k, err := ecdsa.GenerateKey(curve, rand.Reader)
 	if err != nil {
 		panic(err) // we ran out of entropy
 	}
 	return k
 }
 
+func (f *ecKeyFactory) Generate() interface{} {
+	f.startPool.Do(func() {
+		f.pool = make(chan *ecdsa.PrivateKey, ecKeyPoolSize)
+		go func() {
+			for {
+				f.pool <- generateECKey(f.curve)
+			}
+		}()
+	})
+
+	select {
+	case k := <-f.pool:
+		return k
+	default:
+		return generateECKey(f.curve)
+	}
+}
+
+func (f *ecKeyFactory) Derive(seed []byte) interface{} {
+	// Select d in [1, n-1] from a stream with 64 extra bits, so that the bias
+	// from the modular reduction is negligible (FIPS 186-4 B.4.1).
+	params := f.curve.Params()
+	b := make([]byte, (params.N.BitLen()+64+7)/8)
+	(&seedReader{seed: seed}).Read(b)
+
+	nMinusOne := new(big.Int).Sub(params.N, big.NewInt(1))
+	d := new(big.Int).SetBytes(b)
+	d.Mod(d, nMinusOne)
+	d.Add(d, big.NewInt(1))
+
+	k := &ecdsa.PrivateKey{D: d}
+	k.PublicKey.Curve = f.curve
+	k.PublicKey.X, k.PublicKey.Y = f.curve.ScalarBaseMult(d.FillBytes(make([]byte, (params.BitSize+7)/8)))
+	return k
+}
+
+// rsaKeys caches the pre-generated RSA keys from testdata, by key size.
+var rsaKeys sync.Map
+
 type rsaKeyFactory int
 
+// Generate returns the pre-generated key of the factory's size. Every RSA key
+// of a given size has the same key material, since generating RSA keys is
+// slow.
 func (f rsaKeyFactory) Generate() interface{} {
+	if k, ok := rsaKeys.Load(f); ok {
+		return k
+	}
+
 	key, err := func() (*rsa.PrivateKey, error) {
 		pemKey, err := testdata.ReadFile(fmt.Sprintf("testdata/rsa_%d_private.pem", f))
 		if err != nil {
@@ -64,7 +153,14 @@ func (f rsaKeyFactory) Generate() interface{} {
 	if err != nil {
 		panic("error loading pregenerated RSA private key: " + err.Error())
 	}
-	return key
+	k, _ := rsaKeys.LoadOrStore(f, key)
+	return k
+}
+
+// Derive returns the pre-generated key of the factory's size, which is the
+// same for every seed.
+func (f rsaKeyFactory) Derive(seed []byte) interface{} {
+	return f.Generate()
 }
 
 type symmetricKeyFactory int
@@ -76,3 +172,9 @@ func (f symmetricKeyFactory) Generate() interface{} {
 	}
 	return k
 }
+
+func (f symmetricKeyFactory) Derive(seed []byte) interface{} {
+	k := make([]byte, int(f)/8)
+	(&seedReader{seed: seed}).Read(k)
+	return k
+}
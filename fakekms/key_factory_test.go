@@ -0,0 +1,89 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package fakekms
+
+import (
+	"bytes"
+	"crypto/ecdsa"
+	"crypto/elliptic"
+	"crypto/rand"
+	"crypto/sha256"
+	"testing"
+)
+
+func TestECKeyFactoryGeneratesDistinctKeys(t *testing.T) {
+	f := &ecKeyFactory{curve: elliptic.P256()}
+	seen := make(map[string]bool)
+	for i := 0; i < 2*ecKeyPoolSize; i++ {
+		k := f.Generate().(*ecdsa.PrivateKey)
+		if seen[k.D.String()] {
+			t.Fatalf("key %d was generated twice", i)
+		}
+		seen[k.D.String()] = true
+	}
+}
+
+func TestECKeyFactoryDeriveIsDeterministic(t *testing.T) {
+	for _, curve := range []elliptic.Curve{elliptic.P224(), elliptic.P256(), elliptic.P384(), elliptic.P521()} {
+		t.Run(curve.Params().Name, func(t *testing.T) {
+			f := &ecKeyFactory{curve: curve}
+			k1 := f.Derive([]byte("seed")).(*ecdsa.PrivateKey)
+			k2 := f.Derive([]byte("seed")).(*ecdsa.PrivateKey)
+			k3 := f.Derive([]byte("other seed")).(*ecdsa.PrivateKey)
+
+			if !k1.Equal(k2) {
+				t.Error("keys derived from the same seed differ")
+			}
+			if k1.Equal(k3) {
+				t.Error("keys derived from different seeds are equal")
+			}
+
+			digest := sha256.Sum256([]byte("data"))
+			sig, err := ecdsa.SignASN1(rand.Reader, k1, digest[:])
+			if err != nil {
+				t.Fatal(err)
+			}
+			if !ecdsa.VerifyASN1(&k1.PublicKey, digest[:], sig) {
+				t.Error("signature from derived key does not verify")
+			}
+		})
+	}
+}
+
+func TestSymmetricKeyFactoryDeriveIsDeterministic(t *testing.T) {
+	f := symmetricKeyFactory(512)
+	k1 := f.Derive([]byte("seed")).([]byte)
+	k2 := f.Derive([]byte("seed")).([]byte)
+	k3 := f.Derive([]byte("other seed")).([]byte)
+
+	if len(k1) != 64 {
+		t.Errorf("len(k1)=%d, want 64", len(k1))
+	}
+	if !bytes.Equal(k1, k2) {
+		t.Error("keys derived from the same seed differ")
+	}
+	if bytes.Equal(k1, k3) {
+		t.Error("keys derived from different seeds are equal")
+	}
+}
+
+func TestRSAKeyFactoryReturnsPregeneratedKey(t *testing.T) {
+	for _, f := range []rsaKeyFactory{2048, 3072, 4096} {
+		k1, k2 := f.Generate(), f.Derive([]byte("seed"))
+		if k1 != k2 {
+			t.Errorf("rsaKeyFactory(%d) returned different keys", f)
+		}
+	}
+}
@@ -101,23 +101,23 @@ var algorithms = map[kmspb.CryptoKeyVersion_CryptoKeyVersionAlgorithm]algDef{
 	kmspb.CryptoKeyVersion_CryptoKeyVersionAlgorithm(11): // EC_SIGN_P224_SHA256
 	{
 		Purpose:    kmspb.CryptoKey_ASYMMETRIC_SIGN,
-		KeyFactory: &ecKeyFactory{elliptic.P224()},
+		KeyFactory: &ecKeyFactory{curve: elliptic.P224()},
 		Opts:       crypto.SHA256,
 	},
 	kmspb.CryptoKeyVersion_EC_SIGN_P256_SHA256: {
 		Purpose:    kmspb.CryptoKey_ASYMMETRIC_SIGN,
-		KeyFactory: &ecKeyFactory{elliptic.P256()},
+		KeyFactory: &ecKeyFactory{curve: elliptic.P256()},
 		Opts:       crypto.SHA256,
 	},
 	kmspb.CryptoKeyVersion_EC_SIGN_P384_SHA384: {
 		Purpose:    kmspb.CryptoKey_ASYMMETRIC_SIGN,
-		KeyFactory: &ecKeyFactory{elliptic.P384()},
+		KeyFactory: &ecKeyFactory{curve: elliptic.P384()},
 		Opts:       crypto.SHA384,
 	},
 	kmspb.CryptoKeyVersion_CryptoKeyVersionAlgorithm(14): // EC_SIGN_P521_SHA512
 	{
 		Purpose:    kmspb.CryptoKey_ASYMMETRIC_SIGN,
-		KeyFactory: &ecKeyFactory{elliptic.P521()},
+		KeyFactory: &ecKeyFactory{curve: elliptic.P521()},
 		Opts:       crypto.SHA512,
 	},
 
@@ -19,6 +19,7 @@
 package main
 
 import (
+	"flag"
 	"fmt"
 	"log"
 	"os"
@@ -26,20 +27,74 @@ import (
 	"syscall"
 
 	"cloud.google.com/kms/integrations/fakekms"
+	"cloud.google.com/kms/integrations/fakekms/fault/faultpb"
+	"cloud.google.com/kms/integrations/fakekms/state/statepb"
+	"google.golang.org/protobuf/encoding/prototext"
+)
+
+var (
+	delay   = flag.Duration("delay", 0, "the amount of time each KMS request is delayed before processing")
+	keySeed = flag.String("key_seed", "", "if set, key material is derived from this seed and each key version's name")
+	profile = flag.String("performance_profile", "", "if set, the path to a fakekms.PerformanceProfile in text format to apply to all requests")
+
+	seedSpec     = flag.String("seed_spec", "", "if set, the path to a fakekms.SeedSpec in text format describing resources to create at startup")
+	loadSnapshot = flag.String("load_snapshot", "", "if set, the path to a snapshot file to load at startup, before seeding")
+	saveSnapshot = flag.String("save_snapshot", "", "if set, the path of a snapshot file to write at shutdown")
 )
 
 func main() {
+	flag.Parse()
+
 	sigs := make(chan os.Signal)
 	signal.Notify(sigs, syscall.SIGINT, syscall.SIGTERM)
 
-	srv, err := fakekms.NewServer()
+	opts := fakekms.ServerOptions{Delay: *delay}
+	if *keySeed != "" {
+		opts.KeySeed = []byte(*keySeed)
+	}
+	if *profile != "" {
+		b, err := os.ReadFile(*profile)
+		if err != nil {
+			log.Fatal(err)
+		}
+		opts.PerformanceProfile = new(faultpb.PerformanceProfile)
+		if err := prototext.Unmarshal(b, opts.PerformanceProfile); err != nil {
+			log.Fatalf("error parsing performance profile: %v", err)
+		}
+	}
+	srv, err := fakekms.NewServerWithOptions(opts)
 	if err != nil {
 		log.Fatal(err)
 	}
 	defer srv.Close()
+
+	if *loadSnapshot != "" {
+		if err := srv.LoadSnapshot(*loadSnapshot); err != nil {
+			log.Fatal(err)
+		}
+	}
+	if *seedSpec != "" {
+		b, err := os.ReadFile(*seedSpec)
+		if err != nil {
+			log.Fatal(err)
+		}
+		spec := new(statepb.SeedSpec)
+		if err := prototext.Unmarshal(b, spec); err != nil {
+			log.Fatalf("error parsing seed spec: %v", err)
+		}
+		if err := srv.Seed(spec); err != nil {
+			log.Fatal(err)
+		}
+	}
 	fmt.Println(srv.Addr)
 	fmt.Fprintln(os.Stderr, "ready to serve requests")
 
 	sig := <-sigs
 	fmt.Fprintln(os.Stderr, "shutting down on signal:", sig)
+
+	if *saveSnapshot != "" {
+		if err := srv.SaveSnapshot(*saveSnapshot); err != nil {
+			log.Fatal(err)
+		}
+	}
 }
@@ -0,0 +1,36 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Package resource extracts the KMS resource named in a request.
+package resource
+
+import "cloud.google.com/go/kms/apiv1/kmspb"
+
+// Name returns the name of the resource that req operates on. For update
+// requests, that is the name of the resource being updated; for other
+// requests, it is the value of the request's name field, or if it has none,
+// its parent field. It returns "" if the request names no resource.
+func Name(req interface{}) string {
+	switch r := req.(type) {
+	case *kmspb.UpdateCryptoKeyRequest:
+		return r.GetCryptoKey().GetName()
+	case *kmspb.UpdateCryptoKeyVersionRequest:
+		return r.GetCryptoKeyVersion().GetName()
+	case interface{ GetName() string }:
+		return r.GetName()
+	case interface{ GetParent() string }:
+		return r.GetParent()
+	}
+	return ""
+}
@@ -0,0 +1,51 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package resource
+
+import (
+	"testing"
+
+	"cloud.google.com/go/kms/apiv1/kmspb"
+	"google.golang.org/protobuf/types/known/emptypb"
+)
+
+func TestName(t *testing.T) {
+	for _, tc := range []struct {
+		desc string
+		req  interface{}
+		want string
+	}{
+		{"name", &kmspb.GetCryptoKeyRequest{Name: "foo"}, "foo"},
+		{"parent", &kmspb.ListCryptoKeysRequest{Parent: "bar"}, "bar"},
+		{
+			"crypto key update",
+			&kmspb.UpdateCryptoKeyRequest{CryptoKey: &kmspb.CryptoKey{Name: "ck"}},
+			"ck",
+		},
+		{
+			"crypto key version update",
+			&kmspb.UpdateCryptoKeyVersionRequest{
+				CryptoKeyVersion: &kmspb.CryptoKeyVersion{Name: "ckv"},
+			},
+			"ckv",
+		},
+		{"neither", &emptypb.Empty{}, ""},
+		{"not a proto", "baz", ""},
+	} {
+		if got := Name(tc.req); got != tc.want {
+			t.Errorf("%s: Name() = %q, want %q", tc.desc, got, tc.want)
+		}
+	}
+}
@@ -0,0 +1,489 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package fakekms
+
+import (
+	"context"
+	"crypto/x509"
+	"fmt"
+	"os"
+	"runtime"
+	"sort"
+	"sync"
+	"time"
+
+	"cloud.google.com/go/kms/apiv1/kmspb"
+	"cloud.google.com/kms/integrations/fakekms/state/statepb"
+	"google.golang.org/protobuf/proto"
+	"google.golang.org/protobuf/types/known/durationpb"
+	"google.golang.org/protobuf/types/known/emptypb"
+	"google.golang.org/protobuf/types/known/timestamppb"
+)
+
+// stateServer implements the StateService. Unlike KMS RPCs, its RPCs acquire
+// the locks they need.
+type stateServer struct {
+	f *fakeKMS
+}
+
+var _ statepb.StateServiceServer = (*stateServer)(nil)
+
+// Seed implements the StateService API.
+func (s *stateServer) Seed(ctx context.Context, spec *statepb.SeedSpec) (*statepb.SeedResponse, error) {
+	return s.f.seed(spec)
+}
+
+// SaveSnapshot implements the StateService API.
+func (s *stateServer) SaveSnapshot(ctx context.Context, req *statepb.SnapshotRequest) (*emptypb.Empty, error) {
+	if err := s.f.saveSnapshot(req.Path); err != nil {
+		return nil, err
+	}
+	return &emptypb.Empty{}, nil
+}
+
+// LoadSnapshot implements the StateService API.
+func (s *stateServer) LoadSnapshot(ctx context.Context, req *statepb.SnapshotRequest) (*emptypb.Empty, error) {
+	if err := s.f.loadSnapshot(req.Path); err != nil {
+		return nil, err
+	}
+	return &emptypb.Empty{}, nil
+}
+
+// seedVersionStates are the version states that may be seeded.
+var seedVersionStates = map[kmspb.CryptoKeyVersion_CryptoKeyVersionState]bool{
+	kmspb.CryptoKeyVersion_ENABLED:           true,
+	kmspb.CryptoKeyVersion_DISABLED:          true,
+	kmspb.CryptoKeyVersion_DESTROY_SCHEDULED: true,
+	kmspb.CryptoKeyVersion_DESTROYED:         true,
+}
+
+// stateMix assigns states to versions in proportion to their weights.
+type stateMix struct {
+	states     []kmspb.CryptoKeyVersion_CryptoKeyVersionState
+	cumulative []float64
+}
+
+func newStateMix(pb []*statepb.SeedSpec_VersionState) (*stateMix, error) {
+	m := &stateMix{}
+	total := 0.0
+	for _, vs := range pb {
+		v, ok := kmspb.CryptoKeyVersion_CryptoKeyVersionState_value[vs.State]
+		state := kmspb.CryptoKeyVersion_CryptoKeyVersionState(v)
+		if !ok || !seedVersionStates[state] {
+			return nil, errInvalidArgument("unsupported version state: %q", vs.State)
+		}
+		if vs.Weight <= 0 {
+			continue
+		}
+		total += vs.Weight
+		m.states = append(m.states, state)
+		m.cumulative = append(m.cumulative, total)
+	}
+	if len(m.states) == 0 {
+		return &stateMix{
+			states:     []kmspb.CryptoKeyVersion_CryptoKeyVersionState{kmspb.CryptoKeyVersion_ENABLED},
+			cumulative: []float64{1},
+		}, nil
+	}
+	for i := range m.cumulative {
+		m.cumulative[i] /= total
+	}
+	return m, nil
+}
+
+// state returns the state of version i of n. The first versions get the first
+// state, and so on, so that assignments are reproducible.
+func (m *stateMix) state(i, n int) kmspb.CryptoKeyVersion_CryptoKeyVersionState {
+	pos := (float64(i) + 0.5) / float64(n)
+	for j, c := range m.cumulative {
+		if pos < c {
+			return m.states[j]
+		}
+	}
+	return m.states[len(m.states)-1]
+}
+
+// pendingMaterial is a key version whose key material has yet to be created.
+type pendingMaterial struct {
+	def  algDef
+	name cryptoKeyVersionName
+	ckv  *cryptoKeyVersion
+}
+
+// fillKeyMaterial creates key material for each of the pending versions, in
+// parallel.
+func (f *fakeKMS) fillKeyMaterial(pending []pendingMaterial) {
+	var wg sync.WaitGroup
+	work := make(chan pendingMaterial)
+	for i := 0; i < runtime.NumCPU(); i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for p := range work {
+				p.ckv.keyMaterial = f.newKeyMaterial(p.def, p.name)
+			}
+		}()
+	}
+	for _, p := range pending {
+		work <- p
+	}
+	close(work)
+	wg.Wait()
+}
+
+func parseSeedKeys(spec *statepb.SeedSpec_CryptoKeys) (kmspb.CryptoKeyVersion_CryptoKeyVersionAlgorithm, algDef, kmspb.ProtectionLevel, error) {
+	algValue, ok := kmspb.CryptoKeyVersion_CryptoKeyVersionAlgorithm_value[spec.Algorithm]
+	if !ok {
+		return 0, algDef{}, 0, errInvalidArgument("unknown algorithm: %q", spec.Algorithm)
+	}
+	alg := kmspb.CryptoKeyVersion_CryptoKeyVersionAlgorithm(algValue)
+	def, err := algorithmDef(alg)
+	if err != nil {
+		return 0, algDef{}, 0, err
+	}
+
+	protLevel := kmspb.ProtectionLevel_SOFTWARE
+	if spec.ProtectionLevel != "" {
+		v, ok := kmspb.ProtectionLevel_value[spec.ProtectionLevel]
+		if !ok {
+			return 0, algDef{}, 0, errInvalidArgument("unknown protection level: %q", spec.ProtectionLevel)
+		}
+		protLevel = kmspb.ProtectionLevel(v)
+	}
+	if err := validateProtectionLevel(protLevel); err != nil {
+		return 0, algDef{}, 0, err
+	}
+	return alg, def, protLevel, nil
+}
+
+// seed creates the resources described by spec. Resources are built without
+// holding any lock, and inserted atomically.
+func (f *fakeKMS) seed(spec *statepb.SeedSpec) (*statepb.SeedResponse, error) {
+	now := timestamppb.Now()
+	destroyTime := timestamppb.New(time.Now().Add(30 * 24 * time.Hour).Truncate(time.Microsecond))
+	resp := &statepb.SeedResponse{}
+
+	// The key rings that are named in spec, and the keys to add to each.
+	var ringOrder []keyRingName
+	ringKeys := make(map[keyRingName]map[cryptoKeyName]*cryptoKey)
+	var pending []pendingMaterial
+
+	for _, krSpec := range spec.KeyRings {
+		loc, err := parseLocationName(krSpec.Location)
+		if err != nil {
+			return nil, err
+		}
+		var ids []string
+		if krSpec.Count == 0 {
+			ids = []string{krSpec.IdPrefix}
+		} else {
+			for i := 0; i < int(krSpec.Count); i++ {
+				ids = append(ids, fmt.Sprintf("%s-%d", krSpec.IdPrefix, i))
+			}
+		}
+
+		for _, id := range ids {
+			if err := checkID(id); err != nil {
+				return nil, err
+			}
+			krName := keyRingName{locationName: loc, KeyRingID: id}
+			keys, ok := ringKeys[krName]
+			if !ok {
+				keys = make(map[cryptoKeyName]*cryptoKey)
+				ringKeys[krName] = keys
+				ringOrder = append(ringOrder, krName)
+			}
+
+			for _, ckSpec := range krSpec.CryptoKeys {
+				alg, def, protLevel, err := parseSeedKeys(ckSpec)
+				if err != nil {
+					return nil, err
+				}
+				mix, err := newStateMix(ckSpec.StateMix)
+				if err != nil {
+					return nil, err
+				}
+				versions := int(ckSpec.VersionsPerKey)
+				if versions == 0 {
+					versions = 1
+				}
+				total := int(ckSpec.Count) * versions
+
+				for j := 0; j < int(ckSpec.Count); j++ {
+					ckName := cryptoKeyName{keyRingName: krName, CryptoKeyID: fmt.Sprintf("%s-%d", ckSpec.IdPrefix, j)}
+					if err := checkID(ckName.CryptoKeyID); err != nil {
+						return nil, err
+					}
+					if _, ok := keys[ckName]; ok {
+						return nil, errAlreadyExists(ckName)
+					}
+
+					ck := &cryptoKey{
+						pb: &kmspb.CryptoKey{
+							Name:       ckName.String(),
+							CreateTime: now,
+							Purpose:    def.Purpose,
+							VersionTemplate: &kmspb.CryptoKeyVersionTemplate{
+								ProtectionLevel: protLevel,
+								Algorithm:       alg,
+							},
+							DestroyScheduledDuration: &durationpb.Duration{Seconds: 2592000},
+						},
+						versions: make(map[cryptoKeyVersionName]*cryptoKeyVersion),
+					}
+
+					for v := 0; v < versions; v++ {
+						name := cryptoKeyVersionName{cryptoKeyName: ckName, CryptoKeyVersionID: fmt.Sprint(v + 1)}
+						pb := &kmspb.CryptoKeyVersion{
+							Name:            name.String(),
+							CreateTime:      now,
+							Algorithm:       alg,
+							ProtectionLevel: protLevel,
+							State:           mix.state(j*versions+v, total),
+						}
+						ckv := &cryptoKeyVersion{pb: pb}
+
+						switch pb.State {
+						case kmspb.CryptoKeyVersion_DESTROYED:
+							pb.DestroyTime = now
+							pb.DestroyEventTime = now
+						case kmspb.CryptoKeyVersion_DESTROY_SCHEDULED:
+							pb.DestroyTime = destroyTime
+							fallthrough
+						default:
+							pb.GenerateTime = now
+							pending = append(pending, pendingMaterial{def: def, name: name, ckv: ckv})
+						}
+
+						if def.Purpose == kmspb.CryptoKey_ENCRYPT_DECRYPT && ck.pb.Primary == nil &&
+							pb.State == kmspb.CryptoKeyVersion_ENABLED {
+							ck.pb.Primary = pb
+						}
+						ck.versions[name] = ckv
+						resp.CryptoKeyVersionsCreated++
+					}
+
+					keys[ckName] = ck
+					resp.CryptoKeysCreated++
+				}
+			}
+		}
+	}
+
+	f.fillKeyMaterial(pending)
+
+	f.mux.Lock()
+	defer f.mux.Unlock()
+
+	// Check for conflicts before changing anything.
+	for _, krName := range ringOrder {
+		kr, ok := f.keyRings[krName]
+		if !ok {
+			continue
+		}
+		kr.mux.RLock()
+		for ckName := range ringKeys[krName] {
+			if _, ok := kr.keys[ckName]; ok {
+				kr.mux.RUnlock()
+				return nil, errAlreadyExists(ckName)
+			}
+		}
+		kr.mux.RUnlock()
+	}
+
+	for _, krName := range ringOrder {
+		kr, ok := f.keyRings[krName]
+		if !ok {
+			kr = &keyRing{
+				pb:   &kmspb.KeyRing{Name: krName.String(), CreateTime: now},
+				keys: make(map[cryptoKeyName]*cryptoKey),
+			}
+			f.keyRings[krName] = kr
+			resp.KeyRingsCreated++
+		}
+		kr.mux.Lock()
+		for ckName, ck := range ringKeys[krName] {
+			kr.keys[ckName] = ck
+		}
+		kr.mux.Unlock()
+	}
+	return resp, nil
+}
+
+func marshalKeyMaterial(k interface{}) ([]byte, error) {
+	switch k := k.(type) {
+	case nil:
+		return nil, nil
+	case []byte:
+		return k, nil
+	default:
+		return x509.MarshalPKCS8PrivateKey(k)
+	}
+}
+
+// saveSnapshot writes the complete state of f to a file at path.
+func (f *fakeKMS) saveSnapshot(path string) error {
+	snapshot, err := func() (*statepb.Snapshot, error) {
+		f.mux.RLock()
+		defer f.mux.RUnlock()
+
+		snapshot := &statepb.Snapshot{}
+		for _, kr := range f.keyRings {
+			krpb, err := snapshotKeyRing(kr)
+			if err != nil {
+				return nil, err
+			}
+			snapshot.KeyRings = append(snapshot.KeyRings, krpb)
+		}
+		return snapshot, nil
+	}()
+	if err != nil {
+		return err
+	}
+
+	b, err := proto.MarshalOptions{Deterministic: true}.Marshal(snapshot)
+	if err != nil {
+		return errInternal("error marshaling snapshot: %v", err)
+	}
+	if err := os.WriteFile(path, b, 0644); err != nil {
+		return errInvalidArgument("error writing snapshot: %v", err)
+	}
+	return nil
+}
+
+func snapshotKeyRing(kr *keyRing) (*statepb.Snapshot_KeyRing, error) {
+	kr.mux.RLock()
+	defer kr.mux.RUnlock()
+
+	krBytes, err := proto.Marshal(kr.pb)
+	if err != nil {
+		return nil, errInternal("error marshaling key ring: %v", err)
+	}
+	krpb := &statepb.Snapshot_KeyRing{KeyRing: krBytes}
+
+	for _, ck := range kr.keys {
+		ckBytes, err := proto.Marshal(ck.pb)
+		if err != nil {
+			return nil, errInternal("error marshaling crypto key: %v", err)
+		}
+		ckpb := &statepb.Snapshot_CryptoKey{CryptoKey: ckBytes}
+
+		for _, ckv := range ck.versions {
+			ckvBytes, err := proto.Marshal(ckv.pb)
+			if err != nil {
+				return nil, errInternal("error marshaling crypto key version: %v", err)
+			}
+			material, err := marshalKeyMaterial(ckv.keyMaterial)
+			if err != nil {
+				return nil, errInternal("error marshaling key material for %s: %v", ckv.pb.Name, err)
+			}
+			ckpb.Versions = append(ckpb.Versions, &statepb.Snapshot_CryptoKeyVersion{
+				CryptoKeyVersion: ckvBytes,
+				KeyMaterial:      material,
+			})
+		}
+		sort.Slice(ckpb.Versions, func(i, j int) bool {
+			return string(ckpb.Versions[i].CryptoKeyVersion) < string(ckpb.Versions[j].CryptoKeyVersion)
+		})
+		krpb.CryptoKeys = append(krpb.CryptoKeys, ckpb)
+	}
+	sort.Slice(krpb.CryptoKeys, func(i, j int) bool {
+		return string(krpb.CryptoKeys[i].CryptoKey) < string(krpb.CryptoKeys[j].CryptoKey)
+	})
+	return krpb, nil
+}
+
+// loadSnapshot replaces the complete state of f with the contents of the
+// snapshot file at path.
+func (f *fakeKMS) loadSnapshot(path string) error {
+	b, err := os.ReadFile(path)
+	if err != nil {
+		return errInvalidArgument("error reading snapshot: %v", err)
+	}
+	snapshot := &statepb.Snapshot{}
+	if err := proto.Unmarshal(b, snapshot); err != nil {
+		return errInvalidArgument("error parsing snapshot: %v", err)
+	}
+
+	keyRings := make(map[keyRingName]*keyRing)
+	var pending []pendingMaterial
+	for _, krpb := range snapshot.KeyRings {
+		kr := &keyRing{pb: &kmspb.KeyRing{}, keys: make(map[cryptoKeyName]*cryptoKey)}
+		if err := proto.Unmarshal(krpb.KeyRing, kr.pb); err != nil {
+			return errInvalidArgument("error parsing key ring: %v", err)
+		}
+		krName, err := parseKeyRingName(kr.pb.Name)
+		if err != nil {
+			return err
+		}
+
+		for _, ckpb := range krpb.CryptoKeys {
+			ck := &cryptoKey{pb: &kmspb.CryptoKey{}, versions: make(map[cryptoKeyVersionName]*cryptoKeyVersion)}
+			if err := proto.Unmarshal(ckpb.CryptoKey, ck.pb); err != nil {
+				return errInvalidArgument("error parsing crypto key: %v", err)
+			}
+			ckName, err := parseCryptoKeyName(ck.pb.Name)
+			if err != nil {
+				return err
+			}
+
+			for _, ckvpb := range ckpb.Versions {
+				ckv := &cryptoKeyVersion{pb: &kmspb.CryptoKeyVersion{}}
+				if err := proto.Unmarshal(ckvpb.CryptoKeyVersion, ckv.pb); err != nil {
+					return errInvalidArgument("error parsing crypto key version: %v", err)
+				}
+				name, err := parseCryptoKeyVersionName(ckv.pb.Name)
+				if err != nil {
+					return err
+				}
+				def, err := algorithmDef(ckv.pb.Algorithm)
+				if err != nil {
+					return err
+				}
+
+				switch {
+				case ckv.pb.State == kmspb.CryptoKeyVersion_PENDING_GENERATION:
+					// Generation was in flight when the snapshot was taken.
+					ckv.pb.State = kmspb.CryptoKeyVersion_ENABLED
+					ckv.pb.GenerateTime = timestamppb.Now()
+					pending = append(pending, pendingMaterial{def: def, name: name, ckv: ckv})
+				case len(ckvpb.KeyMaterial) == 0:
+				case def.Asymmetric():
+					if ckv.keyMaterial, err = x509.ParsePKCS8PrivateKey(ckvpb.KeyMaterial); err != nil {
+						return errInvalidArgument("error parsing key material for %s: %v", name, err)
+					}
+				default:
+					ckv.keyMaterial = ckvpb.KeyMaterial
+				}
+
+				// The primary version is shared with the version map, so that
+				// updates to the version are visible in the key.
+				if ck.pb.Primary.GetName() == ckv.pb.Name {
+					ck.pb.Primary = ckv.pb
+				}
+				ck.versions[name] = ckv
+			}
+			kr.keys[ckName] = ck
+		}
+		keyRings[krName] = kr
+	}
+
+	f.fillKeyMaterial(pending)
+
+	f.mux.Lock()
+	defer f.mux.Unlock()
+	f.keyRings = keyRings
+	return nil
+}
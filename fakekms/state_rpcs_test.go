@@ -0,0 +1,145 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package fakekms
+
+import (
+	"crypto/ecdsa"
+	"path"
+	"testing"
+
+	"google.golang.org/grpc/codes"
+	"google.golang.org/grpc/status"
+
+	"cloud.google.com/go/kms/apiv1/kmspb"
+	"cloud.google.com/kms/integrations/fakekms/state/statepb"
+)
+
+func testSeedSpec() *statepb.SeedSpec {
+	return &statepb.SeedSpec{
+		KeyRings: []*statepb.SeedSpec_KeyRings{{
+			Location: "projects/p/locations/l",
+			IdPrefix: "kr",
+			Count:    2,
+			CryptoKeys: []*statepb.SeedSpec_CryptoKeys{{
+				IdPrefix:       "ec",
+				Count:          4,
+				Algorithm:      "EC_SIGN_P256_SHA256",
+				VersionsPerKey: 2,
+				StateMix: []*statepb.SeedSpec_VersionState{
+					{State: "ENABLED", Weight: 3},
+					{State: "DESTROYED", Weight: 1},
+				},
+			}, {
+				IdPrefix:  "aes",
+				Count:     1,
+				Algorithm: "GOOGLE_SYMMETRIC_ENCRYPTION",
+			}},
+		}},
+	}
+}
+
+func TestSeedCreatesResources(t *testing.T) {
+	f := &fakeKMS{keyRings: make(map[keyRingName]*keyRing)}
+	resp, err := f.seed(testSeedSpec())
+	if err != nil {
+		t.Fatal(err)
+	}
+	if resp.KeyRingsCreated != 2 || resp.CryptoKeysCreated != 10 || resp.CryptoKeyVersionsCreated != 18 {
+		t.Errorf("resp=%v, want 2 key rings, 10 crypto keys and 18 versions", resp)
+	}
+
+	name, _ := parseCryptoKeyName("projects/p/locations/l/keyRings/kr-1/cryptoKeys/ec-3")
+	ck, err := f.cryptoKey(name)
+	if err != nil {
+		t.Fatal(err)
+	}
+	states := make(map[kmspb.CryptoKeyVersion_CryptoKeyVersionState]int)
+	for _, ckv := range ck.versions {
+		states[ckv.pb.State]++
+		if (ckv.keyMaterial == nil) != (ckv.pb.State == kmspb.CryptoKeyVersion_DESTROYED) {
+			t.Errorf("%s has state %v and key material %v", ckv.pb.Name, ckv.pb.State, ckv.keyMaterial)
+		}
+	}
+	// The last quarter of the versions in each key ring are destroyed.
+	if states[kmspb.CryptoKeyVersion_DESTROYED] != 2 {
+		t.Errorf("states=%v, want 2 DESTROYED versions in the last key", states)
+	}
+
+	aesName, _ := parseCryptoKeyName("projects/p/locations/l/keyRings/kr-0/cryptoKeys/aes-0")
+	aes, err := f.cryptoKey(aesName)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if aes.pb.Primary.GetName() != aesName.String()+"/cryptoKeyVersions/1" {
+		t.Errorf("primary=%v, want version 1", aes.pb.Primary)
+	}
+}
+
+func TestSeedIsAtomic(t *testing.T) {
+	f := &fakeKMS{keyRings: make(map[keyRingName]*keyRing)}
+	if _, err := f.seed(testSeedSpec()); err != nil {
+		t.Fatal(err)
+	}
+
+	spec := testSeedSpec()
+	spec.KeyRings[0].Count = 3
+	if _, err := f.seed(spec); status.Code(err) != codes.AlreadyExists {
+		t.Errorf("status.Code(err)=%v, want AlreadyExists", status.Code(err))
+	}
+	if len(f.keyRings) != 2 {
+		t.Errorf("len(f.keyRings)=%d, want 2", len(f.keyRings))
+	}
+}
+
+func TestSnapshotRoundTrip(t *testing.T) {
+	f := &fakeKMS{keyRings: make(map[keyRingName]*keyRing)}
+	if _, err := f.seed(testSeedSpec()); err != nil {
+		t.Fatal(err)
+	}
+	snapshot := path.Join(t.TempDir(), "snapshot.pb")
+	if err := f.saveSnapshot(snapshot); err != nil {
+		t.Fatal(err)
+	}
+
+	g := &fakeKMS{keyRings: make(map[keyRingName]*keyRing)}
+	if err := g.loadSnapshot(snapshot); err != nil {
+		t.Fatal(err)
+	}
+
+	name, _ := parseCryptoKeyVersionName("projects/p/locations/l/keyRings/kr-0/cryptoKeys/ec-0/cryptoKeyVersions/1")
+	want, err := f.cryptoKeyVersion(name)
+	if err != nil {
+		t.Fatal(err)
+	}
+	got, err := g.cryptoKeyVersion(name)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !got.keyMaterial.(*ecdsa.PrivateKey).Equal(want.keyMaterial) {
+		t.Error("restored key material differs")
+	}
+	if got.pb.State != want.pb.State {
+		t.Errorf("state=%v, want %v", got.pb.State, want.pb.State)
+	}
+
+	aesName, _ := parseCryptoKeyName("projects/p/locations/l/keyRings/kr-0/cryptoKeys/aes-0")
+	aes, err := g.cryptoKey(aesName)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if aes.pb.Primary != aes.versions[cryptoKeyVersionName{aesName, "1"}].pb {
+		t.Error("restored primary is not shared with the version map")
+	}
+}
@@ -0,0 +1,178 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Package stats counts the RPCs received by a gRPC server, so that tests can
+// measure how many KMS requests a client issues.
+package stats
+
+import (
+	"context"
+	"sort"
+	"strings"
+	"sync"
+	"time"
+
+	"google.golang.org/grpc"
+
+	"cloud.google.com/kms/integrations/fakekms/resource"
+	"cloud.google.com/kms/integrations/fakekms/stats/statspb"
+	"google.golang.org/protobuf/proto"
+	"google.golang.org/protobuf/types/known/durationpb"
+	"google.golang.org/protobuf/types/known/emptypb"
+)
+
+var _ statspb.StatsServiceServer = (*Server)(nil)
+
+type counter struct {
+	calls, errors            int64
+	requestBytes, respBytes  int64
+	totalLatency, maxLatency time.Duration
+}
+
+func (c *counter) add(reqBytes, respBytes int64, failed bool, latency time.Duration) {
+	c.calls++
+	if failed {
+		c.errors++
+	}
+	c.requestBytes += reqBytes
+	c.respBytes += respBytes
+	c.totalLatency += latency
+	if latency > c.maxLatency {
+		c.maxLatency = latency
+	}
+}
+
+func (c *counter) proto(method string) *statspb.MethodStats {
+	return &statspb.MethodStats{
+		MethodName:    method,
+		CallCount:     c.calls,
+		ErrorCount:    c.errors,
+		RequestBytes:  c.requestBytes,
+		ResponseBytes: c.respBytes,
+		TotalLatency:  durationpb.New(c.totalLatency),
+		MaxLatency:    durationpb.New(c.maxLatency),
+	}
+}
+
+type resourceMethod struct {
+	resource, method string
+}
+
+// Server implements the StatsService, and counts the requests that pass
+// through the interceptor returned by NewInterceptor.
+type Server struct {
+	lock      sync.Mutex
+	methods   map[string]*counter
+	resources map[resourceMethod]*counter
+}
+
+func (s *Server) GetStats(ctx context.Context, _ *emptypb.Empty) (*statspb.Stats, error) {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+
+	stats := new(statspb.Stats)
+	for method, c := range s.methods {
+		stats.Methods = append(stats.Methods, c.proto(method))
+	}
+	sort.Slice(stats.Methods, func(i, j int) bool {
+		return stats.Methods[i].MethodName < stats.Methods[j].MethodName
+	})
+
+	keys := make([]resourceMethod, 0, len(s.resources))
+	for k := range s.resources {
+		keys = append(keys, k)
+	}
+	sort.Slice(keys, func(i, j int) bool {
+		if keys[i].resource != keys[j].resource {
+			return keys[i].resource < keys[j].resource
+		}
+		return keys[i].method < keys[j].method
+	})
+	for _, k := range keys {
+		n := len(stats.Resources)
+		if n == 0 || stats.Resources[n-1].ResourceName != k.resource {
+			stats.Resources = append(stats.Resources, &statspb.ResourceStats{ResourceName: k.resource})
+			n++
+		}
+		rs := stats.Resources[n-1]
+		rs.Methods = append(rs.Methods, s.resources[k].proto(k.method))
+	}
+	return stats, nil
+}
+
+func (s *Server) ResetStats(ctx context.Context, _ *emptypb.Empty) (*emptypb.Empty, error) {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+
+	s.methods = nil
+	s.resources = nil
+	return &emptypb.Empty{}, nil
+}
+
+func (s *Server) record(method, resource string, reqBytes, respBytes int64, failed bool, latency time.Duration) {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+
+	if s.methods == nil {
+		s.methods = make(map[string]*counter)
+		s.resources = make(map[resourceMethod]*counter)
+	}
+
+	c, ok := s.methods[method]
+	if !ok {
+		c = new(counter)
+		s.methods[method] = c
+	}
+	c.add(reqBytes, respBytes, failed, latency)
+
+	if resource == "" {
+		return
+	}
+	k := resourceMethod{resource: resource, method: method}
+	c, ok = s.resources[k]
+	if !ok {
+		c = new(counter)
+		s.resources[k] = c
+	}
+	c.add(reqBytes, respBytes, failed, latency)
+}
+
+// NewInterceptor returns an interceptor that counts each request it handles.
+// It should be the first interceptor in the chain, so that requests that are
+// failed or delayed by later interceptors are counted as well.
+func (s *Server) NewInterceptor() grpc.UnaryServerInterceptor {
+	return func(ctx context.Context, req interface{}, info *grpc.UnaryServerInfo, handler grpc.UnaryHandler) (interface{}, error) {
+		// Don't count requests meant for fakekms control services.
+		if strings.HasPrefix(info.FullMethod, "/fakekms.") {
+			return handler(ctx, req)
+		}
+
+		start := time.Now()
+		resp, err := handler(ctx, req)
+		latency := time.Since(start)
+
+		// FullMethod looks like "/foo.package.BarService/BazMethod"
+		method := strings.Split(info.FullMethod, "/")[2]
+		s.record(method, resource.Name(req), messageSize(req), messageSize(resp), err != nil, latency)
+		return resp, err
+	}
+}
+
+func messageSize(m interface{}) int64 {
+	msg, ok := m.(proto.Message)
+	if !ok || msg == nil {
+		return 0
+	}
+	return int64(proto.Size(msg))
+}
@@ -0,0 +1,118 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package stats
+
+import (
+	"context"
+	"testing"
+
+	"google.golang.org/grpc"
+	"google.golang.org/grpc/codes"
+	"google.golang.org/grpc/status"
+
+	"cloud.google.com/go/kms/apiv1/kmspb"
+	"cloud.google.com/kms/integrations/fakekms/stats/statspb"
+	"google.golang.org/protobuf/proto"
+	"google.golang.org/protobuf/types/known/emptypb"
+)
+
+const keyName = "projects/p/locations/l/keyRings/kr/cryptoKeys/ck"
+
+func call(t *testing.T, s *Server, fullMethod string, req, resp proto.Message, err error) {
+	t.Helper()
+	handler := func(ctx context.Context, req interface{}) (interface{}, error) {
+		if err != nil {
+			return nil, err
+		}
+		return resp, nil
+	}
+	info := &grpc.UnaryServerInfo{FullMethod: fullMethod}
+	if _, gotErr := s.NewInterceptor()(context.Background(), req, info, handler); gotErr != err {
+		t.Fatalf("interceptor returned err=%v, want %v", gotErr, err)
+	}
+}
+
+func getStats(t *testing.T, s *Server) *statspb.Stats {
+	t.Helper()
+	stats, err := s.GetStats(context.Background(), &emptypb.Empty{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	return stats
+}
+
+func TestCountsCallsByMethodAndResource(t *testing.T) {
+	s := new(Server)
+	req := &kmspb.GetCryptoKeyRequest{Name: keyName}
+	resp := &kmspb.CryptoKey{Name: keyName}
+	call(t, s, "/google.cloud.kms.v1.KeyManagementService/GetCryptoKey", req, resp, nil)
+	call(t, s, "/google.cloud.kms.v1.KeyManagementService/GetCryptoKey", req, resp, nil)
+	call(t, s, "/google.cloud.kms.v1.KeyManagementService/ListCryptoKeyVersions",
+		&kmspb.ListCryptoKeyVersionsRequest{Parent: keyName}, nil,
+		status.Error(codes.NotFound, "not found"))
+
+	stats := getStats(t, s)
+	if len(stats.Methods) != 2 {
+		t.Fatalf("len(stats.Methods)=%d, want 2", len(stats.Methods))
+	}
+	get, list := stats.Methods[0], stats.Methods[1]
+	if get.MethodName != "GetCryptoKey" || get.CallCount != 2 || get.ErrorCount != 0 {
+		t.Errorf("stats.Methods[0]=%v, want 2 successful GetCryptoKey calls", get)
+	}
+	if want := int64(2 * proto.Size(req)); get.RequestBytes != want {
+		t.Errorf("get.RequestBytes=%d, want %d", get.RequestBytes, want)
+	}
+	if want := int64(2 * proto.Size(resp)); get.ResponseBytes != want {
+		t.Errorf("get.ResponseBytes=%d, want %d", get.ResponseBytes, want)
+	}
+	if list.MethodName != "ListCryptoKeyVersions" || list.CallCount != 1 || list.ErrorCount != 1 {
+		t.Errorf("stats.Methods[1]=%v, want 1 failed ListCryptoKeyVersions call", list)
+	}
+
+	if len(stats.Resources) != 1 || stats.Resources[0].ResourceName != keyName {
+		t.Fatalf("stats.Resources=%v, want a single entry for %s", stats.Resources, keyName)
+	}
+	if got := stats.Resources[0].Methods; len(got) != 2 || got[0].CallCount != 2 || got[1].CallCount != 1 {
+		t.Errorf("stats.Resources[0].Methods=%v, want counts of 2 and 1", got)
+	}
+}
+
+func TestControlServicesAreNotCounted(t *testing.T) {
+	s := new(Server)
+	call(t, s, "/fakekms.FaultService/AddFault", &emptypb.Empty{}, &emptypb.Empty{}, nil)
+
+	if stats := getStats(t, s); len(stats.Methods) != 0 {
+		t.Errorf("stats.Methods=%v, want empty", stats.Methods)
+	}
+}
+
+func TestResetStats(t *testing.T) {
+	s := new(Server)
+	call(t, s, "/google.cloud.kms.v1.KeyManagementService/GetCryptoKey",
+		&kmspb.GetCryptoKeyRequest{Name: keyName}, &kmspb.CryptoKey{}, nil)
+
+	if _, err := s.ResetStats(context.Background(), &emptypb.Empty{}); err != nil {
+		t.Fatal(err)
+	}
+	if stats := getStats(t, s); len(stats.Methods) != 0 || len(stats.Resources) != 0 {
+		t.Errorf("GetStats()=%v, want empty", stats)
+	}
+
+	call(t, s, "/google.cloud.kms.v1.KeyManagementService/GetCryptoKey",
+		&kmspb.GetCryptoKeyRequest{Name: keyName}, &kmspb.CryptoKey{}, nil)
+	if stats := getStats(t, s); len(stats.Methods) != 1 || stats.Methods[0].CallCount != 1 {
+		t.Errorf("stats.Methods=%v, want a single call", stats.Methods)
+	}
+}
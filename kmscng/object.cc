@@ -19,6 +19,7 @@
 #include "absl/strings/str_format.h"
 #include "common/kms_client.h"
 #include "common/kms_v1.h"
+#include "common/public_key_cache.h"
 #include "common/status_macros.h"
 #include "kmscng/algorithm_details.h"
 #include "kmscng/cng_headers.h"
@@ -27,37 +28,33 @@
 #include "kmscng/util/status_utils.h"
 #include "kmscng/util/string_utils.h"
 #include "kmscng/version.h"
-#include "kmsp11/util/crypto_utils.h"
 
 namespace cloud_kms::kmscng {
 namespace {
 
-// TODO(b/270419822): drop these once crypto_utils has been migrated to common.
-using cloud_kms::kmsp11::MarshalX509PublicKeyDer;
-using cloud_kms::kmsp11::ParseX509PublicKeyPem;
-
-absl::StatusOr<kms_v1::PublicKey> GetPublicKey(const KmsClient& client,
-                                               std::string key_name) {
-  kms_v1::GetPublicKeyRequest pub_req;
-  pub_req.set_name(key_name);
-  auto pub_resp = client.GetPublicKey(pub_req);
-  if (!pub_resp.ok()) {
+absl::StatusOr<std::shared_ptr<const CachedPublicKey>> GetPublicKey(
+    const KmsClient& client, std::string key_name) {
+  auto pub = PublicKeyCache::Global().Get(client, key_name);
+  if (!pub.ok()) {
     // Populate status with more descriptive SECURITY_STATUS if not found.
-    absl::Status resp_status = pub_resp.status();
-    if (pub_resp.status().code() == absl::StatusCode::kNotFound) {
+    absl::Status resp_status = pub.status();
+    if (pub.status().code() == absl::StatusCode::kNotFound) {
       SetErrorSs(resp_status, NTE_BAD_KEYSET);
+    } else if (pub.status().code() == absl::StatusCode::kInternal) {
+      // The public key could not be parsed.
+      SetErrorSs(resp_status, NTE_INTERNAL_ERROR);
     }
     return resp_status;
   }
 
-  if (pub_resp->protection_level() != kms_v1::ProtectionLevel::HSM) {
+  if ((*pub)->public_key.protection_level() != kms_v1::ProtectionLevel::HSM) {
     return NewError(
         absl::StatusCode::kFailedPrecondition,
         "the key is not loadable due to unsupported protection level",
         NTE_NOT_SUPPORTED, SOURCE_LOCATION);
   }
 
-  return *pub_resp;
+  return *pub;
 }
 
 absl::flat_hash_map<std::wstring, std::string> BuildInfo(
@@ -106,9 +103,9 @@ absl::StatusOr<Object*> ValidateKeyHandle(NCRYPT_PROV_HANDLE prov_handle,
   return object;
 }
 
-Object::Object(std::string kms_key_name, std::unique_ptr<KmsClient> client,
+Object::Object(std::string kms_key_name, std::shared_ptr<KmsClient> client,
                kms_v1::CryptoKeyVersion::CryptoKeyVersionAlgorithm algorithm,
-               bssl::UniquePtr<EVP_PKEY> public_key,
+               std::shared_ptr<const CachedPublicKey> public_key,
                absl::flat_hash_map<std::wstring, std::string> info)
     : kms_key_name_(kms_key_name),
       kms_client_(std::move(client)),
@@ -118,23 +115,18 @@ Object::Object(std::string kms_key_name, std::unique_ptr<KmsClient> client,
 
 absl::StatusOr<Object*> Object::New(NCRYPT_PROV_HANDLE prov_handle,
                                     std::string key_name) {
-  ASSIGN_OR_RETURN(std::unique_ptr<KmsClient> client,
+  ASSIGN_OR_RETURN(std::shared_ptr<KmsClient> client,
                    NewKmsClient(prov_handle));
-  ASSIGN_OR_RETURN(auto public_key, GetPublicKey(*client, key_name));
-  absl::StatusOr<bssl::UniquePtr<EVP_PKEY>> pub =
-      ParseX509PublicKeyPem(public_key.pem());
-  if (!pub.ok()) {
-    absl::Status result = pub.status();
-    SetErrorSs(result, NTE_INTERNAL_ERROR);
-    return result;
-  }
-  ASSIGN_OR_RETURN(AlgorithmDetails alg_details,
-                   GetDetails(public_key.algorithm()));
+  ASSIGN_OR_RETURN(std::shared_ptr<const CachedPublicKey> public_key,
+                   GetPublicKey(*client, key_name));
+  kms_v1::CryptoKeyVersion::CryptoKeyVersionAlgorithm algorithm =
+      public_key->public_key.algorithm();
+  ASSIGN_OR_RETURN(AlgorithmDetails alg_details, GetDetails(algorithm));
   auto info = BuildInfo(prov_handle, key_name, alg_details);
 
   // using `new` to invoke a private constructor
-  return new Object(key_name, std::move(client), public_key.algorithm(),
-                    *std::move(pub), info);
+  return new Object(key_name, std::move(client), algorithm,
+                    std::move(public_key), info);
 }
 
 absl::StatusOr<std::string_view> Object::GetProperty(std::wstring_view name) {
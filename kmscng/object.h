@@ -19,6 +19,7 @@
 #include "absl/status/statusor.h"
 #include "common/kms_client.h"
 #include "common/openssl.h"
+#include "common/public_key_cache.h"
 #include "kmscng/cng_headers.h"
 
 namespace cloud_kms::kmscng {
@@ -35,18 +36,19 @@ class Object {
     return algorithm_;
   }
   EC_KEY* ec_public_key() const {
-    return EVP_PKEY_get0_EC_KEY(public_key_.get());
+    return EVP_PKEY_get0_EC_KEY(public_key_->key.get());
   }
 
  private:
-  Object(std::string kms_key_name, std::unique_ptr<KmsClient> client,
+  Object(std::string kms_key_name, std::shared_ptr<KmsClient> client,
          kms_v1::CryptoKeyVersion::CryptoKeyVersionAlgorithm algorithm,
-         bssl::UniquePtr<EVP_PKEY> public_key,
+         std::shared_ptr<const CachedPublicKey> public_key,
          absl::flat_hash_map<std::wstring, std::string> info);
 
   const std::string kms_key_name_;
-  std::unique_ptr<KmsClient> kms_client_;
-  bssl::UniquePtr<EVP_PKEY> public_key_;
+  std::shared_ptr<KmsClient> kms_client_;
+  // Shared with the process-wide PublicKeyCache.
+  std::shared_ptr<const CachedPublicKey> public_key_;
   const kms_v1::CryptoKeyVersion::CryptoKeyVersionAlgorithm algorithm_;
   const absl::flat_hash_map<std::wstring, std::string> key_info_;
 };
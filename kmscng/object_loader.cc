@@ -65,7 +65,7 @@ bool IsLoadable(const kms_v1::CryptoKeyVersion& ckv) {
 
 absl::StatusOr<std::vector<HeapAllocatedKeyDetails>> BuildCkvList(
     NCRYPT_PROV_HANDLE prov_handle, const ProviderConfig& config) {
-  ASSIGN_OR_RETURN(std::unique_ptr<KmsClient> client,
+  ASSIGN_OR_RETURN(std::shared_ptr<KmsClient> client,
                    NewKmsClient(prov_handle));
   std::vector<HeapAllocatedKeyDetails> result;
   if (config.ByteSizeLong() == 0) {
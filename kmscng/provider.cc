@@ -17,6 +17,7 @@
 #include <cwchar>
 
 #include "absl/container/flat_hash_set.h"
+#include "common/kms_client_registry.h"
 #include "common/status_macros.h"
 #include "kmscng/cng_headers.h"
 #include "kmscng/util/errors.h"
@@ -60,7 +61,7 @@ absl::flat_hash_map<std::wstring, std::string> BuildInfo() {
 
 }  // namespace
 
-absl::StatusOr<std::unique_ptr<KmsClient>> NewKmsClient(
+absl::StatusOr<std::shared_ptr<KmsClient>> NewKmsClient(
     NCRYPT_PROV_HANDLE prov_handle) {
   ASSIGN_OR_RETURN(Provider * prov, ValidateProviderHandle(prov_handle));
   KmsClient::Options options;
@@ -81,7 +82,11 @@ absl::StatusOr<std::unique_ptr<KmsClient>> NewKmsClient(
     SetErrorSs(status, NTE_INTERNAL_ERROR);
   };
 
-  return std::make_unique<KmsClient>(options);
+  return KmsClientRegistry::Global().GetOrCreate(
+      KmsClientRegistry::KeyFor(options, creds_type),
+      [&]() -> absl::StatusOr<std::unique_ptr<KmsClient>> {
+        return std::make_unique<KmsClient>(options);
+      });
 }
 
 absl::StatusOr<Provider*> ValidateProviderHandle(
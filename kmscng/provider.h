@@ -43,9 +43,9 @@ class Provider {
   absl::flat_hash_map<std::wstring, std::string> provider_info_;
 };
 
-// Initializes a new KmsClient while checking the provider properties for
-// configuration options.
-absl::StatusOr<std::unique_ptr<KmsClient>> NewKmsClient(
+// Returns a KmsClient configured from the provider properties. Clients are
+// shared with every other caller that uses the same configuration.
+absl::StatusOr<std::shared_ptr<KmsClient>> NewKmsClient(
     NCRYPT_PROV_HANDLE prov_handle);
 
 // Validates the input NCRYPT_PROV_HANDLE and returns a pointer to the Provider
@@ -106,6 +106,40 @@ extern "C" {
 //   field should not be freed between C_EncryptInit and C_Encrypt..
 #define CKM_CLOUDKMS_AES_GCM (CKM_GOOGLE_DEFINED | 0x01UL)
 
+// Google-defined functions. These are exported by the library, but are not
+// part of CK_FUNCTION_LIST; resolve them with dlsym or GetProcAddress. They are
+// declared with the underlying types of CK_RV, CK_SESSION_HANDLE and CK_ULONG
+// so that this header does not depend on pkcs11.h.
+
+// Sets the time budget, in milliseconds, for the Cloud KMS calls made during
+// each subsequent function call on session hSession, including any retries of
+// those calls. A function call whose budget runs out fails in the same way as
+// one that exceeds the library-wide rpc_timeout_secs, which still applies; a
+// budget can only shorten it. A value of 0 removes the session's budget.
+unsigned long C_KMS_SetSessionDeadline(unsigned long hSession,
+                                       unsigned long ulTimeoutMillis);
+typedef unsigned long (*CK_C_KMS_SetSessionDeadline)(
+    unsigned long hSession, unsigned long ulTimeoutMillis);
+
+// Generates ulCount keys in the key ring of session hSession's token, as if
+// by one call to C_GenerateKey or C_GenerateKeyPair per key, but with the
+// keys created concurrently and added to the token together. Key i is labeled
+// with the pulLabelLens[i] bytes at ppLabels[i], and has the algorithm
+// pulAlgorithms[i], one of the KMS_ALGORITHM_* values above. On return,
+// phKeys[i] holds the handle of key i's private or secret key. If any key
+// cannot be generated, the function returns that key's error and sets its
+// handle to CK_INVALID_HANDLE; the other keys are still generated, and their
+// handles are returned.
+unsigned long C_KMS_GenerateKeys(unsigned long hSession,
+                                 unsigned char** ppLabels,
+                                 unsigned long* pulLabelLens,
+                                 unsigned long* pulAlgorithms,
+                                 unsigned long ulCount, unsigned long* phKeys);
+typedef unsigned long (*CK_C_KMS_GenerateKeys)(
+    unsigned long hSession, unsigned char** ppLabels,
+    unsigned long* pulLabelLens, unsigned long* pulAlgorithms,
+    unsigned long ulCount, unsigned long* phKeys);
+
 #ifdef __cplusplus
 }
 #endif
@@ -104,9 +104,12 @@ func loadP11FunctionNames(t *testing.T) []string {
 		log.Fatalf("error parsing function list textproto: %+v", err)
 	}
 
-	names := make([]string, len(list.Functions))
-	for i, v := range list.Functions {
-		names[i] = v.Name
+	var names []string
+	for _, v := range list.Functions {
+		names = append(names, v.Name)
+	}
+	for _, v := range list.VendorFunctions {
+		names = append(names, v.Name)
 	}
 	sort.Strings(names)
 	return names
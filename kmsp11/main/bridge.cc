@@ -111,7 +111,7 @@ absl::Status Initialize(CK_VOID_PTR pInitArgs) {
       InitializeLogging(config.log_directory(), config.log_filename_suffix()));
 
   absl::StatusOr<std::unique_ptr<Provider>> new_provider =
-      Provider::New(config);
+      Provider::New(config, TakeParkedWarmState());
   if (!new_provider.ok()) {
     ShutdownLogging();
     return new_provider.status();
@@ -123,8 +123,12 @@ absl::Status Initialize(CK_VOID_PTR pInitArgs) {
 // Shut down the library.
 // http://docs.oasis-open.org/pkcs11/pkcs11-base/v2.40/pkcs11-base-v2.40.html#_Toc383864872
 absl::Status Finalize(CK_VOID_PTR pReserved) {
-  RETURN_IF_ERROR(GetProvider());
-  RETURN_IF_ERROR(ReleaseGlobalProvider());
+  ASSIGN_OR_RETURN(Provider * provider, GetProvider());
+  if (provider->library_config().retain_state_on_finalize()) {
+    RETURN_IF_ERROR(ParkGlobalProvider());
+  } else {
+    RETURN_IF_ERROR(ReleaseGlobalProvider());
+  }
   ShutdownLogging();
   return absl::OkStatus();
 }
@@ -962,4 +966,68 @@ absl::Status GenerateRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pRandomData,
   return session->GenerateRandom(absl::MakeSpan(pRandomData, ulRandomLen));
 }
 
+// Set the time budget for Cloud KMS calls made on behalf of a session. This is
+// a Google-defined function; see kmsp11.h.
+absl::Status KMS_SetSessionDeadline(CK_SESSION_HANDLE hSession,
+                                    CK_ULONG ulTimeoutMillis) {
+  ASSIGN_OR_RETURN(std::shared_ptr<Session> session, GetSession(hSession));
+  session->set_rpc_timeout(ulTimeoutMillis == 0
+                               ? absl::InfiniteDuration()
+                               : absl::Milliseconds(ulTimeoutMillis));
+  return absl::OkStatus();
+}
+
+// Generate a batch of keys. This is a Google-defined function; see kmsp11.h.
+absl::Status KMS_GenerateKeys(CK_SESSION_HANDLE hSession,
+                              CK_UTF8CHAR_PTR* ppLabels,
+                              CK_ULONG_PTR pulLabelLens,
+                              CK_ULONG_PTR pulAlgorithms, CK_ULONG ulCount,
+                              CK_OBJECT_HANDLE_PTR phKeys) {
+  ASSIGN_OR_RETURN(std::shared_ptr<Session> session, GetSession(hSession));
+
+  if (ulCount == 0) {
+    return absl::OkStatus();
+  }
+  if (!ppLabels) {
+    return NullArgumentError("ppLabels", SOURCE_LOCATION);
+  }
+  if (!pulLabelLens) {
+    return NullArgumentError("pulLabelLens", SOURCE_LOCATION);
+  }
+  if (!pulAlgorithms) {
+    return NullArgumentError("pulAlgorithms", SOURCE_LOCATION);
+  }
+  if (!phKeys) {
+    return NullArgumentError("phKeys", SOURCE_LOCATION);
+  }
+
+  std::vector<std::vector<CK_ATTRIBUTE>> templates(ulCount);
+  for (CK_ULONG i = 0; i < ulCount; i++) {
+    if (!ppLabels[i]) {
+      return NullArgumentError(absl::StrFormat("ppLabels[%d]", i),
+                               SOURCE_LOCATION);
+    }
+    templates[i] = {
+        {CKA_LABEL, ppLabels[i], pulLabelLens[i]},
+        {CKA_KMS_ALGORITHM, &pulAlgorithms[i], sizeof(CK_ULONG)},
+    };
+  }
+
+  ASSIGN_OR_RETURN(std::vector<absl::StatusOr<CK_OBJECT_HANDLE>> handles,
+                   session->GenerateKeys(templates));
+
+  // Report the first failure, but return the handles of every key that was
+  // generated, so that the caller need not look them up.
+  absl::Status result = absl::OkStatus();
+  for (CK_ULONG i = 0; i < ulCount; i++) {
+    if (handles[i].ok()) {
+      phKeys[i] = *handles[i];
+    } else {
+      phKeys[i] = CK_INVALID_HANDLE;
+      result.Update(handles[i].status());
+    }
+  }
+  return result;
+}
+
 }  // namespace cloud_kms::kmsp11
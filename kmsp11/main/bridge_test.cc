@@ -21,6 +21,7 @@
 #include "common/test/test_platform.h"
 #include "common/test/test_status_macros.h"
 #include "fakekms/cpp/fakekms.h"
+#include "fakekms/cpp/fault_helpers.h"
 #include "gmock/gmock.h"
 #include "kmsp11/config/config.h"
 #include "kmsp11/kmsp11.h"
@@ -1939,5 +1940,149 @@ TEST(BridgeTest, GenerateRandomFailsNullBuffer) {
               StatusRvIs(CKR_ARGUMENTS_BAD));
 }
 
+TEST(BridgeTest, SetSessionDeadlineBoundsKmsCalls) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake_server,
+                       fakekms::Server::New());
+  ASSERT_OK_AND_ASSIGN(std::string config_file,
+                       InitializeBridgeForOneKmsKeyRing(fake_server.get()));
+  absl::Cleanup c = [config_file] {
+    std::remove(config_file.c_str());
+    EXPECT_OK(Finalize(nullptr));
+  };
+
+  CK_SESSION_HANDLE session;
+  EXPECT_OK(OpenSession(0, CKF_SERIAL_SESSION, nullptr, nullptr, &session));
+  fakekms::AddDelayOrDie(*fake_server, absl::Milliseconds(200),
+                         "GenerateRandomBytes");
+
+  std::vector<uint8_t> rand(32);
+  EXPECT_OK(KMS_SetSessionDeadline(session, 50));
+  EXPECT_THAT(GenerateRandom(session, rand.data(), rand.size()),
+              AllOf(StatusIs(absl::StatusCode::kDeadlineExceeded),
+                    StatusRvIs(CKR_DEVICE_ERROR)));
+
+  EXPECT_OK(KMS_SetSessionDeadline(session, 0));
+  EXPECT_OK(GenerateRandom(session, rand.data(), rand.size()));
+}
+
+TEST(BridgeTest, SetSessionDeadlineFailsNotInitialized) {
+  EXPECT_THAT(KMS_SetSessionDeadline(0, 0),
+              StatusRvIs(CKR_CRYPTOKI_NOT_INITIALIZED));
+}
+
+TEST(BridgeTest, SetSessionDeadlineFailsInvalidSessionHandle) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake_server,
+                       fakekms::Server::New());
+  ASSERT_OK_AND_ASSIGN(std::string config_file,
+                       InitializeBridgeForOneKmsKeyRing(fake_server.get()));
+  absl::Cleanup c = [config_file] {
+    std::remove(config_file.c_str());
+    EXPECT_OK(Finalize(nullptr));
+  };
+
+  EXPECT_THAT(KMS_SetSessionDeadline(0, 0),
+              StatusRvIs(CKR_SESSION_HANDLE_INVALID));
+}
+
+TEST(BridgeTest, GenerateKeysSuccess) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake_server,
+                       fakekms::Server::New());
+  ASSERT_OK_AND_ASSIGN(std::string config_file,
+                       InitializeBridgeForOneKmsKeyRing(fake_server.get()));
+  absl::Cleanup c = [config_file] {
+    std::remove(config_file.c_str());
+    EXPECT_OK(Finalize(nullptr));
+  };
+
+  CK_SESSION_HANDLE session;
+  EXPECT_OK(OpenSession(0, CKF_SERIAL_SESSION | CKF_RW_SESSION, nullptr,
+                        nullptr, &session));
+
+  std::string labels[] = {"ec-key", "hmac-key"};
+  CK_UTF8CHAR_PTR label_ptrs[] = {
+      reinterpret_cast<CK_UTF8CHAR_PTR>(labels[0].data()),
+      reinterpret_cast<CK_UTF8CHAR_PTR>(labels[1].data())};
+  CK_ULONG label_lens[] = {labels[0].size(), labels[1].size()};
+  CK_ULONG algorithms[] = {KMS_ALGORITHM_EC_SIGN_P256_SHA256,
+                           KMS_ALGORITHM_HMAC_SHA256};
+  CK_OBJECT_HANDLE handles[2];
+
+  EXPECT_OK(KMS_GenerateKeys(session, label_ptrs, label_lens, algorithms, 2,
+                             handles));
+
+  CK_OBJECT_CLASS expected_classes[] = {CKO_PRIVATE_KEY, CKO_SECRET_KEY};
+  for (int i = 0; i < 2; i++) {
+    CK_OBJECT_CLASS object_class;
+    CK_ATTRIBUTE attr = {CKA_CLASS, &object_class, sizeof(object_class)};
+    EXPECT_OK(GetAttributeValue(session, handles[i], &attr, 1));
+    EXPECT_EQ(object_class, expected_classes[i]);
+  }
+}
+
+TEST(BridgeTest, GenerateKeysReturnsHandlesOfGeneratedKeysOnFailure) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake_server,
+                       fakekms::Server::New());
+  ASSERT_OK_AND_ASSIGN(std::string config_file,
+                       InitializeBridgeForOneKmsKeyRing(fake_server.get()));
+  absl::Cleanup c = [config_file] {
+    std::remove(config_file.c_str());
+    EXPECT_OK(Finalize(nullptr));
+  };
+
+  CK_SESSION_HANDLE session;
+  EXPECT_OK(OpenSession(0, CKF_SERIAL_SESSION | CKF_RW_SESSION, nullptr,
+                        nullptr, &session));
+
+  std::string label = "my-great-key";
+  CK_UTF8CHAR_PTR label_ptr = reinterpret_cast<CK_UTF8CHAR_PTR>(label.data());
+  CK_ULONG label_len = label.size();
+  CK_ULONG algorithm = KMS_ALGORITHM_EC_SIGN_P256_SHA256;
+  CK_OBJECT_HANDLE handle;
+  EXPECT_OK(
+      KMS_GenerateKeys(session, &label_ptr, &label_len, &algorithm, 1, &handle));
+
+  std::string new_label = "my-other-key";
+  CK_UTF8CHAR_PTR label_ptrs[] = {
+      label_ptr, reinterpret_cast<CK_UTF8CHAR_PTR>(new_label.data())};
+  CK_ULONG label_lens[] = {label.size(), new_label.size()};
+  CK_ULONG algorithms[] = {algorithm, algorithm};
+  CK_OBJECT_HANDLE handles[2];
+
+  EXPECT_THAT(KMS_GenerateKeys(session, label_ptrs, label_lens, algorithms, 2,
+                               handles),
+              StatusRvIs(CKR_ARGUMENTS_BAD));
+  EXPECT_EQ(handles[0], CK_INVALID_HANDLE);
+  EXPECT_NE(handles[1], CK_INVALID_HANDLE);
+}
+
+TEST(BridgeTest, GenerateKeysFailsNotInitialized) {
+  EXPECT_THAT(KMS_GenerateKeys(0, nullptr, nullptr, nullptr, 0, nullptr),
+              StatusRvIs(CKR_CRYPTOKI_NOT_INITIALIZED));
+}
+
+TEST(BridgeTest, GenerateKeysFailsHandlesNullptr) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake_server,
+                       fakekms::Server::New());
+  ASSERT_OK_AND_ASSIGN(std::string config_file,
+                       InitializeBridgeForOneKmsKeyRing(fake_server.get()));
+  absl::Cleanup c = [config_file] {
+    std::remove(config_file.c_str());
+    EXPECT_OK(Finalize(nullptr));
+  };
+
+  CK_SESSION_HANDLE session;
+  EXPECT_OK(OpenSession(0, CKF_SERIAL_SESSION | CKF_RW_SESSION, nullptr,
+                        nullptr, &session));
+
+  std::string label = "my-great-key";
+  CK_UTF8CHAR_PTR label_ptr = reinterpret_cast<CK_UTF8CHAR_PTR>(label.data());
+  CK_ULONG label_len = label.size();
+  CK_ULONG algorithm = KMS_ALGORITHM_EC_SIGN_P256_SHA256;
+
+  EXPECT_THAT(
+      KMS_GenerateKeys(session, &label_ptr, &label_len, &algorithm, 1, nullptr),
+      StatusRvIs(CKR_ARGUMENTS_BAD));
+}
+
 }  // namespace
 }  // namespace cloud_kms::kmsp11
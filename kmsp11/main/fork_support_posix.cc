@@ -15,6 +15,8 @@
 #include <pthread.h>
 #include <string.h>
 
+#include "common/kms_client_registry.h"
+#include "common/public_key_cache.h"
 #include "grpc/fork.h"
 #include "kmsp11/main/fork_support.h"
 #include "kmsp11/util/global_provider.h"
@@ -40,6 +42,11 @@ absl::Status RegisterForkHandlers() {
   int result =
       pthread_atfork(/*prepare=*/nullptr, /*parent=*/nullptr, /*child=*/[] {
         ReleaseGlobalProvider().IgnoreError();
+        TakeParkedWarmState().reset();
+        // Fetches in flight in the parent never complete in the child, and
+        // the parent's channels must not be shared with it.
+        PublicKeyCache::Global().Clear();
+        KmsClientRegistry::Global().Clear();
         ShutdownLogging();
       });
   if (result != 0) {
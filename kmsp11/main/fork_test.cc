@@ -38,8 +38,9 @@ TEST(ForkTest, ProviderToleratesForkAfterInitWithEnvVariableSet) {
   SetEnvVariable(grpc_fork_env_var, "1");
   absl::Cleanup c1 = [&] { ClearEnvVariable(grpc_fork_env_var); };
 
+  // An in-process fake would not be serving in the forked child.
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<fakekms::Server> fake_kms,
-                       fakekms::Server::New());
+                       fakekms::Server::NewSubprocess());
   auto client = fake_kms->NewClient();
 
   kms_v1::KeyRing kr;
@@ -14,11 +14,15 @@
 
 #include "kmsp11/object_loader.h"
 
+#include "absl/cleanup/cleanup.h"
+#include "absl/crc/crc32c.h"
+#include "common/public_key_cache.h"
 #include "common/status_macros.h"
 #include "glog/logging.h"
 #include "kmsp11/algorithm_details.h"
 #include "kmsp11/util/crypto_utils.h"
 #include "kmsp11/util/errors.h"
+#include "openssl/hmac.h"
 
 namespace cloud_kms::kmsp11 {
 namespace {
@@ -91,76 +95,175 @@ Key* ObjectLoader::Cache::Get(std::string_view ckv_name) {
   return it->second.get();
 }
 
-Key* ObjectLoader::Cache::Store(const kms_v1::CryptoKeyVersion& ckv,
-                                std::string_view public_key_der,
-                                std::string_view certificate_der) {
-  keys_[ckv.name()] = std::make_unique<Key>();
-  Key* key = keys_[ckv.name()].get();
+absl::StatusOr<Key*> ObjectLoader::Cache::Store(
+    const kms_v1::CryptoKeyVersion& ckv, std::string_view public_key_der,
+    std::string_view certificate_der) {
+  auto key = std::make_unique<Key>();
+  // If a later allocation fails, the handles allocated so far are returned.
+  absl::Cleanup release_handles = [&] { ReleaseHandles(*key); };
 
   *key->mutable_crypto_key_version() = ckv;
-  key->set_public_key_handle(NewHandle());
-  key->set_private_key_handle(NewHandle());
+  ASSIGN_OR_RETURN(CK_OBJECT_HANDLE public_key_handle,
+                   NewHandle(ckv.name(), CKO_PUBLIC_KEY));
+  key->set_public_key_handle(public_key_handle);
+  ASSIGN_OR_RETURN(CK_OBJECT_HANDLE private_key_handle,
+                   NewHandle(ckv.name(), CKO_PRIVATE_KEY));
+  key->set_private_key_handle(private_key_handle);
   key->set_public_key_der(std::string(public_key_der));
 
   if (!certificate_der.empty()) {
     key->mutable_certificate()->set_x509_der(std::string(certificate_der));
-    key->mutable_certificate()->set_handle(NewHandle());
+    ASSIGN_OR_RETURN(CK_OBJECT_HANDLE certificate_handle,
+                     NewHandle(ckv.name(), CKO_CERTIFICATE));
+    key->mutable_certificate()->set_handle(certificate_handle);
   }
 
-  return key;
+  std::move(release_handles).Cancel();
+  return (keys_[ckv.name()] = std::move(key)).get();
 }
 
-Key* ObjectLoader::Cache::StoreSecretKey(const kms_v1::CryptoKeyVersion& ckv) {
-  keys_[ckv.name()] = std::make_unique<Key>();
-  Key* key = keys_[ckv.name()].get();
+absl::StatusOr<Key*> ObjectLoader::Cache::StoreSecretKey(
+    const kms_v1::CryptoKeyVersion& ckv) {
+  auto key = std::make_unique<Key>();
 
   *key->mutable_crypto_key_version() = ckv;
-  key->set_secret_key_handle(NewHandle());
+  ASSIGN_OR_RETURN(CK_OBJECT_HANDLE secret_key_handle,
+                   NewHandle(ckv.name(), CKO_SECRET_KEY));
+  key->set_secret_key_handle(secret_key_handle);
 
-  return key;
+  return (keys_[ckv.name()] = std::move(key)).get();
 }
 
-void ObjectLoader::Cache::EvictUnused(const ObjectStoreState& state) {
-  absl::flat_hash_set<std::string> items_to_retain;
-  for (const Key& key : state.keys()) {
-    items_to_retain.insert(key.crypto_key_version().name());
+std::vector<const Key*> ObjectLoader::Cache::Versions(
+    std::string_view crypto_key_name) const {
+  auto it = versions_.find(crypto_key_name);
+  if (it == versions_.end()) {
+    return {};
+  }
+  return it->second;
+}
+
+std::vector<const Key*> ObjectLoader::Cache::InOrder() const {
+  std::vector<const Key*> result;
+  result.reserve(keys_.size());
+  for (const std::string& crypto_key_name : crypto_keys_) {
+    const std::vector<const Key*>& versions = versions_.at(crypto_key_name);
+    result.insert(result.end(), versions.begin(), versions.end());
+  }
+  return result;
+}
+
+void ObjectLoader::Cache::SetState(
+    std::vector<std::string> crypto_keys,
+    absl::flat_hash_map<std::string, std::vector<const Key*>> versions,
+    const absl::flat_hash_set<std::string>& reloaded) {
+  for (const auto& [crypto_key_name, previous] : versions_) {
+    auto current = versions.find(crypto_key_name);
+    if (current == versions.end()) {
+      for (const Key* key : previous) {
+        Evict(key);
+      }
+      continue;
+    }
+    if (!reloaded.contains(crypto_key_name)) {
+      continue;
+    }
+
+    absl::flat_hash_set<const Key*> retained(current->second.begin(),
+                                             current->second.end());
+    for (const Key* key : previous) {
+      if (!retained.contains(key)) {
+        Evict(key);
+      }
+    }
+  }
+
+  crypto_keys_ = std::move(crypto_keys);
+  versions_ = std::move(versions);
+}
+
+void ObjectLoader::Cache::EvictUnused() {
+  absl::flat_hash_set<const Key*> items_to_retain;
+  for (const auto& [crypto_key_name, versions] : versions_) {
+    items_to_retain.insert(versions.begin(), versions.end());
   }
 
   auto it = keys_.begin();
   while (it != keys_.end()) {
-    if (items_to_retain.contains(it->first)) {
+    if (items_to_retain.contains(it->second.get())) {
       it++;
       continue;
     }
 
-    if (it->second->public_key_handle() != CK_INVALID_HANDLE) {
-      allocated_handles_.erase(it->second->public_key_handle());
+    ReleaseHandles(*it->second);
+    keys_.erase(it++);
+  }
+}
+
+absl::StatusOr<CK_OBJECT_HANDLE> ObjectLoader::Cache::NewHandle(
+    std::string_view ckv_name, CK_OBJECT_CLASS object_class) {
+  if (!keyed_handles()) {
+    return handles_.Allocate(CKR_DEVICE_MEMORY);
+  }
+
+  std::string owner = absl::StrCat(ckv_name, "#", object_class);
+  // On the (unlikely) event of a collision, derive another handle, so that
+  // the handle of the object that was loaded first is unaffected.
+  for (uint32_t attempt = 0;; attempt++) {
+    std::string message = absl::StrCat(owner, "#", attempt);
+    uint8_t mac[EVP_MAX_MD_SIZE];
+    unsigned int mac_len;
+    if (!HMAC(EVP_sha256(), handle_secret_.data(), handle_secret_.size(),
+              reinterpret_cast<const uint8_t*>(message.data()), message.size(),
+              mac, &mac_len)) {
+      return NewInternalError(
+          absl::StrCat("failed to derive handle: ", SslErrorToString()),
+          SOURCE_LOCATION);
     }
-    if (it->second->private_key_handle() != CK_INVALID_HANDLE) {
-      allocated_handles_.erase(it->second->private_key_handle());
+    CK_OBJECT_HANDLE handle = 0;
+    for (size_t i = 0; i < sizeof(CK_OBJECT_HANDLE); i++) {
+      handle = (handle << 8) | mac[i];
     }
-    if (it->second->has_certificate()) {
-      allocated_handles_.erase(it->second->certificate().handle());
+    if (handle == CK_INVALID_HANDLE) {
+      continue;
     }
-    if (it->second->secret_key_handle() != CK_INVALID_HANDLE) {
-      allocated_handles_.erase(it->second->secret_key_handle());
+    if (keyed_handles_.try_emplace(handle, owner).second) {
+      return handle;
+    }
+    LOG(WARNING) << "WARNING: derived object handle for " << owner
+                 << " collides with the handle for "
+                 << keyed_handles_[handle]
+                 << "; handles may differ between processes";
+  }
+}
+
+void ObjectLoader::Cache::ReleaseHandle(CK_OBJECT_HANDLE handle) {
+  if (keyed_handles()) {
+    keyed_handles_.erase(handle);
+  } else {
+    handles_.Release(handle);
+  }
+}
+
+void ObjectLoader::Cache::ReleaseHandles(const Key& key) {
+  for (CK_OBJECT_HANDLE handle :
+       {key.public_key_handle(), key.private_key_handle(),
+        key.certificate().handle(), key.secret_key_handle()}) {
+    if (handle != CK_INVALID_HANDLE) {
+      ReleaseHandle(handle);
     }
-    keys_.erase(it++);
   }
 }
 
-CK_OBJECT_HANDLE ObjectLoader::Cache::NewHandle() {
-  CK_OBJECT_HANDLE handle;
-  do {
-    handle = RandomHandle();
-  } while (allocated_handles_.contains(handle));
-  allocated_handles_.insert(handle);
-  return handle;
+void ObjectLoader::Cache::Evict(const Key* key) {
+  ReleaseHandles(*key);
+  keys_.erase(key->crypto_key_version().name());
 }
 
 absl::StatusOr<std::unique_ptr<ObjectLoader>> ObjectLoader::New(
     std::string_view key_ring_name,
-    absl::Span<const std::string* const> pem_user_certs, bool generate_certs) {
+    absl::Span<const std::string* const> pem_user_certs, bool generate_certs,
+    std::string_view handle_secret) {
   absl::flat_hash_map<std::string, std::string> user_certs;
   for (const std::string* const pem_cert : pem_user_certs) {
     ASSIGN_OR_RETURN(bssl::UniquePtr<X509> parsed_cert,
@@ -184,17 +287,76 @@ absl::StatusOr<std::unique_ptr<ObjectLoader>> ObjectLoader::New(
   }
 
   return absl::WrapUnique(
-      new ObjectLoader(key_ring_name, user_certs, std::move(cert_authority)));
+      new ObjectLoader(key_ring_name, user_certs, std::move(cert_authority),
+                       handle_secret));
+}
+
+uint32_t ObjectLoader::BucketOf(std::string_view crypto_key_name,
+                                uint32_t bucket_count) {
+  return absl::ComputeCrc32c(crypto_key_name) % bucket_count;
+}
+
+absl::Status ObjectLoader::LoadVersions(const KmsClient& client,
+                                        const kms_v1::CryptoKey& key,
+                                        std::vector<const Key*>* versions) {
+  kms_v1::ListCryptoKeyVersionsRequest req;
+  req.set_parent(key.name());
+  CryptoKeyVersionsRange v = client.ListCryptoKeyVersions(req);
+
+  for (CryptoKeyVersionsRange::iterator it = v.begin(); it != v.end(); it++) {
+    ASSIGN_OR_RETURN(kms_v1::CryptoKeyVersion ckv, *it);
+    if (!IsLoadable(ckv)) {
+      continue;
+    }
+
+    Key* cached_key = cache_.Get(ckv.name());
+    if (cached_key) {
+      versions->push_back(cached_key);
+      continue;
+    }
+
+    if (key.purpose() == kms_v1::CryptoKey::MAC ||
+        key.purpose() == kms_v1::CryptoKey::RAW_ENCRYPT_DECRYPT) {
+      ASSIGN_OR_RETURN(Key * stored, cache_.StoreSecretKey(ckv));
+      versions->push_back(stored);
+    } else {
+      ASSIGN_OR_RETURN(std::shared_ptr<const CachedPublicKey> pub,
+                       PublicKeyCache::Global().Get(client, ckv.name()));
+
+      std::string cert_der;
+      if (auto it = user_certs_.find(pub->der); it != user_certs_.end()) {
+        cert_der = it->second;
+      } else if (cert_authority_) {
+        ASSIGN_OR_RETURN(bssl::UniquePtr<X509> cert,
+                         cert_authority_->GenerateCert(ckv, pub->key.get()));
+        ASSIGN_OR_RETURN(cert_der, MarshalX509CertificateDer(cert.get()));
+      }
+
+      ASSIGN_OR_RETURN(Key * stored, cache_.Store(ckv, pub->der, cert_der));
+      versions->push_back(stored);
+    }
+  }
+  return absl::OkStatus();
 }
 
 absl::StatusOr<ObjectStoreState> ObjectLoader::BuildState(
     const KmsClient& client) {
+  return BuildState(client, 0, 1);
+}
+
+absl::StatusOr<ObjectStoreState> ObjectLoader::BuildState(
+    const KmsClient& client, uint32_t bucket, uint32_t bucket_count) {
   // In the initial implementation of Provider::LoopRefresh, there is no danger
   // of overlapping calls to BuildState. That said, holding the mutex for the
   // duration of BuildState seems like a pretty cheap way to guard against an
   // unintentional change that causes BuildState calls to overlap.
   absl::MutexLock lock(&cache_mutex_);
-  ObjectStoreState result;
+  // If the build fails, the keys it stored are not part of any state.
+  absl::Cleanup evict_stored = [&] { cache_.EvictUnused(); };
+
+  std::vector<std::string> crypto_keys;
+  absl::flat_hash_map<std::string, std::vector<const Key*>> versions;
+  absl::flat_hash_set<std::string> reloaded;
 
   kms_v1::ListCryptoKeysRequest req;
   req.set_parent(key_ring_name_);
@@ -206,48 +368,21 @@ absl::StatusOr<ObjectStoreState> ObjectLoader::BuildState(
       continue;
     }
 
-    kms_v1::ListCryptoKeyVersionsRequest req;
-    req.set_parent(key.name());
-    CryptoKeyVersionsRange v = client.ListCryptoKeyVersions(req);
-
-    for (CryptoKeyVersionsRange::iterator it = v.begin(); it != v.end(); it++) {
-      ASSIGN_OR_RETURN(kms_v1::CryptoKeyVersion ckv, *it);
-      if (!IsLoadable(ckv)) {
-        continue;
-      }
+    crypto_keys.push_back(key.name());
+    std::vector<const Key*>& key_versions = versions[key.name()];
+    if (bucket_count > 1 && BucketOf(key.name(), bucket_count) != bucket) {
+      key_versions = cache_.Versions(key.name());
+      continue;
+    }
 
-      Key* cached_key = cache_.Get(ckv.name());
-      if (cached_key) {
-        *result.add_keys() = *cached_key;
-        continue;
-      }
+    reloaded.insert(key.name());
+    RETURN_IF_ERROR(LoadVersions(client, key, &key_versions));
+  }
 
-      if (key.purpose() == kms_v1::CryptoKey::MAC ||
-          key.purpose() == kms_v1::CryptoKey::RAW_ENCRYPT_DECRYPT) {
-        *result.add_keys() = *cache_.StoreSecretKey(ckv);
-      } else {
-        kms_v1::GetPublicKeyRequest pub_req;
-        pub_req.set_name(ckv.name());
-
-        ASSIGN_OR_RETURN(kms_v1::PublicKey pub_resp,
-                         client.GetPublicKey(pub_req));
-        ASSIGN_OR_RETURN(bssl::UniquePtr<EVP_PKEY> pub,
-                         ParseX509PublicKeyPem(pub_resp.pem()));
-        ASSIGN_OR_RETURN(std::string public_key_der,
-                         MarshalX509PublicKeyDer(pub.get()));
-
-        std::string cert_der;
-        if (auto it = user_certs_.find(public_key_der);
-            it != user_certs_.end()) {
-          cert_der = it->second;
-        } else if (cert_authority_) {
-          ASSIGN_OR_RETURN(bssl::UniquePtr<X509> cert,
-                           cert_authority_->GenerateCert(ckv, pub.get()));
-          ASSIGN_OR_RETURN(cert_der, MarshalX509CertificateDer(cert.get()));
-        }
-
-        *result.add_keys() = *cache_.Store(ckv, public_key_der, cert_der);
-      }
+  ObjectStoreState result;
+  for (const std::string& crypto_key_name : crypto_keys) {
+    for (const Key* key : versions[crypto_key_name]) {
+      *result.add_keys() = *key;
     }
   }
 
@@ -265,7 +400,19 @@ absl::StatusOr<ObjectStoreState> ObjectLoader::BuildState(
                  "to a KMS key.";
   }
 
-  cache_.EvictUnused(result);
+  std::move(evict_stored).Cancel();
+  cache_.SetState(std::move(crypto_keys), std::move(versions), reloaded);
+  result.set_keyed_handles(cache_.keyed_handles());
+  return result;
+}
+
+ObjectStoreState ObjectLoader::CachedState() {
+  absl::MutexLock lock(&cache_mutex_);
+  ObjectStoreState result;
+  for (const Key* key : cache_.InOrder()) {
+    *result.add_keys() = *key;
+  }
+  result.set_keyed_handles(cache_.keyed_handles());
   return result;
 }
 
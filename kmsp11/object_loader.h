@@ -25,46 +25,110 @@
 #include "kmsp11/cert_authority.h"
 #include "kmsp11/cryptoki.h"
 #include "kmsp11/object_store_state.pb.h"
+#include "kmsp11/util/handle_allocator.h"
 
 namespace cloud_kms::kmsp11 {
 
 class ObjectLoader {
  public:
+  // If `handle_secret` is non-empty, object handles are derived from it and
+  // the object's identity, so that the same object has the same handle in
+  // every process that uses the same secret. Otherwise, handles are allocated
+  // by a HandleAllocator.
   static absl::StatusOr<std::unique_ptr<ObjectLoader>> New(
       std::string_view key_ring_name,
-      absl::Span<const std::string* const> pem_user_certs, bool generate_certs);
+      absl::Span<const std::string* const> pem_user_certs, bool generate_certs,
+      std::string_view handle_secret = "");
 
   inline std::string_view key_ring_name() const { return key_ring_name_; }
 
   absl::StatusOr<ObjectStoreState> BuildState(const KmsClient& client);
 
+  // Builds a new state in which only the CryptoKeys in `bucket` (of
+  // `bucket_count` buckets, assigned by name) have their versions reloaded
+  // from Cloud KMS. The versions of other CryptoKeys are carried over from the
+  // previously built state. CryptoKeys that no longer exist are removed, so
+  // the key ring itself is always listed. The returned state still holds every
+  // key in the key ring, so only the Cloud KMS calls are limited to the bucket.
+  absl::StatusOr<ObjectStoreState> BuildState(const KmsClient& client,
+                                              uint32_t bucket,
+                                              uint32_t bucket_count);
+
+  // Returns the most recently built state, without contacting Cloud KMS.
+  ObjectStoreState CachedState();
+
+  // Returns the bucket (of `bucket_count` buckets) that the CryptoKey with the
+  // provided name belongs to.
+  static uint32_t BucketOf(std::string_view crypto_key_name,
+                           uint32_t bucket_count);
+
  private:
   ObjectLoader(std::string_view key_ring_name,
                absl::flat_hash_map<std::string, std::string> user_certs,
-               std::unique_ptr<CertAuthority> cert_authority)
+               std::unique_ptr<CertAuthority> cert_authority,
+               std::string_view handle_secret)
       : key_ring_name_(key_ring_name),
         user_certs_(user_certs),
-        cert_authority_(std::move(cert_authority)) {}
+        cert_authority_(std::move(cert_authority)),
+        cache_(handle_secret) {}
 
   std::string key_ring_name_;
   // map from SPKI DER to user-provided certificate DER
   absl::flat_hash_map<std::string, std::string> user_certs_;
   std::unique_ptr<CertAuthority> cert_authority_;
 
+  absl::Status LoadVersions(const KmsClient& client,
+                            const kms_v1::CryptoKey& key,
+                            std::vector<const Key*>* versions)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(cache_mutex_);
+
   class Cache {
    public:
+    explicit Cache(std::string_view handle_secret)
+        : handle_secret_(handle_secret) {}
+
+    bool keyed_handles() const { return !handle_secret_.empty(); }
+
     Key* Get(std::string_view ckv_name);
-    Key* Store(const kms_v1::CryptoKeyVersion& ckv,
-               std::string_view public_key_der,
-               std::string_view certificate_der);
-    Key* StoreSecretKey(const kms_v1::CryptoKeyVersion& ckv);
-    void EvictUnused(const ObjectStoreState& state);
+    // Returns the versions of the provided CryptoKey in the most recently
+    // built state, in order.
+    std::vector<const Key*> Versions(std::string_view crypto_key_name) const;
+    // Returns the keys in the most recently built state, in order.
+    std::vector<const Key*> InOrder() const;
+    absl::StatusOr<Key*> Store(const kms_v1::CryptoKeyVersion& ckv,
+                               std::string_view public_key_der,
+                               std::string_view certificate_der);
+    absl::StatusOr<Key*> StoreSecretKey(const kms_v1::CryptoKeyVersion& ckv);
+    // Makes `crypto_keys` (in order) and `versions` the most recently built
+    // state. Only the CryptoKeys in `reloaded`, and those that are no longer
+    // present, are examined for versions to evict; the versions of every other
+    // CryptoKey must be carried over unchanged.
+    void SetState(
+        std::vector<std::string> crypto_keys,
+        absl::flat_hash_map<std::string, std::vector<const Key*>> versions,
+        const absl::flat_hash_set<std::string>& reloaded);
+    // Evicts every key that is not in the most recently built state.
+    void EvictUnused();
 
    private:
-    CK_OBJECT_HANDLE NewHandle();
+    absl::StatusOr<CK_OBJECT_HANDLE> NewHandle(std::string_view ckv_name,
+                                               CK_OBJECT_CLASS object_class);
+    void ReleaseHandle(CK_OBJECT_HANDLE handle);
+    // Releases every handle that has been set on `key`.
+    void ReleaseHandles(const Key& key);
+    void Evict(const Key* key);
 
-    absl::flat_hash_set<CK_OBJECT_HANDLE> allocated_handles_;
+    const std::string handle_secret_;
+    HandleAllocator handles_;
+    // In keyed mode, the identity of the object that owns each handle.
+    absl::flat_hash_map<CK_OBJECT_HANDLE, std::string> keyed_handles_;
     absl::flat_hash_map<std::string, std::unique_ptr<Key>> keys_;
+    // The names of the CryptoKeys in the most recently built state, in order.
+    // The grouping is kept between builds, so that a bucketed build can carry
+    // over the versions of the CryptoKeys it does not reload.
+    std::vector<std::string> crypto_keys_;
+    // The versions of each CryptoKey in the most recently built state.
+    absl::flat_hash_map<std::string, std::vector<const Key*>> versions_;
   };
 
   absl::Mutex cache_mutex_;
@@ -17,6 +17,7 @@
 #include "common/test/runfiles.h"
 #include "common/test/test_status_macros.h"
 #include "fakekms/cpp/fakekms.h"
+#include "fakekms/cpp/fault_helpers.h"
 #include "gmock/gmock.h"
 #include "kmsp11/test/matchers.h"
 #include "kmsp11/test/resource_helpers.h"
@@ -254,6 +255,56 @@ TEST_F(BuildStateTest, UnmodifiedStateIsUnchangedAfterRefresh) {
   EXPECT_THAT(loader_->BuildState(*client_), IsOkAndHolds(EqualsProto(state)));
 }
 
+TEST_F(BuildStateTest, BuildStateIssuesOneGetPublicKeyPerVersion) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectLoader> loader_,
+                       ObjectLoader::New(key_ring_.name(), {}, true));
+  for (std::string_view key_name : {"ck1", "ck2", "ck3"}) {
+    AddKeyAndInitialVersion(key_name, kms_v1::CryptoKey::ASYMMETRIC_SIGN,
+                            kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+  }
+  fakekms::ResetStatsOrDie(*fake_server_);
+
+  ASSERT_OK(loader_->BuildState(*client_));
+
+  fakekms::Stats stats = fakekms::GetStatsOrDie(*fake_server_);
+  EXPECT_EQ(fakekms::CallCount(stats, "ListCryptoKeys"), 1);
+  EXPECT_EQ(fakekms::CallCount(stats, "ListCryptoKeyVersions"), 3);
+  EXPECT_EQ(fakekms::CallCount(stats, "GetPublicKey"), 3);
+  EXPECT_EQ(fakekms::CallCount(stats), 7);
+}
+
+TEST_F(BuildStateTest, RefreshDoesNotRefetchPublicKeys) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectLoader> loader_,
+                       ObjectLoader::New(key_ring_.name(), {}, true));
+  AddKeyAndInitialVersion("ck", kms_v1::CryptoKey::ASYMMETRIC_SIGN,
+                          kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+  ASSERT_OK(loader_->BuildState(*client_));
+  fakekms::ResetStatsOrDie(*fake_server_);
+
+  ASSERT_OK(loader_->BuildState(*client_));
+
+  EXPECT_EQ(
+      fakekms::CallCount(fakekms::GetStatsOrDie(*fake_server_), "GetPublicKey"),
+      0);
+}
+
+TEST_F(BuildStateTest, LoadersShareFetchedPublicKeys) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectLoader> loader1,
+                       ObjectLoader::New(key_ring_.name(), {}, true));
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectLoader> loader2,
+                       ObjectLoader::New(key_ring_.name(), {}, true));
+  AddKeyAndInitialVersion("ck", kms_v1::CryptoKey::ASYMMETRIC_SIGN,
+                          kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+  ASSERT_OK(loader1->BuildState(*client_));
+  fakekms::ResetStatsOrDie(*fake_server_);
+
+  ASSERT_OK(loader2->BuildState(*client_));
+
+  EXPECT_EQ(
+      fakekms::CallCount(fakekms::GetStatsOrDie(*fake_server_), "GetPublicKey"),
+      0);
+}
+
 TEST_F(BuildStateTest, PreviouslyRetrievedStateIsUnchangedAfterElementIsAdded) {
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectLoader> loader_,
                        ObjectLoader::New(key_ring_.name(), {}, true));
@@ -280,6 +331,103 @@ TEST_F(BuildStateTest, PreviouslyRetrievedStateIsUnchangedAfterElementIsAdded) {
                            EqualsProto(ckv2))));
 }
 
+TEST_F(BuildStateTest, BucketedBuildStateReloadsOnlyOneBucket) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectLoader> loader_,
+                       ObjectLoader::New(key_ring_.name(), {}, true));
+  int keys_in_bucket = 0;
+  for (int i = 0; i < 8; i++) {
+    kms_v1::CryptoKeyVersion ckv = AddKeyAndInitialVersion(
+        absl::StrCat("ck", i), kms_v1::CryptoKey::ASYMMETRIC_SIGN,
+        kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+    std::string_view key_name = ckv.name();
+    key_name = key_name.substr(0, key_name.rfind("/cryptoKeyVersions/"));
+    if (ObjectLoader::BucketOf(key_name, 4) == 0) {
+      keys_in_bucket++;
+    }
+  }
+  ASSERT_OK_AND_ASSIGN(ObjectStoreState state, loader_->BuildState(*client_));
+  fakekms::ResetStatsOrDie(*fake_server_);
+
+  EXPECT_THAT(loader_->BuildState(*client_, 0, 4),
+              IsOkAndHolds(EqualsProto(state)));
+
+  fakekms::Stats stats = fakekms::GetStatsOrDie(*fake_server_);
+  EXPECT_EQ(fakekms::CallCount(stats, "ListCryptoKeys"), 1);
+  EXPECT_EQ(fakekms::CallCount(stats, "ListCryptoKeyVersions"),
+            keys_in_bucket);
+  EXPECT_EQ(fakekms::CallCount(stats, "GetPublicKey"), 0);
+}
+
+TEST_F(BuildStateTest, BucketedBuildStatesCoverAllKeys) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectLoader> loader_,
+                       ObjectLoader::New(key_ring_.name(), {}, true));
+  std::vector<kms_v1::CryptoKeyVersion> ckvs;
+  for (int i = 0; i < 8; i++) {
+    ckvs.push_back(AddKeyAndInitialVersion(
+        absl::StrCat("ck", i), kms_v1::CryptoKey::ASYMMETRIC_SIGN,
+        kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256));
+  }
+  ASSERT_OK(loader_->BuildState(*client_));
+
+  // Add a second version to every key.
+  for (const kms_v1::CryptoKeyVersion& ckv : ckvs) {
+    std::string_view key_name = ckv.name();
+    key_name = key_name.substr(0, key_name.rfind("/cryptoKeyVersions/"));
+    kms_v1::CryptoKeyVersion new_ckv;
+    new_ckv = CreateCryptoKeyVersionOrDie(kms_stub_.get(), key_name, new_ckv);
+    WaitForEnablement(kms_stub_.get(), new_ckv);
+  }
+
+  ObjectStoreState state;
+  for (uint32_t bucket = 0; bucket < 4; bucket++) {
+    ASSERT_OK_AND_ASSIGN(state, loader_->BuildState(*client_, bucket, 4));
+  }
+  EXPECT_EQ(state.keys_size(), 16);
+  EXPECT_THAT(loader_->BuildState(*client_), IsOkAndHolds(EqualsProto(state)));
+}
+
+TEST_F(BuildStateTest, KeyedHandlesAreStableAcrossLoaders) {
+  AddKeyAndInitialVersion("ck", kms_v1::CryptoKey::ASYMMETRIC_SIGN,
+                          kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+  constexpr std::string_view kSecret = "0123456789abcdef";
+
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectLoader> loader1,
+                       ObjectLoader::New(key_ring_.name(), {}, true, kSecret));
+  ASSERT_OK_AND_ASSIGN(ObjectStoreState state1, loader1->BuildState(*client_));
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectLoader> loader2,
+                       ObjectLoader::New(key_ring_.name(), {}, true, kSecret));
+  ASSERT_OK_AND_ASSIGN(ObjectStoreState state2, loader2->BuildState(*client_));
+
+  EXPECT_TRUE(state1.keyed_handles());
+  ASSERT_EQ(state1.keys_size(), 1);
+  ASSERT_EQ(state2.keys_size(), 1);
+  EXPECT_EQ(state1.keys(0).public_key_handle(),
+            state2.keys(0).public_key_handle());
+  EXPECT_EQ(state1.keys(0).private_key_handle(),
+            state2.keys(0).private_key_handle());
+  EXPECT_NE(state1.keys(0).public_key_handle(),
+            state1.keys(0).private_key_handle());
+}
+
+TEST_F(BuildStateTest, KeyedHandlesDependOnSecret) {
+  AddKeyAndInitialVersion("ck", kms_v1::CryptoKey::ASYMMETRIC_SIGN,
+                          kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ObjectLoader> loader1,
+      ObjectLoader::New(key_ring_.name(), {}, true, "0123456789abcdef"));
+  ASSERT_OK_AND_ASSIGN(ObjectStoreState state1, loader1->BuildState(*client_));
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ObjectLoader> loader2,
+      ObjectLoader::New(key_ring_.name(), {}, true, "fedcba9876543210"));
+  ASSERT_OK_AND_ASSIGN(ObjectStoreState state2, loader2->BuildState(*client_));
+
+  ASSERT_EQ(state1.keys_size(), 1);
+  ASSERT_EQ(state2.keys_size(), 1);
+  EXPECT_NE(state1.keys(0).private_key_handle(),
+            state2.keys(0).private_key_handle());
+}
+
 TEST_F(BuildStateTest, KeyWithPurposeEncryptDecryptIsOmitted) {
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectLoader> loader_,
                        ObjectLoader::New(key_ring_.name(), {}, true));
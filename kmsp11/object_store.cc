@@ -17,6 +17,7 @@
 #include "common/status_macros.h"
 #include "kmsp11/util/crypto_utils.h"
 #include "kmsp11/util/errors.h"
+#include "kmsp11/util/handle_allocator.h"
 
 namespace cloud_kms::kmsp11 {
 namespace {
@@ -28,13 +29,19 @@ static_assert(
     sizeof(CK_OBJECT_HANDLE) <= sizeof(google::protobuf::uint64),
     "object handles must fit in proto uint64 for proto compatibility");
 
-using ObjectStoreEntry = ObjectStoreMap::value_type;
+using ObjectStoreEntry = std::pair<CK_OBJECT_HANDLE, std::shared_ptr<Object>>;
 
 absl::StatusOr<std::vector<ObjectStoreEntry>> ParseStoreEntries(
     const ObjectStoreState& state) {
   std::vector<ObjectStoreEntry> entries;
   for (const Key& item : state.keys()) {
-    if (item.secret_key_handle() == 0 && item.private_key_handle() == 0) {
+    if (state.public_keys_only() &&
+        (item.secret_key_handle() != 0 || item.private_key_handle() != 0)) {
+      return absl::InvalidArgumentError(
+          "a public key only state must not contain private or secret keys");
+    }
+    if (!state.public_keys_only() && item.secret_key_handle() == 0 &&
+        item.private_key_handle() == 0) {
       return absl::InvalidArgumentError(
           "both secret_key_handle and private_key_handle are unset, cannot "
           "determine if key is symmetric or asymmetric");
@@ -60,12 +67,14 @@ absl::StatusOr<std::vector<ObjectStoreEntry>> ParseStoreEntries(
         item.public_key_handle(),
         std::make_shared<Object>(std::move(keypair.public_key)));
 
-    if (item.private_key_handle() == 0) {
-      return absl::InvalidArgumentError("private_key_handle is unset");
+    if (!state.public_keys_only()) {
+      if (item.private_key_handle() == 0) {
+        return absl::InvalidArgumentError("private_key_handle is unset");
+      }
+      entries.emplace_back(
+          item.private_key_handle(),
+          std::make_shared<Object>(std::move(keypair.private_key)));
     }
-    entries.emplace_back(
-        item.private_key_handle(),
-        std::make_shared<Object>(std::move(keypair.private_key)));
 
     if (item.has_certificate()) {
       if (item.certificate().handle() == 0) {
@@ -84,12 +93,12 @@ absl::StatusOr<std::vector<ObjectStoreEntry>> ParseStoreEntries(
   return entries;
 }
 
-// A comparison function for ObjectStore entries that sorts by KMS key name,
-// followed by object class.
-bool EntryCompare(const ObjectStoreEntry& e1, const ObjectStoreEntry& e2) {
-  int name_cmp = e1.second->kms_key_name().compare(e2.second->kms_key_name());
+// A comparison function for objects that sorts by KMS key name, followed by
+// object class.
+bool ObjectCompare(const Object& o1, const Object& o2) {
+  int name_cmp = o1.kms_key_name().compare(o2.kms_key_name());
   if (name_cmp == 0) {
-    return e1.second->object_class() < e2.second->object_class();
+    return o1.object_class() < o2.object_class();
   }
   return name_cmp < 0;
 }
@@ -107,42 +116,79 @@ absl::StatusOr<std::unique_ptr<ObjectStore>> ObjectStore::New(
         CKR_DEVICE_ERROR, SOURCE_LOCATION);
   }
 
-  std::unique_ptr<ObjectStore> store = absl::WrapUnique(
-      new ObjectStore(ObjectStoreMap(entries->begin(), entries->end())));
-  if (store->entries_.size() != entries->size()) {
-    return NewInvalidArgumentError(
-        absl::StrFormat("duplicate handle detected: "
-                        "store.entries_.size()=%d; entries.size()=%d",
-                        store->entries_.size(), entries->size()),
-        CKR_DEVICE_ERROR, SOURCE_LOCATION);
+  if (state.keyed_handles()) {
+    std::vector<Entry> packed;
+    absl::flat_hash_map<CK_OBJECT_HANDLE, size_t> index;
+    for (ObjectStoreEntry& entry : *entries) {
+      if (!index.try_emplace(entry.first, packed.size()).second) {
+        return NewInvalidArgumentError(
+            absl::StrFormat("duplicate handle detected: %#x", entry.first),
+            CKR_DEVICE_ERROR, SOURCE_LOCATION);
+      }
+      packed.push_back(Entry{entry.first, std::move(entry.second)});
+    }
+    return absl::WrapUnique(
+        new ObjectStore(std::move(packed), std::move(index)));
+  }
+
+  std::vector<Entry> slots;
+  for (ObjectStoreEntry& entry : *entries) {
+    size_t slot = HandleSlot(entry.first);
+    if (slot >= slots.size()) {
+      slots.resize(slot + 1);
+    }
+    if (slots[slot].object) {
+      return NewInvalidArgumentError(
+          slots[slot].handle == entry.first
+              ? absl::StrFormat("duplicate handle detected: %#x", entry.first)
+              : absl::StrFormat("handles %#x and %#x share a slot",
+                                slots[slot].handle, entry.first),
+          CKR_DEVICE_ERROR, SOURCE_LOCATION);
+    }
+    slots[slot] = Entry{entry.first, std::move(entry.second)};
   }
 
-  return std::move(store);
+  return absl::WrapUnique(new ObjectStore(std::move(slots), {}));
+}
+
+const ObjectStore::Entry* ObjectStore::FindEntry(
+    CK_OBJECT_HANDLE handle) const {
+  if (!index_.empty()) {
+    auto it = index_.find(handle);
+    return it == index_.end() ? nullptr : &entries_[it->second];
+  }
+
+  size_t slot = HandleSlot(handle);
+  if (handle == CK_INVALID_HANDLE || slot >= entries_.size() ||
+      entries_[slot].handle != handle) {
+    return nullptr;
+  }
+  return &entries_[slot];
 }
 
 absl::StatusOr<std::shared_ptr<Object>> ObjectStore::GetObject(
     CK_OBJECT_HANDLE handle) const {
-  ObjectStoreMap::const_iterator it = entries_.find(handle);
-  if (it == entries_.end()) {
+  const Entry* entry = FindEntry(handle);
+  if (!entry) {
     return HandleNotFoundError(handle, CKR_OBJECT_HANDLE_INVALID,
                                SOURCE_LOCATION);
   }
 
-  return it->second;
+  return entry->object;
 }
 
 absl::StatusOr<std::shared_ptr<Object>> ObjectStore::GetKey(
     CK_OBJECT_HANDLE handle) const {
-  ObjectStoreMap::const_iterator it = entries_.find(handle);
-  if (it == entries_.end()) {
+  const Entry* entry = FindEntry(handle);
+  if (!entry) {
     return HandleNotFoundError(handle, CKR_KEY_HANDLE_INVALID, SOURCE_LOCATION);
   }
 
-  switch (it->second->object_class()) {
+  switch (entry->object->object_class()) {
     case CKO_PRIVATE_KEY:
     case CKO_PUBLIC_KEY:
     case CKO_SECRET_KEY:
-      return it->second;
+      return entry->object;
     default:
       return HandleNotFoundError(handle, CKR_KEY_HANDLE_INVALID,
                                  SOURCE_LOCATION);
@@ -151,18 +197,21 @@ absl::StatusOr<std::shared_ptr<Object>> ObjectStore::GetKey(
 
 std::vector<CK_OBJECT_HANDLE> ObjectStore::Find(
     std::function<bool(const Object&)> predicate) const {
-  std::vector<std::reference_wrapper<const ObjectStoreEntry>> matches;
-  for (const ObjectStoreEntry& entry : entries_) {
-    if (predicate(*entry.second)) {
-      matches.push_back(entry);
+  std::vector<const Entry*> matches;
+  for (const Entry& entry : entries_) {
+    if (entry.object && predicate(*entry.object)) {
+      matches.push_back(&entry);
     }
   }
 
-  std::sort(matches.begin(), matches.end(), &EntryCompare);
+  std::sort(matches.begin(), matches.end(),
+            [](const Entry* e1, const Entry* e2) {
+              return ObjectCompare(*e1->object, *e2->object);
+            });
 
   std::vector<CK_OBJECT_HANDLE> handles(matches.size());
   for (size_t i = 0; i < matches.size(); i++) {
-    handles[i] = matches[i].get().first;
+    handles[i] = matches[i]->handle;
   }
   return handles;
 }
@@ -170,12 +219,12 @@ std::vector<CK_OBJECT_HANDLE> ObjectStore::Find(
 absl::StatusOr<CK_OBJECT_HANDLE> ObjectStore::FindSingle(
     std::function<bool(const Object&)> predicate) const {
   std::optional<CK_OBJECT_HANDLE> match;
-  for (const auto& [handle, object] : entries_) {
-    if (predicate(*object)) {
+  for (const Entry& entry : entries_) {
+    if (entry.object && predicate(*entry.object)) {
       if (match.has_value()) {
         return absl::FailedPreconditionError("multiple matches found");
       }
-      match = handle;
+      match = entry.handle;
     }
   }
   if (!match.has_value()) {
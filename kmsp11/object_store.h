@@ -17,6 +17,8 @@
 #ifndef KMSP11_OBJECT_STORE_H_
 #define KMSP11_OBJECT_STORE_H_
 
+#include <vector>
+
 #include "absl/container/flat_hash_map.h"
 #include "absl/status/statusor.h"
 #include "kmsp11/cryptoki.h"
@@ -25,9 +27,6 @@
 
 namespace cloud_kms::kmsp11 {
 
-using ObjectStoreMap =
-    absl::flat_hash_map<CK_OBJECT_HANDLE, std::shared_ptr<Object>>;
-
 class ObjectStore {
  public:
   // Create a new ObjectStore with the provided state.
@@ -56,9 +55,26 @@ class ObjectStore {
       std::function<bool(const Object&)> predicate) const;
 
  private:
-  ObjectStore(ObjectStoreMap entries) : entries_(entries) {}
+  struct Entry {
+    CK_OBJECT_HANDLE handle = CK_INVALID_HANDLE;
+    std::shared_ptr<Object> object;
+  };
+
+  ObjectStore(std::vector<Entry> entries,
+              absl::flat_hash_map<CK_OBJECT_HANDLE, size_t> index)
+      : entries_(std::move(entries)), index_(std::move(index)) {}
+
+  // Returns the entry with the provided handle, or nullptr.
+  const Entry* FindEntry(CK_OBJECT_HANDLE handle) const;
 
-  const ObjectStoreMap entries_;
+  // Entries are indexed by the slot encoded in their handle (see
+  // HandleAllocator). Unused slots have a null object.
+  //
+  // Keyed handles (see ObjectStoreState.keyed_handles) do not encode a slot.
+  // In that case, entries_ is packed and index_ maps each handle to the
+  // position of its entry.
+  const std::vector<Entry> entries_;
+  const absl::flat_hash_map<CK_OBJECT_HANDLE, size_t> index_;
 };
 
 }  // namespace cloud_kms::kmsp11
@@ -294,6 +294,54 @@ TEST(ObjectStoreTest, NewStoreFailsHandleCollision) {
                        HasSubstr("duplicate handle detected")));
 }
 
+TEST(ObjectStoreTest, PublicKeysOnlyStateHasNoPrivateKeys) {
+  ObjectStoreState s;
+  s.set_public_keys_only(true);
+
+  Key* key = s.add_keys();
+  ASSERT_OK_AND_ASSIGN(*key, NewAsymmetricRsaKey());
+  key->clear_private_key_handle();
+
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectStore> store, ObjectStore::New(s));
+
+  EXPECT_THAT(store->Find([](const Object&) { return true; }),
+              ElementsAre(key->public_key_handle()));
+}
+
+TEST(ObjectStoreTest, PublicKeysOnlyStateRejectsPrivateKeyHandle) {
+  ObjectStoreState s;
+  s.set_public_keys_only(true);
+
+  Key* key = s.add_keys();
+  ASSERT_OK_AND_ASSIGN(*key, NewAsymmetricRsaKey());
+
+  EXPECT_THAT(ObjectStore::New(s),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       HasSubstr("must not contain private or secret keys")));
+}
+
+TEST(ObjectStoreTest, KeyedHandlesMayShareSlot) {
+  ObjectStoreState s;
+  s.set_keyed_handles(true);
+
+  Key* key = s.add_keys();
+  ASSERT_OK_AND_ASSIGN(*key, NewAsymmetricRsaKey());
+  key->set_public_key_handle(0x7f000001);
+  key->set_private_key_handle(0x3f000001);
+
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ObjectStore> store, ObjectStore::New(s));
+
+  EXPECT_THAT(store->GetObject(0x7f000001),
+              IsOkAndHolds(Pointee(Property("object_class",
+                                            &Object::object_class,
+                                            CKO_PUBLIC_KEY))));
+  EXPECT_THAT(store->GetObject(0x3f000001),
+              IsOkAndHolds(Pointee(Property("object_class",
+                                            &Object::object_class,
+                                            CKO_PRIVATE_KEY))));
+  EXPECT_THAT(store->GetObject(1), StatusRvIs(CKR_OBJECT_HANDLE_INVALID));
+}
+
 TEST(ObjectStoreTest, GetObjectSuccessPublicKey) {
   ObjectStoreState s;
 
@@ -61,7 +61,7 @@ class AesCbcEncrypter : public EncrypterInterface {
   PaddingMode padding_mode_;
   std::optional<std::vector<uint8_t, ZeroDeallocator<uint8_t>>>
       plaintext_;  // for multi-part
-  std::vector<uint8_t> ciphertext_;
+  std::unique_ptr<std::string> ciphertext_;
 };
 
 absl::StatusOr<absl::Span<const uint8_t>> AesCbcEncrypter::Encrypt(
@@ -134,13 +134,12 @@ absl::StatusOr<absl::Span<const uint8_t>> AesCbcEncrypter::EncryptInternal(
   switch (padding_mode_) {
     case PaddingMode::kPkcs7:
       padded_plaintext = Pad(plaintext);
-      req.set_plaintext(
-          std::string(reinterpret_cast<const char*>(padded_plaintext.data()),
-                      padded_plaintext.size()));
+      req.mutable_plaintext_crc32c()->set_value(
+          CopyWithCRC32C(padded_plaintext, req.mutable_plaintext()));
       break;
     case PaddingMode::kNone:
-      req.set_plaintext(std::string(
-          reinterpret_cast<const char*>(plaintext.data()), plaintext.size()));
+      req.mutable_plaintext_crc32c()->set_value(
+          CopyWithCRC32C(plaintext, req.mutable_plaintext()));
       break;
     default:
       return NewInternalError("unsupported padding mode", SOURCE_LOCATION);
@@ -157,11 +156,10 @@ absl::StatusOr<absl::Span<const uint8_t>> AesCbcEncrypter::EncryptInternal(
         SOURCE_LOCATION);
   }
 
-  ciphertext_.resize(resp.ciphertext().size());
-  std::copy_n(resp.ciphertext().begin(), resp.ciphertext().size(),
-              ciphertext_.begin());
-
-  return ciphertext_;
+  ciphertext_.reset(resp.release_ciphertext());
+  return absl::MakeConstSpan(
+      reinterpret_cast<const uint8_t*>(ciphertext_->data()),
+      ciphertext_->size());
 }
 
 // An implementation of DecrypterInterface that decrypts AES-CBC ciphertexts
@@ -243,8 +241,8 @@ absl::StatusOr<absl::Span<const uint8_t>> AesCbcDecrypter::DecryptInternal(
     KmsClient* client, absl::Span<const uint8_t> ciphertext) {
   kms_v1::RawDecryptRequest req;
   req.set_name(std::string(object_->kms_key_name()));
-  req.set_ciphertext(std::string(
-      reinterpret_cast<const char*>(ciphertext.data()), ciphertext.size()));
+  req.mutable_ciphertext_crc32c()->set_value(
+      CopyWithCRC32C(ciphertext, req.mutable_ciphertext()));
   req.set_initialization_vector(
       std::string(reinterpret_cast<const char*>(iv_.data()), iv_.size()));
 
@@ -55,7 +55,7 @@ class AesCtrEncrypter : public EncrypterInterface {
   const std::vector<uint8_t> iv_;
   std::optional<std::vector<uint8_t, ZeroDeallocator<uint8_t>>>
       plaintext_;  // for multi-part only
-  std::vector<uint8_t> ciphertext_;
+  std::unique_ptr<std::string> ciphertext_;
 };
 
 absl::StatusOr<absl::Span<const uint8_t>> AesCtrEncrypter::Encrypt(
@@ -113,8 +113,8 @@ absl::StatusOr<absl::Span<const uint8_t>> AesCtrEncrypter::EncryptInternal(
 
   kms_v1::RawEncryptRequest req;
   req.set_name(std::string(object_->kms_key_name()));
-  req.set_plaintext(std::string(reinterpret_cast<const char*>(plaintext.data()),
-                                plaintext.size()));
+  req.mutable_plaintext_crc32c()->set_value(
+      CopyWithCRC32C(plaintext, req.mutable_plaintext()));
   req.set_initialization_vector(
       std::string(reinterpret_cast<const char*>(iv_.data()), iv_.size()));
 
@@ -126,11 +126,10 @@ absl::StatusOr<absl::Span<const uint8_t>> AesCtrEncrypter::EncryptInternal(
         SOURCE_LOCATION);
   }
 
-  ciphertext_.resize(resp.ciphertext().size());
-  std::copy_n(resp.ciphertext().begin(), resp.ciphertext().size(),
-              ciphertext_.begin());
-
-  return ciphertext_;
+  ciphertext_.reset(resp.release_ciphertext());
+  return absl::MakeConstSpan(
+      reinterpret_cast<const uint8_t*>(ciphertext_->data()),
+      ciphertext_->size());
 }
 
 // An implementation of DecrypterInterface that decrypts AES-CTR ciphertexts
@@ -208,8 +207,8 @@ absl::StatusOr<absl::Span<const uint8_t>> AesCtrDecrypter::DecryptInternal(
     KmsClient* client, absl::Span<const uint8_t> ciphertext) {
   kms_v1::RawDecryptRequest req;
   req.set_name(std::string(object_->kms_key_name()));
-  req.set_ciphertext(std::string(
-      reinterpret_cast<const char*>(ciphertext.data()), ciphertext.size()));
+  req.mutable_ciphertext_crc32c()->set_value(
+      CopyWithCRC32C(ciphertext, req.mutable_ciphertext()));
   req.set_initialization_vector(
       std::string(reinterpret_cast<const char*>(iv_.data()), iv_.size()));
   ASSIGN_OR_RETURN(kms_v1::RawDecryptResponse resp, client->RawDecrypt(req));
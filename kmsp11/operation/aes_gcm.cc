@@ -60,7 +60,7 @@ class AesGcmEncrypter : public EncrypterInterface {
   std::string aad_;
   std::optional<std::vector<uint8_t, ZeroDeallocator<uint8_t>>>
       plaintext_;  // for multi-part only
-  std::vector<uint8_t> ciphertext_;
+  std::unique_ptr<std::string> ciphertext_;
 };
 
 absl::StatusOr<absl::Span<const uint8_t>> AesGcmEncrypter::Encrypt(
@@ -120,8 +120,8 @@ absl::StatusOr<absl::Span<const uint8_t>> AesGcmEncrypter::EncryptInternal(
     KmsClient* client, absl::Span<const uint8_t> plaintext) {
   kms_v1::RawEncryptRequest req;
   req.set_name(std::string(object_->kms_key_name()));
-  req.set_plaintext(std::string(reinterpret_cast<const char*>(plaintext.data()),
-                                plaintext.size()));
+  req.mutable_plaintext_crc32c()->set_value(
+      CopyWithCRC32C(plaintext, req.mutable_plaintext()));
   req.set_additional_authenticated_data(aad_);
 
   ASSIGN_OR_RETURN(kms_v1::RawEncryptResponse resp, client->RawEncrypt(req));
@@ -129,11 +129,10 @@ absl::StatusOr<absl::Span<const uint8_t>> AesGcmEncrypter::EncryptInternal(
   std::copy_n(resp.initialization_vector().begin(),
               resp.initialization_vector().size(), iv_.begin());
 
-  ciphertext_.resize(resp.ciphertext().size());
-  std::copy_n(resp.ciphertext().begin(), resp.ciphertext().size(),
-              ciphertext_.begin());
-
-  return ciphertext_;
+  ciphertext_.reset(resp.release_ciphertext());
+  return absl::MakeConstSpan(
+      reinterpret_cast<const uint8_t*>(ciphertext_->data()),
+      ciphertext_->size());
 }
 
 // An implementation of DecrypterInterface that decrypts AES-GCM ciphertexts
@@ -217,8 +216,8 @@ absl::StatusOr<absl::Span<const uint8_t>> AesGcmDecrypter::DecryptInternal(
     KmsClient* client, absl::Span<const uint8_t> ciphertext) {
   kms_v1::RawDecryptRequest req;
   req.set_name(std::string(object_->kms_key_name()));
-  req.set_ciphertext(std::string(
-      reinterpret_cast<const char*>(ciphertext.data()), ciphertext.size()));
+  req.mutable_ciphertext_crc32c()->set_value(
+      CopyWithCRC32C(ciphertext, req.mutable_ciphertext()));
   req.set_initialization_vector(reinterpret_cast<const char*>(iv_.data()),
                                 iv_.size());
   req.set_additional_authenticated_data(aad_);
@@ -0,0 +1,171 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/operation/decrypt_cache.h"
+
+#include "common/status_macros.h"
+#include "kmsp11/kmsp11.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+// A DecrypterInterface implementation that consults a DecryptCache before
+// delegating to an inner decrypter.
+class CachingDecrypter : public DecrypterInterface {
+ public:
+  CachingDecrypter(std::unique_ptr<DecrypterInterface> inner,
+                   std::shared_ptr<Object> key, std::string context,
+                   DecryptCache* cache)
+      : inner_(std::move(inner)),
+        key_(key),
+        context_(std::move(context)),
+        cache_(cache) {}
+
+  // Decrypt returns a span whose underlying bytes are bound to the lifetime of
+  // this decrypter.
+  absl::StatusOr<absl::Span<const uint8_t>> Decrypt(
+      KmsClient* client, absl::Span<const uint8_t> ciphertext) override;
+  absl::Status DecryptUpdate(KmsClient* client,
+                             absl::Span<const uint8_t> ciphertext) override;
+  absl::StatusOr<absl::Span<const uint8_t>> DecryptFinal(
+      KmsClient* client) override;
+
+  virtual ~CachingDecrypter() {}
+
+ private:
+  absl::StatusOr<absl::Span<const uint8_t>> Lookup(
+      std::string_view ciphertext_digest, std::string* fingerprint);
+  absl::Span<const uint8_t> Record(std::string fingerprint,
+                                   absl::Span<const uint8_t> plaintext);
+
+  std::unique_ptr<DecrypterInterface> inner_;
+  std::shared_ptr<Object> key_;
+  const std::string context_;
+  DecryptCache* cache_;
+  OperationDigest digest_;
+  DecryptCache::Plaintext plaintext_;
+};
+
+// Computes the fingerprint for `ciphertext_digest` into `fingerprint`, and
+// returns the cached plaintext for it, or an empty span with a null data
+// pointer on a cache miss.
+absl::StatusOr<absl::Span<const uint8_t>> CachingDecrypter::Lookup(
+    std::string_view ciphertext_digest, std::string* fingerprint) {
+  ASSIGN_OR_RETURN(*fingerprint,
+                   cache_->Fingerprint(context_, ciphertext_digest));
+  if (!cache_->Lookup(*fingerprint,
+                      [this](const DecryptCache::Plaintext& plaintext) {
+                        plaintext_.reset(new std::string(*plaintext));
+                      })) {
+    return absl::Span<const uint8_t>();
+  }
+  return absl::MakeConstSpan(
+      reinterpret_cast<const uint8_t*>(plaintext_->data()), plaintext_->size());
+}
+
+absl::Span<const uint8_t> CachingDecrypter::Record(
+    std::string fingerprint, absl::Span<const uint8_t> plaintext) {
+  cache_->Insert(std::move(fingerprint), key_->kms_key_name(),
+                 DecryptCache::Plaintext(new std::string(
+                     reinterpret_cast<const char*>(plaintext.data()),
+                     plaintext.size())));
+  return plaintext;
+}
+
+absl::StatusOr<absl::Span<const uint8_t>> CachingDecrypter::Decrypt(
+    KmsClient* client, absl::Span<const uint8_t> ciphertext) {
+  ASSIGN_OR_RETURN(std::optional<std::string> digest,
+                   digest_.SinglePart(ciphertext));
+  if (!digest) {
+    return inner_->Decrypt(client, ciphertext);
+  }
+
+  std::string fingerprint;
+  ASSIGN_OR_RETURN(absl::Span<const uint8_t> cached,
+                   Lookup(*digest, &fingerprint));
+  if (cached.data()) {
+    return cached;
+  }
+  ASSIGN_OR_RETURN(absl::Span<const uint8_t> plaintext,
+                   inner_->Decrypt(client, ciphertext));
+  return Record(std::move(fingerprint), plaintext);
+}
+
+absl::Status CachingDecrypter::DecryptUpdate(
+    KmsClient* client, absl::Span<const uint8_t> ciphertext) {
+  RETURN_IF_ERROR(inner_->DecryptUpdate(client, ciphertext));
+  return digest_.Update(ciphertext);
+}
+
+absl::StatusOr<absl::Span<const uint8_t>> CachingDecrypter::DecryptFinal(
+    KmsClient* client) {
+  ASSIGN_OR_RETURN(std::optional<std::string> digest, digest_.Final());
+  if (!digest) {
+    return inner_->DecryptFinal(client);
+  }
+
+  std::string fingerprint;
+  ASSIGN_OR_RETURN(absl::Span<const uint8_t> cached,
+                   Lookup(*digest, &fingerprint));
+  if (cached.data()) {
+    return cached;
+  }
+  ASSIGN_OR_RETURN(absl::Span<const uint8_t> plaintext,
+                   inner_->DecryptFinal(client));
+  return Record(std::move(fingerprint), plaintext);
+}
+
+// Returns a canonical encoding of the mechanism and its parameters. Parameters
+// that point to other buffers are encoded by value.
+std::string MechanismContext(const CK_MECHANISM* mechanism) {
+  std::string context;
+  AppendUint64(mechanism->mechanism, context);
+  switch (mechanism->mechanism) {
+    case CKM_CLOUDKMS_AES_GCM: {
+      const CK_GCM_PARAMS* params =
+          static_cast<const CK_GCM_PARAMS*>(mechanism->pParameter);
+      AppendBytes(params->pIv, params->ulIvLen, context);
+      AppendBytes(params->pAAD, params->ulAADLen, context);
+      AppendUint64(params->ulTagBits, context);
+      break;
+    }
+    case CKM_RSA_PKCS_OAEP: {
+      // OAEP labels are not supported, so the source data is always empty.
+      const CK_RSA_PKCS_OAEP_PARAMS* params =
+          static_cast<const CK_RSA_PKCS_OAEP_PARAMS*>(mechanism->pParameter);
+      AppendUint64(params->hashAlg, context);
+      AppendUint64(params->mgf, context);
+      break;
+    }
+    default:
+      // The remaining mechanisms' parameters contain no pointers.
+      AppendBytes(mechanism->pParameter, mechanism->ulParameterLen, context);
+      break;
+  }
+  return context;
+}
+
+}  // namespace
+
+std::unique_ptr<DecrypterInterface> NewCachingDecrypter(
+    std::unique_ptr<DecrypterInterface> inner, std::shared_ptr<Object> key,
+    const CK_MECHANISM* mechanism, DecryptCache* cache) {
+  std::string context;
+  AppendBytes(key->kms_key_name().data(), key->kms_key_name().size(), context);
+  context.append(MechanismContext(mechanism));
+  return std::make_unique<CachingDecrypter>(std::move(inner), key,
+                                            std::move(context), cache);
+}
+
+}  // namespace cloud_kms::kmsp11
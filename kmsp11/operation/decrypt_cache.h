@@ -0,0 +1,55 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KMSP11_OPERATION_DECRYPT_CACHE_H_
+#define KMSP11_OPERATION_DECRYPT_CACHE_H_
+
+#include <memory>
+#include <string>
+
+#include "kmsp11/operation/crypter_interfaces.h"
+#include "kmsp11/operation/fingerprint_cache.h"
+#include "kmsp11/util/crypto_utils.h"
+
+namespace cloud_kms::kmsp11 {
+
+// DecryptCache remembers the results of successful decryptions, so that
+// decrypting the same ciphertext again (for example, unwrapping the same data
+// encryption key in many sessions) is answered locally instead of with an
+// AsymmetricDecrypt or RawDecrypt RPC.
+//
+// An entry's fingerprint covers the key version name, the mechanism and its
+// parameters, and a digest of the ciphertext; see FingerprintCache. Plaintexts
+// are zeroed when their entry is removed.
+class DecryptCache
+    : public FingerprintCache<
+          std::unique_ptr<std::string, ZeroDelete<std::string>>> {
+ public:
+  using Plaintext = std::unique_ptr<std::string, ZeroDelete<std::string>>;
+
+  using FingerprintCache::FingerprintCache;
+};
+
+// Returns a decrypter that answers from `cache` when it can, and otherwise
+// delegates to `inner` and records successful decryptions in `cache`.
+// `mechanism` must already have been validated by `inner`'s factory.
+std::unique_ptr<DecrypterInterface> NewCachingDecrypter(
+    std::unique_ptr<DecrypterInterface> inner, std::shared_ptr<Object> key,
+    const CK_MECHANISM* mechanism, DecryptCache* cache);
+
+}  // namespace cloud_kms::kmsp11
+
+#endif  // KMSP11_OPERATION_DECRYPT_CACHE_H_
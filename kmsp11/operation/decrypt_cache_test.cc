@@ -0,0 +1,194 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/operation/decrypt_cache.h"
+
+#include "absl/time/clock.h"
+#include "common/test/test_status_macros.h"
+#include "kmsp11/kmsp11.h"
+#include "kmsp11/object.h"
+#include "kmsp11/test/matchers.h"
+#include "kmsp11/test/resource_helpers.h"
+#include "kmsp11/util/errors.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+using ::testing::ElementsAreArray;
+
+// A decrypter whose plaintext is the ciphertext with each byte inverted, which
+// rejects empty ciphertexts, and which counts the decryptions that it performs.
+class FakeDecrypter : public DecrypterInterface {
+ public:
+  FakeDecrypter(int* decrypt_count) : decrypt_count_(decrypt_count) {}
+
+  absl::StatusOr<absl::Span<const uint8_t>> Decrypt(
+      KmsClient* client, absl::Span<const uint8_t> ciphertext) override {
+    (*decrypt_count_)++;
+    if (ciphertext.empty()) {
+      return NewInvalidArgumentError("empty ciphertext",
+                                     CKR_ENCRYPTED_DATA_INVALID,
+                                     SOURCE_LOCATION);
+    }
+    plaintext_.clear();
+    for (uint8_t b : ciphertext) {
+      plaintext_.push_back(static_cast<uint8_t>(~b));
+    }
+    return absl::MakeConstSpan(plaintext_);
+  }
+
+  absl::Status DecryptUpdate(KmsClient* client,
+                             absl::Span<const uint8_t> ciphertext) override {
+    ciphertext_.insert(ciphertext_.end(), ciphertext.begin(), ciphertext.end());
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<absl::Span<const uint8_t>> DecryptFinal(
+      KmsClient* client) override {
+    return Decrypt(client, ciphertext_);
+  }
+
+ private:
+  int* decrypt_count_;
+  std::vector<uint8_t> ciphertext_;
+  std::vector<uint8_t> plaintext_;
+};
+
+class DecryptCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_OK_AND_ASSIGN(
+        Object key, NewMockSecretKey(kms_v1::CryptoKeyVersion::AES_256_GCM));
+    key_ = std::make_shared<Object>(key);
+  }
+
+  std::unique_ptr<DecrypterInterface> NewDecrypter(
+      DecryptCache* cache, const CK_MECHANISM& mechanism = {CKM_AES_CTR,
+                                                            nullptr, 0}) {
+    return NewCachingDecrypter(std::make_unique<FakeDecrypter>(&decrypt_count_),
+                               key_, &mechanism, cache);
+  }
+
+  std::shared_ptr<Object> key_;
+  int decrypt_count_ = 0;
+  const std::vector<uint8_t> ciphertext_ = {0x01, 0x02, 0x03};
+  const std::vector<uint8_t> plaintext_ = {0xFE, 0xFD, 0xFC};
+};
+
+TEST_F(DecryptCacheTest, RepeatedDecryptIsAnsweredFromCache) {
+  DecryptCache cache(10, absl::Minutes(5));
+
+  ASSERT_OK_AND_ASSIGN(absl::Span<const uint8_t> first,
+                       NewDecrypter(&cache)->Decrypt(nullptr, ciphertext_));
+  EXPECT_THAT(first, ElementsAreArray(plaintext_));
+
+  std::unique_ptr<DecrypterInterface> decrypter = NewDecrypter(&cache);
+  ASSERT_OK_AND_ASSIGN(absl::Span<const uint8_t> second,
+                       decrypter->Decrypt(nullptr, ciphertext_));
+  EXPECT_THAT(second, ElementsAreArray(plaintext_));
+
+  EXPECT_EQ(decrypt_count_, 1);
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST_F(DecryptCacheTest, FailedDecryptIsNotCached) {
+  DecryptCache cache(10, absl::Minutes(5));
+  std::vector<uint8_t> empty;
+
+  EXPECT_THAT(NewDecrypter(&cache)->Decrypt(nullptr, empty),
+              StatusRvIs(CKR_ENCRYPTED_DATA_INVALID));
+  EXPECT_THAT(NewDecrypter(&cache)->Decrypt(nullptr, empty),
+              StatusRvIs(CKR_ENCRYPTED_DATA_INVALID));
+
+  EXPECT_EQ(decrypt_count_, 2);
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST_F(DecryptCacheTest, MultiPartDecryptMatchesSinglePartDecrypt) {
+  DecryptCache cache(10, absl::Minutes(5));
+  EXPECT_OK(NewDecrypter(&cache)->Decrypt(nullptr, ciphertext_));
+
+  std::unique_ptr<DecrypterInterface> decrypter = NewDecrypter(&cache);
+  absl::Span<const uint8_t> ciphertext = ciphertext_;
+  EXPECT_OK(decrypter->DecryptUpdate(nullptr, ciphertext.first(1)));
+  EXPECT_OK(decrypter->DecryptUpdate(nullptr, ciphertext.subspan(1)));
+  ASSERT_OK_AND_ASSIGN(absl::Span<const uint8_t> plaintext,
+                       decrypter->DecryptFinal(nullptr));
+
+  EXPECT_THAT(plaintext, ElementsAreArray(plaintext_));
+  EXPECT_EQ(decrypt_count_, 1);
+}
+
+TEST_F(DecryptCacheTest, DifferentAadIsNotAnsweredFromCache) {
+  DecryptCache cache(10, absl::Minutes(5));
+  uint8_t iv[12] = {0}, aad1[] = {0x01}, aad2[] = {0x02};
+
+  // Identical parameters in separate buffers share an entry.
+  CK_GCM_PARAMS params1{iv, sizeof(iv), 96, aad1, sizeof(aad1), 128};
+  CK_GCM_PARAMS params1_copy = params1;
+  CK_GCM_PARAMS params2{iv, sizeof(iv), 96, aad2, sizeof(aad2), 128};
+  CK_MECHANISM mech1{CKM_CLOUDKMS_AES_GCM, &params1, sizeof(params1)};
+  CK_MECHANISM mech1_copy{CKM_CLOUDKMS_AES_GCM, &params1_copy,
+                          sizeof(params1_copy)};
+  CK_MECHANISM mech2{CKM_CLOUDKMS_AES_GCM, &params2, sizeof(params2)};
+
+  EXPECT_OK(NewDecrypter(&cache, mech1)->Decrypt(nullptr, ciphertext_));
+  EXPECT_OK(NewDecrypter(&cache, mech1_copy)->Decrypt(nullptr, ciphertext_));
+  EXPECT_EQ(decrypt_count_, 1);
+
+  EXPECT_OK(NewDecrypter(&cache, mech2)->Decrypt(nullptr, ciphertext_));
+  EXPECT_EQ(decrypt_count_, 2);
+}
+
+TEST_F(DecryptCacheTest, LeastRecentlyUsedEntryIsEvicted) {
+  DecryptCache cache(2, absl::Minutes(5));
+  std::vector<uint8_t> a = {0x0a}, b = {0x0b}, c = {0x0c};
+
+  EXPECT_OK(NewDecrypter(&cache)->Decrypt(nullptr, a));
+  EXPECT_OK(NewDecrypter(&cache)->Decrypt(nullptr, b));
+  EXPECT_OK(NewDecrypter(&cache)->Decrypt(nullptr, a));  // a is now newest
+  EXPECT_OK(NewDecrypter(&cache)->Decrypt(nullptr, c));  // evicts b
+  EXPECT_EQ(decrypt_count_, 3);
+
+  EXPECT_OK(NewDecrypter(&cache)->Decrypt(nullptr, a));
+  EXPECT_EQ(decrypt_count_, 3);
+  EXPECT_OK(NewDecrypter(&cache)->Decrypt(nullptr, b));
+  EXPECT_EQ(decrypt_count_, 4);
+}
+
+TEST_F(DecryptCacheTest, ExpiredEntryIsNotUsed) {
+  DecryptCache cache(10, absl::Milliseconds(10));
+
+  EXPECT_OK(NewDecrypter(&cache)->Decrypt(nullptr, ciphertext_));
+  absl::SleepFor(absl::Milliseconds(20));
+  EXPECT_OK(NewDecrypter(&cache)->Decrypt(nullptr, ciphertext_));
+
+  EXPECT_EQ(decrypt_count_, 2);
+}
+
+TEST_F(DecryptCacheTest, RetainKeysRemovesEntriesForMissingKeys) {
+  DecryptCache cache(10, absl::Minutes(5));
+  EXPECT_OK(NewDecrypter(&cache)->Decrypt(nullptr, ciphertext_));
+
+  cache.RetainKeys({std::string(key_->kms_key_name())});
+  EXPECT_EQ(cache.size(), 1);
+
+  cache.RetainKeys({});
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_OK(NewDecrypter(&cache)->Decrypt(nullptr, ciphertext_));
+  EXPECT_EQ(decrypt_count_, 2);
+}
+
+}  // namespace
+}  // namespace cloud_kms::kmsp11
@@ -0,0 +1,107 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/operation/fingerprint_cache.h"
+
+#include "absl/strings/str_cat.h"
+#include "kmsp11/util/errors.h"
+#include "openssl/hmac.h"
+
+namespace cloud_kms::kmsp11 {
+
+void AppendUint64(uint64_t value, std::string& out) {
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<char>((value >> shift) & 0xFF));
+  }
+}
+
+void AppendBytes(const void* data, size_t size, std::string& out) {
+  AppendUint64(size, out);
+  if (size > 0) {
+    out.append(static_cast<const char*>(data), size);
+  }
+}
+
+absl::StatusOr<std::string> ComputeFingerprint(
+    std::string_view secret, std::string_view context, std::string_view digest,
+    absl::Span<const uint8_t> suffix) {
+  std::string message;
+  message.reserve(sizeof(uint64_t) + context.size() + digest.size() +
+                  suffix.size());
+  AppendBytes(context.data(), context.size(), message);
+  message.append(digest);
+  message.append(reinterpret_cast<const char*>(suffix.data()), suffix.size());
+
+  uint8_t mac[EVP_MAX_MD_SIZE];
+  unsigned int mac_len;
+  if (!HMAC(EVP_sha256(), secret.data(), secret.size(),
+            reinterpret_cast<const uint8_t*>(message.data()), message.size(),
+            mac, &mac_len)) {
+    return NewInternalError(
+        absl::StrCat("failed to compute fingerprint: ", SslErrorToString()),
+        SOURCE_LOCATION);
+  }
+  return std::string(reinterpret_cast<const char*>(mac), mac_len);
+}
+
+absl::StatusOr<std::optional<std::string>> OperationDigest::SinglePart(
+    absl::Span<const uint8_t> data) const {
+  if (md_ctx_) {
+    return std::nullopt;
+  }
+
+  uint8_t digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_len;
+  if (EVP_Digest(data.data(), data.size(), digest, &digest_len, EVP_sha256(),
+                 nullptr) != 1) {
+    return NewInternalError(
+        absl::StrCat("failed to compute digest: ", SslErrorToString()),
+        SOURCE_LOCATION);
+  }
+  return std::string(reinterpret_cast<const char*>(digest), digest_len);
+}
+
+absl::Status OperationDigest::Update(absl::Span<const uint8_t> data) {
+  if (!md_ctx_) {
+    md_ctx_.reset(EVP_MD_CTX_new());
+    if (EVP_DigestInit(md_ctx_.get(), EVP_sha256()) != 1) {
+      return NewInternalError(
+          absl::StrCat("failed to initialize digest: ", SslErrorToString()),
+          SOURCE_LOCATION);
+    }
+  }
+  if (EVP_DigestUpdate(md_ctx_.get(), data.data(), data.size()) != 1) {
+    return NewInternalError(
+        absl::StrCat("failed to update digest: ", SslErrorToString()),
+        SOURCE_LOCATION);
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::optional<std::string>> OperationDigest::Final() {
+  if (!md_ctx_) {
+    return std::nullopt;
+  }
+
+  uint8_t digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_len;
+  if (EVP_DigestFinal(md_ctx_.get(), digest, &digest_len) != 1) {
+    return NewInternalError(
+        absl::StrCat("failed to finalize digest: ", SslErrorToString()),
+        SOURCE_LOCATION);
+  }
+  return std::string(reinterpret_cast<const char*>(digest), digest_len);
+}
+
+}  // namespace cloud_kms::kmsp11
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KMSP11_OPERATION_FINGERPRINT_CACHE_H_
+#define KMSP11_OPERATION_FINGERPRINT_CACHE_H_
+
+#include <list>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "common/openssl.h"
+#include "kmsp11/util/crypto_utils.h"
+
+namespace cloud_kms::kmsp11 {
+
+// Appends `value` to `out` as 8 big-endian bytes.
+void AppendUint64(uint64_t value, std::string& out);
+
+// Appends `size` to `out` as with AppendUint64, followed by `size` bytes from
+// `data`.
+void AppendBytes(const void* data, size_t size, std::string& out);
+
+// Returns an HMAC-SHA256 under `secret` of `context`, `digest` and `suffix`.
+// The context is length-prefixed and the digest has a fixed size, so distinct
+// inputs cannot produce the same message.
+absl::StatusOr<std::string> ComputeFingerprint(
+    std::string_view secret, std::string_view context, std::string_view digest,
+    absl::Span<const uint8_t> suffix);
+
+// OperationDigest computes the SHA-256 digest of the input to a single-part or
+// a multi-part operation.
+class OperationDigest {
+ public:
+  // Returns the digest of `data`, the input to a single-part operation, or
+  // std::nullopt if a multi-part operation is in progress. In that case the
+  // caller should let the operation it wraps report the error.
+  absl::StatusOr<std::optional<std::string>> SinglePart(
+      absl::Span<const uint8_t> data) const;
+
+  // Adds `data` to the input of a multi-part operation.
+  absl::Status Update(absl::Span<const uint8_t> data);
+
+  // Returns the digest of the data passed to Update, or std::nullopt if Update
+  // was never called. In that case the caller should let the operation it wraps
+  // report the error.
+  absl::StatusOr<std::optional<std::string>> Final();
+
+ private:
+  bssl::UniquePtr<EVP_MD_CTX> md_ctx_;
+};
+
+// FingerprintCache remembers the results of successful operations with Cloud
+// KMS keys, keyed by a fingerprint of each operation.
+//
+// A fingerprint is an HMAC-SHA256, under a random key chosen when the cache is
+// created, of a context that identifies the key and mechanism, a digest of the
+// operation's input, and an optional suffix. Entries expire after a fixed TTL,
+// and the least recently used entry is evicted when the cache is full.
+// FingerprintCache is safe for concurrent use.
+template <typename Value>
+class FingerprintCache {
+ public:
+  FingerprintCache(size_t capacity, absl::Duration ttl)
+      : capacity_(capacity), ttl_(ttl), secret_(RandBytes(kSecretSize)) {}
+
+  // Returns the fingerprint of an operation. `context` identifies the key and
+  // mechanism, and `digest` is an OperationDigest of the operation's input.
+  inline absl::StatusOr<std::string> Fingerprint(
+      std::string_view context, std::string_view digest,
+      absl::Span<const uint8_t> suffix = {}) const {
+    return ComputeFingerprint(secret_, context, digest, suffix);
+  }
+
+  // Calls `found` with the value recorded for the provided fingerprint and
+  // returns true if it was recorded within the TTL, or returns false otherwise.
+  inline bool Lookup(std::string_view fingerprint,
+                     absl::FunctionRef<void(const Value&)> found) {
+    absl::MutexLock lock(&mutex_);
+    auto it = index_.find(fingerprint);
+    if (it == index_.end()) {
+      return false;
+    }
+    if (it->second->expiry <= absl::Now()) {
+      typename std::list<Entry>::iterator entry = it->second;
+      index_.erase(it);
+      entries_.erase(entry);
+      return false;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    found(it->second->value);
+    return true;
+  }
+
+  // Records the value of a successful operation with the provided key.
+  inline void Insert(std::string fingerprint, std::string_view key_name,
+                     Value value) {
+    absl::MutexLock lock(&mutex_);
+    if (capacity_ == 0) {
+      return;
+    }
+
+    absl::Time expiry = absl::Now() + ttl_;
+    if (auto it = index_.find(fingerprint); it != index_.end()) {
+      it->second->value = std::move(value);
+      it->second->expiry = expiry;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return;
+    }
+
+    if (entries_.size() >= capacity_) {
+      index_.erase(entries_.back().fingerprint);
+      entries_.pop_back();
+    }
+    entries_.push_front(Entry{std::move(fingerprint), std::string(key_name),
+                              std::move(value), expiry});
+    index_.emplace(entries_.front().fingerprint, entries_.begin());
+  }
+
+  // Removes the entries for every key that is not in `key_names`.
+  inline void RetainKeys(const absl::flat_hash_set<std::string>& key_names) {
+    absl::MutexLock lock(&mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      if (key_names.contains(it->key_name)) {
+        ++it;
+        continue;
+      }
+      index_.erase(it->fingerprint);
+      it = entries_.erase(it);
+    }
+  }
+
+  inline size_t size() const {
+    absl::MutexLock lock(&mutex_);
+    return entries_.size();
+  }
+
+ private:
+  static constexpr size_t kSecretSize = 32;
+
+  struct Entry {
+    std::string fingerprint;
+    std::string key_name;
+    Value value;
+    absl::Time expiry;
+  };
+
+  const size_t capacity_;
+  const absl::Duration ttl_;
+  const std::string secret_;
+
+  mutable absl::Mutex mutex_;
+  // Entries in order of use, most recently used first.
+  std::list<Entry> entries_ ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<std::string_view, typename std::list<Entry>::iterator>
+      index_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace cloud_kms::kmsp11
+
+#endif  // KMSP11_OPERATION_FINGERPRINT_CACHE_H_
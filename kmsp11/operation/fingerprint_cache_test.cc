@@ -0,0 +1,97 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/operation/fingerprint_cache.h"
+
+#include "common/test/test_status_macros.h"
+#include "gmock/gmock.h"
+#include "kmsp11/test/matchers.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+using ::testing::Ne;
+using ::testing::Optional;
+
+std::vector<uint8_t> Bytes(std::string_view s) {
+  return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+TEST(FingerprintTest, FingerprintDependsOnEveryInput) {
+  FingerprintCache<int> cache(10, absl::Minutes(5));
+  ASSERT_OK_AND_ASSIGN(std::string base,
+                       cache.Fingerprint("ab", "cd", Bytes("ef")));
+
+  EXPECT_THAT(cache.Fingerprint("ab", "cd", Bytes("ef")), IsOkAndHolds(base));
+  EXPECT_THAT(cache.Fingerprint("abc", "d", Bytes("ef")),
+              IsOkAndHolds(Ne(base)));
+  EXPECT_THAT(cache.Fingerprint("ab", "cd", Bytes("eg")),
+              IsOkAndHolds(Ne(base)));
+}
+
+TEST(FingerprintTest, FingerprintDependsOnCacheSecret) {
+  FingerprintCache<int> cache1(10, absl::Minutes(5));
+  FingerprintCache<int> cache2(10, absl::Minutes(5));
+  ASSERT_OK_AND_ASSIGN(std::string fingerprint, cache1.Fingerprint("ab", "cd"));
+  EXPECT_THAT(cache2.Fingerprint("ab", "cd"), IsOkAndHolds(Ne(fingerprint)));
+}
+
+TEST(FingerprintCacheTest, LookupReturnsInsertedValue) {
+  FingerprintCache<int> cache(10, absl::Minutes(5));
+  cache.Insert("fp", "key", 1);
+
+  int value = 0;
+  EXPECT_TRUE(cache.Lookup("fp", [&](const int& v) { value = v; }));
+  EXPECT_EQ(value, 1);
+  EXPECT_FALSE(cache.Lookup("other", [](const int&) {}));
+}
+
+TEST(FingerprintCacheTest, InsertReplacesValue) {
+  FingerprintCache<int> cache(10, absl::Minutes(5));
+  cache.Insert("fp", "key", 1);
+  cache.Insert("fp", "key", 2);
+
+  int value = 0;
+  EXPECT_TRUE(cache.Lookup("fp", [&](const int& v) { value = v; }));
+  EXPECT_EQ(value, 2);
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST(FingerprintCacheTest, ZeroCapacityCacheIsEmpty) {
+  FingerprintCache<int> cache(0, absl::Minutes(5));
+  cache.Insert("fp", "key", 1);
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(OperationDigestTest, MultiPartDigestMatchesSinglePartDigest) {
+  OperationDigest single;
+  ASSERT_OK_AND_ASSIGN(std::optional<std::string> expected,
+                       single.SinglePart(Bytes("abcd")));
+
+  OperationDigest multi;
+  EXPECT_OK(multi.Update(Bytes("ab")));
+  EXPECT_OK(multi.Update(Bytes("cd")));
+  EXPECT_THAT(multi.Final(), IsOkAndHolds(Optional(*expected)));
+}
+
+TEST(OperationDigestTest, MismatchedPartsHaveNoDigest) {
+  OperationDigest digest;
+  EXPECT_THAT(digest.Final(), IsOkAndHolds(std::nullopt));
+
+  EXPECT_OK(digest.Update(Bytes("ab")));
+  EXPECT_THAT(digest.SinglePart(Bytes("ab")), IsOkAndHolds(std::nullopt));
+}
+
+}  // namespace
+}  // namespace cloud_kms::kmsp11
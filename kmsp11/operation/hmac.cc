@@ -126,8 +126,8 @@ absl::Status HmacSigner::SignInternal(KmsClient* client,
                                       absl::Span<uint8_t> signature) {
   kms_v1::MacSignRequest req;
   req.set_name(std::string(object_->kms_key_name()));
-  req.set_data(
-      std::string(reinterpret_cast<const char*>(data.data()), data.size()));
+  req.mutable_data_crc32c()->set_value(
+      CopyWithCRC32C(data, req.mutable_data()));
 
   ASSIGN_OR_RETURN(kms_v1::MacSignResponse resp, client->MacSign(req));
   std::copy(resp.mac().begin(), resp.mac().end(), signature.begin());
@@ -235,10 +235,10 @@ absl::Status HmacVerifier::VerifyInternal(KmsClient* client,
                                           absl::Span<const uint8_t> signature) {
   kms_v1::MacVerifyRequest req;
   req.set_name(std::string(object_->kms_key_name()));
-  req.set_data(
-      std::string(reinterpret_cast<const char*>(data.data()), data.size()));
-  req.set_mac(std::string(reinterpret_cast<const char*>(signature.data()),
-                          signature.size()));
+  req.mutable_data_crc32c()->set_value(
+      CopyWithCRC32C(data, req.mutable_data()));
+  req.mutable_mac_crc32c()->set_value(
+      CopyWithCRC32C(signature, req.mutable_mac()));
 
   ASSIGN_OR_RETURN(kms_v1::MacVerifyResponse resp, client->MacVerify(req));
   if (!resp.success()) {
@@ -88,7 +88,8 @@ absl::StatusOr<absl::Span<const uint8_t>> RsaOaepDecrypter::Decrypt(
 
   kms_v1::AsymmetricDecryptRequest req;
   req.set_name(std::string(key_->kms_key_name()));
-  req.set_ciphertext(ciphertext.data(), ciphertext.size());
+  req.mutable_ciphertext_crc32c()->set_value(
+      CopyWithCRC32C(ciphertext, req.mutable_ciphertext()));
 
   absl::StatusOr<kms_v1::AsymmetricDecryptResponse> resp =
       client->AsymmetricDecrypt(req);
@@ -118,8 +118,8 @@ absl::Status RsaRawPkcs1Signer::Sign(KmsClient* client,
 
   kms_v1::AsymmetricSignRequest req;
   req.set_name(std::string(object_->kms_key_name()));
-  req.set_data(
-      std::string(reinterpret_cast<const char*>(data.data()), data.size()));
+  req.mutable_data_crc32c()->set_value(
+      CopyWithCRC32C(data, req.mutable_data()));
 
   ASSIGN_OR_RETURN(kms_v1::AsymmetricSignResponse resp,
                    client->AsymmetricSign(req));
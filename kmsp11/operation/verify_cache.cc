@@ -0,0 +1,109 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/operation/verify_cache.h"
+
+#include "common/status_macros.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+// A VerifierInterface implementation that consults a VerifyCache before
+// delegating to an inner verifier.
+class CachingVerifier : public VerifierInterface {
+ public:
+  CachingVerifier(std::unique_ptr<VerifierInterface> inner, std::string context,
+                  VerifyCache* cache)
+      : inner_(std::move(inner)), context_(std::move(context)), cache_(cache) {}
+
+  Object* object() override { return inner_->object(); };
+
+  absl::Status Verify(KmsClient* client, absl::Span<const uint8_t> data,
+                      absl::Span<const uint8_t> signature) override;
+  absl::Status VerifyUpdate(KmsClient* client,
+                            absl::Span<const uint8_t> data) override;
+  absl::Status VerifyFinal(KmsClient* client,
+                           absl::Span<const uint8_t> signature) override;
+
+  virtual ~CachingVerifier() {}
+
+ private:
+  std::unique_ptr<VerifierInterface> inner_;
+  const std::string context_;
+  VerifyCache* cache_;
+  OperationDigest digest_;
+};
+
+absl::Status CachingVerifier::Verify(KmsClient* client,
+                                     absl::Span<const uint8_t> data,
+                                     absl::Span<const uint8_t> signature) {
+  ASSIGN_OR_RETURN(std::optional<std::string> digest,
+                   digest_.SinglePart(data));
+  if (!digest) {
+    return inner_->Verify(client, data, signature);
+  }
+
+  ASSIGN_OR_RETURN(std::string fingerprint,
+                   cache_->Fingerprint(context_, *digest, signature));
+  if (cache_->Lookup(fingerprint, [](const std::monostate&) {})) {
+    return absl::OkStatus();
+  }
+  RETURN_IF_ERROR(inner_->Verify(client, data, signature));
+  cache_->Insert(std::move(fingerprint), object()->kms_key_name(), {});
+  return absl::OkStatus();
+}
+
+absl::Status CachingVerifier::VerifyUpdate(KmsClient* client,
+                                           absl::Span<const uint8_t> data) {
+  RETURN_IF_ERROR(inner_->VerifyUpdate(client, data));
+  return digest_.Update(data);
+}
+
+absl::Status CachingVerifier::VerifyFinal(KmsClient* client,
+                                          absl::Span<const uint8_t> signature) {
+  ASSIGN_OR_RETURN(std::optional<std::string> digest, digest_.Final());
+  if (!digest) {
+    return inner_->VerifyFinal(client, signature);
+  }
+
+  ASSIGN_OR_RETURN(std::string fingerprint,
+                   cache_->Fingerprint(context_, *digest, signature));
+  if (cache_->Lookup(fingerprint, [](const std::monostate&) {})) {
+    return absl::OkStatus();
+  }
+  RETURN_IF_ERROR(inner_->VerifyFinal(client, signature));
+  cache_->Insert(std::move(fingerprint), object()->kms_key_name(), {});
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+std::unique_ptr<VerifierInterface> NewCachingVerifier(
+    std::unique_ptr<VerifierInterface> inner, const CK_MECHANISM* mechanism,
+    VerifyCache* cache) {
+  // Mechanism parameters, such as the PSS salt length, are part of the
+  // context, since they change the meaning of a signature.
+  std::string context;
+  std::string_view key_name = inner->object()->kms_key_name();
+  AppendBytes(key_name.data(), key_name.size(), context);
+  AppendUint64(mechanism->mechanism, context);
+  if (mechanism->pParameter) {
+    context.append(static_cast<const char*>(mechanism->pParameter),
+                   mechanism->ulParameterLen);
+  }
+  return std::make_unique<CachingVerifier>(std::move(inner), std::move(context),
+                                           cache);
+}
+
+}  // namespace cloud_kms::kmsp11
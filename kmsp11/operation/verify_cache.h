@@ -0,0 +1,48 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KMSP11_OPERATION_VERIFY_CACHE_H_
+#define KMSP11_OPERATION_VERIFY_CACHE_H_
+
+#include <memory>
+#include <variant>
+
+#include "kmsp11/operation/crypter_interfaces.h"
+#include "kmsp11/operation/fingerprint_cache.h"
+
+namespace cloud_kms::kmsp11 {
+
+// VerifyCache remembers successful signature verifications, so that verifying
+// the same signature again costs a hash lookup instead of a public key
+// operation or, for MAC keys, a MacVerify RPC. Failed verifications are never
+// cached.
+//
+// An entry's fingerprint covers the key name, the mechanism, a digest of the
+// data and the signature; see FingerprintCache.
+class VerifyCache : public FingerprintCache<std::monostate> {
+ public:
+  using FingerprintCache::FingerprintCache;
+};
+
+// Returns a verifier that answers from `cache` when it can, and otherwise
+// delegates to `inner` and records successful verifications in `cache`.
+std::unique_ptr<VerifierInterface> NewCachingVerifier(
+    std::unique_ptr<VerifierInterface> inner, const CK_MECHANISM* mechanism,
+    VerifyCache* cache);
+
+}  // namespace cloud_kms::kmsp11
+
+#endif  // KMSP11_OPERATION_VERIFY_CACHE_H_
@@ -0,0 +1,171 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/operation/verify_cache.h"
+
+#include "absl/time/clock.h"
+#include "common/test/test_status_macros.h"
+#include "kmsp11/object.h"
+#include "kmsp11/test/matchers.h"
+#include "kmsp11/test/resource_helpers.h"
+#include "kmsp11/util/errors.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+// A verifier that accepts a signature if it equals the data, and counts the
+// verifications that it performs.
+class FakeVerifier : public VerifierInterface {
+ public:
+  FakeVerifier(Object* object, int* verify_count)
+      : object_(object), verify_count_(verify_count) {}
+
+  Object* object() override { return object_; }
+
+  absl::Status Verify(KmsClient* client, absl::Span<const uint8_t> data,
+                      absl::Span<const uint8_t> signature) override {
+    (*verify_count_)++;
+    if (data != signature) {
+      return NewInvalidArgumentError("bad signature", CKR_SIGNATURE_INVALID,
+                                     SOURCE_LOCATION);
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status VerifyUpdate(KmsClient* client,
+                            absl::Span<const uint8_t> data) override {
+    data_.insert(data_.end(), data.begin(), data.end());
+    return absl::OkStatus();
+  }
+
+  absl::Status VerifyFinal(KmsClient* client,
+                           absl::Span<const uint8_t> signature) override {
+    return Verify(client, data_, signature);
+  }
+
+ private:
+  Object* object_;
+  int* verify_count_;
+  std::vector<uint8_t> data_;
+};
+
+class VerifyCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_OK_AND_ASSIGN(
+        Object key, NewMockSecretKey(kms_v1::CryptoKeyVersion::HMAC_SHA256));
+    key_ = std::make_shared<Object>(key);
+  }
+
+  std::unique_ptr<VerifierInterface> NewVerifier(
+      VerifyCache* cache, CK_MECHANISM_TYPE mechanism_type = CKM_SHA256_HMAC) {
+    CK_MECHANISM mechanism{mechanism_type, nullptr, 0};
+    return NewCachingVerifier(
+        std::make_unique<FakeVerifier>(key_.get(), &verify_count_), &mechanism,
+        cache);
+  }
+
+  std::shared_ptr<Object> key_;
+  int verify_count_ = 0;
+  const std::vector<uint8_t> data_ = {0x01, 0x02, 0x03};
+  const std::vector<uint8_t> bad_signature_ = {0x04};
+};
+
+TEST_F(VerifyCacheTest, RepeatedVerifyIsAnsweredFromCache) {
+  VerifyCache cache(10, absl::Minutes(5));
+
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, data_, data_));
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, data_, data_));
+
+  EXPECT_EQ(verify_count_, 1);
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST_F(VerifyCacheTest, FailedVerifyIsNotCached) {
+  VerifyCache cache(10, absl::Minutes(5));
+
+  EXPECT_THAT(NewVerifier(&cache)->Verify(nullptr, data_, bad_signature_),
+              StatusRvIs(CKR_SIGNATURE_INVALID));
+  EXPECT_THAT(NewVerifier(&cache)->Verify(nullptr, data_, bad_signature_),
+              StatusRvIs(CKR_SIGNATURE_INVALID));
+
+  EXPECT_EQ(verify_count_, 2);
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST_F(VerifyCacheTest, MultiPartVerifyMatchesSinglePartVerify) {
+  VerifyCache cache(10, absl::Minutes(5));
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, data_, data_));
+
+  std::unique_ptr<VerifierInterface> verifier = NewVerifier(&cache);
+  absl::Span<const uint8_t> data = data_;
+  EXPECT_OK(verifier->VerifyUpdate(nullptr, data.first(1)));
+  EXPECT_OK(verifier->VerifyUpdate(nullptr, data.subspan(1)));
+  EXPECT_OK(verifier->VerifyFinal(nullptr, data_));
+
+  EXPECT_EQ(verify_count_, 1);
+}
+
+TEST_F(VerifyCacheTest, DifferentMechanismIsNotAnsweredFromCache) {
+  VerifyCache cache(10, absl::Minutes(5));
+
+  EXPECT_OK(
+      NewVerifier(&cache, CKM_SHA256_HMAC)->Verify(nullptr, data_, data_));
+  EXPECT_OK(
+      NewVerifier(&cache, CKM_SHA384_HMAC)->Verify(nullptr, data_, data_));
+
+  EXPECT_EQ(verify_count_, 2);
+}
+
+TEST_F(VerifyCacheTest, LeastRecentlyUsedEntryIsEvicted) {
+  VerifyCache cache(2, absl::Minutes(5));
+  std::vector<uint8_t> a = {0x0a}, b = {0x0b}, c = {0x0c};
+
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, a, a));
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, b, b));
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, a, a));  // a is now newest
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, c, c));  // evicts b
+  EXPECT_EQ(verify_count_, 3);
+
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, a, a));
+  EXPECT_EQ(verify_count_, 3);
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, b, b));
+  EXPECT_EQ(verify_count_, 4);
+}
+
+TEST_F(VerifyCacheTest, ExpiredEntryIsNotUsed) {
+  VerifyCache cache(10, absl::Milliseconds(10));
+
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, data_, data_));
+  absl::SleepFor(absl::Milliseconds(20));
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, data_, data_));
+
+  EXPECT_EQ(verify_count_, 2);
+}
+
+TEST_F(VerifyCacheTest, RetainKeysRemovesEntriesForMissingKeys) {
+  VerifyCache cache(10, absl::Minutes(5));
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, data_, data_));
+
+  cache.RetainKeys({std::string(key_->kms_key_name())});
+  EXPECT_EQ(cache.size(), 1);
+
+  cache.RetainKeys({});
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_OK(NewVerifier(&cache)->Verify(nullptr, data_, data_));
+  EXPECT_EQ(verify_count_, 2);
+}
+
+}  // namespace
+}  // namespace cloud_kms::kmsp11
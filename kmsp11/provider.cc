@@ -14,11 +14,20 @@
 
 #include "kmsp11/provider.h"
 
+#include <algorithm>
+
+#include "absl/container/flat_hash_map.h"
+#include "cloudkms_grpc_service_config.h"
+#include "common/fair_share_scheduler.h"
+#include "common/http_client.h"
 #include "common/kms_client.h"
+#include "common/kms_client_registry.h"
+#include "common/rest_transport.h"
 #include "common/status_macros.h"
 #include "glog/logging.h"
 #include "kmsp11/cert_authority.h"
 #include "kmsp11/mechanism.h"
+#include "kmsp11/public_key_snapshot.h"
 #include "kmsp11/util/string_utils.h"
 #include "kmsp11/version.h"
 
@@ -27,6 +36,9 @@ namespace {
 
 static const char* kDefaultKmsEndpoint = "cloudkms.googleapis.com:443";
 constexpr absl::Duration kDefaultRpcTimeout = absl::Seconds(30);
+constexpr absl::Duration kDefaultVerifyCacheTtl = absl::Minutes(5);
+constexpr absl::Duration kDefaultDecryptCacheTtl = absl::Minutes(5);
+constexpr size_t kMinObjectHandleSecretSize = 16;
 
 absl::StatusOr<CK_INFO> NewCkInfo() {
   CK_INFO info = {
@@ -42,14 +54,57 @@ absl::StatusOr<CK_INFO> NewCkInfo() {
   return info;
 }
 
-std::unique_ptr<KmsClient> NewKmsClient(const LibraryConfig& config) {
+// Returns a scheduler that shares RPC capacity between tokens, or nullptr if
+// no concurrency limit is configured.
+std::shared_ptr<FairShareScheduler> NewScheduler(const LibraryConfig& config) {
+  bool limited = config.max_concurrent_rpcs() > 0;
+  absl::flat_hash_map<std::string, FairShareScheduler::FlowOptions> flows;
+  for (const TokenConfig& token : config.tokens()) {
+    limited |= token.max_concurrent_rpcs() > 0;
+    flows.try_emplace(token.key_ring(),
+                      FairShareScheduler::FlowOptions{
+                          .weight = std::max(token.scheduling_weight(), 1u),
+                          .max_in_flight = token.max_concurrent_rpcs(),
+                      });
+  }
+  if (!limited) {
+    return nullptr;
+  }
+  return std::make_shared<FairShareScheduler>(config.max_concurrent_rpcs(),
+                                              flows);
+}
+
+// Returns a transport that calls the Cloud KMS REST API at `endpoint_address`.
+absl::StatusOr<std::shared_ptr<KmsTransport>> NewRestTransport(
+    const LibraryConfig& config, const std::string& endpoint_address) {
+  bool insecure = config.use_insecure_grpc_channel_credentials();
+  RestTransport::Options options;
+  options.user_agent = UserAgentPrefix(
+      UserAgent::kPkcs11, kLibraryVersion.major, kLibraryVersion.minor);
+  options.user_project_override = config.user_project_override();
+  options.rpc_feature_flags = config.experimental_rpc_feature_flags();
+  // Retry failed calls as the gRPC transport does.
+  ASSIGN_OR_RETURN(options.retry_policies,
+                   ParseRetryPolicies(kDefaultCloudKmsGrpcServiceConfig));
+  if (!insecure) {
+    ASSIGN_OR_RETURN(options.access_token_source,
+                     NewDefaultTokenSource(config.rest_root_certs_file()));
+  }
+  ASSIGN_OR_RETURN(std::unique_ptr<HttpClient> http_client,
+                   NewHttpClient(endpoint_address, /*use_tls=*/!insecure,
+                                 config.rest_root_certs_file()));
+  return std::make_shared<RestTransport>(std::move(http_client),
+                                         std::move(options));
+}
+
+// Returns a KmsClient for `config`, shared with any other Provider in this
+// process whose configuration has the same fingerprint.
+absl::StatusOr<std::shared_ptr<KmsClient>> NewKmsClient(
+    const LibraryConfig& config) {
   KmsClient::Options options;
   options.endpoint_address = config.kms_endpoint().empty()
                                  ? kDefaultKmsEndpoint
                                  : config.kms_endpoint();
-  options.creds = config.use_insecure_grpc_channel_credentials()
-                      ? grpc::InsecureChannelCredentials()
-                      : grpc::GoogleDefaultCredentials();
   options.rpc_timeout = config.rpc_timeout_secs() == 0
                             ? kDefaultRpcTimeout
                             : absl::Seconds(config.rpc_timeout_secs());
@@ -61,28 +116,166 @@ std::unique_ptr<KmsClient> NewKmsClient(const LibraryConfig& config) {
   options.rpc_feature_flags = config.experimental_rpc_feature_flags();
   options.user_project_override = config.user_project_override();
 
-  return std::make_unique<KmsClient>(options);
+  // The scheduler and transport depend on more of the config than the client
+  // options do, so the fingerprint of the whole config is the registry key.
+  return KmsClientRegistry::Global().GetOrCreate(
+      WarmStateFingerprint(config),
+      [&]() -> absl::StatusOr<std::unique_ptr<KmsClient>> {
+        options.scheduler = NewScheduler(config);
+        if (config.use_rest_transport()) {
+          ASSIGN_OR_RETURN(options.transport,
+                           NewRestTransport(config, options.endpoint_address));
+        } else {
+          options.creds = config.use_insecure_grpc_channel_credentials()
+                              ? grpc::InsecureChannelCredentials()
+                              : grpc::GoogleDefaultCredentials();
+        }
+        return std::make_unique<KmsClient>(options);
+      });
 }
 
 }  // namespace
 
-absl::StatusOr<std::unique_ptr<Provider>> Provider::New(LibraryConfig config) {
+std::string WarmStateFingerprint(const LibraryConfig& config) {
+  // Clear the fields that have no bearing on the Cloud KMS client or the
+  // object loaders.
+  LibraryConfig fingerprint = config;
+  fingerprint.clear_log_directory();
+  fingerprint.clear_log_filename_suffix();
+  fingerprint.clear_refresh_interval_secs();
+  fingerprint.clear_refresh_buckets();
+  fingerprint.clear_verify_cache_size();
+  fingerprint.clear_verify_cache_ttl_secs();
+  fingerprint.clear_decrypt_cache_size();
+  fingerprint.clear_decrypt_cache_ttl_secs();
+  fingerprint.clear_retain_state_on_finalize();
+  return fingerprint.SerializeAsString();
+}
+
+absl::StatusOr<std::unique_ptr<Provider>> Provider::New(
+    LibraryConfig config, std::unique_ptr<WarmState> warm_state) {
   ASSIGN_OR_RETURN(CK_INFO info, NewCkInfo());
-  std::unique_ptr<KmsClient> client = NewKmsClient(config);
+  if (!config.object_handle_secret().empty() &&
+      config.object_handle_secret().size() < kMinObjectHandleSecretSize) {
+    return NewInvalidArgumentError(
+        absl::StrFormat("object_handle_secret must be at least %d bytes",
+                        kMinObjectHandleSecretSize),
+        CKR_GENERAL_ERROR, SOURCE_LOCATION);
+  }
+  if (!config.public_key_snapshot_file().empty()) {
+    return NewFromPublicKeySnapshot(config, info);
+  }
+  if (warm_state &&
+      warm_state->config_fingerprint != WarmStateFingerprint(config)) {
+    LOG(INFO) << "INFO: discarding retained state, since the library "
+                 "configuration has changed";
+    warm_state.reset();
+  }
+  std::shared_ptr<KmsClient> client;
+  if (warm_state) {
+    client = std::move(warm_state->kms_client);
+  } else {
+    ASSIGN_OR_RETURN(client, NewKmsClient(config));
+  }
 
   std::vector<std::unique_ptr<Token>> tokens;
   tokens.reserve(config.tokens_size());
   for (const TokenConfig& tokenConfig : config.tokens()) {
-    ASSIGN_OR_RETURN(std::unique_ptr<Token> token,
-                     Token::New(tokens.size(), tokenConfig, client.get(),
-                                config.generate_certs()));
+    std::unique_ptr<VerifyCache> verify_cache;
+    if (config.verify_cache_size() > 0) {
+      verify_cache = std::make_unique<VerifyCache>(
+          config.verify_cache_size(),
+          config.verify_cache_ttl_secs() == 0
+              ? kDefaultVerifyCacheTtl
+              : absl::Seconds(config.verify_cache_ttl_secs()));
+    }
+    std::unique_ptr<DecryptCache> decrypt_cache;
+    if (config.decrypt_cache_size() > 0) {
+      decrypt_cache = std::make_unique<DecryptCache>(
+          config.decrypt_cache_size(),
+          config.decrypt_cache_ttl_secs() == 0
+              ? kDefaultDecryptCacheTtl
+              : absl::Seconds(config.decrypt_cache_ttl_secs()));
+    }
+    std::unique_ptr<Token> token;
+    if (warm_state) {
+      std::unique_ptr<ObjectLoader> loader =
+          std::move(warm_state->object_loaders[tokens.size()]);
+      ObjectStoreState state = loader->CachedState();
+      ASSIGN_OR_RETURN(token, Token::New(tokens.size(), tokenConfig,
+                                         std::move(loader), state,
+                                         std::move(verify_cache),
+                                         std::move(decrypt_cache)));
+    } else {
+      ASSIGN_OR_RETURN(
+          token, Token::New(tokens.size(), tokenConfig, client.get(),
+                            config.generate_certs(), std::move(verify_cache),
+                            std::move(decrypt_cache),
+                            config.object_handle_secret()));
+    }
     tokens.emplace_back(std::move(token));
   }
 
   // using `new` to invoke a private constructor
   return std::unique_ptr<Provider>(
       new Provider(config, info, std::move(tokens), std::move(client),
-                   absl::Seconds(config.refresh_interval_secs())));
+                   absl::Seconds(config.refresh_interval_secs()),
+                   std::max(config.refresh_buckets(), 1u),
+                   /*revalidate=*/warm_state != nullptr));
+}
+
+absl::StatusOr<std::unique_ptr<Provider>> Provider::NewFromPublicKeySnapshot(
+    LibraryConfig config, CK_INFO info) {
+  ASSIGN_OR_RETURN(PublicKeySnapshot snapshot,
+                   ReadPublicKeySnapshot(config.public_key_snapshot_file()));
+
+  std::vector<std::unique_ptr<Token>> tokens;
+  tokens.reserve(config.tokens_size());
+  for (const TokenConfig& tokenConfig : config.tokens()) {
+    auto it = snapshot.key_rings().find(tokenConfig.key_ring());
+    if (it == snapshot.key_rings().end()) {
+      return NewInvalidArgumentError(
+          absl::StrFormat("public key snapshot has no entry for key ring %s",
+                          tokenConfig.key_ring()),
+          CKR_GENERAL_ERROR, SOURCE_LOCATION);
+    }
+    ASSIGN_OR_RETURN(std::unique_ptr<ObjectLoader> loader,
+                     ObjectLoader::New(tokenConfig.key_ring(), {}, false));
+    ASSIGN_OR_RETURN(std::unique_ptr<Token> token,
+                     Token::New(tokens.size(), tokenConfig, std::move(loader),
+                                it->second));
+    tokens.emplace_back(std::move(token));
+  }
+
+  // There is no Cloud KMS client, so the snapshot is never refreshed.
+  return std::unique_ptr<Provider>(new Provider(
+      config, info, std::move(tokens), /*kms_client=*/nullptr,
+      absl::ZeroDuration(), 1, /*revalidate=*/false));
+}
+
+PublicKeySnapshot Provider::ExportPublicKeySnapshot() {
+  PublicKeySnapshot snapshot;
+  for (const std::unique_ptr<Token>& token : tokens_) {
+    (*snapshot.mutable_key_rings())[std::string(token->key_ring_name())] =
+        PublicKeysOnly(token->CachedState());
+  }
+  return snapshot;
+}
+
+std::unique_ptr<WarmState> Provider::ReleaseWarmState(
+    std::unique_ptr<Provider> provider) {
+  // Stop using the client and the loaders before handing them over.
+  provider->refresher_.reset();
+  provider->sessions_.RemoveIf([](const Session&) { return true; });
+
+  auto warm_state = std::make_unique<WarmState>();
+  warm_state->config_fingerprint =
+      WarmStateFingerprint(provider->library_config_);
+  warm_state->kms_client = std::move(provider->kms_client_);
+  for (const std::unique_ptr<Token>& token : provider->tokens_) {
+    warm_state->object_loaders.push_back(token->ReleaseObjectLoader());
+  }
+  return warm_state;
 }
 
 absl::StatusOr<Token*> Provider::TokenAt(CK_SLOT_ID slot_id) {
@@ -116,23 +309,44 @@ absl::Status Provider::CloseAllSessions(CK_SLOT_ID slot_id) {
   return absl::OkStatus();
 }
 
-Provider::Refresher::Refresher(Provider* provider, absl::Duration interval)
+Provider::Refresher::Refresher(Provider* provider, absl::Duration interval,
+                               uint32_t buckets, bool revalidate)
     : thread_(
           [](Provider* provider, const absl::Duration interval,
+             const uint32_t buckets, const bool revalidate,
              const absl::Notification* shutdown) {
-            while (!shutdown->WaitForNotificationWithTimeout(interval)) {
+            if (revalidate) {
               for (const std::unique_ptr<Token>& token : provider->tokens_) {
                 absl::Status refresh_result =
                     token->RefreshState(*provider->kms_client_);
+                if (!refresh_result.ok()) {
+                  LOG(ERROR)
+                      << "error revalidating state for key ring "
+                      << token->key_ring_name() << ": " << refresh_result;
+                }
+              }
+            }
+
+            // With more than one bucket, each step refreshes one bucket of
+            // CryptoKeys, so that every key is revisited once per interval.
+            uint32_t bucket = 0;
+            while (!shutdown->WaitForNotificationWithTimeout(interval /
+                                                             buckets)) {
+              for (const std::unique_ptr<Token>& token : provider->tokens_) {
+                absl::Status refresh_result =
+                    buckets > 1 ? token->RefreshState(*provider->kms_client_,
+                                                      bucket, buckets)
+                                : token->RefreshState(*provider->kms_client_);
                 if (!refresh_result.ok()) {
                   LOG(ERROR)
                       << "error refreshing state for key ring "
                       << token->key_ring_name() << ": " << refresh_result;
                 }
               }
+              bucket = (bucket + 1) % buckets;
             }
           },
-          provider, interval, &shutdown_) {}
+          provider, interval, buckets, revalidate, &shutdown_) {}
 
 Provider::Refresher::~Refresher() {
   shutdown_.Notify();
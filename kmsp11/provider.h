@@ -24,6 +24,7 @@
 #include "kmsp11/config/config.pb.h"
 #include "kmsp11/cryptoki.h"
 #include "kmsp11/mechanism.h"
+#include "kmsp11/object_store_state.pb.h"
 #include "kmsp11/session.h"
 #include "kmsp11/token.h"
 #include "kmsp11/util/errors.h"
@@ -31,13 +32,42 @@
 
 namespace cloud_kms::kmsp11 {
 
+// WarmState holds the parts of a Provider that are expensive to rebuild: the
+// Cloud KMS client, with its channel and credentials, and each token's
+// ObjectLoader, with its parsed keys and generated certificates. It can be
+// adopted by a later Provider with the same config fingerprint.
+struct WarmState {
+  std::string config_fingerprint;
+  std::shared_ptr<KmsClient> kms_client;
+  std::vector<std::unique_ptr<ObjectLoader>> object_loaders;
+};
+
+// Returns a fingerprint of the parts of `config` that a WarmState depends on.
+std::string WarmStateFingerprint(const LibraryConfig& config);
+
 // Provider models a "run" of a Cryptoki library, from C_Initialize to
 // C_Finalize.
 //
 // See go/kms-pkcs11-model
 class Provider {
  public:
-  static absl::StatusOr<std::unique_ptr<Provider>> New(LibraryConfig config);
+  // If `config` names a public_key_snapshot_file, the new Provider serves the
+  // public keys in that file, and does not contact Cloud KMS at all.
+  //
+  // If `warm_state` has the same fingerprint as `config`, the new Provider
+  // adopts it instead of loading its tokens from Cloud KMS, and revalidates
+  // their state in the background. Otherwise, `warm_state` is discarded.
+  static absl::StatusOr<std::unique_ptr<Provider>> New(
+      LibraryConfig config, std::unique_ptr<WarmState> warm_state = nullptr);
+
+  // Destroys `provider`, returning the parts of it that a later Provider can
+  // adopt. All of the provider's sessions are closed.
+  static std::unique_ptr<WarmState> ReleaseWarmState(
+      std::unique_ptr<Provider> provider);
+
+  // Returns the public keys of every token, in the format read from a
+  // public_key_snapshot_file.
+  PublicKeySnapshot ExportPublicKeySnapshot();
 
   const LibraryConfig& library_config() const { return library_config_; }
   const CK_INFO& info() const { return info_; }
@@ -59,9 +89,15 @@ class Provider {
   absl::StatusOr<CK_MECHANISM_INFO> MechanismInfo(CK_MECHANISM_TYPE type);
 
  private:
+  static absl::StatusOr<std::unique_ptr<Provider>> NewFromPublicKeySnapshot(
+      LibraryConfig config, CK_INFO info);
+
   class Refresher {
    public:
-    Refresher(Provider* provider, absl::Duration interval);
+    // If `revalidate` is true, every token is refreshed as soon as the
+    // refresher starts.
+    Refresher(Provider* provider, absl::Duration interval, uint32_t buckets,
+              bool revalidate);
     virtual ~Refresher();
 
    private:
@@ -71,15 +107,18 @@ class Provider {
 
   Provider(LibraryConfig library_config, CK_INFO info,
            std::vector<std::unique_ptr<Token>>&& tokens,
-           std::unique_ptr<KmsClient> kms_client,
-           absl::Duration refresh_interval)
+           std::shared_ptr<KmsClient> kms_client,
+           absl::Duration refresh_interval, uint32_t refresh_buckets,
+           bool revalidate)
       : library_config_(library_config),
         info_(info),
         tokens_(std::move(tokens)),
-        sessions_(CKR_SESSION_HANDLE_INVALID),
+        sessions_(CKR_SESSION_HANDLE_INVALID, CKR_SESSION_COUNT),
         kms_client_(std::move(kms_client)) {
     if (refresh_interval > absl::ZeroDuration()) {
-      refresher_.emplace(this, refresh_interval);
+      refresher_.emplace(this, refresh_interval, refresh_buckets, revalidate);
+    } else if (revalidate) {
+      refresher_.emplace(this, absl::InfiniteDuration(), 1, revalidate);
     }
     auto all_mechanisms = AllMechanisms();
     auto all_mac_mechanisms = AllMacMechanisms();
@@ -96,7 +135,7 @@ class Provider {
   const CK_INFO info_;
   const std::vector<std::unique_ptr<Token>> tokens_;
   HandleMap<Session> sessions_;
-  std::unique_ptr<KmsClient> kms_client_;
+  std::shared_ptr<KmsClient> kms_client_;
   std::optional<Refresher> refresher_;
   std::vector<CK_MECHANISM_TYPE> mechanism_types_;
 };
@@ -14,10 +14,14 @@
 
 #include "kmsp11/provider.h"
 
+#include <filesystem>
+
+#include "absl/cleanup/cleanup.h"
 #include "common/test/proto_parser.h"
 #include "common/test/test_status_macros.h"
 #include "fakekms/cpp/fakekms.h"
 #include "gmock/gmock.h"
+#include "kmsp11/public_key_snapshot.h"
 #include "kmsp11/test/matchers.h"
 #include "kmsp11/test/resource_helpers.h"
 #include "kmsp11/util/string_utils.h"
@@ -30,6 +34,8 @@ using ::testing::Contains;
 using ::testing::Eq;
 using ::testing::Field;
 using ::testing::Le;
+using ::testing::Pointee;
+using ::testing::Property;
 
 class ProviderTest : public testing::Test {
  protected:
@@ -42,7 +48,7 @@ class ProviderTest : public testing::Test {
     kms_v1::KeyRing kr2;
     kr2 = CreateKeyRingOrDie(client.get(), kTestLocation, RandomId(), kr2);
 
-    LibraryConfig config = ParseTestProto(
+    config_ = ParseTestProto(
         absl::StrFormat(R"(
       tokens {
         key_ring: "%s"
@@ -57,11 +63,12 @@ class ProviderTest : public testing::Test {
     )",
                         kr1.name(), kr2.name(), fake_server_->listen_addr()));
 
-    ASSERT_OK_AND_ASSIGN(provider_, Provider::New(config));
+    ASSERT_OK_AND_ASSIGN(provider_, Provider::New(config_));
     info_ = provider_->info();
   }
 
   std::unique_ptr<fakekms::Server> fake_server_;
+  LibraryConfig config_;
   std::unique_ptr<Provider> provider_;
   CK_INFO info_;
 };
@@ -169,5 +176,89 @@ TEST_F(ProviderTest, UnsupportedMechanism) {
                     StatusRvIs(CKR_MECHANISM_INVALID)));
 }
 
+TEST_F(ProviderTest, AdoptedWarmStateKeepsClientAndObjects) {
+  auto kms_stub = fake_server_->NewClient();
+  kms_v1::CryptoKey ck;
+  ck.set_purpose(kms_v1::CryptoKey::ASYMMETRIC_SIGN);
+  ck.mutable_version_template()->set_algorithm(
+      kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+  ck.mutable_version_template()->set_protection_level(kms_v1::HSM);
+  ck = CreateCryptoKeyOrDie(kms_stub.get(), config_.tokens(0).key_ring(), "ck",
+                            ck, true);
+  kms_v1::CryptoKeyVersion ckv;
+  ckv = CreateCryptoKeyVersionOrDie(kms_stub.get(), ck.name(), ckv);
+  WaitForEnablement(kms_stub.get(), ckv);
+
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Provider> provider,
+                       Provider::New(config_));
+  KmsClient* kms_client = provider->kms_client();
+  ASSERT_OK_AND_ASSIGN(Token * token, provider->TokenAt(0));
+  std::vector<CK_OBJECT_HANDLE> handles =
+      token->FindObjects([](const Object&) { return true; });
+  ASSERT_EQ(handles.size(), 2);
+
+  std::unique_ptr<WarmState> warm_state =
+      Provider::ReleaseWarmState(std::move(provider));
+  ASSERT_OK_AND_ASSIGN(provider, Provider::New(config_, std::move(warm_state)));
+
+  EXPECT_EQ(provider->kms_client(), kms_client);
+  ASSERT_OK_AND_ASSIGN(token, provider->TokenAt(0));
+  EXPECT_EQ(token->FindObjects([](const Object&) { return true; }), handles);
+}
+
+TEST_F(ProviderTest, ProvidersWithSameConfigShareKmsClient) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Provider> provider1,
+                       Provider::New(config_));
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Provider> provider2,
+                       Provider::New(config_));
+
+  EXPECT_EQ(provider1->kms_client(), provider2->kms_client());
+}
+
+TEST_F(ProviderTest, ServesExportedPublicKeySnapshot) {
+  auto kms_stub = fake_server_->NewClient();
+  kms_v1::CryptoKey ck;
+  ck.set_purpose(kms_v1::CryptoKey::ASYMMETRIC_SIGN);
+  ck.mutable_version_template()->set_algorithm(
+      kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256);
+  ck.mutable_version_template()->set_protection_level(kms_v1::HSM);
+  ck = CreateCryptoKeyOrDie(kms_stub.get(), config_.tokens(0).key_ring(), "ck",
+                            ck, true);
+  kms_v1::CryptoKeyVersion ckv;
+  ckv = CreateCryptoKeyVersionOrDie(kms_stub.get(), ck.name(), ckv);
+  WaitForEnablement(kms_stub.get(), ckv);
+
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Provider> provider,
+                       Provider::New(config_));
+  std::string path =
+      std::filesystem::temp_directory_path().append(RandomId()).string();
+  absl::Cleanup c = [&] { std::filesystem::remove(path); };
+  ASSERT_OK(WritePublicKeySnapshot(provider->ExportPublicKeySnapshot(), path));
+
+  LibraryConfig config = config_;
+  config.set_public_key_snapshot_file(path);
+  ASSERT_OK_AND_ASSIGN(provider, Provider::New(config));
+
+  EXPECT_EQ(provider->kms_client(), nullptr);
+  ASSERT_OK_AND_ASSIGN(Token * token, provider->TokenAt(0));
+  std::vector<CK_OBJECT_HANDLE> handles =
+      token->FindObjects([](const Object&) { return true; });
+  ASSERT_EQ(handles.size(), 1);
+  EXPECT_THAT(token->GetObject(handles[0]),
+              IsOkAndHolds(Pointee(Property("object_class",
+                                            &Object::object_class,
+                                            CKO_PUBLIC_KEY))));
+}
+
+TEST_F(ProviderTest, WarmStateFingerprintIgnoresOnlyUnrelatedFields) {
+  LibraryConfig config = config_;
+  config.set_log_directory("/tmp");
+  config.set_refresh_interval_secs(60);
+  EXPECT_EQ(WarmStateFingerprint(config), WarmStateFingerprint(config_));
+
+  config.mutable_tokens(0)->set_key_ring(config_.tokens(1).key_ring());
+  EXPECT_NE(WarmStateFingerprint(config), WarmStateFingerprint(config_));
+}
+
 }  // namespace
 }  // namespace cloud_kms::kmsp11
@@ -0,0 +1,76 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/public_key_snapshot.h"
+
+#include <fstream>
+
+#include "absl/strings/str_format.h"
+#include "kmsp11/util/errors.h"
+
+namespace cloud_kms::kmsp11 {
+
+ObjectStoreState PublicKeysOnly(const ObjectStoreState& state) {
+  ObjectStoreState result;
+  result.set_keyed_handles(state.keyed_handles());
+  result.set_public_keys_only(true);
+  for (const Key& key : state.keys()) {
+    if (key.secret_key_handle() != 0) {
+      continue;
+    }
+    Key* public_key = result.add_keys();
+    *public_key = key;
+    public_key->clear_private_key_handle();
+  }
+  return result;
+}
+
+absl::StatusOr<PublicKeySnapshot> ReadPublicKeySnapshot(
+    const std::string& path) {
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if (in.fail()) {
+    return FailedPreconditionError(
+        absl::StrFormat("failed to open public key snapshot at %s", path),
+        CKR_GENERAL_ERROR, SOURCE_LOCATION);
+  }
+
+  PublicKeySnapshot snapshot;
+  if (!snapshot.ParseFromIstream(&in)) {
+    return NewInvalidArgumentError(
+        absl::StrFormat("error parsing public key snapshot at %s", path),
+        CKR_GENERAL_ERROR, SOURCE_LOCATION);
+  }
+  for (const auto& [key_ring, state] : snapshot.key_rings()) {
+    if (!state.public_keys_only()) {
+      return NewInvalidArgumentError(
+          absl::StrFormat("public key snapshot at %s has private state for %s",
+                          path, key_ring),
+          CKR_GENERAL_ERROR, SOURCE_LOCATION);
+    }
+  }
+  return snapshot;
+}
+
+absl::Status WritePublicKeySnapshot(const PublicKeySnapshot& snapshot,
+                                    const std::string& path) {
+  std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (out.fail() || !snapshot.SerializeToOstream(&out)) {
+    return FailedPreconditionError(
+        absl::StrFormat("failed to write public key snapshot to %s", path),
+        CKR_GENERAL_ERROR, SOURCE_LOCATION);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace cloud_kms::kmsp11
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KMSP11_PUBLIC_KEY_SNAPSHOT_H_
+#define KMSP11_PUBLIC_KEY_SNAPSHOT_H_
+
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "kmsp11/object_store_state.pb.h"
+
+namespace cloud_kms::kmsp11 {
+
+// Returns a copy of `state` that holds only its public keys and certificates.
+// Secret keys are omitted, and private key handles are cleared.
+ObjectStoreState PublicKeysOnly(const ObjectStoreState& state);
+
+// Reads a PublicKeySnapshot from the binary-encoded proto at `path`.
+absl::StatusOr<PublicKeySnapshot> ReadPublicKeySnapshot(
+    const std::string& path);
+
+// Writes `snapshot` to `path` as a binary-encoded proto.
+absl::Status WritePublicKeySnapshot(const PublicKeySnapshot& snapshot,
+                                    const std::string& path);
+
+}  // namespace cloud_kms::kmsp11
+
+#endif  // KMSP11_PUBLIC_KEY_SNAPSHOT_H_
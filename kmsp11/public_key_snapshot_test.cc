@@ -0,0 +1,94 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/public_key_snapshot.h"
+
+#include <filesystem>
+
+#include "absl/cleanup/cleanup.h"
+#include "common/test/test_status_macros.h"
+#include "gmock/gmock.h"
+#include "kmsp11/test/matchers.h"
+#include "kmsp11/test/resource_helpers.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+using ::testing::AllOf;
+using ::testing::HasSubstr;
+
+ObjectStoreState NewState() {
+  ObjectStoreState state;
+  Key* asymmetric = state.add_keys();
+  asymmetric->mutable_crypto_key_version()->set_name(
+      "projects/foo/locations/bar/keyRings/baz/cryptoKeys/qux/"
+      "cryptoKeyVersions/1");
+  asymmetric->set_public_key_der("public key");
+  asymmetric->set_public_key_handle(1);
+  asymmetric->set_private_key_handle(2);
+  asymmetric->mutable_certificate()->set_x509_der("certificate");
+  asymmetric->mutable_certificate()->set_handle(3);
+
+  Key* symmetric = state.add_keys();
+  symmetric->mutable_crypto_key_version()->set_name(
+      "projects/foo/locations/bar/keyRings/baz/cryptoKeys/quux/"
+      "cryptoKeyVersions/1");
+  symmetric->set_secret_key_handle(4);
+  return state;
+}
+
+TEST(PublicKeySnapshotTest, PublicKeysOnlyOmitsPrivateAndSecretKeys) {
+  ObjectStoreState state = PublicKeysOnly(NewState());
+
+  EXPECT_TRUE(state.public_keys_only());
+  ASSERT_EQ(state.keys_size(), 1);
+  EXPECT_EQ(state.keys(0).public_key_handle(), 1);
+  EXPECT_EQ(state.keys(0).private_key_handle(), 0);
+  EXPECT_EQ(state.keys(0).certificate().handle(), 3);
+}
+
+TEST(PublicKeySnapshotTest, WrittenSnapshotCanBeRead) {
+  std::string path =
+      std::filesystem::temp_directory_path().append(RandomId()).string();
+  absl::Cleanup c = [&] { std::filesystem::remove(path); };
+
+  PublicKeySnapshot snapshot;
+  (*snapshot.mutable_key_rings())["baz"] = PublicKeysOnly(NewState());
+  ASSERT_OK(WritePublicKeySnapshot(snapshot, path));
+
+  EXPECT_THAT(ReadPublicKeySnapshot(path), IsOkAndHolds(EqualsProto(snapshot)));
+}
+
+TEST(PublicKeySnapshotTest, ReadRejectsPrivateState) {
+  std::string path =
+      std::filesystem::temp_directory_path().append(RandomId()).string();
+  absl::Cleanup c = [&] { std::filesystem::remove(path); };
+
+  PublicKeySnapshot snapshot;
+  (*snapshot.mutable_key_rings())["baz"] = NewState();
+  ASSERT_OK(WritePublicKeySnapshot(snapshot, path));
+
+  EXPECT_THAT(ReadPublicKeySnapshot(path),
+              AllOf(StatusIs(absl::StatusCode::kInvalidArgument,
+                             HasSubstr("private state")),
+                    StatusRvIs(CKR_GENERAL_ERROR)));
+}
+
+TEST(PublicKeySnapshotTest, ReadMissingFileFails) {
+  EXPECT_THAT(ReadPublicKeySnapshot("/nonexistent/snapshot"),
+              StatusRvIs(CKR_GENERAL_ERROR));
+}
+
+}  // namespace
+}  // namespace cloud_kms::kmsp11
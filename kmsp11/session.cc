@@ -16,6 +16,8 @@
 
 #include <regex>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "common/kms_client.h"
 #include "common/status_macros.h"
 #include "kmsp11/kmsp11.h"
@@ -119,6 +121,27 @@ absl::StatusOr<kms_v1::CryptoKeyVersion> CreateNewVersionOfExistingKey(
   return client.CreateCryptoKeyVersionAndWait(req);
 }
 
+kms_v1::CreateCryptoKeyRequest NewCreateCryptoKeyRequest(
+    std::string_view key_ring_name, const KeyGenerationParams& gen_params) {
+  kms_v1::CreateCryptoKeyRequest req;
+  req.set_parent(std::string(key_ring_name));
+  req.set_crypto_key_id(gen_params.label);
+  req.mutable_crypto_key()->set_purpose(gen_params.algorithm.purpose);
+  req.mutable_crypto_key()->mutable_version_template()->set_algorithm(
+      gen_params.algorithm.algorithm);
+  req.mutable_crypto_key()->mutable_version_template()->set_protection_level(
+      kms_v1::HSM);
+  return req;
+}
+
+absl::Status KeyExistsError(std::string_view label,
+                            const absl::Status& create_status) {
+  return NewError(absl::StatusCode::kAlreadyExists,
+                  absl::StrFormat("key with label %s already exists: %s", label,
+                                  create_status.message()),
+                  CKR_ARGUMENTS_BAD, SOURCE_LOCATION);
+}
+
 absl::StatusOr<CryptoKeyAndVersion> CreateKeyAndVersion(
     const KmsClient& client, std::string_view key_ring_name,
     const KeyGenerationParams& gen_params,
@@ -142,17 +165,9 @@ absl::StatusOr<CryptoKeyAndVersion> CreateKeyAndVersion(
     }
   }
 
-  kms_v1::CreateCryptoKeyRequest req;
-  req.set_parent(std::string(key_ring_name));
-  req.set_crypto_key_id(gen_params.label);
-  req.mutable_crypto_key()->set_purpose(gen_params.algorithm.purpose);
-  req.mutable_crypto_key()->mutable_version_template()->set_algorithm(
-      gen_params.algorithm.algorithm);
-  req.mutable_crypto_key()->mutable_version_template()->set_protection_level(
-      kms_v1::HSM);
-
   absl::StatusOr<CryptoKeyAndVersion> key_and_version =
-      client.CreateCryptoKeyAndWaitForFirstVersion(req);
+      client.CreateCryptoKeyAndWaitForFirstVersion(
+          NewCreateCryptoKeyRequest(key_ring_name, gen_params));
   if (absl::IsAlreadyExists(key_and_version.status())) {
     if (experimental_create_multiple_versions) {
       // TODO(bdhess): If we choose to make this experiment a full-fledged
@@ -164,15 +179,23 @@ absl::StatusOr<CryptoKeyAndVersion> CreateKeyAndVersion(
       // purposes of the experiment.
       return key_and_version.status();
     }
-    return NewError(
-        absl::StatusCode::kAlreadyExists,
-        absl::StrFormat("key with label %s already exists: %s",
-                        gen_params.label, key_and_version.status().message()),
-        CKR_ARGUMENTS_BAD, SOURCE_LOCATION);
+    return KeyExistsError(gen_params.label, key_and_version.status());
   }
   return key_and_version;
 }
 
+// Returns an error if `client` is nullptr, which is the case when the library
+// serves public keys from a snapshot rather than from Cloud KMS.
+absl::Status RequireKmsClient(const KmsClient* client) {
+  if (!client) {
+    return FailedPreconditionError(
+        "this function requires Cloud KMS, but the library is serving public "
+        "keys from a snapshot",
+        CKR_FUNCTION_NOT_SUPPORTED, SOURCE_LOCATION);
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace
 
 CK_SESSION_INFO Session::info() const {
@@ -203,6 +226,16 @@ void Session::ReleaseOperation() {
   op_ = std::nullopt;
 }
 
+void Session::set_rpc_timeout(absl::Duration timeout) {
+  absl::MutexLock l(&rpc_timeout_mutex_);
+  rpc_timeout_ = timeout;
+}
+
+absl::Time Session::RpcDeadline() const {
+  absl::MutexLock l(&rpc_timeout_mutex_);
+  return absl::Now() + rpc_timeout_;
+}
+
 absl::Status Session::FindObjectsInit(
     absl::Span<const CK_ATTRIBUTE> attributes) {
   absl::MutexLock l(&op_mutex_);
@@ -256,12 +289,17 @@ absl::Status Session::DecryptInit(std::shared_ptr<Object> key,
     return OperationActiveError(SOURCE_LOCATION);
   }
 
-  ASSIGN_OR_RETURN(op_, NewDecryptOp(key, mechanism));
+  ASSIGN_OR_RETURN(DecryptOp op, NewDecryptOp(key, mechanism));
+  if (DecryptCache* cache = token_->decrypt_cache(); cache) {
+    op = NewCachingDecrypter(std::move(op), key, mechanism, cache);
+  }
+  op_ = std::move(op);
   return absl::OkStatus();
 }
 
 absl::StatusOr<absl::Span<const uint8_t>> Session::Decrypt(
     absl::Span<const uint8_t> ciphertext) {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<DecryptOp>(*op_)) {
@@ -272,6 +310,7 @@ absl::StatusOr<absl::Span<const uint8_t>> Session::Decrypt(
 }
 
 absl::Status Session::DecryptUpdate(absl::Span<const uint8_t> ciphertext) {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<DecryptOp>(*op_)) {
@@ -282,6 +321,7 @@ absl::Status Session::DecryptUpdate(absl::Span<const uint8_t> ciphertext) {
 }
 
 absl::StatusOr<absl::Span<const uint8_t>> Session::DecryptFinal() {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<DecryptOp>(*op_)) {
@@ -305,6 +345,7 @@ absl::Status Session::EncryptInit(std::shared_ptr<Object> key,
 
 absl::StatusOr<absl::Span<const uint8_t>> Session::Encrypt(
     absl::Span<const uint8_t> plaintext) {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<EncryptOp>(*op_)) {
@@ -315,6 +356,7 @@ absl::StatusOr<absl::Span<const uint8_t>> Session::Encrypt(
 }
 
 absl::Status Session::EncryptUpdate(absl::Span<const uint8_t> plaintext) {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<EncryptOp>(*op_)) {
@@ -324,6 +366,7 @@ absl::Status Session::EncryptUpdate(absl::Span<const uint8_t> plaintext) {
   return std::get<EncryptOp>(*op_)->EncryptUpdate(kms_client_, plaintext);
 }
 absl::StatusOr<absl::Span<const uint8_t>> Session::EncryptFinal() {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<EncryptOp>(*op_)) {
@@ -347,6 +390,7 @@ absl::Status Session::SignInit(std::shared_ptr<Object> key,
 
 absl::Status Session::Sign(absl::Span<const uint8_t> digest,
                            absl::Span<uint8_t> signature) {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<SignOp>(*op_)) {
@@ -357,6 +401,7 @@ absl::Status Session::Sign(absl::Span<const uint8_t> digest,
 }
 
 absl::Status Session::SignUpdate(absl::Span<const uint8_t> data) {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<SignOp>(*op_)) {
@@ -367,6 +412,7 @@ absl::Status Session::SignUpdate(absl::Span<const uint8_t> data) {
 }
 
 absl::Status Session::SignFinal(absl::Span<uint8_t> signature) {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<SignOp>(*op_)) {
@@ -394,12 +440,17 @@ absl::Status Session::VerifyInit(std::shared_ptr<Object> key,
     return OperationActiveError(SOURCE_LOCATION);
   }
 
-  ASSIGN_OR_RETURN(op_, NewVerifyOp(key, mechanism));
+  ASSIGN_OR_RETURN(VerifyOp op, NewVerifyOp(key, mechanism));
+  if (VerifyCache* cache = token_->verify_cache(); cache) {
+    op = NewCachingVerifier(std::move(op), mechanism, cache);
+  }
+  op_ = std::move(op);
   return absl::OkStatus();
 }
 
 absl::Status Session::Verify(absl::Span<const uint8_t> digest,
                              absl::Span<const uint8_t> signature) {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<VerifyOp>(*op_)) {
@@ -410,6 +461,7 @@ absl::Status Session::Verify(absl::Span<const uint8_t> digest,
 }
 
 absl::Status Session::VerifyUpdate(absl::Span<const uint8_t> data) {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<VerifyOp>(*op_)) {
@@ -420,6 +472,7 @@ absl::Status Session::VerifyUpdate(absl::Span<const uint8_t> data) {
 }
 
 absl::Status Session::VerifyFinal(absl::Span<const uint8_t> signature) {
+  ScopedRpcDeadline deadline(RpcDeadline());
   absl::MutexLock l(&op_mutex_);
 
   if (!op_.has_value() || !std::holds_alternative<VerifyOp>(*op_)) {
@@ -434,6 +487,8 @@ absl::StatusOr<AsymmetricHandleSet> Session::GenerateKeyPair(
     absl::Span<const CK_ATTRIBUTE> public_key_attrs,
     absl::Span<const CK_ATTRIBUTE> private_key_attrs,
     bool experimental_create_multiple_versions) {
+  ScopedRpcDeadline deadline(RpcDeadline());
+  RETURN_IF_ERROR(RequireKmsClient(kms_client_));
   if (session_type_ == SessionType::kReadOnly) {
     return SessionReadOnlyError(SOURCE_LOCATION);
   }
@@ -491,6 +546,8 @@ absl::StatusOr<CK_OBJECT_HANDLE> Session::GenerateKey(
     const CK_MECHANISM& mechanism,
     absl::Span<const CK_ATTRIBUTE> secret_key_attrs,
     bool experimental_create_multiple_versions) {
+  ScopedRpcDeadline deadline(RpcDeadline());
+  RETURN_IF_ERROR(RequireKmsClient(kms_client_));
   if (session_type_ == SessionType::kReadOnly) {
     return SessionReadOnlyError(SOURCE_LOCATION);
   }
@@ -528,7 +585,99 @@ absl::StatusOr<CK_OBJECT_HANDLE> Session::GenerateKey(
   });
 }
 
+absl::StatusOr<std::vector<absl::StatusOr<CK_OBJECT_HANDLE>>>
+Session::GenerateKeys(absl::Span<const std::vector<CK_ATTRIBUTE>> key_attrs) {
+  // Cloud KMS key generation is throttled per project, so a larger batch
+  // would mostly add threads that wait for quota.
+  constexpr size_t kMaxParallelism = 16;
+
+  ScopedRpcDeadline deadline(RpcDeadline());
+  RETURN_IF_ERROR(RequireKmsClient(kms_client_));
+  if (session_type_ == SessionType::kReadOnly) {
+    return SessionReadOnlyError(SOURCE_LOCATION);
+  }
+
+  // Validate every template before creating any key.
+  std::vector<KeyGenerationParams> gen_params;
+  gen_params.reserve(key_attrs.size());
+  std::vector<kms_v1::CreateCryptoKeyRequest> requests;
+  requests.reserve(key_attrs.size());
+  absl::flat_hash_set<std::string_view> labels;
+  for (const std::vector<CK_ATTRIBUTE>& attrs : key_attrs) {
+    ASSIGN_OR_RETURN(KeyGenerationParams params,
+                     ExtractKeyGenerationParams(attrs));
+    requests.push_back(
+        NewCreateCryptoKeyRequest(token_->key_ring_name(), params));
+    gen_params.push_back(std::move(params));
+  }
+  for (const KeyGenerationParams& params : gen_params) {
+    if (!labels.insert(params.label).second) {
+      return NewInvalidArgumentError(
+          absl::StrFormat("label %s is specified more than once",
+                          params.label),
+          CKR_TEMPLATE_INCONSISTENT, SOURCE_LOCATION);
+    }
+  }
+
+  std::vector<absl::StatusOr<CryptoKeyAndVersion>> created =
+      kms_client_->CreateCryptoKeysAndWaitForFirstVersions(requests,
+                                                           kMaxParallelism);
+
+  // Add all of the new keys to the token in a single refresh, rather than
+  // refreshing once per key. The new keys exist whether or not the refresh
+  // succeeds, so a failed refresh is retried once, and then reported in the
+  // result of each new key.
+  absl::Status refreshed = token_->RefreshState(*kms_client_);
+  if (!refreshed.ok()) {
+    refreshed = token_->RefreshState(*kms_client_);
+  }
+
+  std::vector<absl::StatusOr<CK_OBJECT_HANDLE>> result;
+  result.reserve(created.size());
+  absl::flat_hash_map<std::string, size_t> pending_handles;
+  for (size_t i = 0; i < created.size(); i++) {
+    if (!created[i].ok()) {
+      result.push_back(absl::IsAlreadyExists(created[i].status())
+                           ? KeyExistsError(gen_params[i].label,
+                                            created[i].status())
+                           : created[i].status());
+      continue;
+    }
+    if (!refreshed.ok()) {
+      result.push_back(NewError(
+          refreshed.code(),
+          absl::StrFormat("key %s was generated, but the token could not be "
+                          "refreshed to load it: %s",
+                          created[i]->crypto_key_version.name(),
+                          refreshed.message()),
+          GetCkRv(refreshed), SOURCE_LOCATION));
+      continue;
+    }
+    result.push_back(NewInternalError(
+        absl::StrFormat("generated key %s was not found in the token",
+                        created[i]->crypto_key_version.name()),
+        SOURCE_LOCATION));
+    pending_handles.try_emplace(created[i]->crypto_key_version.name(), i);
+  }
+
+  // Look up all of the new handles in one pass over the token's objects.
+  std::vector<CK_OBJECT_HANDLE> handles =
+      token_->FindObjects([&](const Object& o) -> bool {
+        return (o.object_class() == CKO_PRIVATE_KEY ||
+                o.object_class() == CKO_SECRET_KEY) &&
+               pending_handles.contains(o.kms_key_name());
+      });
+  for (CK_OBJECT_HANDLE handle : handles) {
+    ASSIGN_OR_RETURN(std::shared_ptr<Object> object,
+                     token_->GetObject(handle));
+    result[pending_handles.at(object->kms_key_name())] = handle;
+  }
+  return result;
+}
+
 absl::Status Session::DestroyObject(std::shared_ptr<Object> key) {
+  ScopedRpcDeadline deadline(RpcDeadline());
+  RETURN_IF_ERROR(RequireKmsClient(kms_client_));
   if (session_type_ == SessionType::kReadOnly) {
     return SessionReadOnlyError(SOURCE_LOCATION);
   }
@@ -548,6 +697,8 @@ absl::Status Session::DestroyObject(std::shared_ptr<Object> key) {
 }
 
 absl::Status Session::GenerateRandom(absl::Span<uint8_t> buffer) {
+  ScopedRpcDeadline deadline(RpcDeadline());
+  RETURN_IF_ERROR(RequireKmsClient(kms_client_));
   if (buffer.size() < 8 || buffer.size() > 1024) {
     return NewError(
         absl::StatusCode::kInvalidArgument,
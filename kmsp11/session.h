@@ -42,6 +42,11 @@ class Session {
 
   void ReleaseOperation();
 
+  // Sets the time budget for the Cloud KMS calls made during each subsequent
+  // call on this session. The library-wide RPC timeout still applies; the
+  // default of absl::InfiniteDuration() means that only it applies.
+  void set_rpc_timeout(absl::Duration timeout);
+
   absl::Status FindObjectsInit(absl::Span<const CK_ATTRIBUTE> attributes);
   absl::StatusOr<absl::Span<const CK_OBJECT_HANDLE>> FindObjects(
       size_t max_count);
@@ -85,17 +90,35 @@ class Session {
       absl::Span<const CK_ATTRIBUTE> secret_key_attrs,
       bool experimental_create_multiple_versions = false);
 
+  // Generates one key for each template in `key_attrs`, each of which holds
+  // the CKA_LABEL and CKA_KMS_ALGORITHM of a new key, as in GenerateKey. The
+  // keys are created concurrently and then added to the token together. An
+  // error is returned if any template is invalid, in which case no key is
+  // created. Otherwise the result holds, for each template, the handle of the
+  // new private or secret key or the error that prevented its generation. If
+  // the token cannot be refreshed to load the new keys, the result for each
+  // new key holds that error.
+  absl::StatusOr<std::vector<absl::StatusOr<CK_OBJECT_HANDLE>>> GenerateKeys(
+      absl::Span<const std::vector<CK_ATTRIBUTE>> key_attrs);
+
   absl::Status DestroyObject(std::shared_ptr<Object> object);
 
   absl::Status GenerateRandom(absl::Span<uint8_t> buffer);
 
  private:
+  // Returns the deadline for Cloud KMS calls made by a call that starts now.
+  absl::Time RpcDeadline() const;
+
   Token* token_;
   const SessionType session_type_;
   KmsClient* kms_client_;
 
   absl::Mutex op_mutex_;
   std::optional<Operation> op_ ABSL_GUARDED_BY(op_mutex_);
+
+  mutable absl::Mutex rpc_timeout_mutex_;
+  absl::Duration rpc_timeout_ ABSL_GUARDED_BY(rpc_timeout_mutex_) =
+      absl::InfiniteDuration();
 };
 
 }  // namespace cloud_kms::kmsp11
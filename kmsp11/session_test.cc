@@ -14,8 +14,11 @@
 
 #include "kmsp11/session.h"
 
+#include <deque>
+
 #include "common/test/test_status_macros.h"
 #include "fakekms/cpp/fakekms.h"
+#include "fakekms/cpp/fault_helpers.h"
 #include "gmock/gmock.h"
 #include "kmsp11/kmsp11.h"
 #include "kmsp11/test/matchers.h"
@@ -338,6 +341,59 @@ TEST_F(SessionTest, Decrypt) {
   EXPECT_THAT(s.Decrypt(ciphertext), IsOkAndHolds(plaintext));
 }
 
+TEST_F(SessionTest, RepeatedDecryptIsAnsweredFromDecryptCache) {
+  auto kms_client = fake_server_->NewClient();
+
+  kms_v1::CryptoKey ck;
+  ck.set_purpose(kms_v1::CryptoKey::ASYMMETRIC_DECRYPT);
+  ck.mutable_version_template()->set_algorithm(
+      kms_v1::CryptoKeyVersion::RSA_DECRYPT_OAEP_2048_SHA256);
+  ck.mutable_version_template()->set_protection_level(
+      kms_v1::ProtectionLevel::HSM);
+  ck = CreateCryptoKeyOrDie(kms_client.get(), key_ring_.name(), "ck", ck, true);
+
+  kms_v1::CryptoKeyVersion ckv;
+  ckv = CreateCryptoKeyVersionOrDie(kms_client.get(), ck.name(), ckv);
+  ckv = WaitForEnablement(kms_client.get(), ckv);
+
+  kms_v1::PublicKey pub_proto = GetPublicKeyOrDie(kms_client.get(), ckv);
+  ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<EVP_PKEY> pub,
+                       ParseX509PublicKeyPem(pub_proto.pem()));
+
+  std::vector<uint8_t> plaintext = {0x00, 0x01, 0xFE, 0xFF};
+  uint8_t ciphertext[256];
+  EXPECT_OK(EncryptRsaOaep(pub.get(), EVP_sha256(), plaintext,
+                           absl::MakeSpan(ciphertext)));
+
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<Token> token,
+      Token::New(0, config_, client_.get(), false, nullptr,
+                 std::make_unique<DecryptCache>(10, absl::Minutes(5))));
+  Session s(token.get(), SessionType::kReadOnly, client_.get());
+
+  ASSERT_OK_AND_ASSIGN(CK_OBJECT_HANDLE handle,
+                       s.token()->FindSingleObject([&](const Object& o) {
+                         return o.kms_key_name() == ckv.name() &&
+                                o.object_class() == CKO_PRIVATE_KEY;
+                       }));
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<Object> object,
+                       s.token()->GetObject(handle));
+
+  CK_RSA_PKCS_OAEP_PARAMS params{CKM_SHA256, CKG_MGF1_SHA256,
+                                 CKZ_DATA_SPECIFIED, nullptr, 0};
+  CK_MECHANISM mech{CKM_RSA_PKCS_OAEP, &params, sizeof(params)};
+
+  fakekms::ResetStatsOrDie(*fake_server_);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_OK(s.DecryptInit(object, &mech));
+    EXPECT_THAT(s.Decrypt(ciphertext), IsOkAndHolds(plaintext));
+    s.ReleaseOperation();
+  }
+  EXPECT_EQ(fakekms::CallCount(fakekms::GetStatsOrDie(*fake_server_),
+                               "AsymmetricDecrypt"),
+            1);
+}
+
 TEST_F(SessionTest, DecryptInitAlreadyActive) {
   auto kms_client = fake_server_->NewClient();
 
@@ -770,6 +826,51 @@ TEST_F(SessionTest, SignVerify) {
   EXPECT_OK(s.Verify(digest, signature));
 }
 
+TEST_F(SessionTest, RepeatedMacVerifyIsAnsweredFromVerifyCache) {
+  auto kms_client = fake_server_->NewClient();
+
+  kms_v1::CryptoKey ck;
+  ck.set_purpose(kms_v1::CryptoKey::MAC);
+  ck.mutable_version_template()->set_algorithm(
+      kms_v1::CryptoKeyVersion::HMAC_SHA256);
+  ck.mutable_version_template()->set_protection_level(
+      kms_v1::ProtectionLevel::HSM);
+  ck = CreateCryptoKeyOrDie(kms_client.get(), key_ring_.name(), "ck", ck, true);
+
+  kms_v1::CryptoKeyVersion ckv;
+  ckv = CreateCryptoKeyVersionOrDie(kms_client.get(), ck.name(), ckv);
+  ckv = WaitForEnablement(kms_client.get(), ckv);
+
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<Token> token,
+      Token::New(0, config_, client_.get(), false,
+                 std::make_unique<VerifyCache>(10, absl::Minutes(5))));
+  Session s(token.get(), SessionType::kReadOnly, client_.get());
+
+  ASSERT_OK_AND_ASSIGN(CK_OBJECT_HANDLE handle,
+                       s.token()->FindSingleObject([&](const Object& o) {
+                         return o.kms_key_name() == ckv.name();
+                       }));
+  ASSERT_OK_AND_ASSIGN(std::shared_ptr<Object> key,
+                       s.token()->GetObject(handle));
+
+  CK_MECHANISM mech{CKM_SHA256_HMAC, nullptr, 0};
+  uint8_t data[16] = {0}, signature[32];
+  EXPECT_OK(s.SignInit(key, &mech));
+  EXPECT_OK(s.Sign(data, absl::MakeSpan(signature)));
+  s.ReleaseOperation();
+
+  fakekms::ResetStatsOrDie(*fake_server_);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_OK(s.VerifyInit(key, &mech));
+    EXPECT_OK(s.Verify(data, signature));
+    s.ReleaseOperation();
+  }
+  EXPECT_EQ(
+      fakekms::CallCount(fakekms::GetStatsOrDie(*fake_server_), "MacVerify"),
+      1);
+}
+
 TEST_F(SessionTest, SignUpdateNotInitialized) {
   ASSERT_OK_AND_ASSIGN(std::unique_ptr<Token> token,
                        Token::New(0, config_, client_.get()));
@@ -1626,6 +1727,166 @@ TEST_F(GenerateKeyTest, GeneratedKeyIsImmediatelyAvailable) {
   EXPECT_OK(token->GetObject(handle));
 }
 
+class GenerateKeysTest : public SessionTest {
+ protected:
+  // Returns a key template with the provided label and algorithm. The
+  // template refers to storage owned by the fixture.
+  std::vector<CK_ATTRIBUTE> KeyTemplate(std::string_view label,
+                                        CK_ULONG kms_algorithm) {
+    std::string& label_value = labels_.emplace_back(label);
+    CK_ULONG& algorithm_value = algorithms_.emplace_back(kms_algorithm);
+    return {
+        {CKA_KMS_ALGORITHM, &algorithm_value, sizeof(algorithm_value)},
+        {CKA_LABEL, label_value.data(), label_value.size()},
+    };
+  }
+
+ private:
+  std::deque<std::string> labels_;
+  std::deque<CK_ULONG> algorithms_;
+};
+
+TEST_F(GenerateKeysTest, ReadOnlySessionReturnsFailedPrecondition) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Token> token,
+                       Token::New(0, config_, client_.get()));
+  Session s(token.get(), SessionType::kReadOnly, client_.get());
+
+  std::vector<std::vector<CK_ATTRIBUTE>> templates = {
+      KeyTemplate("key", KMS_ALGORITHM_EC_SIGN_P256_SHA256)};
+  EXPECT_THAT(s.GenerateKeys(templates),
+              AllOf(StatusIs(absl::StatusCode::kFailedPrecondition),
+                    StatusRvIs(CKR_SESSION_READ_ONLY)));
+}
+
+TEST_F(GenerateKeysTest, InvalidTemplateCreatesNoKeys) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Token> token,
+                       Token::New(0, config_, client_.get()));
+  Session s(token.get(), SessionType::kReadWrite, client_.get());
+
+  std::vector<std::vector<CK_ATTRIBUTE>> templates = {
+      KeyTemplate("key1", KMS_ALGORITHM_EC_SIGN_P256_SHA256),
+      KeyTemplate("key2", 0),
+  };
+  EXPECT_THAT(s.GenerateKeys(templates),
+              AllOf(StatusIs(absl::StatusCode::kInvalidArgument),
+                    StatusRvIs(CKR_ATTRIBUTE_VALUE_INVALID)));
+  EXPECT_THAT(token->FindObjects([](const Object&) { return true; }),
+              IsEmpty());
+}
+
+TEST_F(GenerateKeysTest, RepeatedLabelReturnsInvalidArgument) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Token> token,
+                       Token::New(0, config_, client_.get()));
+  Session s(token.get(), SessionType::kReadWrite, client_.get());
+
+  std::vector<std::vector<CK_ATTRIBUTE>> templates = {
+      KeyTemplate("key", KMS_ALGORITHM_EC_SIGN_P256_SHA256),
+      KeyTemplate("key", KMS_ALGORITHM_HMAC_SHA256),
+  };
+  EXPECT_THAT(s.GenerateKeys(templates),
+              AllOf(StatusIs(absl::StatusCode::kInvalidArgument),
+                    StatusRvIs(CKR_TEMPLATE_INCONSISTENT)));
+}
+
+TEST_F(GenerateKeysTest, GeneratedKeysAreImmediatelyAvailable) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Token> token,
+                       Token::New(0, config_, client_.get()));
+  Session s(token.get(), SessionType::kReadWrite, client_.get());
+
+  std::vector<std::vector<CK_ATTRIBUTE>> templates = {
+      KeyTemplate("ec-key", KMS_ALGORITHM_EC_SIGN_P256_SHA256),
+      KeyTemplate("hmac-key", KMS_ALGORITHM_HMAC_SHA256),
+      KeyTemplate("rsa-key", KMS_ALGORITHM_RSA_DECRYPT_OAEP_2048_SHA256),
+  };
+  ASSERT_OK_AND_ASSIGN(std::vector<absl::StatusOr<CK_OBJECT_HANDLE>> handles,
+                       s.GenerateKeys(templates));
+  ASSERT_THAT(handles, SizeIs(3));
+
+  std::vector<CK_OBJECT_CLASS> expected_classes = {
+      CKO_PRIVATE_KEY, CKO_SECRET_KEY, CKO_PRIVATE_KEY};
+  for (size_t i = 0; i < handles.size(); i++) {
+    ASSERT_OK(handles[i]);
+    EXPECT_THAT(token->GetObject(*handles[i]),
+                IsOkAndHolds(Pointee(Property("object_class",
+                                              &Object::object_class,
+                                              expected_classes[i]))));
+  }
+  // Each key pair has a public key as well.
+  EXPECT_THAT(token->FindObjects([](const Object&) { return true; }),
+              SizeIs(5));
+}
+
+TEST_F(GenerateKeysTest, ExistingLabelFailsOnlyThatKey) {
+  std::string label = "my-great-key";
+
+  auto kms_client = fake_server_->NewClient();
+  kms_v1::CryptoKey ck;
+  ck.set_purpose(kms_v1::CryptoKey::ASYMMETRIC_SIGN);
+  ck.mutable_version_template()->set_algorithm(
+      kms_v1::CryptoKeyVersion::EC_SIGN_P384_SHA384);
+  ck.mutable_version_template()->set_protection_level(
+      kms_v1::ProtectionLevel::HSM);
+  ck =
+      CreateCryptoKeyOrDie(kms_client.get(), key_ring_.name(), label, ck, true);
+
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Token> token,
+                       Token::New(0, config_, client_.get()));
+  Session s(token.get(), SessionType::kReadWrite, client_.get());
+
+  std::vector<std::vector<CK_ATTRIBUTE>> templates = {
+      KeyTemplate("new-key", KMS_ALGORITHM_EC_SIGN_P256_SHA256),
+      KeyTemplate(label, KMS_ALGORITHM_EC_SIGN_P256_SHA256),
+  };
+  ASSERT_OK_AND_ASSIGN(std::vector<absl::StatusOr<CK_OBJECT_HANDLE>> handles,
+                       s.GenerateKeys(templates));
+  ASSERT_THAT(handles, SizeIs(2));
+
+  ASSERT_OK(handles[0]);
+  EXPECT_OK(token->GetObject(*handles[0]));
+  EXPECT_THAT(handles[1], AllOf(StatusIs(absl::StatusCode::kAlreadyExists),
+                                StatusRvIs(CKR_ARGUMENTS_BAD)));
+}
+
+TEST_F(GenerateKeysTest, TransientRefreshFailureIsRetried) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Token> token,
+                       Token::New(0, config_, client_.get()));
+  Session s(token.get(), SessionType::kReadWrite, client_.get());
+  fakekms::AddErrorOrDie(*fake_server_,
+                         absl::PermissionDeniedError("denied"),
+                         "ListCryptoKeys");
+
+  std::vector<std::vector<CK_ATTRIBUTE>> templates = {
+      KeyTemplate("key", KMS_ALGORITHM_EC_SIGN_P256_SHA256)};
+  ASSERT_OK_AND_ASSIGN(std::vector<absl::StatusOr<CK_OBJECT_HANDLE>> handles,
+                       s.GenerateKeys(templates));
+  ASSERT_THAT(handles, SizeIs(1));
+  ASSERT_OK(handles[0]);
+  EXPECT_OK(token->GetObject(*handles[0]));
+}
+
+TEST_F(GenerateKeysTest, RefreshFailureIsReportedForEachGeneratedKey) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Token> token,
+                       Token::New(0, config_, client_.get()));
+  Session s(token.get(), SessionType::kReadWrite, client_.get());
+  for (int i = 0; i < 2; i++) {
+    fakekms::AddErrorOrDie(*fake_server_,
+                           absl::PermissionDeniedError("denied"),
+                           "ListCryptoKeys");
+  }
+
+  std::vector<std::vector<CK_ATTRIBUTE>> templates = {
+      KeyTemplate("ec-key", KMS_ALGORITHM_EC_SIGN_P256_SHA256),
+      KeyTemplate("hmac-key", KMS_ALGORITHM_HMAC_SHA256),
+  };
+  ASSERT_OK_AND_ASSIGN(std::vector<absl::StatusOr<CK_OBJECT_HANDLE>> handles,
+                       s.GenerateKeys(templates));
+  ASSERT_THAT(handles, SizeIs(2));
+  EXPECT_THAT(handles[0], StatusIs(absl::StatusCode::kPermissionDenied,
+                                   HasSubstr("ec-key")));
+  EXPECT_THAT(handles[1], StatusIs(absl::StatusCode::kPermissionDenied,
+                                   HasSubstr("hmac-key")));
+}
+
 class DestroyObjectTest : public SessionTest {};
 
 TEST_F(DestroyObjectTest, ReadOnlySessionReturnsFailedPrecondition) {
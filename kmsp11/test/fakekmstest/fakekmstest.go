@@ -0,0 +1,150 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Package fakekmstest runs fakekms in a child process for the library's
+// benchmarks, seeds it with keys and points the library at it.
+//
+// Running fakekms in a child process keeps its CPU time and allocations from
+// being attributed to the library.
+package fakekmstest
+
+import (
+	"bufio"
+	"context"
+	"fmt"
+	"os"
+	"os/exec"
+	"path"
+	"strings"
+	"syscall"
+	"testing"
+	"time"
+
+	kms "cloud.google.com/go/kms/apiv1"
+	"cloud.google.com/go/kms/apiv1/kmspb"
+	"github.com/bazelbuild/rules_go/go/tools/bazel"
+	"google.golang.org/api/option"
+	"google.golang.org/grpc"
+)
+
+// ConfigVar is the environment variable that holds the library's config path.
+const ConfigVar = "KMS_PKCS11_CONFIG"
+
+const configTemplate = `---
+kms_endpoint: %q
+use_insecure_grpc_channel_credentials: 1
+tokens:
+  - key_ring: %q
+log_directory: %q
+`
+
+// Key describes a CryptoKey to create with CreateKeys.
+type Key struct {
+	Purpose   kmspb.CryptoKey_CryptoKeyPurpose
+	Algorithm kmspb.CryptoKeyVersion_CryptoKeyVersionAlgorithm
+}
+
+// Start launches fakekms in a child process with the provided flags, and
+// returns its address. fakekms is stopped when the test completes.
+func Start(t *testing.T, args ...string) string {
+	t.Helper()
+	bin, ok := bazel.FindBinary("fakekms/main", "fakekms")
+	if !ok {
+		t.Fatal("unable to locate fakekms binary")
+	}
+	cmd := exec.Command(bin, args...)
+	stdout, err := cmd.StdoutPipe()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if err := cmd.Start(); err != nil {
+		t.Fatalf("error starting fakekms: %v", err)
+	}
+	t.Cleanup(func() {
+		cmd.Process.Signal(syscall.SIGTERM)
+		cmd.Wait()
+	})
+
+	addr, err := bufio.NewReader(stdout).ReadString('\n')
+	if err != nil {
+		t.Fatalf("error reading fakekms address: %v", err)
+	}
+	return strings.TrimSpace(addr)
+}
+
+// CreateKeys creates keyRing and the provided keys, identified by CryptoKey
+// ID, in the fakekms at addr. It waits for the first version of each key to
+// become enabled.
+func CreateKeys(t *testing.T, addr, keyRing string, keys map[string]Key) {
+	t.Helper()
+	ctx := context.Background()
+	cc, err := grpc.Dial(addr, grpc.WithInsecure())
+	if err != nil {
+		t.Fatal(err)
+	}
+	client, err := kms.NewKeyManagementClient(ctx, option.WithGRPCConn(cc))
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	if _, err := client.CreateKeyRing(ctx, &kmspb.CreateKeyRingRequest{
+		Parent:    path.Dir(path.Dir(keyRing)),
+		KeyRingId: path.Base(keyRing),
+	}); err != nil {
+		t.Fatal(err)
+	}
+
+	for id, k := range keys {
+		ck, err := client.CreateCryptoKey(ctx, &kmspb.CreateCryptoKeyRequest{
+			Parent:      keyRing,
+			CryptoKeyId: id,
+			CryptoKey: &kmspb.CryptoKey{
+				Purpose:         k.Purpose,
+				VersionTemplate: &kmspb.CryptoKeyVersionTemplate{Algorithm: k.Algorithm},
+			},
+		})
+		if err != nil {
+			t.Fatal(err)
+		}
+		name := ck.GetName() + "/cryptoKeyVersions/1"
+		for {
+			ckv, err := client.GetCryptoKeyVersion(ctx, &kmspb.GetCryptoKeyVersionRequest{Name: name})
+			if err != nil {
+				t.Fatal(err)
+			}
+			if ckv.GetState() == kmspb.CryptoKeyVersion_ENABLED {
+				break
+			}
+			time.Sleep(10 * time.Millisecond)
+		}
+	}
+}
+
+// WriteConfig writes a library config with one token for keyRing in the
+// fakekms at addr, and sets ConfigVar to it for the rest of the test.
+func WriteConfig(t *testing.T, addr, keyRing string) {
+	t.Helper()
+	dir := t.TempDir()
+	logDir := path.Join(dir, "log")
+	if err := os.Mkdir(logDir, 0755); err != nil {
+		t.Fatal(err)
+	}
+	configFile := path.Join(dir, "config.yaml")
+	config := fmt.Sprintf(configTemplate, addr, keyRing, logDir)
+	if err := os.WriteFile(configFile, []byte(config), 0644); err != nil {
+		t.Fatal(err)
+	}
+	t.Setenv(ConfigVar, configFile)
+}
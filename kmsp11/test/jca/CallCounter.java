@@ -0,0 +1,69 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package kmsp11.test.jca;
+
+import com.google.devtools.build.runfiles.Runfiles;
+import java.io.IOException;
+import java.util.LinkedHashMap;
+import java.util.Map;
+
+/**
+ * CallCounter exposes the per-function call counts of libcallcounter.so, a PKCS #11 library that
+ * forwards every call to libkmsp11 and counts it.
+ *
+ * <p>The counting library is loaded once per process, and forwards to the library that is named in
+ * {@link #TARGET_ENV_VARIABLE} when the first call is made. A process may therefore only use one
+ * counting provider.
+ */
+public class CallCounter {
+  static final String TARGET_ENV_VARIABLE = "KMS_PKCS11_CALL_COUNTER_TARGET";
+  private static final String LIBRARY_LOCATION =
+      "com_google_kmstools/kmsp11/test/jca/libcallcounter.so";
+
+  private static final String libraryPath;
+  private static final String[] functionNames;
+
+  static {
+    try {
+      libraryPath = Runfiles.create().rlocation(LIBRARY_LOCATION);
+    } catch (IOException e) {
+      throw new RuntimeException("failure locating libcallcounter.so", e);
+    }
+    // SunPKCS11 loads the library from the same path, so both share one set of counters.
+    Runtime.getRuntime().load(libraryPath);
+    functionNames = functionNames();
+  }
+
+  private CallCounter() {} // no instances
+
+  /** Returns the path of the counting PKCS #11 library. */
+  public static String getLibraryPath() {
+    return libraryPath;
+  }
+
+  /** Returns the number of calls made to each Cryptoki function so far, keyed by function name. */
+  public static Map<String, Long> getCounts() {
+    long[] counts = snapshot();
+    Map<String, Long> result = new LinkedHashMap<>();
+    for (int i = 0; i < counts.length; i++) {
+      result.put(functionNames[i], counts[i]);
+    }
+    return result;
+  }
+
+  private static native String[] functionNames();
+
+  private static native long[] snapshot();
+}
@@ -0,0 +1,339 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package kmsp11.test.jca;
+
+import com.google.cloud.kms.pkcs11.fakekms.stats.MethodStats;
+import com.google.cloud.kms.pkcs11.fakekms.stats.Stats;
+import com.google.cloud.kms.v1.*;
+import java.io.FileWriter;
+import java.io.IOException;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Paths;
+import java.security.KeyStore;
+import java.security.PrivateKey;
+import java.security.Provider;
+import java.security.PublicKey;
+import java.security.Signature;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.TreeMap;
+import java.util.Map;
+import java.util.concurrent.CyclicBarrier;
+import javax.crypto.Cipher;
+import javax.crypto.SecretKey;
+import javax.crypto.spec.IvParameterSpec;
+import org.junit.AfterClass;
+import org.junit.Assert;
+import org.junit.BeforeClass;
+import org.junit.Test;
+
+/**
+ * JcaBenchmark measures the throughput and latency of common JCA operations made through SunPKCS11
+ * and libkmsp11, against an in-process fake KMS. For each operation and thread count it reports
+ * ops/s, latency percentiles, the number of PKCS #11 calls that SunPKCS11 made per operation, and
+ * the number of KMS RPCs that libkmsp11 made per operation.
+ *
+ * <p>Each measurement is preceded by warmup iterations that are discarded, so that JIT compilation
+ * and session pool growth in SunPKCS11 are not attributed to the operation. Results are written to
+ * stdout and to jca_benchmark.csv in TEST_UNDECLARED_OUTPUTS_DIR.
+ *
+ * <p>Iteration length can be set in milliseconds with KMS_PKCS11_JCA_BENCHMARK_ITERATION_MS.
+ */
+public class JcaBenchmark {
+  private static final int[] THREAD_COUNTS = {1, 2, 4, 8, 16};
+  private static final int WARMUP_ITERATIONS = 2;
+  private static final int MEASUREMENT_ITERATIONS = 3;
+  private static final long DEFAULT_ITERATION_MILLIS = 1000;
+
+  private static final byte[] DATA =
+      "Here is some data to authenticate or encrypt".getBytes(StandardCharsets.UTF_8);
+
+  private static JcaTestFixture f;
+  private static Provider provider;
+  private static PrivateKey ecPrivateKey;
+  private static PublicKey ecPublicKey;
+  private static SecretKey aesKey;
+  private static final List<String> results = new ArrayList<>();
+
+  /** An operation under test. Instances are created once per worker thread. */
+  private interface Operation {
+    void run() throws Exception;
+  }
+
+  private interface OperationFactory {
+    Operation create() throws Exception;
+  }
+
+  @BeforeClass
+  public static void setup() throws Exception {
+    f = new JcaTestFixture();
+    createCkv("ec-p256-key", CryptoKey.CryptoKeyPurpose.ASYMMETRIC_SIGN.getNumber(),
+        CryptoKeyVersion.CryptoKeyVersionAlgorithm.EC_SIGN_P256_SHA256.getNumber());
+    // TODO(b/234842124): use real enum values once the KMS proto changes are public.
+    createCkv("aes-128-cbc-key", /* RAW_ENCRYPT_DECRYPT */ 7, /* AES_128_CBC */ 42);
+
+    provider = f.newCountingProvider();
+    KeyStore keyStore = KeyStore.getInstance("PKCS11", provider);
+    keyStore.load(null, null);
+
+    KeyStore.PrivateKeyEntry pk =
+        (KeyStore.PrivateKeyEntry) keyStore.getEntry("ec-p256-key", null);
+    ecPrivateKey = pk.getPrivateKey();
+    ecPublicKey = pk.getCertificate().getPublicKey();
+    aesKey = ((KeyStore.SecretKeyEntry) keyStore.getEntry("aes-128-cbc-key", null)).getSecretKey();
+
+    results.add("operation,threads,ops,ops_per_sec,p50_us,p90_us,p99_us,p11_calls_per_op,"
+        + "p11_calls_by_function,kms_rpcs_per_op,kms_rpcs_by_method");
+  }
+
+  @AfterClass
+  public static void tearDown() throws IOException {
+    String outputsDir = System.getenv("TEST_UNDECLARED_OUTPUTS_DIR");
+    if (outputsDir != null) {
+      try (FileWriter w = new FileWriter(Paths.get(outputsDir, "jca_benchmark.csv").toFile())) {
+        for (String line : results) {
+          w.write(line);
+          w.write(System.lineSeparator());
+        }
+      }
+    }
+    f.close();
+  }
+
+  @Test
+  public void benchmarkEcP256Sign() throws Exception {
+    run("ec_p256_sign", () -> {
+      Signature signer = Signature.getInstance("SHA256withECDSA", provider);
+      return () -> {
+        signer.initSign(ecPrivateKey);
+        signer.update(DATA);
+        signer.sign();
+      };
+    });
+  }
+
+  @Test
+  public void benchmarkEcP256Verify() throws Exception {
+    Signature signer = Signature.getInstance("SHA256withECDSA", provider);
+    signer.initSign(ecPrivateKey);
+    signer.update(DATA);
+    byte[] signature = signer.sign();
+
+    run("ec_p256_verify", () -> {
+      Signature verifier = Signature.getInstance("SHA256withECDSA", provider);
+      return () -> {
+        verifier.initVerify(ecPublicKey);
+        verifier.update(DATA);
+        Assert.assertTrue(verifier.verify(signature));
+      };
+    });
+  }
+
+  @Test
+  public void benchmarkAes128CbcEncrypt() throws Exception {
+    IvParameterSpec iv = new IvParameterSpec(new byte[16]);
+    run("aes_128_cbc_encrypt", () -> {
+      Cipher cipher = Cipher.getInstance("AES/CBC/PKCS5Padding", provider);
+      return () -> {
+        cipher.init(Cipher.ENCRYPT_MODE, aesKey, iv);
+        cipher.doFinal(DATA);
+      };
+    });
+  }
+
+  @Test
+  public void benchmarkAes128CbcDecrypt() throws Exception {
+    IvParameterSpec iv = new IvParameterSpec(new byte[16]);
+    Cipher encrypter = Cipher.getInstance("AES/CBC/PKCS5Padding", provider);
+    encrypter.init(Cipher.ENCRYPT_MODE, aesKey, iv);
+    byte[] ciphertext = encrypter.doFinal(DATA);
+
+    run("aes_128_cbc_decrypt", () -> {
+      Cipher cipher = Cipher.getInstance("AES/CBC/PKCS5Padding", provider);
+      return () -> {
+        cipher.init(Cipher.DECRYPT_MODE, aesKey, iv);
+        Assert.assertArrayEquals(DATA, cipher.doFinal(ciphertext));
+      };
+    });
+  }
+
+  private static void run(String name, OperationFactory factory) throws Exception {
+    long iterationNanos = iterationMillis() * 1_000_000L;
+    for (int threads : THREAD_COUNTS) {
+      for (int i = 0; i < WARMUP_ITERATIONS; i++) {
+        measure(factory, threads, iterationNanos);
+      }
+
+      Map<String, Long> before = CallCounter.getCounts();
+      Map<String, Long> rpcsBefore = rpcCounts();
+      List<long[]> latencies = new ArrayList<>();
+      long elapsedNanos = 0;
+      for (int i = 0; i < MEASUREMENT_ITERATIONS; i++) {
+        long start = System.nanoTime();
+        latencies.addAll(measure(factory, threads, iterationNanos));
+        elapsedNanos += System.nanoTime() - start;
+      }
+      Map<String, Long> after = CallCounter.getCounts();
+      Map<String, Long> rpcsAfter = rpcCounts();
+
+      report(name, threads, elapsedNanos, latencies, before, after, rpcsBefore, rpcsAfter);
+    }
+  }
+
+  /**
+   * Runs one iteration of the operation on `threads` threads, and returns the latency of each
+   * operation in nanoseconds, one array per thread.
+   */
+  private static List<long[]> measure(OperationFactory factory, int threads, long iterationNanos)
+      throws Exception {
+    CyclicBarrier barrier = new CyclicBarrier(threads);
+    List<Thread> workers = new ArrayList<>();
+    List<long[]> latencies = new ArrayList<>();
+    Exception[] failures = new Exception[threads];
+
+    for (int t = 0; t < threads; t++) {
+      final int index = t;
+      latencies.add(null);
+      Thread worker = new Thread(() -> {
+        try {
+          Operation op = factory.create();
+          long[] samples = new long[1024];
+          int count = 0;
+
+          barrier.await();
+          long deadline = System.nanoTime() + iterationNanos;
+          for (long now = System.nanoTime(); now < deadline; ) {
+            op.run();
+            long end = System.nanoTime();
+            if (count == samples.length) {
+              samples = Arrays.copyOf(samples, samples.length * 2);
+            }
+            samples[count++] = end - now;
+            now = end;
+          }
+          synchronized (latencies) {
+            latencies.set(index, Arrays.copyOf(samples, count));
+          }
+        } catch (Exception e) {
+          failures[index] = e;
+          barrier.reset();
+        }
+      });
+      workers.add(worker);
+      worker.start();
+    }
+
+    for (Thread worker : workers) {
+      worker.join();
+    }
+    for (Exception e : failures) {
+      if (e != null) {
+        throw e;
+      }
+    }
+    return latencies;
+  }
+
+  private static void report(String name, int threads, long elapsedNanos, List<long[]> latencies,
+      Map<String, Long> before, Map<String, Long> after, Map<String, Long> rpcsBefore,
+      Map<String, Long> rpcsAfter) {
+    long[] all = latencies.stream().flatMapToLong(Arrays::stream).sorted().toArray();
+    long ops = all.length;
+    double opsPerSec = ops / (elapsedNanos / 1e9);
+
+    StringBuilder byFunction = new StringBuilder();
+    long totalCalls = perOp(before, after, ops, byFunction);
+    StringBuilder byMethod = new StringBuilder();
+    long totalRpcs = perOp(rpcsBefore, rpcsAfter, ops, byMethod);
+
+    String line = String.format("%s,%d,%d,%.1f,%.1f,%.1f,%.1f,%.2f,%s,%.2f,%s", name, threads,
+        ops, opsPerSec, percentile(all, 0.50) / 1e3, percentile(all, 0.90) / 1e3,
+        percentile(all, 0.99) / 1e3, (double) totalCalls / ops, byFunction,
+        (double) totalRpcs / ops, byMethod);
+    results.add(line);
+
+    System.out.println(line);
+  }
+
+  /**
+   * Returns the total increase in the counts from `before` to `after`, and appends the per-op
+   * increase of each count that changed to `breakdown`.
+   */
+  private static long perOp(Map<String, Long> before, Map<String, Long> after, long ops,
+      StringBuilder breakdown) {
+    long total = 0;
+    for (Map.Entry<String, Long> e : after.entrySet()) {
+      long count = e.getValue() - before.getOrDefault(e.getKey(), 0L);
+      if (count == 0) {
+        continue;
+      }
+      total += count;
+      if (breakdown.length() > 0) {
+        breakdown.append(' ');
+      }
+      breakdown.append(String.format("%s=%.2f", e.getKey(), (double) count / ops));
+    }
+    return total;
+  }
+
+  /** Returns the number of KMS RPCs that fakekms has received so far, keyed by method name. */
+  private static Map<String, Long> rpcCounts() {
+    Stats stats = f.getFakeKms().getStats();
+    Map<String, Long> result = new TreeMap<>();
+    for (MethodStats method : stats.getMethodsList()) {
+      result.put(method.getMethodName(), method.getCallCount());
+    }
+    return result;
+  }
+
+  private static long percentile(long[] sorted, double p) {
+    if (sorted.length == 0) {
+      return 0;
+    }
+    int index = (int) Math.ceil(p * sorted.length) - 1;
+    return sorted[Math.max(0, Math.min(index, sorted.length - 1))];
+  }
+
+  private static long iterationMillis() {
+    String value = System.getenv("KMS_PKCS11_JCA_BENCHMARK_ITERATION_MS");
+    return value == null ? DEFAULT_ITERATION_MILLIS : Long.parseLong(value);
+  }
+
+  private static CryptoKeyVersion createCkv(String cryptoKeyId, int purposeID, int algorithmID)
+      throws Exception {
+    CreateCryptoKeyRequest ckReq =
+        CreateCryptoKeyRequest.newBuilder()
+            .setParent(f.getKeyRing().getName())
+            .setCryptoKeyId(cryptoKeyId)
+            .setCryptoKey(CryptoKey.newBuilder().setPurposeValue(purposeID).setVersionTemplate(
+                CryptoKeyVersionTemplate.newBuilder()
+                    .setAlgorithmValue(algorithmID)
+                    .setProtectionLevel(ProtectionLevel.HSM)))
+            .setSkipInitialVersionCreation(true)
+            .build();
+
+    CryptoKey ck = f.getClient().createCryptoKey(ckReq);
+    CryptoKeyVersion ckv =
+        f.getClient().createCryptoKeyVersion(ck.getName(), CryptoKeyVersion.getDefaultInstance());
+
+    while (ckv.getState() != CryptoKeyVersion.CryptoKeyVersionState.ENABLED) {
+      Thread.sleep(1 /* millisecond */);
+      ckv = f.getClient().getCryptoKeyVersion(ckv.getName());
+    }
+
+    return ckv;
+  }
+}
@@ -73,6 +73,11 @@ public class JcaTestFixture implements AutoCloseable {
     return client;
   }
 
+  /** Get the fake KMS server. */
+  public FakeKms getFakeKms() {
+    return fakeKms;
+  }
+
   /** Get the KeyRing associated with this fixture. */
   public KeyRing getKeyRing() {
     return keyRing;
@@ -81,7 +86,18 @@ public class JcaTestFixture implements AutoCloseable {
   /** Create a new SunPKCS11 provider that points to our PKCS11 library. */
   public Provider newProvider() throws IOException {
     Provider p = Security.getProvider("SunPKCS11");
-    return p.configure(newProviderConfig());
+    return p.configure(newProviderConfig(copyLibrary()));
+  }
+
+  /**
+   * Create a new SunPKCS11 provider that points to our PKCS11 library through {@link
+   * CallCounter}, so that the PKCS11 calls made by the provider can be counted. This may only be
+   * called once per process.
+   */
+  public Provider newCountingProvider() throws IOException {
+    Environment.set(CallCounter.TARGET_ENV_VARIABLE, copyLibrary());
+    Provider p = Security.getProvider("SunPKCS11");
+    return p.configure(newProviderConfig(CallCounter.getLibraryPath()));
   }
 
   /** Release the resources associated with this test fixture. */
@@ -121,7 +137,7 @@ public class JcaTestFixture implements AutoCloseable {
     return s.toString();
   }
 
-  private static String newProviderConfig() throws IOException {
+  private static String newProviderConfig(String libraryPath) {
     StringBuilder s = new StringBuilder();
     s.append("--");
     s.append(System.lineSeparator());
@@ -130,6 +146,14 @@ public class JcaTestFixture implements AutoCloseable {
     s.append(UUID.randomUUID().toString());
     s.append(System.lineSeparator());
 
+    s.append("library = ");
+    s.append(libraryPath);
+    s.append(System.lineSeparator());
+
+    return s.toString();
+  }
+
+  private static String copyLibrary() throws IOException {
     // The SunPKCS11 provider caches loads of the same .so file. In order to change
     // the library config within a single Java process, we need to make a copy.
     File libraryCopy = File.createTempFile("libkmsp11", ".so");
@@ -138,11 +162,6 @@ public class JcaTestFixture implements AutoCloseable {
         Paths.get(runfiles.rlocation(SHARED_LIB_PATH)),
         libraryCopy.toPath(),
         StandardCopyOption.REPLACE_EXISTING);
-
-    s.append("library = ");
-    s.append(libraryCopy.getAbsolutePath());
-    s.append(System.lineSeparator());
-
-    return s.toString();
+    return libraryCopy.getAbsolutePath();
   }
 }
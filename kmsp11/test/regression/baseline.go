@@ -0,0 +1,230 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Package regression compares benchmark results with checked-in baselines.
+package regression
+
+import (
+	"encoding/json"
+	"fmt"
+	"io"
+	"math"
+	"os"
+	"sort"
+	"text/tabwriter"
+)
+
+// Summary is a noise-aware summary of repeated measurements of one metric.
+type Summary struct {
+	Median float64
+	// Low and High bound an approximate 95% confidence interval for the
+	// median.
+	Low, High float64
+	N         int
+}
+
+// Summarize returns the median of samples and a distribution-free confidence
+// interval for it, using the binomial order statistics of the sorted samples.
+func Summarize(samples []float64) Summary {
+	n := len(samples)
+	if n == 0 {
+		return Summary{}
+	}
+	s := append([]float64(nil), samples...)
+	sort.Float64s(s)
+
+	var median float64
+	if n%2 == 1 {
+		median = s[n/2]
+	} else {
+		median = (s[n/2-1] + s[n/2]) / 2
+	}
+
+	// Normal approximation to the ranks bounding a 95% interval.
+	half := 1.96 * math.Sqrt(float64(n)) / 2
+	lo := int(math.Floor(float64(n)/2 - half))
+	hi := int(math.Ceil(float64(n)/2+half)) - 1
+	if lo < 0 {
+		lo = 0
+	}
+	if hi > n-1 {
+		hi = n - 1
+	}
+	return Summary{Median: median, Low: s[lo], High: s[hi], N: n}
+}
+
+// Metric is the baseline for a single metric of a scenario.
+type Metric struct {
+	// The recorded median. Nil if the metric has not been recorded yet, in
+	// which case it is reported but never fails.
+	Median *float64 `json:"median,omitempty"`
+	// The relative change (e.g. 0.1 for 10%) beyond which a change counts as a
+	// regression.
+	Tolerance float64 `json:"tolerance"`
+	// If set, larger values are better (e.g. throughput). Otherwise smaller
+	// values are better (e.g. CPU time or allocations).
+	HigherIsBetter bool   `json:"higher_is_better,omitempty"`
+	Unit           string `json:"unit,omitempty"`
+	// If set, the metric must have a recorded median, and comparing with a
+	// baseline that lacks one fails. Used for deterministic metrics (e.g.
+	// allocation counts), which do not depend on the machine they are
+	// recorded on.
+	Required bool `json:"required,omitempty"`
+}
+
+// Baseline holds the metric baselines for a set of scenarios, keyed by
+// scenario name and then metric name.
+type Baseline struct {
+	Scenarios map[string]map[string]*Metric `json:"scenarios"`
+}
+
+// LoadBaseline reads a baseline JSON file.
+func LoadBaseline(path string) (*Baseline, error) {
+	b, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	baseline := new(Baseline)
+	if err := json.Unmarshal(b, baseline); err != nil {
+		return nil, fmt.Errorf("error parsing baseline %s: %w", path, err)
+	}
+	return baseline, nil
+}
+
+// Save writes the baseline as indented JSON.
+func (b *Baseline) Save(path string) error {
+	out, err := json.MarshalIndent(b, "", "  ")
+	if err != nil {
+		return err
+	}
+	return os.WriteFile(path, append(out, '\n'), 0644)
+}
+
+// Update replaces the recorded medians with those in results, keeping each
+// metric's tolerance and direction.
+func (b *Baseline) Update(results map[string]map[string]Summary) {
+	for scenario, metrics := range results {
+		for name, s := range metrics {
+			m := b.metric(scenario, name)
+			median := s.Median
+			m.Median = &median
+		}
+	}
+}
+
+// HasMedians reports whether any metric has a recorded median. A baseline
+// without medians cannot detect regressions.
+func (b *Baseline) HasMedians() bool {
+	for _, metrics := range b.Scenarios {
+		for _, m := range metrics {
+			if m.Median != nil {
+				return true
+			}
+		}
+	}
+	return false
+}
+
+func (b *Baseline) metric(scenario, name string) *Metric {
+	if b.Scenarios == nil {
+		b.Scenarios = make(map[string]map[string]*Metric)
+	}
+	if b.Scenarios[scenario] == nil {
+		b.Scenarios[scenario] = make(map[string]*Metric)
+	}
+	m, ok := b.Scenarios[scenario][name]
+	if !ok {
+		m = &Metric{Tolerance: 0.1}
+		b.Scenarios[scenario][name] = m
+	}
+	return m
+}
+
+// Comparison is the result of comparing one metric with its baseline.
+type Comparison struct {
+	Scenario, Metric string
+	Baseline         *Metric
+	Current          Summary
+	// The relative change of the current median from the baseline median, with
+	// positive values always meaning "worse".
+	Change    float64
+	Regressed bool
+	// Set if the baseline requires this metric but has no recorded median.
+	Unrecorded bool
+}
+
+// Compare compares results with the baseline. A metric regresses only when
+// its whole confidence interval is worse than the baseline median by more than
+// the tolerance, so that noisy runs do not fail spuriously. A required metric
+// without a recorded median is marked Unrecorded.
+func (b *Baseline) Compare(results map[string]map[string]Summary) []Comparison {
+	var comparisons []Comparison
+	for scenario, metrics := range results {
+		for name, s := range metrics {
+			c := Comparison{Scenario: scenario, Metric: name, Current: s}
+			if m, ok := b.Scenarios[scenario][name]; ok {
+				c.Baseline = m
+				c.Unrecorded = m.Required && m.Median == nil
+			}
+			if c.Baseline != nil && c.Baseline.Median != nil && *c.Baseline.Median != 0 {
+				base := *c.Baseline.Median
+				bound := s.Low // the most favorable value for smaller-is-better
+				c.Change = (s.Median - base) / base
+				if c.Baseline.HigherIsBetter {
+					bound = s.High
+					c.Change = -c.Change
+				}
+				worse := (bound - base) / base
+				if c.Baseline.HigherIsBetter {
+					worse = -worse
+				}
+				c.Regressed = worse > c.Baseline.Tolerance
+			}
+			comparisons = append(comparisons, c)
+		}
+	}
+	sort.Slice(comparisons, func(i, j int) bool {
+		if comparisons[i].Scenario != comparisons[j].Scenario {
+			return comparisons[i].Scenario < comparisons[j].Scenario
+		}
+		return comparisons[i].Metric < comparisons[j].Metric
+	})
+	return comparisons
+}
+
+// WriteReport writes a table of comparisons, marking regressed metrics.
+func WriteReport(w io.Writer, comparisons []Comparison) {
+	tw := tabwriter.NewWriter(w, 0, 8, 2, ' ', 0)
+	fmt.Fprintln(tw, "\tscenario\tmetric\tbaseline\tcurrent [95% CI]\tchange (+ is worse)\ttolerance")
+	for _, c := range comparisons {
+		mark, base, change, tolerance := "", "-", "-", "-"
+		if c.Regressed {
+			mark = "REGRESSED"
+		}
+		if c.Unrecorded {
+			mark = "UNRECORDED"
+		}
+		if c.Baseline != nil {
+			tolerance = fmt.Sprintf("%.0f%%", c.Baseline.Tolerance*100)
+			if c.Baseline.Median != nil {
+				base = fmt.Sprintf("%.4g", *c.Baseline.Median)
+				change = fmt.Sprintf("%+.1f%%", c.Change*100)
+			}
+		}
+		fmt.Fprintf(tw, "%s\t%s\t%s\t%s\t%.4g [%.4g, %.4g]\t%s\t%s\n", mark,
+			c.Scenario, c.Metric, base, c.Current.Median, c.Current.Low,
+			c.Current.High, change, tolerance)
+	}
+	tw.Flush()
+}
@@ -0,0 +1,149 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package regression
+
+import (
+	"path/filepath"
+	"testing"
+)
+
+func float(f float64) *float64 { return &f }
+
+func TestSummarizeMedianAndInterval(t *testing.T) {
+	s := Summarize([]float64{5, 1, 4, 2, 3, 9, 7, 8, 6})
+	if s.Median != 5 {
+		t.Errorf("Median = %v, want 5", s.Median)
+	}
+	if s.Low > s.Median || s.High < s.Median || s.Low < 1 || s.High > 9 {
+		t.Errorf("interval [%v, %v] does not bracket the median", s.Low, s.High)
+	}
+}
+
+func TestSummarizeEvenCount(t *testing.T) {
+	if s := Summarize([]float64{1, 2, 3, 4}); s.Median != 2.5 {
+		t.Errorf("Median = %v, want 2.5", s.Median)
+	}
+}
+
+func TestCompareFlagsRegressionOutsideInterval(t *testing.T) {
+	b := &Baseline{Scenarios: map[string]map[string]*Metric{
+		"sign": {"cpu_us_per_op": {Median: float(100), Tolerance: 0.1}},
+	}}
+	results := map[string]map[string]Summary{
+		"sign": {"cpu_us_per_op": {Median: 130, Low: 120, High: 140}},
+	}
+	c := b.Compare(results)
+	if len(c) != 1 || !c[0].Regressed {
+		t.Errorf("Compare() = %+v, want one regression", c)
+	}
+}
+
+func TestCompareIgnoresNoiseWithinInterval(t *testing.T) {
+	b := &Baseline{Scenarios: map[string]map[string]*Metric{
+		"sign": {"cpu_us_per_op": {Median: float(100), Tolerance: 0.1}},
+	}}
+	// The median is 15% worse, but the interval reaches back to the baseline.
+	results := map[string]map[string]Summary{
+		"sign": {"cpu_us_per_op": {Median: 115, Low: 105, High: 140}},
+	}
+	if c := b.Compare(results); c[0].Regressed {
+		t.Errorf("Compare() = %+v, want no regression", c)
+	}
+}
+
+func TestCompareHigherIsBetter(t *testing.T) {
+	b := &Baseline{Scenarios: map[string]map[string]*Metric{
+		"load": {"ops_per_sec": {Median: float(1000), Tolerance: 0.1, HigherIsBetter: true}},
+	}}
+	results := map[string]map[string]Summary{
+		"load": {"ops_per_sec": {Median: 700, Low: 650, High: 750}},
+	}
+	c := b.Compare(results)
+	if !c[0].Regressed || c[0].Change <= 0 {
+		t.Errorf("Compare() = %+v, want a positive (worse) regression", c)
+	}
+}
+
+func TestCompareUnrecordedMetricNeverFails(t *testing.T) {
+	b := &Baseline{Scenarios: map[string]map[string]*Metric{
+		"sign": {"cpu_us_per_op": {Tolerance: 0.1}},
+	}}
+	results := map[string]map[string]Summary{
+		"sign": {"cpu_us_per_op": {Median: 1e9, Low: 1e9, High: 1e9}},
+		"new":  {"allocs_per_op": {Median: 1, Low: 1, High: 1}},
+	}
+	for _, c := range b.Compare(results) {
+		if c.Regressed {
+			t.Errorf("unexpected regression %+v", c)
+		}
+	}
+}
+
+func TestCompareMarksUnrecordedRequiredMetric(t *testing.T) {
+	b := &Baseline{Scenarios: map[string]map[string]*Metric{
+		"sign": {
+			"allocs_per_op": {Tolerance: 0.05, Required: true},
+			"cpu_us_per_op": {Tolerance: 0.1},
+		},
+	}}
+	results := map[string]map[string]Summary{
+		"sign": {
+			"allocs_per_op": {Median: 10, Low: 10, High: 10},
+			"cpu_us_per_op": {Median: 5, Low: 5, High: 5},
+		},
+	}
+	for _, c := range b.Compare(results) {
+		if want := c.Metric == "allocs_per_op"; c.Unrecorded != want {
+			t.Errorf("%s: Unrecorded = %v, want %v", c.Metric, c.Unrecorded, want)
+		}
+	}
+}
+
+func TestHasMedians(t *testing.T) {
+	b := &Baseline{Scenarios: map[string]map[string]*Metric{
+		"sign": {"cpu_us_per_op": {Tolerance: 0.2}},
+	}}
+	if b.HasMedians() {
+		t.Error("HasMedians() = true for a baseline without medians")
+	}
+	b.Update(map[string]map[string]Summary{
+		"sign": {"cpu_us_per_op": {Median: 42}},
+	})
+	if !b.HasMedians() {
+		t.Error("HasMedians() = false after Update")
+	}
+}
+
+func TestUpdateAndSaveRoundTrip(t *testing.T) {
+	b := &Baseline{Scenarios: map[string]map[string]*Metric{
+		"sign": {"cpu_us_per_op": {Tolerance: 0.2, Unit: "us"}},
+	}}
+	b.Update(map[string]map[string]Summary{
+		"sign": {"cpu_us_per_op": {Median: 42}},
+	})
+
+	path := filepath.Join(t.TempDir(), "baseline.json")
+	if err := b.Save(path); err != nil {
+		t.Fatal(err)
+	}
+	got, err := LoadBaseline(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	m := got.Scenarios["sign"]["cpu_us_per_op"]
+	if m.Median == nil || *m.Median != 42 || m.Tolerance != 0.2 || m.Unit != "us" {
+		t.Errorf("round trip = %+v", m)
+	}
+}
@@ -0,0 +1,59 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//go:build linux
+
+package harness
+
+// Defining malloc, calloc and realloc in the test binary interposes them for
+// every shared object in the process, including the dlopen'ed PKCS #11
+// library. Each wrapper bumps a counter and forwards to glibc.
+
+/*
+#include <stddef.h>
+#include <stdatomic.h>
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static atomic_ulong alloc_count;
+
+void* malloc(size_t size) {
+  atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+  atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+static unsigned long get_alloc_count(void) {
+  return atomic_load_explicit(&alloc_count, memory_order_relaxed);
+}
+*/
+import "C"
+
+// allocCount returns the number of C heap allocations made by the process so
+// far. This includes allocations made by the cgo wrapper around the library,
+// which are constant per call and so do not affect comparisons.
+func allocCount() uint64 {
+	return uint64(C.get_alloc_count())
+}
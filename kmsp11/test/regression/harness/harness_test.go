@@ -0,0 +1,333 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Package harness runs the library against fakekms, and compares CPU time,
+// allocations, latency and startup time with a checked-in baseline.
+//
+// fakekms runs in a child process so that its CPU time and allocations are not
+// attributed to the library. Each scenario is repeated, and a metric is only
+// reported as regressed when its whole confidence interval is worse than the
+// baseline by more than the metric's tolerance.
+//
+// To record a new baseline on the reference machine, run with
+// --test.run=TestRegression --write_baseline=<path to the baseline in the source tree>.
+//
+// The checked-in baseline does not have recorded medians yet, so the gate is
+// inactive: results are reported, but nothing can be flagged as regressed.
+// Once medians are recorded, mark the metrics that must always have one (such
+// as allocs_per_op) with "required": true.
+package harness
+
+import (
+	"bytes"
+	"crypto/rand"
+	"flag"
+	"fmt"
+	"strings"
+	"sync"
+	"syscall"
+	"testing"
+	"time"
+
+	"cloud.google.com/go/kms/apiv1/kmspb"
+	"cloud.google.com/kms/integrations/kmsp11/test/fakekmstest"
+	"cloud.google.com/kms/integrations/kmsp11/test/regression"
+	"github.com/bazelbuild/rules_go/go/tools/bazel"
+	"github.com/miekg/pkcs11"
+)
+
+var (
+	baselinePath  = flag.String("baseline", "kmsp11/test/regression/baselines/kmsp11_fakekms.json", "runfiles path of the baseline to compare with")
+	writeBaseline = flag.String("write_baseline", "", "if set, write the measured medians to this file instead of comparing")
+	repetitions   = flag.Int("repetitions", 10, "number of times each scenario is repeated")
+	opsPerRep     = flag.Int("ops", 200, "number of operations per scenario repetition")
+	loadWorkers   = flag.Int("load_workers", 8, "number of concurrent sessions in load scenarios")
+	startupKeys   = flag.Int("startup_keys", 50, "number of additional keys present at startup")
+)
+
+const keyRing = "projects/regression/locations/us-central1/keyRings/regression"
+
+// seedKeys creates the keys used by the scenarios.
+func seedKeys(t *testing.T, addr string) {
+	t.Helper()
+	keys := map[string]fakekmstest.Key{
+		"ec-sign":     {Purpose: kmspb.CryptoKey_ASYMMETRIC_SIGN, Algorithm: kmspb.CryptoKeyVersion_EC_SIGN_P256_SHA256},
+		"rsa-decrypt": {Purpose: kmspb.CryptoKey_ASYMMETRIC_DECRYPT, Algorithm: kmspb.CryptoKeyVersion_RSA_DECRYPT_OAEP_2048_SHA256},
+	}
+	for i := 0; i < *startupKeys; i++ {
+		keys[fmt.Sprintf("filler-%d", i)] = keys["ec-sign"]
+	}
+	fakekmstest.CreateKeys(t, addr, keyRing, keys)
+}
+
+// sample is a snapshot of the process counters used to compute metrics.
+type sample struct {
+	wall   time.Time
+	cpu    time.Duration
+	allocs uint64
+}
+
+func takeSample() sample {
+	var ru syscall.Rusage
+	syscall.Getrusage(syscall.RUSAGE_SELF, &ru)
+	cpu := time.Duration(ru.Utime.Nano() + ru.Stime.Nano())
+	return sample{wall: time.Now(), cpu: cpu, allocs: allocCount()}
+}
+
+// perOp returns the per-operation metrics between two samples.
+func perOp(start, end sample, ops int) map[string]float64 {
+	n := float64(ops)
+	return map[string]float64{
+		"us_per_op":     float64(end.wall.Sub(start.wall).Microseconds()) / n,
+		"cpu_us_per_op": float64((end.cpu - start.cpu).Microseconds()) / n,
+		"allocs_per_op": float64(end.allocs-start.allocs) / n,
+	}
+}
+
+type env struct {
+	t      *testing.T
+	ctx    *pkcs11.Ctx
+	ecKey  pkcs11.ObjectHandle
+	rsaPub pkcs11.ObjectHandle
+}
+
+func (e *env) openSession() pkcs11.SessionHandle {
+	s, err := e.ctx.OpenSession(0, pkcs11.CKF_SERIAL_SESSION)
+	if err != nil {
+		e.t.Fatalf("OpenSession: %v", err)
+	}
+	return s
+}
+
+func (e *env) findKey(s pkcs11.SessionHandle, label string, class uint) pkcs11.ObjectHandle {
+	if err := e.ctx.FindObjectsInit(s, []*pkcs11.Attribute{
+		pkcs11.NewAttribute(pkcs11.CKA_LABEL, label),
+		pkcs11.NewAttribute(pkcs11.CKA_CLASS, class),
+	}); err != nil {
+		e.t.Fatalf("FindObjectsInit: %v", err)
+	}
+	objs, _, err := e.ctx.FindObjects(s, 1)
+	if err != nil || len(objs) != 1 {
+		e.t.Fatalf("FindObjects(%s) = %v, %v", label, objs, err)
+	}
+	if err := e.ctx.FindObjectsFinal(s); err != nil {
+		e.t.Fatalf("FindObjectsFinal: %v", err)
+	}
+	return objs[0]
+}
+
+// scenario runs a workload of ops operations (per session, for concurrent
+// scenarios) and returns its metrics.
+type scenario func(e *env, ops int) map[string]float64
+
+// sequential measures op run ops times on one session.
+func sequential(op func(e *env, s pkcs11.SessionHandle) error) scenario {
+	return func(e *env, ops int) map[string]float64 {
+		s := e.openSession()
+		defer e.ctx.CloseSession(s)
+		start := takeSample()
+		for i := 0; i < ops; i++ {
+			if err := op(e, s); err != nil {
+				e.t.Fatal(err)
+			}
+		}
+		return perOp(start, takeSample(), ops)
+	}
+}
+
+// concurrent measures throughput with loadWorkers sessions running op
+// concurrently.
+func concurrent(op func(e *env, s pkcs11.SessionHandle) error) scenario {
+	return func(e *env, ops int) map[string]float64 {
+		sessions := make([]pkcs11.SessionHandle, *loadWorkers)
+		for i := range sessions {
+			sessions[i] = e.openSession()
+			defer e.ctx.CloseSession(sessions[i])
+		}
+		start := takeSample()
+		var wg sync.WaitGroup
+		errs := make(chan error, len(sessions))
+		for _, s := range sessions {
+			wg.Add(1)
+			go func(s pkcs11.SessionHandle) {
+				defer wg.Done()
+				for i := 0; i < ops; i++ {
+					if err := op(e, s); err != nil {
+						errs <- err
+						return
+					}
+				}
+			}(s)
+		}
+		wg.Wait()
+		close(errs)
+		for err := range errs {
+			e.t.Fatal(err)
+		}
+		end := takeSample()
+		total := ops * len(sessions)
+		m := perOp(start, end, total)
+		delete(m, "us_per_op")
+		m["ops_per_sec"] = float64(total) / end.wall.Sub(start.wall).Seconds()
+		return m
+	}
+}
+
+func ecdsaSign(e *env, s pkcs11.SessionHandle) error {
+	digest := make([]byte, 32)
+	rand.Read(digest)
+	if err := e.ctx.SignInit(s, []*pkcs11.Mechanism{pkcs11.NewMechanism(pkcs11.CKM_ECDSA, nil)}, e.ecKey); err != nil {
+		return fmt.Errorf("SignInit: %w", err)
+	}
+	if _, err := e.ctx.Sign(s, digest); err != nil {
+		return fmt.Errorf("Sign: %w", err)
+	}
+	return nil
+}
+
+func rsaOAEPEncrypt(e *env, s pkcs11.SessionHandle) error {
+	params := pkcs11.NewOAEPParams(pkcs11.CKM_SHA256, pkcs11.CKG_MGF1_SHA256, pkcs11.CKZ_DATA_SPECIFIED, nil)
+	if err := e.ctx.EncryptInit(s, []*pkcs11.Mechanism{pkcs11.NewMechanism(pkcs11.CKM_RSA_PKCS_OAEP, params)}, e.rsaPub); err != nil {
+		return fmt.Errorf("EncryptInit: %w", err)
+	}
+	if _, err := e.ctx.Encrypt(s, bytes.Repeat([]byte{0x5a}, 64)); err != nil {
+		return fmt.Errorf("Encrypt: %w", err)
+	}
+	return nil
+}
+
+func findObjects(e *env, s pkcs11.SessionHandle) error {
+	if err := e.ctx.FindObjectsInit(s, []*pkcs11.Attribute{pkcs11.NewAttribute(pkcs11.CKA_CLASS, pkcs11.CKO_PRIVATE_KEY)}); err != nil {
+		return fmt.Errorf("FindObjectsInit: %w", err)
+	}
+	if _, _, err := e.ctx.FindObjects(s, 100); err != nil {
+		return fmt.Errorf("FindObjects: %w", err)
+	}
+	return e.ctx.FindObjectsFinal(s)
+}
+
+func generateRandom(e *env, s pkcs11.SessionHandle) error {
+	_, err := e.ctx.GenerateRandom(s, 32)
+	return err
+}
+
+var scenarios = map[string]scenario{
+	"ecdsa_p256_sign":            sequential(ecdsaSign),
+	"ecdsa_p256_sign_concurrent": concurrent(ecdsaSign),
+	"rsa_oaep_2048_encrypt":      sequential(rsaOAEPEncrypt),
+	"find_objects":               sequential(findObjects),
+	"generate_random_32":         sequential(generateRandom),
+}
+
+// runOnce initializes the library, measures startup, runs every scenario once
+// and finalizes the library.
+func runOnce(t *testing.T, ctx *pkcs11.Ctx, samples map[string]map[string][]float64) {
+	add := func(scenario string, metrics map[string]float64) {
+		if samples[scenario] == nil {
+			samples[scenario] = make(map[string][]float64)
+		}
+		for name, v := range metrics {
+			samples[scenario][name] = append(samples[scenario][name], v)
+		}
+	}
+
+	start := takeSample()
+	if err := ctx.Initialize(); err != nil {
+		t.Fatalf("Initialize: %v", err)
+	}
+	end := takeSample()
+	add("startup", map[string]float64{
+		"startup_ms": float64(end.wall.Sub(start.wall).Microseconds()) / 1000,
+		"cpu_ms":     float64((end.cpu - start.cpu).Microseconds()) / 1000,
+		"allocs":     float64(end.allocs - start.allocs),
+	})
+	defer ctx.Finalize()
+
+	e := &env{t: t, ctx: ctx}
+	s := e.openSession()
+	e.ecKey = e.findKey(s, "ec-sign", pkcs11.CKO_PRIVATE_KEY)
+	e.rsaPub = e.findKey(s, "rsa-decrypt", pkcs11.CKO_PUBLIC_KEY)
+	ctx.CloseSession(s)
+
+	for name, sc := range scenarios {
+		// Warm up once, so that one-time costs like loading public keys are
+		// excluded from the measurement.
+		sc(e, 1)
+		add(name, sc(e, *opsPerRep))
+	}
+}
+
+func TestRegression(t *testing.T) {
+	lib, err := bazel.Runfile("kmsp11/main/libkmsp11.so")
+	if err != nil {
+		t.Fatalf("error locating KMS PKCS11 .so library: %v", err)
+	}
+	ctx := pkcs11.New(lib)
+	defer ctx.Destroy()
+
+	addr := fakekmstest.Start(t)
+	seedKeys(t, addr)
+	fakekmstest.WriteConfig(t, addr, keyRing)
+
+	samples := make(map[string]map[string][]float64)
+	for i := 0; i < *repetitions; i++ {
+		runOnce(t, ctx, samples)
+	}
+
+	results := make(map[string]map[string]regression.Summary)
+	for scenario, metrics := range samples {
+		results[scenario] = make(map[string]regression.Summary)
+		for name, s := range metrics {
+			results[scenario][name] = regression.Summarize(s)
+		}
+	}
+
+	baselineFile, err := bazel.Runfile(*baselinePath)
+	if err != nil {
+		t.Fatalf("error locating baseline: %v", err)
+	}
+	baseline, err := regression.LoadBaseline(baselineFile)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	if *writeBaseline != "" {
+		baseline.Update(results)
+		if err := baseline.Save(*writeBaseline); err != nil {
+			t.Fatal(err)
+		}
+		t.Logf("wrote baseline to %s", *writeBaseline)
+		return
+	}
+
+	comparisons := baseline.Compare(results)
+	var report strings.Builder
+	regression.WriteReport(&report, comparisons)
+	t.Logf("results:\n%s", report.String())
+	if !baseline.HasMedians() {
+		t.Logf("%s has no recorded medians, so no regression can be detected; "+
+			"record them with --write_baseline", *baselinePath)
+	}
+	for _, c := range comparisons {
+		if c.Regressed {
+			t.Errorf("%s/%s regressed: %.4g -> %.4g (%+.1f%%, tolerance %.0f%%)",
+				c.Scenario, c.Metric, *c.Baseline.Median, c.Current.Median,
+				c.Change*100, c.Baseline.Tolerance*100)
+		}
+		if c.Unrecorded {
+			t.Errorf("%s/%s has no recorded median; record one with --write_baseline",
+				c.Scenario, c.Metric)
+		}
+	}
+}
@@ -0,0 +1,268 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how the purely local hot paths of the library scale with the number
+// of application threads. Each workload is run for a fixed duration at each
+// thread count from 1 to 256, and the results are written as CSV with columns
+//
+//   workload,threads,ops,seconds,ops_per_sec,speedup,efficiency
+//
+// where speedup is relative to one thread and efficiency is speedup divided by
+// the thread count. The CSV is written to standard output and, when run under
+// Bazel, to thread_scaling.csv in the test's undeclared outputs directory.
+//
+// The duration of each point may be set in milliseconds with the
+// KMS_PKCS11_SCALING_POINT_MS environment variable.
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "common/openssl.h"
+#include "common/test/test_status_macros.h"
+#include "fakekms/cpp/fakekms.h"
+#include "gmock/gmock.h"
+#include "kmsp11/main/bridge.h"
+#include "kmsp11/test/common_setup.h"
+#include "kmsp11/test/resource_helpers.h"
+#include "kmsp11/util/global_provider.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+constexpr int kThreadCounts[] = {1, 2, 4, 8, 16, 32, 64, 128, 256};
+
+absl::Duration PointDuration() {
+  const char* env = std::getenv("KMS_PKCS11_SCALING_POINT_MS");
+  int ms;
+  if (env && absl::SimpleAtoi(env, &ms) && ms > 0) {
+    return absl::Milliseconds(ms);
+  }
+  return absl::Seconds(1);
+}
+
+// A workload performs one operation, using per-thread state created by its
+// setup function. It returns false if the operation failed.
+struct Workload {
+  std::string name;
+  std::function<CK_SESSION_HANDLE()> setup;
+  std::function<bool(CK_SESSION_HANDLE)> op;
+  std::function<void(CK_SESSION_HANDLE)> teardown;
+};
+
+struct Point {
+  int threads;
+  uint64_t ops;
+  uint64_t errors;
+  double seconds;
+};
+
+Point RunPoint(const Workload& w, int thread_count, absl::Duration duration) {
+  std::vector<CK_SESSION_HANDLE> state(thread_count);
+  for (CK_SESSION_HANDLE& s : state) {
+    s = w.setup();
+  }
+
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> ops(0), errors(0);
+  absl::Notification start;
+  std::vector<std::thread> threads;
+  threads.reserve(thread_count);
+  for (int i = 0; i < thread_count; i++) {
+    threads.emplace_back([&, i] {
+      uint64_t local_ops = 0, local_errors = 0;
+      start.WaitForNotification();
+      while (!stop.load(std::memory_order_relaxed)) {
+        if (!w.op(state[i])) {
+          local_errors++;
+        }
+        local_ops++;
+      }
+      ops += local_ops;
+      errors += local_errors;
+    });
+  }
+
+  absl::Time begin = absl::Now();
+  start.Notify();
+  absl::SleepFor(duration);
+  stop = true;
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  double seconds = absl::ToDoubleSeconds(absl::Now() - begin);
+
+  for (CK_SESSION_HANDLE s : state) {
+    w.teardown(s);
+  }
+  return Point{thread_count, ops, errors, seconds};
+}
+
+class ThreadScalingTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_OK_AND_ASSIGN(fake_server_, fakekms::Server::New());
+    kms_v1::CryptoKeyVersion ckv;
+    ASSERT_OK_AND_ASSIGN(
+        config_file_,
+        InitializeBridgeForOneKmsKey(
+            fake_server_.get(), kms_v1::CryptoKey::ASYMMETRIC_SIGN,
+            kms_v1::CryptoKeyVersion::EC_SIGN_P256_SHA256, &ckv));
+
+    provider_ = GetGlobalProvider();
+    ASSERT_OK_AND_ASSIGN(token_, provider_->TokenAt(0));
+
+    CK_SESSION_HANDLE session;
+    ASSERT_OK(OpenSession(0, CKF_SERIAL_SESSION, nullptr, nullptr, &session));
+    ASSERT_OK_AND_ASSIGN(private_key_, GetPrivateKeyObjectHandle(session, ckv));
+    ASSERT_OK_AND_ASSIGN(public_key_, GetPublicKeyObjectHandle(session, ckv));
+
+    // Sign once, so that verification can run locally in the workloads.
+    digest_.resize(32);
+    RAND_bytes(digest_.data(), digest_.size());
+    CK_MECHANISM mech{CKM_ECDSA, nullptr, 0};
+    ASSERT_OK(SignInit(session, &mech, private_key_));
+    CK_ULONG signature_size = 64;
+    signature_.resize(signature_size);
+    ASSERT_OK(Sign(session, digest_.data(), digest_.size(), signature_.data(),
+                   &signature_size));
+    ASSERT_OK(CloseSession(session));
+  }
+
+  void TearDown() override {
+    EXPECT_OK(Finalize(nullptr));
+    std::remove(config_file_.c_str());
+  }
+
+  static CK_SESSION_HANDLE OpenOrDie() {
+    CK_SESSION_HANDLE session;
+    CHECK_OK(OpenSession(0, CKF_SERIAL_SESSION, nullptr, nullptr, &session));
+    return session;
+  }
+  static void CloseOrDie(CK_SESSION_HANDLE session) {
+    CHECK_OK(CloseSession(session));
+  }
+
+  std::vector<Workload> Workloads() {
+    auto no_session = [] { return CK_SESSION_HANDLE(0); };
+    auto no_teardown = [](CK_SESSION_HANDLE) {};
+
+    return {
+        {"GetSession", OpenOrDie,
+         [this](CK_SESSION_HANDLE s) { return provider_->GetSession(s).ok(); },
+         CloseOrDie},
+        {"Token::GetObject", no_session,
+         [this](CK_SESSION_HANDLE) {
+           return token_->GetObject(public_key_).ok();
+         },
+         no_teardown},
+        {"AttributeMap::Value", no_session,
+         [this](CK_SESSION_HANDLE) {
+           absl::StatusOr<std::shared_ptr<Object>> key =
+               token_->GetObject(public_key_);
+           return key.ok() && (*key)->attributes().Value(CKA_EC_POINT).ok() &&
+                  (*key)->attributes().Value(CKA_LABEL).ok();
+         },
+         no_teardown},
+        {"C_GetAttributeValue", OpenOrDie,
+         [this](CK_SESSION_HANDLE s) {
+           CK_KEY_TYPE key_type;
+           CK_BBOOL verify;
+           CK_ATTRIBUTE attrs[] = {
+               {CKA_KEY_TYPE, &key_type, sizeof(key_type)},
+               {CKA_VERIFY, &verify, sizeof(verify)},
+           };
+           return GetAttributeValue(s, public_key_, attrs, 2).ok();
+         },
+         CloseOrDie},
+        {"C_FindObjectsInit+C_FindObjects", OpenOrDie,
+         [](CK_SESSION_HANDLE s) {
+           CK_OBJECT_CLASS object_class = CKO_PUBLIC_KEY;
+           CK_ATTRIBUTE attr{CKA_CLASS, &object_class, sizeof(object_class)};
+           CK_OBJECT_HANDLE handles[4];
+           CK_ULONG found;
+           return FindObjectsInit(s, &attr, 1).ok() &&
+                  FindObjects(s, handles, 4, &found).ok() &&
+                  FindObjectsFinal(s).ok();
+         },
+         CloseOrDie},
+        {"C_Verify", OpenOrDie,
+         [this](CK_SESSION_HANDLE s) {
+           CK_MECHANISM mech{CKM_ECDSA, nullptr, 0};
+           return VerifyInit(s, &mech, public_key_).ok() &&
+                  Verify(s, digest_.data(), digest_.size(), signature_.data(),
+                         signature_.size())
+                      .ok();
+         },
+         CloseOrDie},
+        {"C_OpenSession+C_CloseSession", no_session,
+         [](CK_SESSION_HANDLE) {
+           CK_SESSION_HANDLE s;
+           return OpenSession(0, CKF_SERIAL_SESSION, nullptr, nullptr, &s)
+                      .ok() &&
+                  CloseSession(s).ok();
+         },
+         no_teardown},
+    };
+  }
+
+  std::unique_ptr<fakekms::Server> fake_server_;
+  std::string config_file_;
+  Provider* provider_;
+  Token* token_;
+  CK_OBJECT_HANDLE private_key_, public_key_;
+  std::vector<uint8_t> digest_, signature_;
+};
+
+TEST_F(ThreadScalingTest, SweepThreadCounts) {
+  absl::Duration duration = PointDuration();
+
+  std::string csv =
+      "workload,threads,ops,seconds,ops_per_sec,speedup,efficiency\n";
+  for (const Workload& w : Workloads()) {
+    double single_thread_rate = 0;
+    for (int thread_count : kThreadCounts) {
+      Point p = RunPoint(w, thread_count, duration);
+      EXPECT_EQ(p.errors, 0u) << w.name << " at " << thread_count << " threads";
+
+      double rate = p.ops / p.seconds;
+      if (thread_count == 1) {
+        single_thread_rate = rate;
+      }
+      double speedup = single_thread_rate > 0 ? rate / single_thread_rate : 0;
+      csv += absl::StrFormat("%s,%d,%d,%.3f,%.1f,%.3f,%.3f\n", w.name,
+                             thread_count, p.ops, p.seconds, rate, speedup,
+                             speedup / thread_count);
+    }
+  }
+
+  std::cout << "# hardware_concurrency=" << std::thread::hardware_concurrency()
+            << std::endl
+            << csv;
+  if (const char* dir = std::getenv("TEST_UNDECLARED_OUTPUTS_DIR")) {
+    std::ofstream(absl::StrCat(dir, "/thread_scaling.csv")) << csv;
+  }
+}
+
+}  // namespace
+}  // namespace cloud_kms::kmsp11
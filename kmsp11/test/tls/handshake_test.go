@@ -0,0 +1,296 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Package tlsbench measures TLS handshake throughput for a server whose
+// private key lives in KMS, and is used through the library.
+//
+// The server and client run in this process, and fakekms runs in a child
+// process with a configurable per-request delay. Each handshake is a full
+// handshake: session resumption is disabled, so every handshake needs one
+// signature from the server's key. For each client concurrency level, the
+// benchmark reports handshakes per second, handshake latency percentiles and
+// PKCS #11 calls per handshake, on stdout and in tls_handshake.csv in
+// TEST_UNDECLARED_OUTPUTS_DIR.
+//
+// Example:
+//
+//	bazel test //kmsp11/test/tls:handshake_test --test_output=streamed \
+//	    --test_arg=--kms_delay=20ms --test_arg=--key_alg=rsa_pss_2048
+package tlsbench
+
+import (
+	"crypto/rand"
+	"crypto/tls"
+	"crypto/x509"
+	"crypto/x509/pkix"
+	"flag"
+	"fmt"
+	"io"
+	"math/big"
+	"net"
+	"os"
+	"path"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"testing"
+	"time"
+
+	"cloud.google.com/go/kms/apiv1/kmspb"
+	"cloud.google.com/kms/integrations/kmsp11/test/fakekmstest"
+	"github.com/bazelbuild/rules_go/go/tools/bazel"
+	"github.com/miekg/pkcs11"
+)
+
+var (
+	kmsDelay    = flag.Duration("kms_delay", 0, "the delay that fakekms adds to each KMS request")
+	keyAlg      = flag.String("key_alg", "ec_p256", "the server key algorithm: ec_p256 or rsa_pss_2048")
+	concurrency = flag.String("concurrency", "1,2,4,8,16,32,64", "comma-separated client concurrency levels")
+	pointTime   = flag.Duration("point_duration", 5*time.Second, "how long handshakes are driven at each concurrency level")
+	warmupTime  = flag.Duration("warmup_duration", time.Second, "how long handshakes are driven before each measurement")
+)
+
+const (
+	keyRing = "projects/tls-bench/locations/us-central1/keyRings/tls-bench"
+	keyID   = "tls-server"
+)
+
+var algorithms = map[string]kmspb.CryptoKeyVersion_CryptoKeyVersionAlgorithm{
+	"ec_p256":      kmspb.CryptoKeyVersion_EC_SIGN_P256_SHA256,
+	"rsa_pss_2048": kmspb.CryptoKeyVersion_RSA_SIGN_PSS_2048_SHA256,
+}
+
+func initLibrary(t *testing.T, addr string) *countingCtx {
+	t.Helper()
+	fakekmstest.WriteConfig(t, addr, keyRing)
+
+	lib, err := bazel.Runfile("kmsp11/main/libkmsp11.so")
+	if err != nil {
+		t.Fatalf("error locating KMS PKCS11 .so library: %v", err)
+	}
+	ctx := pkcs11.New(lib)
+	if err := ctx.Initialize(); err != nil {
+		t.Fatalf("error initializing: %v", err)
+	}
+	t.Cleanup(func() {
+		ctx.Finalize()
+		ctx.Destroy()
+	})
+	return &countingCtx{Ctx: ctx}
+}
+
+func findPrivateKey(t *testing.T, pool *sessionPool) pkcs11.ObjectHandle {
+	t.Helper()
+	s, err := pool.get()
+	if err != nil {
+		t.Fatalf("OpenSession: %v", err)
+	}
+	defer pool.put(s)
+
+	if err := pool.ctx.FindObjectsInit(s, []*pkcs11.Attribute{
+		pkcs11.NewAttribute(pkcs11.CKA_LABEL, keyID),
+		pkcs11.NewAttribute(pkcs11.CKA_CLASS, pkcs11.CKO_PRIVATE_KEY),
+	}); err != nil {
+		t.Fatalf("FindObjectsInit: %v", err)
+	}
+	objs, _, err := pool.ctx.FindObjects(s, 1)
+	if err != nil || len(objs) != 1 {
+		t.Fatalf("FindObjects(%s) = %v, %v", keyID, objs, err)
+	}
+	if err := pool.ctx.FindObjectsFinal(s); err != nil {
+		t.Fatalf("FindObjectsFinal: %v", err)
+	}
+	return objs[0]
+}
+
+// selfSignedCertificate returns a certificate for localhost that is signed
+// with the server's own key.
+func selfSignedCertificate(t *testing.T, s *signer) tls.Certificate {
+	t.Helper()
+	tmpl := &x509.Certificate{
+		SerialNumber: big.NewInt(1),
+		Subject:      pkix.Name{CommonName: "localhost"},
+		DNSNames:     []string{"localhost"},
+		NotBefore:    time.Now().Add(-time.Hour),
+		NotAfter:     time.Now().Add(24 * time.Hour),
+		KeyUsage:     x509.KeyUsageDigitalSignature,
+		ExtKeyUsage:  []x509.ExtKeyUsage{x509.ExtKeyUsageServerAuth},
+	}
+	if *keyAlg == "rsa_pss_2048" {
+		tmpl.SignatureAlgorithm = x509.SHA256WithRSAPSS
+	}
+	der, err := x509.CreateCertificate(rand.Reader, tmpl, tmpl, s.Public(), s)
+	if err != nil {
+		t.Fatalf("error creating certificate: %v", err)
+	}
+	return tls.Certificate{Certificate: [][]byte{der}, PrivateKey: s}
+}
+
+// serve accepts connections on lis and completes a TLS handshake on each,
+// until lis is closed.
+func serve(lis net.Listener) {
+	for {
+		conn, err := lis.Accept()
+		if err != nil {
+			return
+		}
+		go func() {
+			defer conn.Close()
+			tc := conn.(*tls.Conn)
+			if err := tc.Handshake(); err != nil {
+				return
+			}
+			// Wait for the client to hang up, so that the client's measurement
+			// covers the server's whole handshake.
+			io.Copy(io.Discard, tc)
+		}()
+	}
+}
+
+// drive runs handshakes from n concurrent clients for d, and returns the
+// latency of each successful handshake.
+func drive(t *testing.T, addr string, cfg *tls.Config, n int, d time.Duration) []time.Duration {
+	t.Helper()
+	var mu sync.Mutex
+	var latencies []time.Duration
+	var firstErr error
+	deadline := time.Now().Add(d)
+
+	var wg sync.WaitGroup
+	for i := 0; i < n; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			var local []time.Duration
+			for time.Now().Before(deadline) {
+				start := time.Now()
+				conn, err := tls.Dial("tcp", addr, cfg)
+				if err != nil {
+					mu.Lock()
+					if firstErr == nil {
+						firstErr = err
+					}
+					mu.Unlock()
+					return
+				}
+				local = append(local, time.Since(start))
+				conn.Close()
+			}
+			mu.Lock()
+			latencies = append(latencies, local...)
+			mu.Unlock()
+		}()
+	}
+	wg.Wait()
+	if firstErr != nil {
+		t.Fatalf("handshake failed: %v", firstErr)
+	}
+	return latencies
+}
+
+func percentile(sorted []time.Duration, p float64) time.Duration {
+	if len(sorted) == 0 {
+		return 0
+	}
+	i := int(p*float64(len(sorted))+0.5) - 1
+	if i < 0 {
+		i = 0
+	}
+	if i >= len(sorted) {
+		i = len(sorted) - 1
+	}
+	return sorted[i]
+}
+
+func parseConcurrency(t *testing.T) []int {
+	t.Helper()
+	var levels []int
+	for _, f := range strings.Split(*concurrency, ",") {
+		n, err := strconv.Atoi(strings.TrimSpace(f))
+		if err != nil || n < 1 {
+			t.Fatalf("invalid concurrency level %q", f)
+		}
+		levels = append(levels, n)
+	}
+	return levels
+}
+
+func TestHandshakeThroughput(t *testing.T) {
+	alg, ok := algorithms[*keyAlg]
+	if !ok {
+		t.Fatalf("unsupported key algorithm %q", *keyAlg)
+	}
+	levels := parseConcurrency(t)
+
+	kmsAddr := fakekmstest.Start(t, "--delay="+kmsDelay.String())
+	fakekmstest.CreateKeys(t, kmsAddr, keyRing, map[string]fakekmstest.Key{
+		keyID: {Purpose: kmspb.CryptoKey_ASYMMETRIC_SIGN, Algorithm: alg},
+	})
+	ctx := initLibrary(t, kmsAddr)
+
+	pool := newSessionPool(ctx, 0, levels[len(levels)-1])
+	defer pool.close()
+	s, err := newSigner(pool, findPrivateKey(t, pool))
+	if err != nil {
+		t.Fatal(err)
+	}
+	cert := selfSignedCertificate(t, s)
+
+	lis, err := tls.Listen("tcp", "localhost:0", &tls.Config{
+		Certificates:           []tls.Certificate{cert},
+		SessionTicketsDisabled: true,
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer lis.Close()
+	go serve(lis)
+
+	leaf, err := x509.ParseCertificate(cert.Certificate[0])
+	if err != nil {
+		t.Fatal(err)
+	}
+	roots := x509.NewCertPool()
+	roots.AddCert(leaf)
+	clientConfig := &tls.Config{RootCAs: roots, ServerName: "localhost"}
+
+	lines := []string{"key_alg,kms_delay_ms,concurrency,handshakes,handshakes_per_sec,p50_ms,p90_ms,p99_ms,p11_calls_per_handshake"}
+	fmt.Println(lines[0])
+	for _, n := range levels {
+		drive(t, lis.Addr().String(), clientConfig, n, *warmupTime)
+
+		callsBefore := ctx.calls.Load()
+		start := time.Now()
+		latencies := drive(t, lis.Addr().String(), clientConfig, n, *pointTime)
+		elapsed := time.Since(start)
+		calls := ctx.calls.Load() - callsBefore
+
+		sort.Slice(latencies, func(i, j int) bool { return latencies[i] < latencies[j] })
+		count := float64(len(latencies))
+		ms := func(d time.Duration) float64 { return float64(d.Microseconds()) / 1000 }
+		line := fmt.Sprintf("%s,%.1f,%d,%d,%.1f,%.2f,%.2f,%.2f,%.2f", *keyAlg, ms(*kmsDelay), n,
+			len(latencies), count/elapsed.Seconds(), ms(percentile(latencies, 0.50)),
+			ms(percentile(latencies, 0.90)), ms(percentile(latencies, 0.99)), float64(calls)/count)
+		fmt.Println(line)
+		lines = append(lines, line)
+	}
+
+	if dir := os.Getenv("TEST_UNDECLARED_OUTPUTS_DIR"); dir != "" {
+		csv := strings.Join(lines, "\n") + "\n"
+		if err := os.WriteFile(path.Join(dir, "tls_handshake.csv"), []byte(csv), 0644); err != nil {
+			t.Errorf("error writing results: %v", err)
+		}
+	}
+}
@@ -0,0 +1,172 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package tlsbench
+
+import (
+	"crypto"
+	"crypto/rsa"
+	"crypto/x509"
+	"encoding/asn1"
+	"fmt"
+	"io"
+	"math/big"
+	"sync/atomic"
+
+	"github.com/miekg/pkcs11"
+)
+
+// countingCtx counts the Cryptoki calls that the signer makes per signature.
+// Setup calls, such as those made to locate the key, are not counted.
+type countingCtx struct {
+	*pkcs11.Ctx
+	calls atomic.Uint64
+}
+
+func (c *countingCtx) OpenSession(slotID uint, flags uint) (pkcs11.SessionHandle, error) {
+	c.calls.Add(1)
+	return c.Ctx.OpenSession(slotID, flags)
+}
+
+func (c *countingCtx) CloseSession(sh pkcs11.SessionHandle) error {
+	c.calls.Add(1)
+	return c.Ctx.CloseSession(sh)
+}
+
+func (c *countingCtx) SignInit(sh pkcs11.SessionHandle, m []*pkcs11.Mechanism, o pkcs11.ObjectHandle) error {
+	c.calls.Add(1)
+	return c.Ctx.SignInit(sh, m, o)
+}
+
+func (c *countingCtx) Sign(sh pkcs11.SessionHandle, message []byte) ([]byte, error) {
+	c.calls.Add(1)
+	return c.Ctx.Sign(sh, message)
+}
+
+// sessionPool hands out sessions on a single slot. Like the session pools in
+// the OpenSSL engine and provider for PKCS #11, it opens a new session when no
+// idle session is available, and keeps up to cap(idle) sessions for reuse.
+type sessionPool struct {
+	ctx  *countingCtx
+	slot uint
+	idle chan pkcs11.SessionHandle
+}
+
+func newSessionPool(ctx *countingCtx, slot uint, maxIdle int) *sessionPool {
+	return &sessionPool{ctx: ctx, slot: slot, idle: make(chan pkcs11.SessionHandle, maxIdle)}
+}
+
+func (p *sessionPool) get() (pkcs11.SessionHandle, error) {
+	select {
+	case s := <-p.idle:
+		return s, nil
+	default:
+		return p.ctx.OpenSession(p.slot, pkcs11.CKF_SERIAL_SESSION)
+	}
+}
+
+func (p *sessionPool) put(s pkcs11.SessionHandle) {
+	select {
+	case p.idle <- s:
+	default:
+		p.ctx.CloseSession(s)
+	}
+}
+
+func (p *sessionPool) close() {
+	for {
+		select {
+		case s := <-p.idle:
+			p.ctx.CloseSession(s)
+		default:
+			return
+		}
+	}
+}
+
+// signer is a crypto.Signer whose private key is a PKCS #11 object. It makes
+// the same calls for each signature as an OpenSSL integration would: a
+// C_SignInit and a single-part C_Sign over the digest, on a pooled session.
+type signer struct {
+	pool *sessionPool
+	key  pkcs11.ObjectHandle
+	pub  crypto.PublicKey
+}
+
+func newSigner(pool *sessionPool, key pkcs11.ObjectHandle) (*signer, error) {
+	s, err := pool.get()
+	if err != nil {
+		return nil, fmt.Errorf("OpenSession: %w", err)
+	}
+	defer pool.put(s)
+
+	attrs, err := pool.ctx.GetAttributeValue(s, key, []*pkcs11.Attribute{
+		pkcs11.NewAttribute(pkcs11.CKA_PUBLIC_KEY_INFO, nil),
+	})
+	if err != nil {
+		return nil, fmt.Errorf("GetAttributeValue: %w", err)
+	}
+	pub, err := x509.ParsePKIXPublicKey(attrs[0].Value)
+	if err != nil {
+		return nil, fmt.Errorf("error parsing public key: %w", err)
+	}
+	return &signer{pool: pool, key: key, pub: pub}, nil
+}
+
+func (s *signer) Public() crypto.PublicKey {
+	return s.pub
+}
+
+func (s *signer) Sign(_ io.Reader, digest []byte, opts crypto.SignerOpts) ([]byte, error) {
+	var mech *pkcs11.Mechanism
+	switch s.pub.(type) {
+	case *rsa.PublicKey:
+		pssOpts, ok := opts.(*rsa.PSSOptions)
+		if !ok || opts.HashFunc() != crypto.SHA256 {
+			return nil, fmt.Errorf("unsupported RSA signer options: %#v", opts)
+		}
+		saltLen := pssOpts.SaltLength
+		if saltLen == rsa.PSSSaltLengthEqualsHash || saltLen == rsa.PSSSaltLengthAuto {
+			saltLen = crypto.SHA256.Size()
+		}
+		mech = pkcs11.NewMechanism(pkcs11.CKM_RSA_PKCS_PSS,
+			pkcs11.NewPSSParams(pkcs11.CKM_SHA256, pkcs11.CKG_MGF1_SHA256, uint(saltLen)))
+	default:
+		mech = pkcs11.NewMechanism(pkcs11.CKM_ECDSA, nil)
+	}
+
+	session, err := s.pool.get()
+	if err != nil {
+		return nil, fmt.Errorf("OpenSession: %w", err)
+	}
+	defer s.pool.put(session)
+
+	if err := s.pool.ctx.SignInit(session, []*pkcs11.Mechanism{mech}, s.key); err != nil {
+		return nil, fmt.Errorf("SignInit: %w", err)
+	}
+	sig, err := s.pool.ctx.Sign(session, digest)
+	if err != nil {
+		return nil, fmt.Errorf("Sign: %w", err)
+	}
+
+	if mech.Mechanism == pkcs11.CKM_ECDSA {
+		// PKCS #11 returns r || s, and TLS wants an ASN.1 ECDSA-Sig-Value.
+		half := len(sig) / 2
+		return asn1.Marshal(struct{ R, S *big.Int }{
+			new(big.Int).SetBytes(sig[:half]),
+			new(big.Int).SetBytes(sig[half:]),
+		})
+	}
+	return sig, nil
+}
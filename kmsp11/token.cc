@@ -75,24 +75,35 @@ absl::StatusOr<CK_TOKEN_INFO> NewTokenInfo(std::string_view token_label) {
 
 }  // namespace
 
-absl::StatusOr<std::unique_ptr<Token>> Token::New(CK_SLOT_ID slot_id,
-                                                  TokenConfig token_config,
-                                                  KmsClient* kms_client,
-                                                  bool generate_certs) {
-  ASSIGN_OR_RETURN(CK_SLOT_INFO slot_info, NewSlotInfo());
-  ASSIGN_OR_RETURN(CK_TOKEN_INFO token_info,
-                   NewTokenInfo(token_config.label()));
-
+absl::StatusOr<std::unique_ptr<Token>> Token::New(
+    CK_SLOT_ID slot_id, TokenConfig token_config, KmsClient* kms_client,
+    bool generate_certs, std::unique_ptr<VerifyCache> verify_cache,
+    std::unique_ptr<DecryptCache> decrypt_cache,
+    std::string_view object_handle_secret) {
   ASSIGN_OR_RETURN(
       std::unique_ptr<ObjectLoader> loader,
-      ObjectLoader::New(token_config.key_ring(),
-                        token_config.certs(), generate_certs));
+      ObjectLoader::New(token_config.key_ring(), token_config.certs(),
+                        generate_certs, object_handle_secret));
   ASSIGN_OR_RETURN(ObjectStoreState state, loader->BuildState(*kms_client));
+  return New(slot_id, token_config, std::move(loader), state,
+             std::move(verify_cache), std::move(decrypt_cache));
+}
+
+absl::StatusOr<std::unique_ptr<Token>> Token::New(
+    CK_SLOT_ID slot_id, TokenConfig token_config,
+    std::unique_ptr<ObjectLoader> object_loader, const ObjectStoreState& state,
+    std::unique_ptr<VerifyCache> verify_cache,
+    std::unique_ptr<DecryptCache> decrypt_cache) {
+  ASSIGN_OR_RETURN(CK_SLOT_INFO slot_info, NewSlotInfo());
+  ASSIGN_OR_RETURN(CK_TOKEN_INFO token_info,
+                   NewTokenInfo(token_config.label()));
   ASSIGN_OR_RETURN(std::unique_ptr<ObjectStore> store, ObjectStore::New(state));
 
   // using `new` to invoke a private constructor
-  return std::unique_ptr<Token>(new Token(slot_id, slot_info, token_info,
-                                          std::move(loader), std::move(store)));
+  return std::unique_ptr<Token>(
+      new Token(slot_id, slot_info, token_info, std::move(object_loader),
+                std::move(store), std::move(verify_cache),
+                std::move(decrypt_cache)));
 }
 
 bool Token::is_logged_in() const {
@@ -141,10 +152,38 @@ absl::Status Token::Logout() {
 
 absl::Status Token::RefreshState(const KmsClient& client) {
   ASSIGN_OR_RETURN(ObjectStoreState state, object_loader_->BuildState(client));
+  return SwapState(state);
+}
+
+absl::Status Token::RefreshState(const KmsClient& client, uint32_t bucket,
+                                 uint32_t bucket_count) {
+  ASSIGN_OR_RETURN(ObjectStoreState state,
+                   object_loader_->BuildState(client, bucket, bucket_count));
+  return SwapState(state);
+}
+
+absl::Status Token::SwapState(const ObjectStoreState& state) {
   ASSIGN_OR_RETURN(std::unique_ptr<ObjectStore> store, ObjectStore::New(state));
 
-  absl::WriterMutexLock lock(&objects_mutex_);
-  objects_.swap(store);
+  {
+    absl::WriterMutexLock lock(&objects_mutex_);
+    objects_.swap(store);
+  }
+
+  // Cached results with keys that are no longer available must not outlive
+  // them.
+  if (verify_cache_ || decrypt_cache_) {
+    absl::flat_hash_set<std::string> key_names;
+    for (const Key& key : state.keys()) {
+      key_names.insert(key.crypto_key_version().name());
+    }
+    if (verify_cache_) {
+      verify_cache_->RetainKeys(key_names);
+    }
+    if (decrypt_cache_) {
+      decrypt_cache_->RetainKeys(key_names);
+    }
+  }
   return absl::OkStatus();
 }
 
@@ -26,6 +26,8 @@
 #include "kmsp11/object.h"
 #include "kmsp11/object_loader.h"
 #include "kmsp11/object_store.h"
+#include "kmsp11/operation/decrypt_cache.h"
+#include "kmsp11/operation/verify_cache.h"
 
 namespace cloud_kms::kmsp11 {
 
@@ -37,7 +39,20 @@ class Token {
  public:
   static absl::StatusOr<std::unique_ptr<Token>> New(
       CK_SLOT_ID slot_id, TokenConfig token_config, KmsClient* kms_client,
-      bool generate_certs = false);
+      bool generate_certs = false,
+      std::unique_ptr<VerifyCache> verify_cache = nullptr,
+      std::unique_ptr<DecryptCache> decrypt_cache = nullptr,
+      std::string_view object_handle_secret = "");
+
+  // Creates a token that adopts an existing ObjectLoader, such as one retained
+  // from a previous Provider, and whose objects are those in `state`. Cloud KMS
+  // is not contacted.
+  static absl::StatusOr<std::unique_ptr<Token>> New(
+      CK_SLOT_ID slot_id, TokenConfig token_config,
+      std::unique_ptr<ObjectLoader> object_loader,
+      const ObjectStoreState& state,
+      std::unique_ptr<VerifyCache> verify_cache = nullptr,
+      std::unique_ptr<DecryptCache> decrypt_cache = nullptr);
 
   CK_SLOT_ID slot_id() const { return slot_id_; }
   const CK_SLOT_INFO& slot_info() const { return slot_info_; }
@@ -76,17 +91,45 @@ class Token {
 
   absl::Status RefreshState(const KmsClient& client);
 
+  // Refreshes only the CryptoKeys in `bucket` of `bucket_count`; see
+  // ObjectLoader::BuildState.
+  absl::Status RefreshState(const KmsClient& client, uint32_t bucket,
+                            uint32_t bucket_count);
+
+  // Returns the most recently loaded state, without contacting Cloud KMS.
+  ObjectStoreState CachedState() { return object_loader_->CachedState(); }
+
+  // Releases this token's ObjectLoader so that it can be adopted by another
+  // token. The token must not be used afterwards.
+  std::unique_ptr<ObjectLoader> ReleaseObjectLoader() {
+    return std::move(object_loader_);
+  }
+
+  // Returns the cache of successful verifications with this token's keys, or
+  // nullptr if verifications are not cached.
+  VerifyCache* verify_cache() const { return verify_cache_.get(); }
+
+  // Returns the cache of decryption results with this token's keys, or nullptr
+  // if decryption results are not cached.
+  DecryptCache* decrypt_cache() const { return decrypt_cache_.get(); }
+
  private:
   Token(CK_SLOT_ID slot_id, CK_SLOT_INFO slot_info, CK_TOKEN_INFO token_info,
         std::unique_ptr<ObjectLoader> object_loader,
-        std::unique_ptr<ObjectStore> objects)
+        std::unique_ptr<ObjectStore> objects,
+        std::unique_ptr<VerifyCache> verify_cache,
+        std::unique_ptr<DecryptCache> decrypt_cache)
       : slot_id_(slot_id),
         slot_info_(slot_info),
         token_info_(token_info),
         object_loader_(std::move(object_loader)),
         objects_(std::move(objects)),
+        verify_cache_(std::move(verify_cache)),
+        decrypt_cache_(std::move(decrypt_cache)),
         is_logged_in_(false) {}
 
+  absl::Status SwapState(const ObjectStoreState& state);
+
   const CK_SLOT_ID slot_id_;
   const CK_SLOT_INFO slot_info_;
   const CK_TOKEN_INFO token_info_;
@@ -94,6 +137,8 @@ class Token {
   std::unique_ptr<ObjectLoader> object_loader_;
   mutable absl::Mutex objects_mutex_;
   std::unique_ptr<ObjectStore> objects_ ABSL_GUARDED_BY(objects_mutex_);
+  const std::unique_ptr<VerifyCache> verify_cache_;
+  const std::unique_ptr<DecryptCache> decrypt_cache_;
 
   // All sessions with the same token have the same login state (rather than
   // login state being per-session, which seems like the more obvious choice.)
@@ -0,0 +1,59 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// export_public_keys loads the key rings named in a library configuration
+// file, and writes their public keys to a snapshot file that the library can
+// serve with `public_key_snapshot_file`.
+//
+// Usage: export_public_keys <config file> <snapshot file>
+
+#include <iostream>
+
+#include "common/status_macros.h"
+#include "kmsp11/config/config.h"
+#include "kmsp11/provider.h"
+#include "kmsp11/public_key_snapshot.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+absl::Status ExportPublicKeys(const std::string& config_path,
+                              const std::string& snapshot_path) {
+  ASSIGN_OR_RETURN(LibraryConfig config, LoadConfigFromFile(config_path));
+  // The snapshot is loaded once; there is no need to keep it fresh.
+  config.clear_refresh_interval_secs();
+  config.clear_public_key_snapshot_file();
+
+  ASSIGN_OR_RETURN(std::unique_ptr<Provider> provider, Provider::New(config));
+  return WritePublicKeySnapshot(provider->ExportPublicKeySnapshot(),
+                                snapshot_path);
+}
+
+}  // namespace
+}  // namespace cloud_kms::kmsp11
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " <config file> <snapshot file>"
+              << std::endl;
+    return 2;
+  }
+
+  absl::Status result = cloud_kms::kmsp11::ExportPublicKeys(argv[1], argv[2]);
+  if (!result.ok()) {
+    std::cerr << "error exporting public keys: " << result << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,350 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"errors"
+	"sync"
+	"time"
+
+	"github.com/miekg/pkcs11"
+)
+
+// handleWaitTimeout bounds how long a call waits for a handle that is created
+// by a call on another recorded thread.
+const handleWaitTimeout = time.Second
+
+type handleKind int
+
+const (
+	sessionHandle handleKind = iota
+	objectHandle
+)
+
+type handleKey struct {
+	kind     handleKind
+	recorded uint
+}
+
+// handleMap translates the handles in a trace to the handles returned by the
+// library under replay.
+type handleMap struct {
+	mu sync.Mutex
+	m  map[handleKey]uint
+}
+
+func (h *handleMap) put(kind handleKind, recorded, live uint) {
+	h.mu.Lock()
+	defer h.mu.Unlock()
+	h.m[handleKey{kind, recorded}] = live
+}
+
+func (h *handleMap) get(kind handleKind, recorded uint) (uint, bool) {
+	deadline := time.Now().Add(handleWaitTimeout)
+	for {
+		h.mu.Lock()
+		live, ok := h.m[handleKey{kind, recorded}]
+		h.mu.Unlock()
+		if ok || time.Now().After(deadline) {
+			return live, ok
+		}
+		time.Sleep(time.Millisecond)
+	}
+}
+
+// result is the outcome of replaying a single call.
+type result struct {
+	call     *call
+	replayed bool
+	rv       uint
+	elapsed  time.Duration
+}
+
+// replayer replays a trace against a single PKCS #11 library.
+type replayer struct {
+	ctx     *pkcs11.Ctx
+	speed   float64
+	handles *handleMap
+}
+
+func rvOf(err error) uint {
+	var p11err pkcs11.Error
+	if errors.As(err, &p11err) {
+		return uint(p11err)
+	}
+	if err != nil {
+		return pkcs11.CKR_GENERAL_ERROR
+	}
+	return pkcs11.CKR_OK
+}
+
+// placeholder returns a zeroed buffer in place of caller data, which is never
+// included in a trace.
+func placeholder(a arg) []byte {
+	return make([]byte, a.value)
+}
+
+// mechanism rebuilds a recorded mechanism. Mechanism parameters are not
+// recorded, so common defaults are substituted.
+func mechanism(a arg) []*pkcs11.Mechanism {
+	var params interface{}
+	if a.paramLen > 0 {
+		switch a.value {
+		case pkcs11.CKM_RSA_PKCS_PSS:
+			params = pkcs11.NewPSSParams(pkcs11.CKM_SHA256, pkcs11.CKG_MGF1_SHA256, 32)
+		case pkcs11.CKM_RSA_PKCS_OAEP:
+			params = pkcs11.NewOAEPParams(pkcs11.CKM_SHA256, pkcs11.CKG_MGF1_SHA256, pkcs11.CKZ_DATA_SPECIFIED, nil)
+		case pkcs11.CKM_AES_GCM:
+			params = pkcs11.NewGCMParams(make([]byte, 12), nil, 128)
+		default:
+			params = make([]byte, a.paramLen)
+		}
+	}
+	return []*pkcs11.Mechanism{pkcs11.NewMechanism(a.value, params)}
+}
+
+// attributes builds a template from recorded attributes. Attributes whose
+// values were not recorded are left out, so a replayed search may match more
+// objects than the recorded one did.
+func attributes(attrs []attribute) []*pkcs11.Attribute {
+	var result []*pkcs11.Attribute
+	for _, a := range attrs {
+		if a.redacted {
+			continue
+		}
+		result = append(result, pkcs11.NewAttribute(a.typ, a.value))
+	}
+	return result
+}
+
+// prepare translates a recorded call into a function that makes the same call
+// against the library under replay. It returns false if the call cannot or
+// should not be replayed.
+func (r *replayer) prepare(c *call) (func() error, bool) {
+	var sh pkcs11.SessionHandle
+	if s := c.arg("hSession"); s.kind == kindValue {
+		live, ok := r.handles.get(sessionHandle, s.value)
+		if !ok {
+			return nil, false
+		}
+		sh = pkcs11.SessionHandle(live)
+	}
+	object := func(name string) (pkcs11.ObjectHandle, bool) {
+		live, ok := r.handles.get(objectHandle, c.arg(name).value)
+		return pkcs11.ObjectHandle(live), ok
+	}
+	// Calls that only query the length of an output buffer are issued
+	// internally by the Go wrapper, so they are not replayed separately.
+	isSizeQuery := func(name string) bool { return c.arg(name).kind == kindNull }
+
+	switch c.fn.GetName() {
+	case "C_GetInfo":
+		return func() error { _, err := r.ctx.GetInfo(); return err }, true
+	case "C_GetSlotList":
+		if isSizeQuery("pSlotList") {
+			return nil, false
+		}
+		present := c.arg("tokenPresent").value != 0
+		return func() error { _, err := r.ctx.GetSlotList(present); return err }, true
+	case "C_GetSlotInfo":
+		slot := c.arg("slotID").value
+		return func() error { _, err := r.ctx.GetSlotInfo(slot); return err }, true
+	case "C_GetTokenInfo":
+		slot := c.arg("slotID").value
+		return func() error { _, err := r.ctx.GetTokenInfo(slot); return err }, true
+	case "C_GetMechanismList":
+		if isSizeQuery("pMechanismList") {
+			return nil, false
+		}
+		slot := c.arg("slotID").value
+		return func() error { _, err := r.ctx.GetMechanismList(slot); return err }, true
+	case "C_GetMechanismInfo":
+		slot := c.arg("slotID").value
+		m := []*pkcs11.Mechanism{pkcs11.NewMechanism(c.arg("type").value, nil)}
+		return func() error { _, err := r.ctx.GetMechanismInfo(slot, m); return err }, true
+	case "C_OpenSession":
+		slot, flags, out := c.arg("slotID").value, c.arg("flags").value, c.arg("phSession")
+		return func() error {
+			s, err := r.ctx.OpenSession(slot, flags)
+			if err == nil && out.kind == kindOutput {
+				r.handles.put(sessionHandle, out.value, uint(s))
+			}
+			return err
+		}, true
+	case "C_CloseSession":
+		return func() error { return r.ctx.CloseSession(sh) }, true
+	case "C_GetSessionInfo":
+		return func() error { _, err := r.ctx.GetSessionInfo(sh); return err }, true
+	case "C_Login":
+		userType := c.arg("userType").value
+		return func() error { return r.ctx.Login(sh, userType, "") }, true
+	case "C_Logout":
+		return func() error { return r.ctx.Logout(sh) }, true
+	case "C_FindObjectsInit":
+		var tmpl []*pkcs11.Attribute
+		if t, ok := c.extra(kindTemplate); ok {
+			tmpl = attributes(t.attrs)
+		}
+		return func() error { return r.ctx.FindObjectsInit(sh, tmpl) }, true
+	case "C_FindObjects":
+		maxCount := int(c.arg("ulMaxObjectCount").value)
+		var recorded []uint
+		if h, ok := c.extra(kindHandles); ok {
+			recorded = h.handles
+		}
+		return func() error {
+			found, _, err := r.ctx.FindObjects(sh, maxCount)
+			// Object handles are correlated by their position in the results.
+			for i := 0; i < len(found) && i < len(recorded); i++ {
+				r.handles.put(objectHandle, recorded[i], uint(found[i]))
+			}
+			return err
+		}, true
+	case "C_FindObjectsFinal":
+		return func() error { return r.ctx.FindObjectsFinal(sh) }, true
+	case "C_GetAttributeValue":
+		o, ok := object("hObject")
+		if !ok {
+			return nil, false
+		}
+		var tmpl []*pkcs11.Attribute
+		if t, ok := c.extra(kindAttributeTypes); ok {
+			tmpl = attributes(t.attrs)
+		}
+		return func() error { _, err := r.ctx.GetAttributeValue(sh, o, tmpl); return err }, true
+	case "C_SignInit", "C_VerifyInit", "C_EncryptInit", "C_DecryptInit":
+		o, ok := object("hKey")
+		if !ok {
+			return nil, false
+		}
+		m := mechanism(c.arg("pMechanism"))
+		switch c.fn.GetName() {
+		case "C_SignInit":
+			return func() error { return r.ctx.SignInit(sh, m, o) }, true
+		case "C_VerifyInit":
+			return func() error { return r.ctx.VerifyInit(sh, m, o) }, true
+		case "C_EncryptInit":
+			return func() error { return r.ctx.EncryptInit(sh, m, o) }, true
+		default:
+			return func() error { return r.ctx.DecryptInit(sh, m, o) }, true
+		}
+	case "C_Sign":
+		if isSizeQuery("pSignature") {
+			return nil, false
+		}
+		data := placeholder(c.arg("ulDataLen"))
+		return func() error { _, err := r.ctx.Sign(sh, data); return err }, true
+	case "C_SignUpdate":
+		data := placeholder(c.arg("ulPartLen"))
+		return func() error { return r.ctx.SignUpdate(sh, data) }, true
+	case "C_SignFinal":
+		if isSizeQuery("pSignature") {
+			return nil, false
+		}
+		return func() error { _, err := r.ctx.SignFinal(sh); return err }, true
+	case "C_Verify":
+		data := placeholder(c.arg("ulDataLen"))
+		sig := placeholder(c.arg("ulSignatureLen"))
+		return func() error { return r.ctx.Verify(sh, data, sig) }, true
+	case "C_VerifyUpdate":
+		data := placeholder(c.arg("ulPartLen"))
+		return func() error { return r.ctx.VerifyUpdate(sh, data) }, true
+	case "C_VerifyFinal":
+		sig := placeholder(c.arg("ulSignatureLen"))
+		return func() error { return r.ctx.VerifyFinal(sh, sig) }, true
+	case "C_Encrypt":
+		if isSizeQuery("pEncryptedData") {
+			return nil, false
+		}
+		data := placeholder(c.arg("ulDataLen"))
+		return func() error { _, err := r.ctx.Encrypt(sh, data); return err }, true
+	case "C_Decrypt":
+		if isSizeQuery("pData") {
+			return nil, false
+		}
+		data := placeholder(c.arg("ulEncryptedDataLen"))
+		return func() error { _, err := r.ctx.Decrypt(sh, data); return err }, true
+	case "C_GenerateRandom":
+		n := int(c.arg("ulRandomLen").value)
+		return func() error { _, err := r.ctx.GenerateRandom(sh, n); return err }, true
+	}
+	// Everything else, including C_Initialize and C_Finalize (which the
+	// replayer issues itself) and calls that create or destroy keys, is
+	// skipped.
+	return nil, false
+}
+
+// replay replays the provided calls, preserving per-thread ordering and, unless
+// speed is zero, the recorded pacing scaled by speed.
+func (r *replayer) replay(calls []*call) []result {
+	byThread := make(map[uint64][]int)
+	var threads []uint64
+	for i, c := range calls {
+		if _, ok := byThread[c.thread]; !ok {
+			threads = append(threads, c.thread)
+		}
+		byThread[c.thread] = append(byThread[c.thread], i)
+	}
+
+	results := make([]result, len(calls))
+	begin := time.Now()
+	var wg sync.WaitGroup
+	for _, t := range threads {
+		wg.Add(1)
+		go func(indexes []int) {
+			defer wg.Done()
+			for _, i := range indexes {
+				c := calls[i]
+				if r.speed > 0 {
+					due := begin.Add(time.Duration(float64(c.start) / r.speed))
+					time.Sleep(time.Until(due))
+				}
+				results[i].call = c
+				op, ok := r.prepare(c)
+				if !ok {
+					continue
+				}
+				start := time.Now()
+				err := op()
+				results[i].elapsed = time.Since(start)
+				results[i].rv = rvOf(err)
+				results[i].replayed = true
+			}
+		}(byThread[t])
+	}
+	wg.Wait()
+	return results
+}
+
+// replayLibrary loads the library at libPath and replays the trace against it.
+func replayLibrary(libPath string, calls []*call, speed float64) ([]result, error) {
+	ctx := pkcs11.New(libPath)
+	if ctx == nil {
+		return nil, errors.New("unable to load library " + libPath)
+	}
+	defer ctx.Destroy()
+
+	if err := ctx.Initialize(); err != nil {
+		return nil, err
+	}
+	defer ctx.Finalize()
+
+	r := &replayer{
+		ctx:     ctx,
+		speed:   speed,
+		handles: &handleMap{m: make(map[handleKey]uint)},
+	}
+	return r.replay(calls), nil
+}
@@ -0,0 +1,249 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"time"
+
+	"cloud.google.com/kms/integrations/kmsp11/tools/p11fn/p11fnpb"
+	"github.com/miekg/pkcs11"
+)
+
+// traceMagic must match kCallTraceMagic in kmsp11/util/call_trace.h.
+const traceMagic = "KP11TRC1"
+
+// argKind must match CallTraceArgKind in kmsp11/util/call_trace.h.
+type argKind byte
+
+const (
+	kindValue argKind = iota
+	kindNull
+	kindBuffer
+	kindOutput
+	kindMechanism
+	kindHandles
+	kindTemplate
+	kindAttributeTypes
+)
+
+type attribute struct {
+	typ   uint
+	value []byte
+	// Set for template attributes whose value was not recorded, such as
+	// CKA_LABEL or CKA_ID. Only the length of their value is known.
+	redacted bool
+}
+
+// arg is a decoded call argument or extra.
+type arg struct {
+	kind argKind
+	// The scalar for kindValue and kindOutput, or the mechanism type for
+	// kindMechanism.
+	value    uint
+	paramLen uint
+	handles  []uint
+	// The template for kindTemplate, or the requested types (with nil values)
+	// for kindAttributeTypes.
+	attrs []attribute
+}
+
+// call is a single recorded Cryptoki call.
+type call struct {
+	fn       *p11fnpb.CkFunc
+	thread   uint64
+	start    time.Duration
+	duration time.Duration
+	rv       uint
+	args     []arg
+	extras   []arg
+}
+
+// arg returns the positional argument with the provided name.
+func (c *call) arg(name string) arg {
+	for i, a := range c.fn.GetArgs() {
+		if a.GetName() == name && i < len(c.args) {
+			return c.args[i]
+		}
+	}
+	return arg{kind: kindNull}
+}
+
+// extra returns the first extra of the provided kind.
+func (c *call) extra(kind argKind) (arg, bool) {
+	for _, e := range c.extras {
+		if e.kind == kind {
+			return e, true
+		}
+	}
+	return arg{}, false
+}
+
+type byteReader interface {
+	io.Reader
+	io.ByteReader
+}
+
+func readUvarint(r io.ByteReader) (uint, error) {
+	v, err := binary.ReadUvarint(r)
+	return uint(v), err
+}
+
+func readArg(r byteReader) (arg, error) {
+	k, err := r.ReadByte()
+	if err != nil {
+		return arg{}, err
+	}
+	a := arg{kind: argKind(k)}
+	switch a.kind {
+	case kindNull, kindBuffer:
+	case kindValue, kindOutput:
+		a.value, err = readUvarint(r)
+	case kindMechanism:
+		if a.value, err = readUvarint(r); err == nil {
+			a.paramLen, err = readUvarint(r)
+		}
+	case kindHandles:
+		var n uint
+		if n, err = readUvarint(r); err != nil {
+			return arg{}, err
+		}
+		for i := uint(0); i < n && err == nil; i++ {
+			var h uint
+			h, err = readUvarint(r)
+			a.handles = append(a.handles, h)
+		}
+	case kindTemplate, kindAttributeTypes:
+		var n uint
+		if n, err = readUvarint(r); err != nil {
+			return arg{}, err
+		}
+		for i := uint(0); i < n && err == nil; i++ {
+			var at attribute
+			if at.typ, err = readUvarint(r); err != nil {
+				break
+			}
+			if a.kind == kindTemplate {
+				at, err = readTemplateValue(r, at.typ)
+			}
+			a.attrs = append(a.attrs, at)
+		}
+	default:
+		return arg{}, fmt.Errorf("unknown argument kind %d", k)
+	}
+	return a, err
+}
+
+// readTemplateValue reads the length and, if it was recorded, the value of a
+// template attribute. Recorded values are enumerations (CK_ULONG) or booleans
+// (CK_BBOOL), and are re-encoded in their native representation.
+func readTemplateValue(r byteReader, typ uint) (attribute, error) {
+	at := attribute{typ: typ}
+	l, err := readUvarint(r)
+	if err != nil {
+		return at, err
+	}
+	recorded, err := readUvarint(r)
+	if err != nil {
+		return at, err
+	}
+	if recorded == 0 {
+		at.redacted = true
+		return at, nil
+	}
+	v, err := readUvarint(r)
+	if err != nil {
+		return at, err
+	}
+	if l == 1 {
+		at.value = []byte{byte(v)}
+	} else {
+		at.value = pkcs11.NewAttribute(typ, v).Value
+	}
+	return at, nil
+}
+
+func parseCall(record []byte, funcs *p11fnpb.CkFuncList) (*call, error) {
+	r := bytes.NewReader(record)
+	var fields [7]uint
+	for i := range fields {
+		v, err := readUvarint(r)
+		if err != nil {
+			return nil, fmt.Errorf("error reading record header: %w", err)
+		}
+		fields[i] = v
+	}
+	if fields[0] >= uint(len(funcs.GetFunctions())) {
+		return nil, fmt.Errorf("unknown function ID %d", fields[0])
+	}
+
+	c := &call{
+		fn:       funcs.GetFunctions()[fields[0]],
+		thread:   uint64(fields[1]),
+		start:    time.Duration(fields[2]),
+		duration: time.Duration(fields[3]),
+		rv:       fields[4],
+	}
+	for i := uint(0); i < fields[5]+fields[6]; i++ {
+		a, err := readArg(r)
+		if err != nil {
+			return nil, fmt.Errorf("error reading argument %d of %s: %w", i, c.fn.GetName(), err)
+		}
+		if i < fields[5] {
+			c.args = append(c.args, a)
+		} else {
+			c.extras = append(c.extras, a)
+		}
+	}
+	return c, nil
+}
+
+// readTrace decodes all of the calls in a trace file.
+func readTrace(in io.Reader, funcs *p11fnpb.CkFuncList) ([]*call, error) {
+	r := bufio.NewReader(in)
+	magic := make([]byte, len(traceMagic))
+	if _, err := io.ReadFull(r, magic); err != nil || string(magic) != traceMagic {
+		return nil, errors.New("input is not a call trace")
+	}
+
+	var calls []*call
+	for {
+		l, err := binary.ReadUvarint(r)
+		if err == io.EOF {
+			return calls, nil
+		}
+		if err != nil {
+			return nil, fmt.Errorf("error reading record length: %w", err)
+		}
+		record := make([]byte, l)
+		if _, err := io.ReadFull(r, record); err != nil {
+			// A process that exits abnormally may leave a truncated final record.
+			if errors.Is(err, io.ErrUnexpectedEOF) {
+				return calls, nil
+			}
+			return nil, err
+		}
+		c, err := parseCall(record, funcs)
+		if err != nil {
+			return nil, fmt.Errorf("record %d: %w", len(calls), err)
+		}
+		calls = append(calls, c)
+	}
+}
@@ -0,0 +1,133 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"testing"
+	"time"
+
+	"cloud.google.com/kms/integrations/kmsp11/tools/p11fn/p11fnpb"
+	"github.com/miekg/pkcs11"
+)
+
+var testFuncs = &p11fnpb.CkFuncList{
+	Functions: []*p11fnpb.CkFunc{
+		{Name: "C_GetInfo", Args: []*p11fnpb.CkArg{{Name: "pInfo"}}},
+		{Name: "C_FindObjects", Args: []*p11fnpb.CkArg{
+			{Name: "hSession"}, {Name: "phObject"},
+			{Name: "ulMaxObjectCount"}, {Name: "pulObjectCount"}}},
+	},
+}
+
+func uvarints(values ...uint64) []byte {
+	var b []byte
+	for _, v := range values {
+		b = binary.AppendUvarint(b, v)
+	}
+	return b
+}
+
+func encodeTrace(records ...[]byte) []byte {
+	b := []byte(traceMagic)
+	for _, r := range records {
+		b = append(b, uvarints(uint64(len(r)))...)
+		b = append(b, r...)
+	}
+	return b
+}
+
+func TestReadTraceDecodesCalls(t *testing.T) {
+	findObjects := uvarints(1, 3, 1000, 250, 0, 4, 1,
+		uint64(kindValue), 7,
+		uint64(kindBuffer),
+		uint64(kindValue), 10,
+		uint64(kindOutput), 2,
+		uint64(kindHandles), 2, 300, 301)
+
+	calls, err := readTrace(bytes.NewReader(encodeTrace(findObjects)), testFuncs)
+	if err != nil {
+		t.Fatalf("readTrace() = %v", err)
+	}
+	if len(calls) != 1 {
+		t.Fatalf("len(calls) = %d, want 1", len(calls))
+	}
+
+	c := calls[0]
+	if c.fn.GetName() != "C_FindObjects" || c.thread != 3 ||
+		c.start != 1000*time.Nanosecond || c.duration != 250*time.Nanosecond {
+		t.Errorf("unexpected call header: %+v", c)
+	}
+	if got := c.arg("hSession"); got.kind != kindValue || got.value != 7 {
+		t.Errorf("hSession = %+v, want value 7", got)
+	}
+	if got := c.arg("pulObjectCount"); got.kind != kindOutput || got.value != 2 {
+		t.Errorf("pulObjectCount = %+v, want output 2", got)
+	}
+	h, ok := c.extra(kindHandles)
+	if !ok || len(h.handles) != 2 || h.handles[0] != 300 || h.handles[1] != 301 {
+		t.Errorf("handles = %+v, want [300 301]", h)
+	}
+}
+
+func TestReadArgDecodesTemplate(t *testing.T) {
+	b := uvarints(uint64(kindTemplate), 2,
+		pkcs11.CKA_SIGN, 1, 1, 1,
+		pkcs11.CKA_LABEL, 6, 0)
+
+	a, err := readArg(bytes.NewReader(b))
+	if err != nil {
+		t.Fatalf("readArg() = %v", err)
+	}
+	if len(a.attrs) != 2 {
+		t.Fatalf("len(attrs) = %d, want 2", len(a.attrs))
+	}
+	if got := a.attrs[0]; got.redacted || !bytes.Equal(got.value, []byte{1}) {
+		t.Errorf("CKA_SIGN = %+v, want value [1]", got)
+	}
+	if got := a.attrs[1]; !got.redacted || got.value != nil {
+		t.Errorf("CKA_LABEL = %+v, want redacted", got)
+	}
+	if got := attributes(a.attrs); len(got) != 1 || got[0].Type != pkcs11.CKA_SIGN {
+		t.Errorf("attributes() = %+v, want only CKA_SIGN", got)
+	}
+}
+
+func TestReadTraceIgnoresTruncatedRecord(t *testing.T) {
+	getInfo := uvarints(0, 0, 0, 0, 0, 1, 0, uint64(kindBuffer))
+	b := encodeTrace(getInfo, getInfo)
+
+	calls, err := readTrace(bytes.NewReader(b[:len(b)-1]), testFuncs)
+	if err != nil {
+		t.Fatalf("readTrace() = %v", err)
+	}
+	if len(calls) != 1 {
+		t.Errorf("len(calls) = %d, want 1", len(calls))
+	}
+}
+
+func TestReadTraceRejectsBadMagic(t *testing.T) {
+	if _, err := readTrace(bytes.NewReader([]byte("not a trace")), testFuncs); err == nil {
+		t.Error("readTrace() succeeded, want error")
+	}
+}
+
+func TestReadTraceRejectsUnknownFunction(t *testing.T) {
+	b := encodeTrace(uvarints(99, 0, 0, 0, 0, 0, 0))
+	if _, err := readTrace(bytes.NewReader(b), testFuncs); err == nil {
+		t.Error("readTrace() succeeded, want error")
+	}
+}
@@ -0,0 +1,134 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// tracereplay replays a PKCS #11 call trace recorded by setting
+// KMS_PKCS11_CALL_TRACE against one or two PKCS #11 libraries, and reports
+// per-function latency for the recording and each replay.
+//
+// Traces contain call shapes, not payloads: data buffers are replayed as zeroed
+// buffers of the recorded length, so return values for calls like C_Verify and
+// C_Decrypt are expected to differ from the recording.
+package main
+
+import (
+	"flag"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"log"
+	"os"
+	"sort"
+	"text/tabwriter"
+	"time"
+
+	"google.golang.org/protobuf/encoding/prototext"
+
+	"cloud.google.com/kms/integrations/kmsp11/tools/p11fn/p11fnpb"
+)
+
+var (
+	funcListPath = flag.String("func_list_path", "", "path to function list proto")
+	tracePath    = flag.String("trace", "", "path to the recorded call trace")
+	libPath      = flag.String("lib", "", "path to the PKCS #11 library to replay against")
+	compareLib   = flag.String("compare_lib", "", "optional path to a second library to replay against")
+	speed        = flag.Float64("speed", 1, "pacing relative to the recording; 0 replays as fast as possible")
+)
+
+type latencies map[string][]time.Duration
+
+func percentile(d []time.Duration, p float64) time.Duration {
+	if len(d) == 0 {
+		return 0
+	}
+	return d[int(p*float64(len(d)-1))]
+}
+
+func printLatencies(w io.Writer, title string, l latencies) {
+	fmt.Fprintf(w, "\n%s\n", title)
+	tw := tabwriter.NewWriter(w, 0, 8, 2, ' ', 0)
+	fmt.Fprintln(tw, "function\tcount\tp50\tp90\tp99")
+	var names []string
+	for name := range l {
+		names = append(names, name)
+	}
+	sort.Strings(names)
+	for _, name := range names {
+		d := l[name]
+		sort.Slice(d, func(i, j int) bool { return d[i] < d[j] })
+		fmt.Fprintf(tw, "%s\t%d\t%v\t%v\t%v\n", name, len(d),
+			percentile(d, 0.5), percentile(d, 0.9), percentile(d, 0.99))
+	}
+	tw.Flush()
+}
+
+func report(w io.Writer, lib string, results []result) {
+	l := make(latencies)
+	mismatches := make(map[string]int)
+	skipped := 0
+	for _, r := range results {
+		if !r.replayed {
+			skipped++
+			continue
+		}
+		name := r.call.fn.GetName()
+		l[name] = append(l[name], r.elapsed)
+		if r.rv != r.call.rv {
+			mismatches[name]++
+		}
+	}
+	printLatencies(w, fmt.Sprintf("replayed against %s (%d calls skipped)", lib, skipped), l)
+	for name, n := range mismatches {
+		fmt.Fprintf(w, "%s: %d calls returned a different CK_RV than recorded\n", name, n)
+	}
+}
+
+func main() {
+	flag.Parse()
+
+	b, err := ioutil.ReadFile(*funcListPath)
+	if err != nil {
+		log.Fatalf("error reading function list: %+v", err)
+	}
+	funcs := new(p11fnpb.CkFuncList)
+	if err := prototext.Unmarshal(b, funcs); err != nil {
+		log.Fatalf("error parsing function list textproto: %+v", err)
+	}
+
+	f, err := os.Open(*tracePath)
+	if err != nil {
+		log.Fatalf("error opening trace: %+v", err)
+	}
+	calls, err := readTrace(f, funcs)
+	f.Close()
+	if err != nil {
+		log.Fatalf("error reading trace: %+v", err)
+	}
+
+	recorded := make(latencies)
+	for _, c := range calls {
+		recorded[c.fn.GetName()] = append(recorded[c.fn.GetName()], c.duration)
+	}
+	printLatencies(os.Stdout, fmt.Sprintf("recorded (%d calls)", len(calls)), recorded)
+
+	for _, lib := range []string{*libPath, *compareLib} {
+		if lib == "" {
+			continue
+		}
+		results, err := replayLibrary(lib, calls, *speed)
+		if err != nil {
+			log.Fatalf("error replaying against %s: %+v", lib, err)
+		}
+		report(os.Stdout, lib, results)
+	}
+}
@@ -0,0 +1,301 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/util/call_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+#include "glog/logging.h"
+#include "kmsp11/util/errors.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+void PutVarint(uint64_t value, std::string& out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+void PutKind(CallTraceArgKind kind, std::string& out) {
+  out.push_back(static_cast<char>(kind));
+}
+
+// Returns true if the value of a template attribute may be recorded. Only
+// enumerated and boolean attributes qualify; values such as labels, IDs and
+// key material are caller data, and are never recorded.
+bool IsRecordedTemplateValue(const CK_ATTRIBUTE& attr) {
+  if (!attr.pValue) {
+    return false;
+  }
+  switch (attr.type) {
+    case CKA_CLASS:
+    case CKA_KEY_TYPE:
+    case CKA_CERTIFICATE_TYPE:
+      return attr.ulValueLen == sizeof(CK_ULONG);
+    case CKA_TOKEN:
+    case CKA_PRIVATE:
+    case CKA_MODIFIABLE:
+    case CKA_SENSITIVE:
+    case CKA_EXTRACTABLE:
+    case CKA_ALWAYS_SENSITIVE:
+    case CKA_NEVER_EXTRACTABLE:
+    case CKA_LOCAL:
+    case CKA_ENCRYPT:
+    case CKA_DECRYPT:
+    case CKA_SIGN:
+    case CKA_VERIFY:
+    case CKA_WRAP:
+    case CKA_UNWRAP:
+    case CKA_DERIVE:
+      return attr.ulValueLen == sizeof(CK_BBOOL);
+    default:
+      return false;
+  }
+}
+
+// Returns a small, stable ordinal for the calling thread. Ordinals are cheaper
+// to encode than native thread IDs, and are all the replayer needs.
+uint64_t ThreadOrdinal() {
+  static std::atomic<uint64_t> next_ordinal(0);
+  thread_local const uint64_t ordinal = next_ordinal.fetch_add(1);
+  return ordinal;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<CallTraceWriter>> CallTraceWriter::New(
+    const std::string& path) {
+  std::FILE* file = std::fopen(path.c_str(), "wb");
+  if (!file) {
+    return NewInternalError(
+        absl::StrFormat("unable to open call trace file %s", path),
+        SOURCE_LOCATION);
+  }
+  if (std::fwrite(kCallTraceMagic.data(), 1, kCallTraceMagic.size(), file) !=
+      kCallTraceMagic.size()) {
+    std::fclose(file);
+    return NewInternalError(
+        absl::StrFormat("unable to write call trace file %s", path),
+        SOURCE_LOCATION);
+  }
+  return absl::WrapUnique(new CallTraceWriter(file));
+}
+
+CallTraceWriter::~CallTraceWriter() {
+  absl::MutexLock lock(&mutex_);
+  std::fclose(file_);
+}
+
+uint64_t CallTraceWriter::ElapsedNanos() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start_)
+      .count();
+}
+
+void CallTraceWriter::Append(std::string_view record) {
+  std::string length;
+  PutVarint(record.size(), length);
+
+  absl::MutexLock lock(&mutex_);
+  std::fwrite(length.data(), 1, length.size(), file_);
+  std::fwrite(record.data(), 1, record.size(), file_);
+}
+
+void CallTraceWriter::Flush() {
+  absl::MutexLock lock(&mutex_);
+  std::fflush(file_);
+}
+
+CallTraceWriter* GetCallTraceWriter() {
+  static CallTraceWriter* const writer = []() -> CallTraceWriter* {
+    const char* path = std::getenv(kCallTraceEnvVariable);
+    if (!path || !*path) {
+      return nullptr;
+    }
+    absl::StatusOr<std::unique_ptr<CallTraceWriter>> w =
+        CallTraceWriter::New(path);
+    if (!w.ok()) {
+      LOG(ERROR) << "call tracing is disabled: " << w.status();
+      return nullptr;
+    }
+    // Buffered records are written when the process exits, even if the
+    // application never calls C_Finalize.
+    std::atexit([] { GetCallTraceWriter()->Flush(); });
+    return w->release();
+  }();
+  return writer;
+}
+
+CallTrace::CallTrace(uint32_t function_id, CallTraceWriter* writer)
+    : function_id_(function_id), writer_(writer) {
+  if (writer_) {
+    start_ns_ = writer_->ElapsedNanos();
+  }
+}
+
+void CallTrace::AddArg(CK_ULONG value) {
+  if (writer_) {
+    args_.push_back({CallTraceArgKind::kValue, value, nullptr, nullptr});
+  }
+}
+
+void CallTrace::AddArg(CK_MECHANISM_PTR mechanism) {
+  if (writer_) {
+    args_.push_back(
+        {mechanism ? CallTraceArgKind::kMechanism : CallTraceArgKind::kNull, 0,
+         mechanism, nullptr});
+  }
+}
+
+void CallTrace::AddArg(CK_NOTIFY notify) {
+  if (writer_) {
+    args_.push_back(
+        {notify ? CallTraceArgKind::kBuffer : CallTraceArgKind::kNull, 0,
+         nullptr, nullptr});
+  }
+}
+
+void CallTrace::AddArg(const void* buffer) {
+  if (writer_) {
+    args_.push_back(
+        {buffer ? CallTraceArgKind::kBuffer : CallTraceArgKind::kNull, 0,
+         nullptr, nullptr});
+  }
+}
+
+void CallTrace::AddOutput(CK_ULONG_PTR output) {
+  if (writer_) {
+    args_.push_back(
+        {output ? CallTraceArgKind::kOutput : CallTraceArgKind::kNull, 0,
+         output, nullptr});
+  }
+}
+
+void CallTrace::AddHandles(CK_OBJECT_HANDLE_PTR handles, CK_ULONG max_count,
+                           CK_ULONG_PTR count) {
+  if (writer_ && handles && count) {
+    extras_.push_back({CallTraceArgKind::kHandles, max_count, handles, count});
+  }
+}
+
+void CallTrace::AddTemplate(CK_ATTRIBUTE_PTR attributes, CK_ULONG count) {
+  if (writer_ && attributes) {
+    extras_.push_back(
+        {CallTraceArgKind::kTemplate, count, attributes, nullptr});
+  }
+}
+
+void CallTrace::AddAttributeTypes(CK_ATTRIBUTE_PTR attributes,
+                                  CK_ULONG count) {
+  if (writer_ && attributes) {
+    extras_.push_back(
+        {CallTraceArgKind::kAttributeTypes, count, attributes, nullptr});
+  }
+}
+
+void CallTrace::EncodeArg(const Arg& arg, CK_RV rv, std::string& out) const {
+  PutKind(arg.kind, out);
+  switch (arg.kind) {
+    case CallTraceArgKind::kNull:
+    case CallTraceArgKind::kBuffer:
+      return;
+    case CallTraceArgKind::kValue:
+      PutVarint(arg.value, out);
+      return;
+    case CallTraceArgKind::kOutput: {
+      // Output values are only meaningful if the library wrote them. Lengths
+      // are also written when the caller's buffer is too small.
+      bool written = rv == CKR_OK || rv == CKR_BUFFER_TOO_SMALL;
+      PutVarint(written ? *static_cast<const CK_ULONG*>(arg.ptr) : 0, out);
+      return;
+    }
+    case CallTraceArgKind::kMechanism: {
+      auto* mechanism = static_cast<const CK_MECHANISM*>(arg.ptr);
+      PutVarint(mechanism->mechanism, out);
+      PutVarint(mechanism->ulParameterLen, out);
+      return;
+    }
+    case CallTraceArgKind::kHandles: {
+      CK_ULONG count = rv == CKR_OK ? std::min(*arg.count, arg.value) : 0;
+      auto* handles = static_cast<const CK_OBJECT_HANDLE*>(arg.ptr);
+      PutVarint(count, out);
+      for (CK_ULONG i = 0; i < count; i++) {
+        PutVarint(handles[i], out);
+      }
+      return;
+    }
+    case CallTraceArgKind::kTemplate: {
+      auto* attrs = static_cast<const CK_ATTRIBUTE*>(arg.ptr);
+      PutVarint(arg.value, out);
+      for (CK_ULONG i = 0; i < arg.value; i++) {
+        PutVarint(attrs[i].type, out);
+        PutVarint(attrs[i].pValue ? attrs[i].ulValueLen : 0, out);
+        if (!IsRecordedTemplateValue(attrs[i])) {
+          PutVarint(0, out);
+          continue;
+        }
+        PutVarint(1, out);
+        if (attrs[i].ulValueLen == sizeof(CK_BBOOL)) {
+          PutVarint(*static_cast<const CK_BBOOL*>(attrs[i].pValue), out);
+        } else {
+          PutVarint(*static_cast<const CK_ULONG*>(attrs[i].pValue), out);
+        }
+      }
+      return;
+    }
+    case CallTraceArgKind::kAttributeTypes: {
+      auto* attrs = static_cast<const CK_ATTRIBUTE*>(arg.ptr);
+      PutVarint(arg.value, out);
+      for (CK_ULONG i = 0; i < arg.value; i++) {
+        PutVarint(attrs[i].type, out);
+      }
+      return;
+    }
+  }
+}
+
+CK_RV CallTrace::Finish(CK_RV rv) {
+  if (!writer_) {
+    return rv;
+  }
+  uint64_t end_ns = writer_->ElapsedNanos();
+
+  std::string record;
+  record.reserve(64);
+  PutVarint(function_id_, record);
+  PutVarint(ThreadOrdinal(), record);
+  PutVarint(start_ns_, record);
+  PutVarint(end_ns - start_ns_, record);
+  PutVarint(rv, record);
+  PutVarint(args_.size(), record);
+  PutVarint(extras_.size(), record);
+  for (const Arg& arg : args_) {
+    EncodeArg(arg, rv, record);
+  }
+  for (const Arg& extra : extras_) {
+    EncodeArg(extra, rv, record);
+  }
+
+  writer_->Append(record);
+  return rv;
+}
+
+}  // namespace cloud_kms::kmsp11
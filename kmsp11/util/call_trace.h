@@ -0,0 +1,161 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KMSP11_UTIL_CALL_TRACE_H_
+#define KMSP11_UTIL_CALL_TRACE_H_
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "absl/container/inlined_vector.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "kmsp11/cryptoki.h"
+
+namespace cloud_kms::kmsp11 {
+
+// When this environment variable names a file, every Cryptoki call made
+// through the library's exported entry points is appended to that file as a
+// call trace record. See kmsp11/tools/tracereplay for a consumer.
+const char* const kCallTraceEnvVariable = "KMS_PKCS11_CALL_TRACE";
+
+// The first bytes of every trace file.
+inline constexpr std::string_view kCallTraceMagic = "KP11TRC1";
+
+// The kinds of values that may appear in a call trace record. The numeric
+// values are part of the trace file format and must not be changed.
+//
+// A trace never contains caller payloads (data, signatures, plaintext,
+// ciphertext or PINs). Pointers to caller buffers are recorded as present or
+// absent; lengths are recorded as scalars.
+enum class CallTraceArgKind : uint8_t {
+  // A scalar argument, such as a handle, flag or length. One varint follows.
+  kValue = 0,
+  // A null pointer. Nothing follows.
+  kNull = 1,
+  // A non-null pointer to caller-owned memory. Nothing follows.
+  kBuffer = 2,
+  // A non-null pointer to a single CK_ULONG written by the library. One varint
+  // follows: the value on return, or 0 if the call failed.
+  kOutput = 3,
+  // A non-null CK_MECHANISM_PTR. Two varints follow: the mechanism type and
+  // the parameter length.
+  kMechanism = 4,
+  // The handles written by C_FindObjects. A varint count follows, then that
+  // many varint handles.
+  kHandles = 5,
+  // A C_FindObjectsInit template. A varint count follows, then for each
+  // attribute a varint type, a varint length and a varint flag. If the flag is
+  // 1, the value follows as a varint; this is only done for enumerated and
+  // boolean attributes such as CKA_CLASS, CKA_KEY_TYPE or CKA_SIGN. The values
+  // of all other attributes (e.g. CKA_LABEL, CKA_ID or CKA_VALUE) are never
+  // recorded, and their flag is 0.
+  kTemplate = 6,
+  // The attribute types requested in C_GetAttributeValue. A varint count
+  // follows, then that many varint types.
+  kAttributeTypes = 7,
+};
+
+// CallTraceWriter appends encoded call records to a trace file. It is safe for
+// concurrent use.
+//
+// The file starts with kCallTraceMagic. Each record that follows is a varint
+// byte length and then, all as varints: the function's index in
+// kmsp11/tools/p11fn/function_defs.textproto, a per-thread ordinal, the start
+// time and duration in nanoseconds relative to the creation of the writer, the
+// CK_RV, the count of positional arguments and the count of extras. Each
+// argument and extra is a CallTraceArgKind byte followed by its payload.
+class CallTraceWriter {
+ public:
+  static absl::StatusOr<std::unique_ptr<CallTraceWriter>> New(
+      const std::string& path);
+
+  ~CallTraceWriter();
+
+  // Returns the number of nanoseconds elapsed since the writer was created.
+  uint64_t ElapsedNanos() const;
+
+  void Append(std::string_view record);
+  void Flush();
+
+ private:
+  CallTraceWriter(std::FILE* file)
+      : start_(std::chrono::steady_clock::now()), file_(file) {}
+
+  const std::chrono::steady_clock::time_point start_;
+  absl::Mutex mutex_;
+  std::FILE* file_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Returns the process-wide trace writer, or nullptr if tracing is disabled.
+// The writer is created on first use if kCallTraceEnvVariable is set.
+CallTraceWriter* GetCallTraceWriter();
+
+// CallTrace captures a single Cryptoki call. All of its methods are no-ops
+// when it is constructed without a writer, so that the exported entry points
+// pay only for a null check when tracing is disabled.
+//
+// Pointer arguments are retained until Finish, so that values written by the
+// library can be recorded once the call has returned.
+class CallTrace {
+ public:
+  CallTrace(uint32_t function_id, CallTraceWriter* writer);
+  explicit CallTrace(uint32_t function_id)
+      : CallTrace(function_id, GetCallTraceWriter()) {}
+
+  void AddArg(CK_ULONG value);
+  void AddArg(CK_MECHANISM_PTR mechanism);
+  void AddArg(CK_NOTIFY notify);
+  void AddArg(const void* buffer);
+
+  // Records a pointer to a single CK_ULONG that the library writes.
+  void AddOutput(CK_ULONG_PTR output);
+
+  // Records the handles that C_FindObjects wrote into `handles`.
+  void AddHandles(CK_OBJECT_HANDLE_PTR handles, CK_ULONG max_count,
+                  CK_ULONG_PTR count);
+  // Records the attribute types and lengths of a C_FindObjectsInit template,
+  // and the values of its enumerated and boolean attributes.
+  void AddTemplate(CK_ATTRIBUTE_PTR attributes, CK_ULONG count);
+  // Records the attribute types of a C_GetAttributeValue template.
+  void AddAttributeTypes(CK_ATTRIBUTE_PTR attributes, CK_ULONG count);
+
+  // Writes the record for this call and returns `rv` unchanged.
+  CK_RV Finish(CK_RV rv);
+
+ private:
+  struct Arg {
+    CallTraceArgKind kind;
+    CK_ULONG value;
+    const void* ptr;
+    CK_ULONG_PTR count;
+  };
+
+  void EncodeArg(const Arg& arg, CK_RV rv, std::string& out) const;
+
+  const uint32_t function_id_;
+  CallTraceWriter* const writer_;
+  uint64_t start_ns_ = 0;
+  absl::InlinedVector<Arg, 6> args_;
+  absl::InlinedVector<Arg, 1> extras_;
+};
+
+}  // namespace cloud_kms::kmsp11
+
+#endif  // KMSP11_UTIL_CALL_TRACE_H_
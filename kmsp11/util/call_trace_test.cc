@@ -0,0 +1,178 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/util/call_trace.h"
+
+#include <cstdio>
+
+#include "common/string_utils.h"
+#include "common/test/test_status_macros.h"
+#include "gmock/gmock.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+using ::testing::Not;
+using ::testing::StartsWith;
+
+// Decodes the varints and kind bytes in `data` for easy comparison. Kind
+// bytes are always smaller than 0x80, so they decode as one-byte varints.
+std::vector<uint64_t> DecodeVarints(std::string_view data) {
+  std::vector<uint64_t> values;
+  uint64_t value = 0;
+  int shift = 0;
+  for (char c : data) {
+    value |= static_cast<uint64_t>(c & 0x7F) << shift;
+    shift += 7;
+    if (!(c & 0x80)) {
+      values.push_back(value);
+      value = 0;
+      shift = 0;
+    }
+  }
+  return values;
+}
+
+class CallTraceTest : public testing::Test {
+ protected:
+  CallTraceTest() : trace_path_(std::tmpnam(nullptr)) {}
+  ~CallTraceTest() { std::remove(trace_path_.c_str()); }
+
+  std::string trace_path_;
+};
+
+TEST_F(CallTraceTest, NewFileBeginsWithMagic) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<CallTraceWriter> writer,
+                       CallTraceWriter::New(trace_path_));
+  writer->Flush();
+
+  ASSERT_OK_AND_ASSIGN(std::string contents, ReadFileToString(trace_path_));
+  EXPECT_EQ(contents, kCallTraceMagic);
+}
+
+TEST_F(CallTraceTest, NewInvalidPathFails) {
+  EXPECT_FALSE(CallTraceWriter::New("/nonexistent/dir/trace").ok());
+}
+
+TEST_F(CallTraceTest, FinishWithoutWriterReturnsRv) {
+  CallTrace trace(3, nullptr);
+  trace.AddArg(CK_ULONG{5});
+  EXPECT_EQ(trace.Finish(CKR_SLOT_ID_INVALID), CKR_SLOT_ID_INVALID);
+}
+
+TEST_F(CallTraceTest, RecordContainsScalarsAndOutputs) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<CallTraceWriter> writer,
+                       CallTraceWriter::New(trace_path_));
+
+  CK_MECHANISM mech{CKM_RSA_PKCS, nullptr, 0};
+  uint8_t data[4];
+  CK_ULONG data_len = 0;
+  CallTrace trace(42, writer.get());
+  trace.AddArg(CK_ULONG{7});
+  trace.AddArg(&mech);
+  trace.AddArg(static_cast<const void*>(data));
+  trace.AddArg(static_cast<const void*>(nullptr));
+  trace.AddOutput(&data_len);
+  data_len = 300;  // written by the "library" before Finish
+  EXPECT_EQ(trace.Finish(CKR_OK), CKR_OK);
+  writer->Flush();
+
+  ASSERT_OK_AND_ASSIGN(std::string contents, ReadFileToString(trace_path_));
+  ASSERT_THAT(contents, StartsWith(kCallTraceMagic));
+  std::vector<uint64_t> values =
+      DecodeVarints(std::string_view(contents).substr(kCallTraceMagic.size()));
+
+  // Length, function ID, thread ordinal, start, duration.
+  ASSERT_GE(values.size(), 5);
+  EXPECT_EQ(values[1], 42);
+  EXPECT_THAT(
+      std::vector<uint64_t>(values.begin() + 5, values.end()),
+      ElementsAre(CKR_OK, 5, 0,                                 //
+                  uint64_t(CallTraceArgKind::kValue), 7,        //
+                  uint64_t(CallTraceArgKind::kMechanism), CKM_RSA_PKCS, 0,
+                  uint64_t(CallTraceArgKind::kBuffer),          //
+                  uint64_t(CallTraceArgKind::kNull),            //
+                  uint64_t(CallTraceArgKind::kOutput), 300));
+}
+
+TEST_F(CallTraceTest, FailedCallRecordsZeroOutput) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<CallTraceWriter> writer,
+                       CallTraceWriter::New(trace_path_));
+
+  CK_ULONG out = 12;
+  CallTrace trace(1, writer.get());
+  trace.AddOutput(&out);
+  trace.Finish(CKR_DEVICE_ERROR);
+  writer->Flush();
+
+  ASSERT_OK_AND_ASSIGN(std::string contents, ReadFileToString(trace_path_));
+  std::vector<uint64_t> values =
+      DecodeVarints(std::string_view(contents).substr(kCallTraceMagic.size()));
+  EXPECT_THAT(std::vector<uint64_t>(values.begin() + 5, values.end()),
+              ElementsAre(CKR_DEVICE_ERROR, 1, 0,
+                          uint64_t(CallTraceArgKind::kOutput), 0));
+}
+
+TEST_F(CallTraceTest, FoundHandlesAreRecorded) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<CallTraceWriter> writer,
+                       CallTraceWriter::New(trace_path_));
+
+  CK_OBJECT_HANDLE handles[4] = {11, 12, 0, 0};
+  CK_ULONG count = 2;
+  CallTrace trace(27, writer.get());
+  trace.AddHandles(handles, 4, &count);
+  trace.Finish(CKR_OK);
+  writer->Flush();
+
+  ASSERT_OK_AND_ASSIGN(std::string contents, ReadFileToString(trace_path_));
+  std::vector<uint64_t> values =
+      DecodeVarints(std::string_view(contents).substr(kCallTraceMagic.size()));
+  EXPECT_THAT(std::vector<uint64_t>(values.begin() + 5, values.end()),
+              ElementsAre(CKR_OK, 0, 1, uint64_t(CallTraceArgKind::kHandles),
+                          2, 11, 12));
+}
+
+TEST_F(CallTraceTest, TemplateRecordsOnlyEnumeratedAndBooleanValues) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<CallTraceWriter> writer,
+                       CallTraceWriter::New(trace_path_));
+
+  CK_OBJECT_CLASS object_class = CKO_PRIVATE_KEY;
+  CK_BBOOL sign = CK_TRUE;
+  char label[] = "secret";
+  CK_ATTRIBUTE tmpl[] = {
+      {CKA_CLASS, &object_class, sizeof(object_class)},
+      {CKA_SIGN, &sign, sizeof(sign)},
+      {CKA_LABEL, label, 6},
+  };
+  CallTrace trace(26, writer.get());
+  trace.AddTemplate(tmpl, 3);
+  trace.Finish(CKR_OK);
+  writer->Flush();
+
+  ASSERT_OK_AND_ASSIGN(std::string contents, ReadFileToString(trace_path_));
+  EXPECT_THAT(contents, Not(HasSubstr("secret")));
+  std::vector<uint64_t> values =
+      DecodeVarints(std::string_view(contents).substr(kCallTraceMagic.size()));
+  EXPECT_THAT(std::vector<uint64_t>(values.begin() + 5, values.end()),
+              ElementsAre(CKR_OK, 0, 1, uint64_t(CallTraceArgKind::kTemplate),
+                          3,                                                //
+                          CKA_CLASS, sizeof(CK_ULONG), 1, CKO_PRIVATE_KEY,  //
+                          CKA_SIGN, 1, 1, CK_TRUE,                          //
+                          CKA_LABEL, 6, 0));
+}
+
+}  // namespace
+}  // namespace cloud_kms::kmsp11
@@ -27,6 +27,10 @@ namespace {
 // See go/ub-examples#non-trivially-destructible-staticglobal-variables;
 Provider* static_provider = nullptr;
 
+// State retained from a previous global provider by ParkGlobalProvider, or
+// nullptr. A bare pointer for the same reason as static_provider.
+WarmState* parked_state = nullptr;
+
 }  // namespace
 
 Provider* GetGlobalProvider() { return static_provider; }
@@ -58,4 +62,25 @@ absl::Status ReleaseGlobalProvider() {
   return absl::OkStatus();
 }
 
+absl::Status ParkGlobalProvider() {
+  if (!static_provider) {
+    return NewInternalError(
+        "ParkGlobalProvider was invoked, but a global provider has not been "
+        "set.",
+        SOURCE_LOCATION);
+  }
+  delete parked_state;
+  parked_state =
+      Provider::ReleaseWarmState(std::unique_ptr<Provider>(static_provider))
+          .release();
+  static_provider = nullptr;
+  return absl::OkStatus();
+}
+
+std::unique_ptr<WarmState> TakeParkedWarmState() {
+  std::unique_ptr<WarmState> state(parked_state);
+  parked_state = nullptr;
+  return state;
+}
+
 }  // namespace cloud_kms::kmsp11
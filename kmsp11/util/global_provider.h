@@ -35,6 +35,15 @@ Provider* GetGlobalProvider();
 // if no global provider instance exists.
 absl::Status ReleaseGlobalProvider();
 
+// Frees the global Provider instance, but retains its WarmState for a later
+// Provider to adopt. Any previously retained state is discarded. Returns
+// InternalError/CKR_GENERAL_ERROR if no global provider instance exists.
+absl::Status ParkGlobalProvider();
+
+// Returns the WarmState retained by ParkGlobalProvider, or nullptr if there is
+// none. The state is no longer retained afterwards.
+std::unique_ptr<WarmState> TakeParkedWarmState();
+
 }  // namespace cloud_kms::kmsp11
 
 #endif  // KMSP11_UTIL_GLOBAL_PROVIDER_H_
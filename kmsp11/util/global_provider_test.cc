@@ -87,5 +87,26 @@ TEST(GlobalProviderTest, SetAndGetProviderAfterReleaseReturnsProvider) {
   EXPECT_EQ(GetGlobalProvider(), captured_provider2);
 }
 
+TEST(GlobalProviderTest, ParkProviderRetainsWarmState) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<Provider> provider,
+                       Provider::New(LibraryConfig()));
+  KmsClient* captured_client = provider->kms_client();
+
+  ASSERT_OK(SetGlobalProvider(std::move(provider)));
+  ASSERT_OK(ParkGlobalProvider());
+
+  EXPECT_THAT(GetGlobalProvider(), IsNull());
+  std::unique_ptr<WarmState> state = TakeParkedWarmState();
+  ASSERT_NE(state, nullptr);
+  EXPECT_EQ(state->kms_client.get(), captured_client);
+  EXPECT_THAT(TakeParkedWarmState(), IsNull());
+}
+
+TEST(GlobalProviderTest, ParkWithoutProviderReturnsError) {
+  EXPECT_THAT(ParkGlobalProvider(),
+              AllOf(StatusIs(absl::StatusCode::kInternal),
+                    StatusRvIs(CKR_GENERAL_ERROR)));
+}
+
 }  // namespace
 }  // namespace cloud_kms::kmsp11
@@ -0,0 +1,53 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/util/handle_allocator.h"
+
+#include "kmsp11/util/crypto_utils.h"
+#include "kmsp11/util/errors.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+constexpr size_t kMaxSlots = size_t(1) << kHandleSlotBits;
+constexpr CK_ULONG kGenerationMask = (CK_ULONG(1) << kHandleGenerationBits) - 1;
+constexpr int kTagShift = kHandleSlotBits + kHandleGenerationBits;
+
+}  // namespace
+
+absl::StatusOr<CK_ULONG> HandleAllocator::Allocate(CK_RV exhausted_rv) {
+  size_t slot;
+  if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  } else if (generations_.size() < kMaxSlots) {
+    slot = generations_.size();
+    generations_.push_back(0);
+  } else {
+    return NewError(absl::StatusCode::kResourceExhausted,
+                    absl::StrFormat("all %d handles are in use", kMaxSlots - 1),
+                    exhausted_rv, SOURCE_LOCATION);
+  }
+
+  CK_ULONG tag = RandomHandle() >> kTagShift;
+  return (tag << kTagShift) | (generations_[slot] << kHandleSlotBits) | slot;
+}
+
+void HandleAllocator::Release(CK_ULONG handle) {
+  size_t slot = HandleSlot(handle);
+  generations_[slot] = (generations_[slot] + 1) & kGenerationMask;
+  free_slots_.push_back(slot);
+}
+
+}  // namespace cloud_kms::kmsp11
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KMSP11_UTIL_HANDLE_ALLOCATOR_H_
+#define KMSP11_UTIL_HANDLE_ALLOCATOR_H_
+
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "kmsp11/cryptoki.h"
+
+namespace cloud_kms::kmsp11 {
+
+// A handle is laid out as [tag | generation | slot], from most to least
+// significant bits. The slot is a dense index that can be used to look up the
+// handle's item in an array. The generation changes each time a slot is
+// reused, so that a stale handle for the slot is not mistaken for the new
+// one. The tag is random, so that handles are not predictable.
+//
+// CK_ULONG is 32 bits wide on Windows, so the fields are narrower there.
+inline constexpr int kHandleSlotBits = sizeof(CK_ULONG) >= 8 ? 24 : 16;
+inline constexpr int kHandleGenerationBits = sizeof(CK_ULONG) >= 8 ? 16 : 8;
+
+// Returns the slot index encoded in the provided handle.
+inline size_t HandleSlot(CK_ULONG handle) {
+  return handle & ((CK_ULONG(1) << kHandleSlotBits) - 1);
+}
+
+// HandleAllocator allocates handles with the layout described above. Slot 0
+// is never used, so that no handle is equal to CK_INVALID_HANDLE.
+//
+// HandleAllocator is not thread-safe.
+class HandleAllocator {
+ public:
+  HandleAllocator() : generations_(1) {}
+
+  // Returns a new handle, or an error with the provided CK_RV if every slot is
+  // in use.
+  absl::StatusOr<CK_ULONG> Allocate(CK_RV exhausted_rv);
+
+  // Makes the slot of a handle returned by Allocate available for reuse.
+  void Release(CK_ULONG handle);
+
+  // Returns the number of slots that have been used, including slot 0.
+  size_t slot_count() const { return generations_.size(); }
+
+ private:
+  // The generation of the next handle for each slot.
+  std::vector<CK_ULONG> generations_;
+  std::vector<size_t> free_slots_;
+};
+
+}  // namespace cloud_kms::kmsp11
+
+#endif  // KMSP11_UTIL_HANDLE_ALLOCATOR_H_
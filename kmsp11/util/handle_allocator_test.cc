@@ -0,0 +1,61 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kmsp11/util/handle_allocator.h"
+
+#include "absl/container/flat_hash_set.h"
+#include "common/test/test_status_macros.h"
+#include "gtest/gtest.h"
+
+namespace cloud_kms::kmsp11 {
+namespace {
+
+TEST(HandleAllocatorTest, SlotsAreDenseAndStartAtOne) {
+  HandleAllocator allocator;
+
+  for (size_t i = 1; i <= 3; i++) {
+    ASSERT_OK_AND_ASSIGN(CK_ULONG handle,
+                         allocator.Allocate(CKR_DEVICE_MEMORY));
+    EXPECT_NE(handle, CK_INVALID_HANDLE);
+    EXPECT_EQ(HandleSlot(handle), i);
+  }
+  EXPECT_EQ(allocator.slot_count(), 4);
+}
+
+TEST(HandleAllocatorTest, ReleasedSlotIsReusedWithNewHandle) {
+  HandleAllocator allocator;
+
+  ASSERT_OK_AND_ASSIGN(CK_ULONG first, allocator.Allocate(CKR_DEVICE_MEMORY));
+  allocator.Release(first);
+  ASSERT_OK_AND_ASSIGN(CK_ULONG second, allocator.Allocate(CKR_DEVICE_MEMORY));
+
+  EXPECT_EQ(HandleSlot(second), HandleSlot(first));
+  EXPECT_NE(second, first);
+  EXPECT_EQ(allocator.slot_count(), 2);
+}
+
+TEST(HandleAllocatorTest, HandlesAreUnpredictable) {
+  // Handles for the same slot and generation differ in their tag bits.
+  absl::flat_hash_set<CK_ULONG> handles;
+  for (int i = 0; i < 16; i++) {
+    HandleAllocator allocator;
+    ASSERT_OK_AND_ASSIGN(CK_ULONG handle,
+                         allocator.Allocate(CKR_DEVICE_MEMORY));
+    handles.insert(handle);
+  }
+  EXPECT_GT(handles.size(), 1);
+}
+
+}  // namespace
+}  // namespace cloud_kms::kmsp11
@@ -17,40 +17,46 @@
 #ifndef KMSP11_UTIL_HANDLE_MAP_H_
 #define KMSP11_UTIL_HANDLE_MAP_H_
 
-#include "absl/container/flat_hash_map.h"
+#include <vector>
+
 #include "absl/functional/function_ref.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "common/status_macros.h"
 #include "kmsp11/cryptoki.h"
-#include "kmsp11/util/crypto_utils.h"
 #include "kmsp11/util/errors.h"
+#include "kmsp11/util/handle_allocator.h"
 
 namespace cloud_kms::kmsp11 {
 
 // A HandleMap contains a set of items with assigned CK_ULONG handles.
 // It is intended for use with the PKCS #11 Session and Object types, both
 // of which are identified by a handle.
+//
+// Items are stored in an array indexed by the slot encoded in their handle
+// (see HandleAllocator), so that a lookup is a bounds check and an array load.
 template <typename T>
 class HandleMap {
  public:
   // Create a new map. The provided CK_RV will be used for Get and Remove
-  // operations performed against an unknown handle.
-  HandleMap(CK_RV not_found_rv) : not_found_rv_(not_found_rv) {}
+  // operations performed against an unknown handle. `exhausted_rv` is used
+  // when an item cannot be added because every handle is in use.
+  HandleMap(CK_RV not_found_rv, CK_RV exhausted_rv = CKR_DEVICE_MEMORY)
+      : not_found_rv_(not_found_rv), exhausted_rv_(exhausted_rv) {}
 
   // Constructs a new T using the provided arguments, adds it to the map, and
   // returns its handle.
   template <typename... Args>
-  inline CK_ULONG Add(Args&&... args) {
+  inline absl::StatusOr<CK_ULONG> Add(Args&&... args) {
     absl::WriterMutexLock lock(&mutex_);
 
-    // Generate a new handle by picking a random handle and ensuring that it is
-    // not already in use. Repeat this process until we have a useable handle.
-    CK_ULONG handle;
-    do {
-      handle = RandomHandle();
-    } while (items_.contains(handle));
-
-    items_.try_emplace(handle,
-                       std::make_shared<T>(std::forward<Args>(args)...));
+    ASSIGN_OR_RETURN(CK_ULONG handle, allocator_.Allocate(exhausted_rv_));
+    size_t slot = HandleSlot(handle);
+    if (slot >= entries_.size()) {
+      entries_.resize(slot + 1);
+    }
+    entries_[slot] =
+        Entry{handle, std::make_shared<T>(std::forward<Args>(args)...)};
     return handle;
   }
 
@@ -59,12 +65,12 @@ class HandleMap {
   inline absl::StatusOr<std::shared_ptr<T>> Get(CK_ULONG handle) const {
     absl::ReaderMutexLock lock(&mutex_);
 
-    auto it = items_.find(handle);
-    if (it == items_.end()) {
+    const Entry* entry = Find(handle);
+    if (!entry) {
       return HandleNotFoundError(handle, not_found_rv_, SOURCE_LOCATION);
     }
 
-    return it->second;
+    return entry->item;
   }
 
   // Removes the map element with the provided handle, or returns NotFound if
@@ -72,12 +78,11 @@ class HandleMap {
   inline absl::Status Remove(CK_ULONG handle) {
     absl::WriterMutexLock lock(&mutex_);
 
-    auto it = items_.find(handle);
-    if (it == items_.end()) {
+    if (!Find(handle)) {
       return HandleNotFoundError(handle, not_found_rv_, SOURCE_LOCATION);
     }
 
-    items_.erase(it);
+    Erase(entries_[HandleSlot(handle)]);
     return absl::OkStatus();
   }
 
@@ -85,21 +90,39 @@ class HandleMap {
   inline void RemoveIf(absl::FunctionRef<bool(const T&)> predicate) {
     absl::WriterMutexLock lock(&mutex_);
 
-    auto it = items_.begin();
-    while (it != items_.end()) {
-      if (predicate(*it->second)) {
-        items_.erase(it++);
-      } else {
-        it++;
+    for (Entry& entry : entries_) {
+      if (entry.item && predicate(*entry.item)) {
+        Erase(entry);
       }
     }
   }
 
  private:
+  struct Entry {
+    CK_ULONG handle = CK_INVALID_HANDLE;
+    std::shared_ptr<T> item;
+  };
+
+  inline const Entry* Find(CK_ULONG handle) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+    size_t slot = HandleSlot(handle);
+    if (handle == CK_INVALID_HANDLE || slot >= entries_.size() ||
+        entries_[slot].handle != handle) {
+      return nullptr;
+    }
+    return &entries_[slot];
+  }
+
+  inline void Erase(Entry& entry) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    allocator_.Release(entry.handle);
+    entry = Entry();
+  }
+
   CK_RV not_found_rv_;
+  CK_RV exhausted_rv_;
   mutable absl::Mutex mutex_;
-  absl::flat_hash_map<CK_ULONG, std::shared_ptr<T>> items_
-      ABSL_GUARDED_BY(mutex_);
+  HandleAllocator allocator_ ABSL_GUARDED_BY(mutex_);
+  std::vector<Entry> entries_ ABSL_GUARDED_BY(mutex_);
 };
 
 }  // namespace cloud_kms::kmsp11
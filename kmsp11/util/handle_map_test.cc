@@ -27,24 +27,24 @@ using ::testing::Pointee;
 TEST(HandleMapTest, ItemHandleValid) {
   HandleMap<int> map(CKR_SESSION_HANDLE_INVALID);
 
-  CK_ULONG handle = map.Add(3);
+  ASSERT_OK_AND_ASSIGN(CK_ULONG handle, map.Add(3));
   EXPECT_NE(handle, CK_INVALID_HANDLE);
 }
 
 TEST(HandleMapTest, ItemHandlesDifferent) {
   HandleMap<int> map(CKR_SESSION_HANDLE_INVALID);
 
-  CK_ULONG handle1 = map.Add(3);
-  CK_ULONG handle2 = map.Add(4);
+  ASSERT_OK_AND_ASSIGN(CK_ULONG handle1, map.Add(3));
+  ASSERT_OK_AND_ASSIGN(CK_ULONG handle2, map.Add(4));
   EXPECT_NE(handle1, handle2);
 }
 
 TEST(HandleMapTest, AllItemsAdded) {
   HandleMap<int> map(CKR_SESSION_HANDLE_INVALID);
 
-  CK_ULONG handle1 = map.Add(3);
-  CK_ULONG handle2 = map.Add(4);
-  CK_ULONG handle3 = map.Add(5);
+  ASSERT_OK_AND_ASSIGN(CK_ULONG handle1, map.Add(3));
+  ASSERT_OK_AND_ASSIGN(CK_ULONG handle2, map.Add(4));
+  ASSERT_OK_AND_ASSIGN(CK_ULONG handle3, map.Add(5));
 
   EXPECT_THAT(map.Get(handle1), IsOkAndHolds(Pointee(3)));
   EXPECT_THAT(map.Get(handle2), IsOkAndHolds(Pointee(4)));
@@ -54,7 +54,7 @@ TEST(HandleMapTest, AllItemsAdded) {
 TEST(HandleMapTest, GetByHandle) {
   HandleMap<int> map(CKR_SESSION_HANDLE_INVALID);
 
-  CK_ULONG handle = map.Add(3);
+  ASSERT_OK_AND_ASSIGN(CK_ULONG handle, map.Add(3));
 
   ASSERT_OK_AND_ASSIGN(std::shared_ptr<int> value, map.Get(handle));
   EXPECT_EQ(*value, 3);
@@ -69,7 +69,7 @@ TEST(HandleMapTest, GetInvalidHandle) {
 TEST(HandleMapTest, RemoveRemoves) {
   HandleMap<int> map(CKR_SESSION_HANDLE_INVALID);
 
-  CK_ULONG handle = map.Add(3);
+  ASSERT_OK_AND_ASSIGN(CK_ULONG handle, map.Add(3));
   EXPECT_OK(map.Remove(handle));
 
   EXPECT_THAT(map.Get(handle), StatusRvIs(CKR_SESSION_HANDLE_INVALID));
@@ -83,10 +83,10 @@ TEST(HandleMapTest, RemoveInvalidHandle) {
 
 TEST(HandleMapTest, RemoveIfRemovesOnPredicate) {
   HandleMap<int> map(CKR_SESSION_HANDLE_INVALID);
-  CK_ULONG h1 = map.Add(1);
-  CK_ULONG h2 = map.Add(2);
-  CK_ULONG h3 = map.Add(3);
-  CK_ULONG h4 = map.Add(4);
+  ASSERT_OK_AND_ASSIGN(CK_ULONG h1, map.Add(1));
+  ASSERT_OK_AND_ASSIGN(CK_ULONG h2, map.Add(2));
+  ASSERT_OK_AND_ASSIGN(CK_ULONG h3, map.Add(3));
+  ASSERT_OK_AND_ASSIGN(CK_ULONG h4, map.Add(4));
 
   map.RemoveIf([](const int& i) -> bool { return i % 2 == 0; });
 
@@ -96,5 +96,19 @@ TEST(HandleMapTest, RemoveIfRemovesOnPredicate) {
   EXPECT_THAT(map.Get(h4), StatusRvIs(CKR_SESSION_HANDLE_INVALID));
 }
 
+TEST(HandleMapTest, StaleHandleIsNotFoundAfterSlotIsReused) {
+  HandleMap<int> map(CKR_SESSION_HANDLE_INVALID);
+
+  ASSERT_OK_AND_ASSIGN(CK_ULONG stale, map.Add(1));
+  EXPECT_OK(map.Remove(stale));
+  ASSERT_OK_AND_ASSIGN(CK_ULONG current, map.Add(2));
+
+  ASSERT_EQ(HandleSlot(current), HandleSlot(stale));
+  EXPECT_NE(current, stale);
+  EXPECT_THAT(map.Get(stale), StatusRvIs(CKR_SESSION_HANDLE_INVALID));
+  EXPECT_THAT(map.Remove(stale), StatusRvIs(CKR_SESSION_HANDLE_INVALID));
+  EXPECT_THAT(map.Get(current), IsOkAndHolds(Pointee(2)));
+}
+
 }  // namespace
 }  // namespace cloud_kms::kmsp11